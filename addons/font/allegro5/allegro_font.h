@@ -66,6 +66,12 @@ struct ALLEGRO_GLYPH
 };
 #endif
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_FONT_SRC)
+/* Type: ALLEGRO_TEXT_LAYOUT
+*/
+typedef struct ALLEGRO_TEXT_LAYOUT ALLEGRO_TEXT_LAYOUT;
+#endif
+
 enum {
    ALLEGRO_NO_KERNING       = -1,
    ALLEGRO_ALIGN_LEFT       = 0,
@@ -75,6 +81,10 @@ enum {
    ALLEGRO_ALIGN_INTEGER    = 4,
 };
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_FONT_SRC)
+#define ALLEGRO_SHADER_VAR_SDF_SMOOTHING "al_sdf_smoothing"
+#endif
+
 ALLEGRO_FONT_FUNC(bool, al_register_font_loader, (const char *ext, ALLEGRO_FONT *(*load)(const char *filename, int size, int flags)));
 ALLEGRO_FONT_FUNC(ALLEGRO_FONT *, al_load_bitmap_font, (const char *filename));
 ALLEGRO_FONT_FUNC(ALLEGRO_FONT *, al_load_bitmap_font_flags, (const char *filename, int flags));
@@ -139,6 +149,31 @@ ALLEGRO_FONT_FUNC(void, al_set_fallback_font, (ALLEGRO_FONT *font,
 ALLEGRO_FONT_FUNC(ALLEGRO_FONT *, al_get_fallback_font, (
    ALLEGRO_FONT *font));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_FONT_SRC)
+ALLEGRO_FONT_FUNC(ALLEGRO_SHADER *, al_create_sdf_font_shader, (
+   ALLEGRO_SHADER_PLATFORM platform));
+
+ALLEGRO_FONT_FUNC(bool, al_save_packed_bmfont, (const ALLEGRO_FONT *font,
+   const char *filename));
+
+ALLEGRO_FONT_FUNC(ALLEGRO_TEXT_LAYOUT *, al_create_text_layout, (
+   const ALLEGRO_FONT *font, float max_width, const ALLEGRO_USTR *ustr));
+ALLEGRO_FONT_FUNC(void, al_destroy_text_layout, (ALLEGRO_TEXT_LAYOUT *layout));
+ALLEGRO_FONT_FUNC(bool, al_set_text_layout_width, (ALLEGRO_TEXT_LAYOUT *layout,
+   float max_width));
+ALLEGRO_FONT_FUNC(float, al_get_text_layout_width, (
+   const ALLEGRO_TEXT_LAYOUT *layout));
+ALLEGRO_FONT_FUNC(int, al_get_text_layout_line_count, (
+   const ALLEGRO_TEXT_LAYOUT *layout));
+ALLEGRO_FONT_FUNC(bool, al_get_text_layout_line, (
+   const ALLEGRO_TEXT_LAYOUT *layout, int line_num, int *start, int *end,
+   float *width));
+ALLEGRO_FONT_FUNC(int, al_get_text_layout_offset, (
+   const ALLEGRO_TEXT_LAYOUT *layout, int line_num, float x));
+ALLEGRO_FONT_FUNC(void, al_draw_text_layout, (const ALLEGRO_TEXT_LAYOUT *layout,
+   ALLEGRO_COLOR color, float x, float y, float line_height, int flags));
+#endif
+
 #ifdef __cplusplus
    }
 #endif
@@ -4,6 +4,7 @@
 #include "allegro5/internal/aintern_list.h"
 
 typedef struct ALLEGRO_FONT_VTABLE ALLEGRO_FONT_VTABLE;
+typedef struct ALLEGRO_FONT_FALLBACK_CACHE ALLEGRO_FONT_FALLBACK_CACHE;
 
 struct ALLEGRO_FONT
 {
@@ -12,6 +13,8 @@ struct ALLEGRO_FONT
    ALLEGRO_FONT *fallback;
    ALLEGRO_FONT_VTABLE *vtable;
    _AL_LIST_ITEM *dtor_item;
+   /* Which font of the fallback chain has which glyph. */
+   ALLEGRO_FONT_FALLBACK_CACHE *fallback_cache;
 };
 
 /* text- and font-related stuff */
@@ -36,6 +39,12 @@ struct ALLEGRO_FONT_VTABLE
       int codepoint1, int codepoint2));
 
    ALLEGRO_FONT_METHOD(bool, get_glyph, (const ALLEGRO_FONT *f, int prev_codepoint, int codepoint, ALLEGRO_GLYPH *glyph));
+
+   /* Whether the font itself, not counting its fallback, has the glyph. */
+   ALLEGRO_FONT_METHOD(bool, has_glyph, (const ALLEGRO_FONT *f, int codepoint));
 };
 
+ALLEGRO_FONT_FUNC(ALLEGRO_FONT *, _al_find_fallback_font, (const ALLEGRO_FONT *f,
+   int codepoint));
+
 #endif
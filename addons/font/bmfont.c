@@ -3,12 +3,29 @@
 #include <stdio.h>
 
 #include "allegro5/internal/aintern_font.h"
+#include "allegro5/internal/aintern_vector.h"
 
 #include "font.h"
 #include "xml.h"
 
 ALLEGRO_DEBUG_CHANNEL("font")
 
+/* Characters are found through pages of this many codepoints. */
+#define INDEX_PAGE_BITS 8
+#define INDEX_PAGE_SIZE (1 << INDEX_PAGE_BITS)
+#define MAX_CODEPOINT 0x10FFFF
+
+/* The packed format, see al_save_packed_bmfont. */
+#define PACKED_MAGIC "A5FN"
+#define PACKED_VERSION 1
+#define PACKED_HEADER_SIZE (4 + 4 * 6)
+
+/* Sizes of records in the BMFont binary format, which the packed format
+ * uses as well.
+ */
+#define CHAR_RECORD_SIZE 20
+#define KERNING_RECORD_SIZE 10
+
 typedef struct {
    int first;
    int second;
@@ -16,6 +33,7 @@ typedef struct {
 } BMFONT_KERNING;
 
 typedef struct {
+   int id;
    int page;
    int x, y;
    int width, height;
@@ -23,144 +41,204 @@ typedef struct {
    int xadvance;
    int chnl;
    int kerning_pairs;
-   BMFONT_KERNING *kerning;
+   BMFONT_KERNING *kerning;   /* points into BMFONT_DATA.kerning */
 } BMFONT_CHAR;
 
-typedef struct BMFONT_RANGE BMFONT_RANGE;
-
-struct BMFONT_RANGE {
+typedef struct {
    int first;
    int count;
-   BMFONT_CHAR **characters;
-   BMFONT_RANGE *next;
-};
+} BMFONT_RANGE;
 
 typedef struct {
    int pages_count;
    ALLEGRO_BITMAP **pages;
-   BMFONT_RANGE *range_first;
+   char **page_files;         /* as named in the font file */
    int base;
    int line_height;
    int flags;
 
+   int chars_count;
+   BMFONT_CHAR *chars;        /* sorted by id */
+   int ranges_count;
+   BMFONT_RANGE *ranges;
+
    int kerning_pairs;
-   BMFONT_KERNING *kerning;
+   BMFONT_KERNING *kerning;   /* sorted by first, then second */
+
+   int index_pages_count;
+   BMFONT_CHAR ***index_pages; /* [INDEX_PAGE_SIZE] each, or NULL */
 } BMFONT_DATA;
 
 typedef struct {
    ALLEGRO_FONT *font;
    ALLEGRO_USTR *tag;
    ALLEGRO_USTR *attribute;
-   BMFONT_CHAR *c;
+   _AL_VECTOR chars;          /* of BMFONT_CHAR */
+   _AL_VECTOR kerning;        /* of BMFONT_KERNING */
    ALLEGRO_PATH *path;
 } BMFONT_PARSER;
 
-static void reallocate(BMFONT_RANGE *range) {
-   range->characters = al_realloc(range->characters,
-      range->count * sizeof *range->characters);
-}
-
-static void prepend_char(BMFONT_PARSER *parser, BMFONT_RANGE *range) {
-   range->first--;
-   range->count++;
-   reallocate(range);
-   memmove(range->characters + 1, range->characters,
-      (range->count - 1) * sizeof *range->characters);
-   range->characters[0] = parser->c;
-}
-
-static void append_char(BMFONT_PARSER *parser, BMFONT_RANGE *range) {
-   range->count++;
-   reallocate(range);
-   range->characters[range->count - 1] = parser->c;
-}
-
-static void combine_ranges(BMFONT_DATA *data,
-      BMFONT_RANGE *range, BMFONT_RANGE *range2) {
-   (void)data;
-   range->count += range2->count;
-   reallocate(range);
-   memmove(range->characters + range->count - range2->count,
-      range2->characters,
-      range2->count * sizeof *range->characters);
-   range->next = range2->next;
-   al_free(range2->characters);
-   al_free(range2);
-}
-
-static void insert_new_range(BMFONT_PARSER *parser, BMFONT_RANGE *prev,
-      int codepoint) {
-   BMFONT_RANGE *range = al_calloc(1, sizeof *range);
-   range->first = codepoint;
-   range->count = 1;
-   reallocate(range);
-   range->characters[0] = parser->c;
-   if (prev) {
-      range->next = prev->next;
-      prev->next = range;
+static BMFONT_CHAR *find_codepoint(BMFONT_DATA *data, int codepoint) {
+   BMFONT_CHAR **page;
+   if (codepoint < 0)
+      return NULL;
+   if ((codepoint >> INDEX_PAGE_BITS) >= data->index_pages_count)
+      return NULL;
+   page = data->index_pages[codepoint >> INDEX_PAGE_BITS];
+   if (!page)
+      return NULL;
+   return page[codepoint & (INDEX_PAGE_SIZE - 1)];
+}
+
+static int compare_chars(const void *a, const void *b) {
+   const BMFONT_CHAR *ca = a;
+   const BMFONT_CHAR *cb = b;
+   return (ca->id > cb->id) - (ca->id < cb->id);
+}
+
+static int compare_kerning(const void *a, const void *b) {
+   const BMFONT_KERNING *ka = a;
+   const BMFONT_KERNING *kb = b;
+   if (ka->first != kb->first)
+      return (ka->first > kb->first) - (ka->first < kb->first);
+   return (ka->second > kb->second) - (ka->second < kb->second);
+}
+
+static bool chars_sorted(BMFONT_DATA *data) {
+   int i;
+   for (i = 1; i < data->chars_count; i++) {
+      if (data->chars[i - 1].id >= data->chars[i].id)
+         return false;
    }
-   else {
-      ALLEGRO_FONT *font = parser->font;
-      BMFONT_DATA *data = font->data;
-      range->next = data->range_first;
-      data->range_first = range;
+   return true;
+}
+
+static bool kerning_sorted(BMFONT_DATA *data) {
+   int i;
+   for (i = 1; i < data->kerning_pairs; i++) {
+      if (compare_kerning(data->kerning + i - 1, data->kerning + i) > 0)
+         return false;
    }
+   return true;
 }
 
-/* Adding a new codepoint creates either a new range consisting of that
- * single codepoint, appends the codepoint to the end of a range,
- * prepends it to the beginning of a range, or merges two ranges.
+/* Sort the characters and kerning pairs, unless they already are, and build
+ * the tables used to find them. Characters with an id outside the Unicode
+ * range are dropped, and so are all but the first of several with the same
+ * id.
  */
-static void add_codepoint(BMFONT_PARSER *parser, int codepoint) {
-   ALLEGRO_FONT *font = parser->font;
-   BMFONT_DATA *data = font->data;
-   BMFONT_RANGE *prev = NULL;
-   BMFONT_RANGE *range = data->range_first;
-   while (range) {
-      if (codepoint == range->first - 1) {
-         prepend_char(parser, range);
-         return;
-      }
-      if (codepoint < range->first) {
-         insert_new_range(parser, prev, codepoint);
-         return;
+static bool finish_font(BMFONT_DATA *data) {
+   int i, j, n;
+
+   if (!chars_sorted(data)) {
+      qsort(data->chars, data->chars_count, sizeof *data->chars,
+         compare_chars);
+   }
+   if (!kerning_sorted(data)) {
+      qsort(data->kerning, data->kerning_pairs, sizeof *data->kerning,
+         compare_kerning);
+   }
+
+   n = 0;
+   for (i = 0; i < data->chars_count; i++) {
+      BMFONT_CHAR *c = data->chars + i;
+      if (c->id < 0 || c->id > MAX_CODEPOINT)
+         continue;
+      if (n > 0 && data->chars[n - 1].id == c->id)
+         continue;
+      data->chars[n++] = *c;
+   }
+   data->chars_count = n;
+
+   /* Both arrays are sorted, so the pairs of each character are found by
+    * walking them together.
+    */
+   j = 0;
+   for (i = 0; i < data->chars_count; i++) {
+      BMFONT_CHAR *c = data->chars + i;
+      while (j < data->kerning_pairs && data->kerning[j].first < c->id)
+         j++;
+      c->kerning = data->kerning + j;
+      c->kerning_pairs = 0;
+      while (j < data->kerning_pairs && data->kerning[j].first == c->id) {
+         c->kerning_pairs++;
+         j++;
       }
-      if (codepoint == range->first + range->count) {
-         append_char(parser, range);
-         BMFONT_RANGE *range2 = range->next;
-         if (range2 != NULL && codepoint == range2->first - 1) {
-            combine_ranges(data, range, range2);
-         }
-         return;
+   }
+
+   data->ranges_count = 0;
+   for (i = 0; i < data->chars_count; i++) {
+      if (i == 0 || data->chars[i].id != data->chars[i - 1].id + 1)
+         data->ranges_count++;
+   }
+   data->ranges = al_malloc((data->ranges_count + 1) * sizeof *data->ranges);
+   if (!data->ranges)
+      return false;
+   n = -1;
+   for (i = 0; i < data->chars_count; i++) {
+      if (i == 0 || data->chars[i].id != data->chars[i - 1].id + 1) {
+         n++;
+         data->ranges[n].first = data->chars[i].id;
+         data->ranges[n].count = 0;
       }
-      prev = range;
-      range = range->next;
+      data->ranges[n].count++;
    }
-   insert_new_range(parser, prev, codepoint);
-}
 
-static BMFONT_CHAR *find_codepoint(BMFONT_DATA *data, int codepoint) {
-   BMFONT_RANGE *range = data->range_first;
-   while (range) {
-      if (codepoint >= range->first &&
-            codepoint < range->first + range->count) {
-         return range->characters[codepoint - range->first];
+   if (data->chars_count > 0) {
+      int last = data->chars[data->chars_count - 1].id;
+      data->index_pages_count = (last >> INDEX_PAGE_BITS) + 1;
+      data->index_pages = al_calloc(data->index_pages_count,
+         sizeof *data->index_pages);
+      if (!data->index_pages)
+         return false;
+   }
+   for (i = 0; i < data->chars_count; i++) {
+      BMFONT_CHAR *c = data->chars + i;
+      BMFONT_CHAR ***page = data->index_pages + (c->id >> INDEX_PAGE_BITS);
+      if (!*page) {
+         *page = al_calloc(INDEX_PAGE_SIZE, sizeof **page);
+         if (!*page)
+            return false;
       }
-      range = range->next;
+      (*page)[c->id & (INDEX_PAGE_SIZE - 1)] = c;
    }
-   return NULL;
+
+   return true;
 }
 
-static void add_page(BMFONT_PARSER *parser, char const *filename) {
-   ALLEGRO_FONT *font = parser->font;
-   BMFONT_DATA *data = font->data;
-   data->pages_count++;
-   data->pages = al_realloc(data->pages, data->pages_count *
+static bool add_page(BMFONT_DATA *data, ALLEGRO_PATH *path,
+      char const *filename) {
+   ALLEGRO_BITMAP **pages;
+   char **page_files;
+   char *name;
+   ALLEGRO_BITMAP *page;
+
+   pages = al_realloc(data->pages, (data->pages_count + 1) *
       sizeof *data->pages);
-   al_set_path_filename(parser->path, filename);
-   ALLEGRO_BITMAP *page = al_load_bitmap_flags(
-      al_path_cstr(parser->path, '/'), data->flags);
-   data->pages[data->pages_count - 1] = page;
+   if (!pages)
+      return false;
+   data->pages = pages;
+   page_files = al_realloc(data->page_files, (data->pages_count + 1) *
+      sizeof *data->page_files);
+   if (!page_files)
+      return false;
+   data->page_files = page_files;
+
+   name = al_malloc(strlen(filename) + 1);
+   if (!name)
+      return false;
+   strcpy(name, filename);
+
+   al_set_path_filename(path, filename);
+   page = al_load_bitmap_flags(al_path_cstr(path, '/'), data->flags);
+   if (!page) {
+      ALLEGRO_WARN("Could not load font page %s.\n", al_path_cstr(path, '/'));
+   }
+
+   data->pages[data->pages_count] = page;
+   data->page_files[data->pages_count] = name;
+   data->pages_count++;
+   return true;
 }
 
 static bool tag_is(BMFONT_PARSER *parser, char const *str) {
@@ -183,12 +261,13 @@ static int xml_callback(XmlState state, char const *value, void *u)
    if (state == ElementName) {
       al_ustr_assign_cstr(parser->tag, value);
       if (tag_is(parser, "char")) {
-         parser->c = al_calloc(1, sizeof *parser->c);
+         BMFONT_CHAR *c = _al_vector_alloc_back(&parser->chars);
+         memset(c, 0, sizeof *c);
+         c->id = -1;
       }
       else if (tag_is(parser, "kerning")) {
-         data->kerning_pairs++;
-         data->kerning = al_realloc(data->kerning, data->kerning_pairs *
-            sizeof *data->kerning);
+         BMFONT_KERNING *k = _al_vector_alloc_back(&parser->kerning);
+         memset(k, 0, sizeof *k);
       }
    }
    if (state == AttributeName) {
@@ -196,22 +275,21 @@ static int xml_callback(XmlState state, char const *value, void *u)
    }
    if (state == AttributeValue) {
       if (tag_is(parser, "char")) {
-         if (attribute_is(parser, "x")) parser->c->x = get_int(value);
-         else if (attribute_is(parser, "y")) parser->c->y = get_int(value);
-         else if (attribute_is(parser, "xoffset")) parser->c->xoffset = get_int(value);
-         else if (attribute_is(parser, "yoffset")) parser->c->yoffset = get_int(value);
-         else if (attribute_is(parser, "width")) parser->c->width = get_int(value);
-         else if (attribute_is(parser, "height")) parser->c->height = get_int(value);
-         else if (attribute_is(parser, "page")) parser->c->page = get_int(value);
-         else if (attribute_is(parser, "xadvance")) parser->c->xadvance = get_int(value);
-         else if (attribute_is(parser, "chnl")) parser->c->chnl = get_int(value);
-         else if (attribute_is(parser, "id")) {
-            add_codepoint(parser, get_int(value));
-         }
+         BMFONT_CHAR *c = _al_vector_ref_back(&parser->chars);
+         if (attribute_is(parser, "x")) c->x = get_int(value);
+         else if (attribute_is(parser, "y")) c->y = get_int(value);
+         else if (attribute_is(parser, "xoffset")) c->xoffset = get_int(value);
+         else if (attribute_is(parser, "yoffset")) c->yoffset = get_int(value);
+         else if (attribute_is(parser, "width")) c->width = get_int(value);
+         else if (attribute_is(parser, "height")) c->height = get_int(value);
+         else if (attribute_is(parser, "page")) c->page = get_int(value);
+         else if (attribute_is(parser, "xadvance")) c->xadvance = get_int(value);
+         else if (attribute_is(parser, "chnl")) c->chnl = get_int(value);
+         else if (attribute_is(parser, "id")) c->id = get_int(value);
       }
       else if (tag_is(parser, "page")) {
          if (attribute_is(parser, "file")) {
-            add_page(parser, value);
+            add_page(data, parser->path, value);
          }
       }
       else if (tag_is(parser, "common")) {
@@ -219,7 +297,7 @@ static int xml_callback(XmlState state, char const *value, void *u)
          else if (attribute_is(parser, "base")) data->base = get_int(value);
       }
       else if (tag_is(parser, "kerning")) {
-         BMFONT_KERNING *k = data->kerning + data->kerning_pairs - 1;
+         BMFONT_KERNING *k = _al_vector_ref_back(&parser->kerning);
          if (attribute_is(parser, "first")) k->first = get_int(value);
          else if (attribute_is(parser, "second")) k->second = get_int(value);
          else if (attribute_is(parser, "amount")) k->amount = get_int(value);
@@ -245,12 +323,16 @@ static int font_descent(const ALLEGRO_FONT *f) {
 
 static int get_kerning(BMFONT_CHAR *prev, int c) {
    if (!prev) return 0;
-   int i;
-   for (i = 0; i < prev->kerning_pairs; i++) {
-      if (prev->kerning[i].second == c) {
-         int a = prev->kerning[i].amount;
-         return a;
-      }
+   int lo = 0, hi = prev->kerning_pairs;
+   while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      int second = prev->kerning[mid].second;
+      if (second == c)
+         return prev->kerning[mid].amount;
+      if (second < c)
+         lo = mid + 1;
+      else
+         hi = mid;
    }
    return 0;
 }
@@ -292,9 +374,10 @@ static int measure_char(const ALLEGRO_FONT *f, ALLEGRO_COLOR color,
       h = c->height;
    }
    else {
-      if (!f->fallback) return 0;
-      advance = al_get_glyph_width(f->fallback, ch);
-      al_get_glyph_dimensions(f->fallback, ch, &xo, &yo, &w, &h);
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, ch);
+      if (!fallback) return 0;
+      advance = al_get_glyph_width(fallback, ch);
+      al_get_glyph_dimensions(fallback, ch, &xo, &yo, &w, &h);
    }
    if (glyph) {
       if (glyph->x == INT_MAX) glyph->x = xo;
@@ -310,8 +393,9 @@ static bool get_glyph_dimensions(const ALLEGRO_FONT *f,
    BMFONT_DATA *data = f->data;
    BMFONT_CHAR *c = find_codepoint(data, codepoint);
    if (!c) {
-      if (!f->fallback) return false;
-      return al_get_glyph_dimensions(f->fallback, codepoint,
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, codepoint);
+      if (!fallback) return false;
+      return al_get_glyph_dimensions(fallback, codepoint,
          bbx, bby, bbw, bbh);
    }
    *bbx = c->xoffset;
@@ -331,8 +415,9 @@ static int get_glyph_advance(const ALLEGRO_FONT *f,
    }
 
    if (!c) {
-      if (!f->fallback) return 0;
-      return al_get_glyph_advance(f->fallback, codepoint1, codepoint2);
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, codepoint1);
+      if (!fallback) return 0;
+      return al_get_glyph_advance(fallback, codepoint1, codepoint2);
    }
 
    if (codepoint2 != ALLEGRO_NO_KERNING)
@@ -346,6 +431,7 @@ static bool get_glyph(const ALLEGRO_FONT *f, int prev_codepoint,
    BMFONT_DATA *data = f->data;
    BMFONT_CHAR *prev = find_codepoint(data, prev_codepoint);
    BMFONT_CHAR *c = find_codepoint(data, codepoint);
+   ALLEGRO_FONT *fallback;
    if (c) {
       glyph->bitmap = data->pages[c->page];
       glyph->x = c->x;
@@ -358,8 +444,9 @@ static bool get_glyph(const ALLEGRO_FONT *f, int prev_codepoint,
       glyph->advance = c->xadvance + glyph->kerning;
       return true;
    }
-   if (f->fallback) {
-      return al_get_glyph(f->fallback, prev_codepoint, codepoint,
+   fallback = _al_find_fallback_font(f, codepoint);
+   if (fallback) {
+      return al_get_glyph(fallback, prev_codepoint, codepoint,
          glyph);
    }
    return false;
@@ -379,8 +466,9 @@ static int render_char(const ALLEGRO_FONT *f, ALLEGRO_COLOR color, int ch, float
    BMFONT_DATA *data = f->data;
    BMFONT_CHAR *c = find_codepoint(data, ch);
    if (!c) {
-      if (f->fallback) return f->fallback->vtable->render_char(
-         f->fallback, color, ch, x, y);
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, ch);
+      if (fallback) return fallback->vtable->render_char(
+         fallback, color, ch, x, y);
       return 0;
    }
    ALLEGRO_BITMAP *page = data->pages[c->page];
@@ -400,32 +488,27 @@ static int render(const ALLEGRO_FONT *f, ALLEGRO_COLOR color,
    return each_character(f, color, text, x, y, NULL, render_char_cb);
 }
 
-static void destroy_range(BMFONT_RANGE *range) {
-   int i;
-   for (i = 0; i < range->count; i++) {
-      BMFONT_CHAR *c = range->characters[i];
-      al_free(c->kerning);
-      al_free(c);
-   }
-   al_free(range);
-}
-
-static void destroy(ALLEGRO_FONT *f) {
-   BMFONT_DATA *data = f->data;
-   BMFONT_RANGE *range = data->range_first;
-   while (range) {
-      BMFONT_RANGE *next = range->next;
-      destroy_range(range);
-      range = next;
-   }
-
+static void destroy_data(BMFONT_DATA *data) {
    int i;
    for (i = 0; i < data->pages_count; i++) {
       al_destroy_bitmap(data->pages[i]);
+      al_free(data->page_files[i]);
    }
    al_free(data->pages);
+   al_free(data->page_files);
 
+   for (i = 0; i < data->index_pages_count; i++) {
+      al_free(data->index_pages[i]);
+   }
+   al_free(data->index_pages);
+   al_free(data->chars);
+   al_free(data->ranges);
    al_free(data->kerning);
+   al_free(data);
+}
+
+static void destroy(ALLEGRO_FONT *f) {
+   destroy_data(f->data);
    al_free(f);
 }
 
@@ -447,17 +530,16 @@ static void get_text_dimensions(const ALLEGRO_FONT *f,
 static int get_font_ranges(ALLEGRO_FONT *f,
       int ranges_count, int *ranges) {
    BMFONT_DATA *data = f->data;
-   BMFONT_RANGE *range = data->range_first;
-   int i = 0;
-   while (range) {
-      if (i < ranges_count) {
-         ranges[i * 2 + 0] = range->first;
-         ranges[i * 2 + 1] = range->first + range->count - 1;
-      }
-      range = range->next;
-      i++;
+   int i;
+   for (i = 0; i < data->ranges_count && i < ranges_count; i++) {
+      ranges[i * 2 + 0] = data->ranges[i].first;
+      ranges[i * 2 + 1] = data->ranges[i].first + data->ranges[i].count - 1;
    }
-   return i;
+   return data->ranges_count;
+}
+
+static bool has_glyph(const ALLEGRO_FONT *f, int codepoint) {
+   return find_codepoint(f->data, codepoint) != NULL;
 }
 
 static ALLEGRO_FONT_VTABLE _al_font_vtable_xml = {
@@ -473,9 +555,28 @@ static ALLEGRO_FONT_VTABLE _al_font_vtable_xml = {
    get_font_ranges,
    get_glyph_dimensions,
    get_glyph_advance,
-   get_glyph
+   get_glyph,
+   has_glyph
 };
 
+static ALLEGRO_FONT *create_font(BMFONT_DATA *data) {
+   ALLEGRO_FONT *font;
+
+   if (!finish_font(data)) {
+      destroy_data(data);
+      return NULL;
+   }
+
+   font = al_calloc(1, sizeof *font);
+   if (!font) {
+      destroy_data(data);
+      return NULL;
+   }
+   font->vtable = &_al_font_vtable_xml;
+   font->data = data;
+   return font;
+}
+
 ALLEGRO_FONT *_al_load_bmfont_xml(const char *filename, int size,
       int font_flags)
 {
@@ -492,28 +593,423 @@ ALLEGRO_FONT *_al_load_bmfont_xml(const char *filename, int size,
    parser->tag = al_ustr_new("");
    parser->attribute = al_ustr_new("");
    parser->path = al_create_path(filename);
+   _al_vector_init(&parser->chars, sizeof(BMFONT_CHAR));
+   _al_vector_init(&parser->kerning, sizeof(BMFONT_KERNING));
    data->flags = font_flags;
 
-   ALLEGRO_FONT *font = al_calloc(1, sizeof *font);
-   font->vtable = &_al_font_vtable_xml;
-   font->data = data;
-   parser->font = font;
+   ALLEGRO_FONT font;
+   font.data = data;
+   parser->font = &font;
 
+   /* This also closes the file. */
    _al_xml_parse(f, xml_callback, parser);
 
-   int i;
-   for (i = 0; i < data->kerning_pairs; i++) {
-      BMFONT_KERNING *k = data->kerning + i;
-      BMFONT_CHAR *c = find_codepoint(data, k->first);
-      c->kerning_pairs++;
-      c->kerning = al_realloc(c->kerning, c->kerning_pairs *
-         sizeof *c->kerning);
-      c->kerning[c->kerning_pairs - 1] = *k;
-   }
-
+   /* Move the parsed characters and kerning pairs into plain arrays. */
+   data->chars_count = _al_vector_size(&parser->chars);
+   data->chars = al_malloc((data->chars_count + 1) * sizeof *data->chars);
+   if (data->chars_count > 0)
+      memcpy(data->chars, _al_vector_ref_front(&parser->chars),
+         data->chars_count * sizeof *data->chars);
+   data->kerning_pairs = _al_vector_size(&parser->kerning);
+   data->kerning = al_malloc((data->kerning_pairs + 1) *
+      sizeof *data->kerning);
+   if (data->kerning_pairs > 0)
+      memcpy(data->kerning, _al_vector_ref_front(&parser->kerning),
+         data->kerning_pairs * sizeof *data->kerning);
+
+   _al_vector_free(&parser->chars);
+   _al_vector_free(&parser->kerning);
    al_ustr_free(parser->tag);
    al_ustr_free(parser->attribute);
    al_destroy_path(parser->path);
 
+   return create_font(data);
+}
+
+
+static int get16(const unsigned char *p) {
+   return p[0] | (p[1] << 8);
+}
+
+static int get16s(const unsigned char *p) {
+   return (int16_t)get16(p);
+}
+
+static int get32(const unsigned char *p) {
+   return (int)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+      ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static void put16(unsigned char *p, int v) {
+   p[0] = v & 0xff;
+   p[1] = (v >> 8) & 0xff;
+}
+
+static void put32(unsigned char *p, int v) {
+   put16(p, v & 0xffff);
+   put16(p + 2, (v >> 16) & 0xffff);
+}
+
+/* Read the whole file in one go. */
+static unsigned char *read_file(const char *filename, size_t *size) {
+   ALLEGRO_FILE *f;
+   unsigned char *buf;
+   int64_t fsize;
+
+   f = al_fopen(filename, "rb");
+   if (!f) {
+      ALLEGRO_DEBUG("Could not open %s.\n", filename);
+      return NULL;
+   }
+   fsize = al_fsize(f);
+   if (fsize < 0) {
+      al_fclose(f);
+      return NULL;
+   }
+   buf = al_malloc(fsize + 1);
+   if (!buf || al_fread(f, buf, fsize) != (size_t)fsize) {
+      ALLEGRO_ERROR("Could not read %s.\n", filename);
+      al_free(buf);
+      al_fclose(f);
+      return NULL;
+   }
+   al_fclose(f);
+   *size = fsize;
+   return buf;
+}
+
+static void read_char_record(const unsigned char *p, BMFONT_CHAR *c) {
+   memset(c, 0, sizeof *c);
+   c->id = get32(p);
+   c->x = get16(p + 4);
+   c->y = get16(p + 6);
+   c->width = get16(p + 8);
+   c->height = get16(p + 10);
+   c->xoffset = get16s(p + 12);
+   c->yoffset = get16s(p + 14);
+   c->xadvance = get16s(p + 16);
+   c->page = p[18];
+   c->chnl = p[19];
+}
+
+static void read_kerning_record(const unsigned char *p, BMFONT_KERNING *k) {
+   k->first = get32(p);
+   k->second = get32(p + 4);
+   k->amount = get16s(p + 8);
+}
+
+static bool read_chars(BMFONT_DATA *data, const unsigned char *p, int count) {
+   int i;
+   data->chars = al_malloc((count + 1) * sizeof *data->chars);
+   if (!data->chars)
+      return false;
+   for (i = 0; i < count; i++)
+      read_char_record(p + i * CHAR_RECORD_SIZE, data->chars + i);
+   data->chars_count = count;
+   return true;
+}
+
+static bool read_kerning(BMFONT_DATA *data, const unsigned char *p,
+      int count) {
+   int i;
+   data->kerning = al_malloc((count + 1) * sizeof *data->kerning);
+   if (!data->kerning)
+      return false;
+   for (i = 0; i < count; i++)
+      read_kerning_record(p + i * KERNING_RECORD_SIZE, data->kerning + i);
+   data->kerning_pairs = count;
+   return true;
+}
+
+/* Check that the page ids used by the characters exist. */
+static bool check_pages(BMFONT_DATA *data, const char *filename) {
+   int i;
+   for (i = 0; i < data->chars_count; i++) {
+      int page = data->chars[i].page;
+      if (page >= data->pages_count || !data->pages[page]) {
+         ALLEGRO_ERROR("Missing page %d in %s.\n", page, filename);
+         return false;
+      }
+   }
+   return true;
+}
+
+/* The binary format written by AngelCode's BMFont: a header followed by
+ * blocks of info, common, pages, chars and kerning pairs.
+ */
+static ALLEGRO_FONT *load_bmfont_binary(const char *filename,
+      const unsigned char *buf, size_t size, int font_flags) {
+   BMFONT_DATA *data;
+   ALLEGRO_PATH *path;
+   size_t pos = 4;
+   bool ok = true;
+
+   if (buf[3] != 3) {
+      ALLEGRO_ERROR("Unsupported BMFont version %d in %s.\n", buf[3],
+         filename);
+      return NULL;
+   }
+
+   data = al_calloc(1, sizeof *data);
+   if (!data)
+      return NULL;
+   data->flags = font_flags;
+   path = al_create_path(filename);
+
+   while (ok && pos + 5 <= size) {
+      int type = buf[pos];
+      size_t block_size = (uint32_t)get32(buf + pos + 1);
+      const unsigned char *p = buf + pos + 5;
+      pos += 5;
+      if (block_size > size - pos) {
+         ALLEGRO_ERROR("Truncated block %d in %s.\n", type, filename);
+         ok = false;
+         break;
+      }
+      pos += block_size;
+
+      if (type == 2 && block_size >= 15) {
+         data->line_height = get16(p);
+         data->base = get16(p + 2);
+      }
+      else if (type == 3) {
+         /* Names of equal length, each terminated by a zero byte. */
+         const unsigned char *end = p + block_size;
+         while (ok && p < end) {
+            const unsigned char *nul = memchr(p, 0, end - p);
+            if (!nul)
+               break;
+            ok = add_page(data, path, (const char *)p);
+            p = nul + 1;
+         }
+      }
+      else if (type == 4 && !data->chars) {
+         ok = read_chars(data, p, block_size / CHAR_RECORD_SIZE);
+      }
+      else if (type == 5 && !data->kerning) {
+         ok = read_kerning(data, p, block_size / KERNING_RECORD_SIZE);
+      }
+   }
+
+   al_destroy_path(path);
+
+   if (ok && !data->chars)
+      ok = read_chars(data, buf, 0);
+   if (ok && !data->kerning)
+      ok = read_kerning(data, buf, 0);
+   if (!ok || !check_pages(data, filename)) {
+      destroy_data(data);
+      return NULL;
+   }
+
+   return create_font(data);
+}
+
+ALLEGRO_FONT *_al_load_bmfont(const char *filename, int size,
+      int font_flags)
+{
+   ALLEGRO_FILE *f;
+   char magic[4];
+   unsigned char *buf;
+   size_t buf_size;
+   ALLEGRO_FONT *font;
+
+   f = al_fopen(filename, "rb");
+   if (!f) {
+      ALLEGRO_DEBUG("Could not open %s.\n", filename);
+      return NULL;
+   }
+   if (al_fread(f, magic, 3) != 3 || memcmp(magic, "BMF", 3) != 0) {
+      al_fclose(f);
+      return _al_load_bmfont_xml(filename, size, font_flags);
+   }
+   al_fclose(f);
+
+   buf = read_file(filename, &buf_size);
+   if (!buf)
+      return NULL;
+   font = NULL;
+   if (buf_size >= 4)
+      font = load_bmfont_binary(filename, buf, buf_size, font_flags);
+   al_free(buf);
    return font;
 }
+
+
+/* Layout of the packed format, all integers little endian:
+ *
+ *    "A5FN", version, line height, base,
+ *    number of pages, characters and kerning pairs, as 32-bit integers
+ *    the page file names, each as a 32-bit length followed by the name
+ *    the characters sorted by id, as in the BMFont binary format
+ *    the kerning pairs sorted by first then second character, likewise
+ */
+ALLEGRO_FONT *_al_load_packed_bmfont(const char *filename, int size,
+      int font_flags)
+{
+   BMFONT_DATA *data = NULL;
+   ALLEGRO_PATH *path = NULL;
+   unsigned char *buf;
+   size_t buf_size;
+   size_t pos;
+   int pages_count, chars_count, kerning_count;
+   int i;
+   (void)size;
+
+   buf = read_file(filename, &buf_size);
+   if (!buf)
+      return NULL;
+
+   if (buf_size < PACKED_HEADER_SIZE ||
+         memcmp(buf, PACKED_MAGIC, 4) != 0 ||
+         get32(buf + 4) != PACKED_VERSION) {
+      ALLEGRO_ERROR("%s is not a packed font.\n", filename);
+      goto fail;
+   }
+
+   data = al_calloc(1, sizeof *data);
+   if (!data)
+      goto fail;
+   data->flags = font_flags;
+   data->line_height = get32(buf + 8);
+   data->base = get32(buf + 12);
+   pages_count = get32(buf + 16);
+   chars_count = get32(buf + 20);
+   kerning_count = get32(buf + 24);
+   if (pages_count < 0 || chars_count < 0 || kerning_count < 0)
+      goto corrupt;
+
+   path = al_create_path(filename);
+   pos = PACKED_HEADER_SIZE;
+   for (i = 0; i < pages_count; i++) {
+      char *name;
+      size_t len;
+      bool added;
+      if (buf_size - pos < 4)
+         goto corrupt;
+      len = (uint32_t)get32(buf + pos);
+      pos += 4;
+      if (buf_size - pos < len)
+         goto corrupt;
+      name = al_malloc(len + 1);
+      if (!name)
+         goto fail;
+      memcpy(name, buf + pos, len);
+      name[len] = '\0';
+      pos += len;
+      added = add_page(data, path, name);
+      al_free(name);
+      if (!added)
+         goto fail;
+   }
+
+   if ((buf_size - pos) / CHAR_RECORD_SIZE < (size_t)chars_count)
+      goto corrupt;
+   if (!read_chars(data, buf + pos, chars_count))
+      goto fail;
+   pos += (size_t)chars_count * CHAR_RECORD_SIZE;
+
+   if ((buf_size - pos) / KERNING_RECORD_SIZE < (size_t)kerning_count)
+      goto corrupt;
+   if (!read_kerning(data, buf + pos, kerning_count))
+      goto fail;
+
+   if (!check_pages(data, filename))
+      goto fail;
+
+   al_destroy_path(path);
+   al_free(buf);
+   return create_font(data);
+
+corrupt:
+   ALLEGRO_ERROR("%s is corrupt.\n", filename);
+fail:
+   if (path)
+      al_destroy_path(path);
+   if (data)
+      destroy_data(data);
+   al_free(buf);
+   return NULL;
+}
+
+
+/* Function: al_save_packed_bmfont
+ */
+bool al_save_packed_bmfont(const ALLEGRO_FONT *font, const char *filename)
+{
+   BMFONT_DATA *data;
+   ALLEGRO_FILE *f;
+   unsigned char *buf, *p;
+   size_t size;
+   int i;
+   bool ok;
+
+   ASSERT(font);
+   ASSERT(filename);
+
+   if (font->vtable != &_al_font_vtable_xml) {
+      ALLEGRO_ERROR("Only BMFont fonts can be saved as packed fonts.\n");
+      return false;
+   }
+   data = font->data;
+
+   size = PACKED_HEADER_SIZE;
+   for (i = 0; i < data->pages_count; i++)
+      size += 4 + strlen(data->page_files[i]);
+   size += (size_t)data->chars_count * CHAR_RECORD_SIZE;
+   size += (size_t)data->kerning_pairs * KERNING_RECORD_SIZE;
+
+   buf = al_calloc(1, size);
+   if (!buf)
+      return false;
+
+   memcpy(buf, PACKED_MAGIC, 4);
+   put32(buf + 4, PACKED_VERSION);
+   put32(buf + 8, data->line_height);
+   put32(buf + 12, data->base);
+   put32(buf + 16, data->pages_count);
+   put32(buf + 20, data->chars_count);
+   put32(buf + 24, data->kerning_pairs);
+   p = buf + PACKED_HEADER_SIZE;
+
+   for (i = 0; i < data->pages_count; i++) {
+      int len = strlen(data->page_files[i]);
+      put32(p, len);
+      memcpy(p + 4, data->page_files[i], len);
+      p += 4 + len;
+   }
+
+   /* Both are kept sorted, so the loader has nothing left to do. */
+   for (i = 0; i < data->chars_count; i++, p += CHAR_RECORD_SIZE) {
+      BMFONT_CHAR *c = data->chars + i;
+      put32(p, c->id);
+      put16(p + 4, c->x);
+      put16(p + 6, c->y);
+      put16(p + 8, c->width);
+      put16(p + 10, c->height);
+      put16(p + 12, c->xoffset);
+      put16(p + 14, c->yoffset);
+      put16(p + 16, c->xadvance);
+      p[18] = c->page;
+      p[19] = c->chnl;
+   }
+   for (i = 0; i < data->kerning_pairs; i++, p += KERNING_RECORD_SIZE) {
+      BMFONT_KERNING *k = data->kerning + i;
+      put32(p, k->first);
+      put32(p + 4, k->second);
+      put16(p + 8, k->amount);
+   }
+
+   f = al_fopen(filename, "wb");
+   if (!f) {
+      ALLEGRO_ERROR("Unable to open %s for writing.\n", filename);
+      al_free(buf);
+      return false;
+   }
+   ok = al_fwrite(f, buf, size) == size;
+   ok = al_fclose(f) && ok;
+   al_free(buf);
+   if (!ok)
+      ALLEGRO_ERROR("Failed writing %s.\n", filename);
+   return ok;
+}
@@ -151,10 +151,12 @@ static ALLEGRO_BITMAP* _al_font_color_find_glyph(const ALLEGRO_FONT* f, int ch)
 static int color_char_length(const ALLEGRO_FONT* f, int ch)
 {
    ALLEGRO_BITMAP* g = _al_font_color_find_glyph(f, ch);
+   ALLEGRO_FONT *fallback;
    if (g)
       return al_get_bitmap_width(g);
-   if (f->fallback)
-      return al_get_glyph_width(f->fallback, ch);
+   fallback = _al_find_fallback_font(f, ch);
+   if (fallback)
+      return al_get_glyph_width(fallback, ch);
    return 0;
 }
 
@@ -173,6 +175,7 @@ static int color_render_char(const ALLEGRO_FONT* f,
    int w = 0;
    int h = f->vtable->font_height(f);
    ALLEGRO_BITMAP *g;
+   ALLEGRO_FONT *fallback;
 
    g = _al_font_color_find_glyph(f, ch);
    if (g) {
@@ -181,14 +184,28 @@ static int color_render_char(const ALLEGRO_FONT* f,
 
       w = al_get_bitmap_width(g);
    }
-   else if (f->fallback) {
-      al_draw_glyph(f->fallback, color, x, y, ch);
-      w = al_get_glyph_width(f->fallback, ch);
+   else if ((fallback = _al_find_fallback_font(f, ch))) {
+      al_draw_glyph(fallback, color, x, y, ch);
+      w = al_get_glyph_width(fallback, ch);
    }
 
    return w;
 }
 
+/* Glyphs are drawn in runs of consecutive characters coming from the same
+ * glyph sheet, each of which costs a single draw call.
+ */
+#define COLOR_RUN_SIZE 64
+
+static void color_flush_run(ALLEGRO_BITMAP *sheet, ALLEGRO_COLOR color,
+   _AL_BITMAP_QUAD *run, int *run_size)
+{
+   if (*run_size > 0) {
+      _al_draw_tinted_bitmap_quads(sheet, color, run, *run_size);
+      *run_size = 0;
+   }
+}
+
 /* color_render:
  *  (color vtable entry)
  *  Renders a color font onto a bitmap, at the specified location, using
@@ -200,13 +217,41 @@ static int color_render(const ALLEGRO_FONT* f, ALLEGRO_COLOR color,
 {
     int pos = 0;
     int advance = 0;
+    int h = f->vtable->font_height(f);
     int32_t ch;
     bool held = al_is_bitmap_drawing_held();
+    ALLEGRO_BITMAP *sheet = NULL;
+    _AL_BITMAP_QUAD run[COLOR_RUN_SIZE];
+    int run_size = 0;
 
     al_hold_bitmap_drawing(true);
     while ((ch = al_ustr_get_next(text, &pos)) >= 0) {
-        advance += f->vtable->render_char(f, color, ch, x + advance, y);
+        ALLEGRO_BITMAP *g = _al_font_color_find_glyph(f, ch);
+        ALLEGRO_BITMAP *parent;
+        _AL_BITMAP_QUAD *q;
+
+        if (!g) {
+            color_flush_run(sheet, color, run, &run_size);
+            advance += f->vtable->render_char(f, color, ch, x + advance, y);
+            continue;
+        }
+
+        parent = g->parent ? g->parent : g;
+        if (parent != sheet || run_size == COLOR_RUN_SIZE) {
+            color_flush_run(sheet, color, run, &run_size);
+            sheet = parent;
+        }
+
+        q = &run[run_size++];
+        q->sx = g->xofs;
+        q->sy = g->yofs;
+        q->sw = g->w;
+        q->sh = g->h;
+        q->dx = x + advance;
+        q->dy = y + ((float)h - g->h)/2.0f;
+        advance += g->w;
     }
+    color_flush_run(sheet, color, run, &run_size);
     al_hold_bitmap_drawing(held);
     return advance;
 }
@@ -215,6 +260,7 @@ static int color_render(const ALLEGRO_FONT* f, ALLEGRO_COLOR color,
 static bool color_get_glyph(const ALLEGRO_FONT *f, int prev_codepoint, int codepoint, ALLEGRO_GLYPH *glyph)
 {
    ALLEGRO_BITMAP *g = _al_font_color_find_glyph(f, codepoint);
+   ALLEGRO_FONT *fallback;
    if (g) {
       glyph->bitmap = g;
       glyph->x = 0;
@@ -227,8 +273,9 @@ static bool color_get_glyph(const ALLEGRO_FONT *f, int prev_codepoint, int codep
       glyph->advance = glyph->w;
       return true;
    }
-   if (f->fallback) {
-      return f->fallback->vtable->get_glyph(f->fallback, prev_codepoint, codepoint, glyph);
+   fallback = _al_find_fallback_font(f, codepoint);
+   if (fallback) {
+      return fallback->vtable->get_glyph(fallback, prev_codepoint, codepoint, glyph);
    }
    return false;
 }
@@ -296,8 +343,9 @@ static bool color_get_glyph_dimensions(ALLEGRO_FONT const *f,
 {
    ALLEGRO_BITMAP *glyph = _al_font_color_find_glyph(f, codepoint);
    if(!glyph) {
-      if (f->fallback) {
-         return al_get_glyph_dimensions(f->fallback, codepoint,
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, codepoint);
+      if (fallback) {
+         return al_get_glyph_dimensions(fallback, codepoint,
             bbx, bby, bbw, bbh);
       }
       return false;
@@ -325,6 +373,11 @@ static int color_get_glyph_advance(ALLEGRO_FONT const *f,
    return color_char_length(f, codepoint1);
 }
 
+static bool color_has_glyph(const ALLEGRO_FONT *f, int codepoint)
+{
+   return _al_font_find_page(f->data, codepoint) != NULL;
+}
+
 /********
  * vtable declarations
  ********/
@@ -342,7 +395,8 @@ ALLEGRO_FONT_VTABLE _al_font_vtable_color = {
     color_get_font_ranges,
     color_get_glyph_dimensions,
     color_get_glyph_advance,
-    color_get_glyph
+    color_get_glyph,
+    color_has_glyph
 };
 
 
@@ -378,7 +432,8 @@ bool al_init_font_addon(void)
    al_register_font_loader(".tga", _al_load_bitmap_font);
 
    al_register_font_loader(".xml", _al_load_bmfont_xml);
-   al_register_font_loader(".fnt", _al_load_bmfont_xml);
+   al_register_font_loader(".fnt", _al_load_bmfont);
+   al_register_font_loader(".a5fnt", _al_load_packed_bmfont);
 
    _al_add_exit_func(font_shutdown, "font_shutdown");
 
@@ -0,0 +1,161 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Shader for drawing signed distance field fonts.
+ *
+ *      The glyph bitmaps hold the distance to the outline in the alpha
+ *      channel, with 0.5 on the outline itself. The font sets how wide the
+ *      anti-aliased edge should be as it draws.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_font.h"
+#include "allegro5/internal/aintern.h"
+
+ALLEGRO_DEBUG_CHANNEL("font")
+
+
+static const char *sdf_glsl_pixel_source =
+   "#ifdef GL_ES\n"
+   "precision mediump float;\n"
+   "#endif\n"
+   "uniform sampler2D " ALLEGRO_SHADER_VAR_TEX ";\n"
+   "uniform bool " ALLEGRO_SHADER_VAR_USE_TEX ";\n"
+   "uniform float " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ";\n"
+   "varying vec4 varying_color;\n"
+   "varying vec2 varying_texcoord;\n"
+   "\n"
+   "void main()\n"
+   "{\n"
+   "  if (" ALLEGRO_SHADER_VAR_USE_TEX ") {\n"
+   "    float d = texture2D(" ALLEGRO_SHADER_VAR_TEX ", varying_texcoord).a;\n"
+   "    gl_FragColor = varying_color * smoothstep(\n"
+   "      0.5 - " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ",\n"
+   "      0.5 + " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ", d);\n"
+   "  }\n"
+   "  else\n"
+   "    gl_FragColor = varying_color;\n"
+   "}\n";
+
+static const char *sdf_glsl_pixel_source_gl3 =
+   "#version 330 core\n"
+   "#ifdef GL_ES\n"
+   "precision mediump float;\n"
+   "#endif\n"
+   "uniform sampler2D " ALLEGRO_SHADER_VAR_TEX ";\n"
+   "uniform bool " ALLEGRO_SHADER_VAR_USE_TEX ";\n"
+   "uniform float " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ";\n"
+   "in vec4 varying_color;\n"
+   "in vec2 varying_texcoord;\n"
+   "layout(location = 0) out vec4 diffuseColor;\n"
+   "\n"
+   "void main()\n"
+   "{\n"
+   "  if (" ALLEGRO_SHADER_VAR_USE_TEX ") {\n"
+   "    float d = texture(" ALLEGRO_SHADER_VAR_TEX ", varying_texcoord).a;\n"
+   "    diffuseColor = varying_color * smoothstep(\n"
+   "      0.5 - " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ",\n"
+   "      0.5 + " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ", d);\n"
+   "  }\n"
+   "  else\n"
+   "    diffuseColor = varying_color;\n"
+   "}\n";
+
+static const char *sdf_hlsl_pixel_source =
+   "bool " ALLEGRO_SHADER_VAR_USE_TEX ";\n"
+   "texture " ALLEGRO_SHADER_VAR_TEX ";\n"
+   "float " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ";\n"
+   "sampler2D s = sampler_state {\n"
+   "   texture = <" ALLEGRO_SHADER_VAR_TEX ">;\n"
+   "};\n"
+   "\n"
+   "float4 ps_main(VS_OUTPUT Input) : COLOR0\n"
+   "{\n"
+   "   if (" ALLEGRO_SHADER_VAR_USE_TEX ") {\n"
+   "      float d = tex2D(s, Input.TexCoord).a;\n"
+   "      return Input.Color * smoothstep(\n"
+   "         0.5 - " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ",\n"
+   "         0.5 + " ALLEGRO_SHADER_VAR_SDF_SMOOTHING ", d);\n"
+   "   }\n"
+   "   else {\n"
+   "      return Input.Color;\n"
+   "   }\n"
+   "}\n";
+
+
+static const char *get_pixel_source(ALLEGRO_SHADER_PLATFORM platform)
+{
+   ALLEGRO_DISPLAY *display = al_get_current_display();
+
+   switch (platform) {
+      case ALLEGRO_SHADER_GLSL:
+      case ALLEGRO_SHADER_GLSL_MINIMAL:
+         /* Must match the version of the default vertex shader. */
+         if (display && (al_get_display_flags(display) &
+               (ALLEGRO_OPENGL_3_0 | ALLEGRO_OPENGL_FORWARD_COMPATIBLE)))
+            return sdf_glsl_pixel_source_gl3;
+         return sdf_glsl_pixel_source;
+      case ALLEGRO_SHADER_HLSL:
+      case ALLEGRO_SHADER_HLSL_MINIMAL:
+      case ALLEGRO_SHADER_HLSL_SM_3_0:
+         return sdf_hlsl_pixel_source;
+      default:
+         return NULL;
+   }
+}
+
+
+/* Function: al_create_sdf_font_shader
+ */
+ALLEGRO_SHADER *al_create_sdf_font_shader(ALLEGRO_SHADER_PLATFORM platform)
+{
+   ALLEGRO_SHADER *shader;
+   const char *pixel_source;
+
+   shader = al_create_shader(platform);
+   if (!shader) {
+      ALLEGRO_ERROR("Unable to create a shader.\n");
+      return NULL;
+   }
+
+   platform = al_get_shader_platform(shader);
+   pixel_source = get_pixel_source(platform);
+   if (!pixel_source) {
+      ALLEGRO_ERROR("No SDF font shader for platform %d.\n", platform);
+      goto fail;
+   }
+
+   if (!al_attach_shader_source(shader, ALLEGRO_VERTEX_SHADER,
+         al_get_default_shader_source(platform, ALLEGRO_VERTEX_SHADER))) {
+      ALLEGRO_ERROR("al_attach_shader_source for vertex shader failed: %s\n",
+         al_get_shader_log(shader));
+      goto fail;
+   }
+   if (!al_attach_shader_source(shader, ALLEGRO_PIXEL_SHADER, pixel_source)) {
+      ALLEGRO_ERROR("al_attach_shader_source for pixel shader failed: %s\n",
+         al_get_shader_log(shader));
+      goto fail;
+   }
+   if (!al_build_shader(shader)) {
+      ALLEGRO_ERROR("al_build_shader failed: %s\n", al_get_shader_log(shader));
+      goto fail;
+   }
+
+   return shader;
+
+fail:
+   al_destroy_shader(shader);
+   return NULL;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -24,6 +24,7 @@
 
 #include <math.h>
 #include <ctype.h>
+#include <string.h>
 #include "allegro5/allegro.h"
 
 #include "allegro5/allegro_font.h"
@@ -354,6 +355,174 @@ void al_get_text_dimensions(const ALLEGRO_FONT *f,
 
 
 
+/* Longer fallback chains are walked without the cache. */
+#define MAX_FALLBACK_FONTS 64
+#define FALLBACK_PAGE_BITS 8
+#define FALLBACK_PAGE_SIZE (1 << FALLBACK_PAGE_BITS)
+#define FALLBACK_NUM_PAGES ((0x10FFFF >> FALLBACK_PAGE_BITS) + 1)
+#define FALLBACK_UNKNOWN 0
+#define FALLBACK_MISSING 255
+
+/* Caches for each codepoint which font of the fallback chain it is found
+ * in, as an index into fonts plus one. The chain is remembered as it was
+ * when the generation counter had the given value, and any change to a
+ * fallback font anywhere increments the counter.
+ */
+struct ALLEGRO_FONT_FALLBACK_CACHE {
+   int generation;
+   int num_fonts;
+   ALLEGRO_FONT *fonts[MAX_FALLBACK_FONTS];
+   unsigned char latin[FALLBACK_PAGE_SIZE];
+   unsigned char **pages;     /* [FALLBACK_NUM_PAGES], allocated as needed */
+};
+
+static int fallback_generation;
+
+
+static void free_fallback_cache(ALLEGRO_FONT_FALLBACK_CACHE *cache)
+{
+   int i;
+
+   if (!cache)
+      return;
+
+   if (cache->pages) {
+      for (i = 0; i < FALLBACK_NUM_PAGES; i++)
+         al_free(cache->pages[i]);
+      al_free(cache->pages);
+   }
+   al_free(cache);
+}
+
+
+/* Start over with the current fallback chain. Returns false if it is too
+ * long to be cached.
+ */
+static bool reset_fallback_cache(ALLEGRO_FONT_FALLBACK_CACHE *cache,
+   const ALLEGRO_FONT *f)
+{
+   ALLEGRO_FONT *fallback;
+   int i;
+
+   cache->generation = fallback_generation;
+   cache->num_fonts = 0;
+   for (fallback = f->fallback; fallback; fallback = fallback->fallback) {
+      if (cache->num_fonts == MAX_FALLBACK_FONTS) {
+         cache->num_fonts = 0;
+         return false;
+      }
+      cache->fonts[cache->num_fonts++] = fallback;
+   }
+
+   memset(cache->latin, FALLBACK_UNKNOWN, sizeof cache->latin);
+   if (cache->pages) {
+      for (i = 0; i < FALLBACK_NUM_PAGES; i++) {
+         al_free(cache->pages[i]);
+         cache->pages[i] = NULL;
+      }
+   }
+   return true;
+}
+
+
+/* Returns the font of the chain which has the glyph, or the last one if
+ * none of them does, which then draws whatever it draws for a missing
+ * glyph.
+ */
+static ALLEGRO_FONT *walk_fallback_chain(const ALLEGRO_FONT *f, int codepoint)
+{
+   ALLEGRO_FONT *fallback = f->fallback;
+   int i;
+
+   for (i = 0; fallback->fallback && i < MAX_FALLBACK_FONTS; i++) {
+      if (fallback->vtable->has_glyph(fallback, codepoint))
+         break;
+      fallback = fallback->fallback;
+   }
+   return fallback;
+}
+
+
+/* Returns the entry of the cache for the codepoint, or NULL if it can't be
+ * cached.
+ */
+static unsigned char *get_fallback_entry(ALLEGRO_FONT_FALLBACK_CACHE *cache,
+   int codepoint)
+{
+   unsigned char **page;
+
+   if (codepoint >= 0 && codepoint < FALLBACK_PAGE_SIZE)
+      return &cache->latin[codepoint];
+   if (codepoint < 0 || codepoint > 0x10FFFF)
+      return NULL;
+
+   if (!cache->pages) {
+      cache->pages = al_calloc(FALLBACK_NUM_PAGES, sizeof *cache->pages);
+      if (!cache->pages)
+         return NULL;
+   }
+   page = &cache->pages[codepoint >> FALLBACK_PAGE_BITS];
+   if (!*page) {
+      *page = al_calloc(FALLBACK_PAGE_SIZE, 1);
+      if (!*page)
+         return NULL;
+   }
+   return &(*page)[codepoint & (FALLBACK_PAGE_SIZE - 1)];
+}
+
+
+/* Internal function: _al_find_fallback_font
+ *  Returns the font of the fallback chain of f which should be asked for
+ *  the glyph, or NULL if f has no fallback font. Font drivers call this
+ *  when they don't have a glyph themselves, so that each character only
+ *  probes the fonts of the chain once.
+ */
+ALLEGRO_FONT *_al_find_fallback_font(const ALLEGRO_FONT *f, int codepoint)
+{
+   ALLEGRO_FONT_FALLBACK_CACHE *cache;
+   unsigned char *entry;
+   int i;
+
+   if (!f->fallback)
+      return NULL;
+
+   /* The cache doesn't change what the font draws. */
+   cache = f->fallback_cache;
+   if (!cache) {
+      cache = al_calloc(1, sizeof *cache);
+      if (!cache)
+         return walk_fallback_chain(f, codepoint);
+      ((ALLEGRO_FONT *)f)->fallback_cache = cache;
+      cache->generation = fallback_generation - 1;
+   }
+   if (cache->generation != fallback_generation) {
+      if (!reset_fallback_cache(cache, f))
+         return walk_fallback_chain(f, codepoint);
+   }
+   if (cache->num_fonts == 0)
+      return walk_fallback_chain(f, codepoint);
+
+   entry = get_fallback_entry(cache, codepoint);
+   if (!entry)
+      return walk_fallback_chain(f, codepoint);
+
+   if (*entry == FALLBACK_UNKNOWN) {
+      *entry = FALLBACK_MISSING;
+      for (i = 0; i < cache->num_fonts; i++) {
+         ALLEGRO_FONT *fallback = cache->fonts[i];
+         if (fallback->vtable->has_glyph(fallback, codepoint)) {
+            *entry = i + 1;
+            break;
+         }
+      }
+   }
+
+   if (*entry == FALLBACK_MISSING)
+      return cache->fonts[cache->num_fonts - 1];
+   return cache->fonts[*entry - 1];
+}
+
+
 /* Function: al_destroy_font
  */
 void al_destroy_font(ALLEGRO_FONT *f)
@@ -363,6 +532,10 @@ void al_destroy_font(ALLEGRO_FONT *f)
 
    _al_unregister_destructor(_al_dtor_list, f->dtor_item);
 
+   /* Other fonts may have cached where this one is in their chains. */
+   fallback_generation++;
+   free_fallback_cache(f->fallback_cache);
+
    f->vtable->destroy(f);
 }
 
@@ -697,6 +870,7 @@ void al_draw_multiline_textf(const ALLEGRO_FONT *font,
 void al_set_fallback_font(ALLEGRO_FONT *font, ALLEGRO_FONT *fallback)
 {
    font->fallback = fallback;
+   fallback_generation++;
 }
 
 /* Function: al_get_fallback_font
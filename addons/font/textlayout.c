@@ -0,0 +1,419 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Multi-line text layouts which remember their line breaks.
+ *
+ *      The text is split into words once, and every word is measured once.
+ *      Wrapping at a new width then only adds up the cached widths, and
+ *      breaks the text in the same places as al_do_multiline_ustr.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#define ALLEGRO_INTERNAL_UNSTABLE
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_font.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_vector.h"
+
+
+/* A run of text up to the next space or tab, or the end of its line. The
+ * word that follows is separated by exactly one such character, so there
+ * are empty words where several of them follow each other.
+ */
+typedef struct TEXT_LAYOUT_WORD {
+   int start;
+   int end;
+   float width;
+   /* What the separator and kerning add to the width of a line when the
+    * next word is on it too. For the last word of a hard line, the width
+    * of any whitespace after it instead.
+    */
+   float join;
+} TEXT_LAYOUT_WORD;
+
+
+/* A line of the text as separated by newline characters. */
+typedef struct TEXT_LAYOUT_HARD_LINE {
+   int start;
+   int end;
+   int first_word;
+   int num_words;
+   float width;               /* if drawn on a single line */
+} TEXT_LAYOUT_HARD_LINE;
+
+
+typedef struct TEXT_LAYOUT_LINE {
+   int start;
+   int end;
+   float width;
+} TEXT_LAYOUT_LINE;
+
+
+struct ALLEGRO_TEXT_LAYOUT {
+   const ALLEGRO_FONT *font;
+   ALLEGRO_USTR *text;
+   _AL_VECTOR words;          /* of TEXT_LAYOUT_WORD */
+   _AL_VECTOR hard_lines;     /* of TEXT_LAYOUT_HARD_LINE */
+
+   float max_width;
+   TEXT_LAYOUT_LINE *lines;
+   int num_lines;
+   int lines_capacity;
+};
+
+
+static float measure(const ALLEGRO_TEXT_LAYOUT *layout, int start, int end)
+{
+   ALLEGRO_USTR_INFO info;
+   const ALLEGRO_USTR *ref;
+
+   if (start >= end)
+      return 0;
+   ref = al_ref_ustr(&info, layout->text, start, end);
+   return al_get_ustr_width(layout->font, ref);
+}
+
+
+/* Split a hard line into words and measure them. Widths of whole lines are
+ * later added up from these, which gives the same result as measuring the
+ * line as long as kerning only depends on pairs of characters.
+ */
+static bool add_hard_line(ALLEGRO_TEXT_LAYOUT *layout, int start, int end)
+{
+   TEXT_LAYOUT_HARD_LINE *hard_line;
+   const char *s = al_cstr(layout->text);
+   int first_word = _al_vector_size(&layout->words);
+   int pos = start;
+   int i;
+
+   while (pos < end) {
+      TEXT_LAYOUT_WORD *word;
+      int word_end = pos;
+
+      /* Neither can be part of a multi-byte character. */
+      while (word_end < end && s[word_end] != ' ' && s[word_end] != '\t')
+         word_end++;
+
+      word = _al_vector_alloc_back(&layout->words);
+      if (!word)
+         return false;
+      word->start = pos;
+      word->end = word_end;
+      word->width = measure(layout, pos, word_end);
+      word->join = 0;
+
+      pos = word_end + 1;
+   }
+
+   hard_line = _al_vector_alloc_back(&layout->hard_lines);
+   if (!hard_line)
+      return false;
+   hard_line->start = start;
+   hard_line->end = end;
+   hard_line->first_word = first_word;
+   hard_line->num_words = _al_vector_size(&layout->words) - first_word;
+   hard_line->width = 0;
+
+   for (i = 0; i < hard_line->num_words; i++) {
+      TEXT_LAYOUT_WORD *w = _al_vector_ref(&layout->words, first_word + i);
+      if (i + 1 < hard_line->num_words) {
+         TEXT_LAYOUT_WORD *next = w + 1;
+         w->join = measure(layout, w->start, next->end) - w->width -
+            next->width;
+      }
+      else if (w->end < end) {
+         w->join = measure(layout, w->start, end) - w->width;
+      }
+      hard_line->width += w->width + w->join;
+   }
+
+   return true;
+}
+
+
+static bool split_text(ALLEGRO_TEXT_LAYOUT *layout)
+{
+   int size = al_ustr_size(layout->text);
+   int pos = 0;
+
+   while (pos < size) {
+      int end = al_ustr_find_chr(layout->text, pos, '\n');
+      if (end < 0)
+         end = size;
+      if (!add_hard_line(layout, pos, end))
+         return false;
+      pos = end;
+      al_ustr_next(layout->text, &pos);
+   }
+
+   return true;
+}
+
+
+static bool add_line(ALLEGRO_TEXT_LAYOUT *layout, int start, int end,
+   float width)
+{
+   TEXT_LAYOUT_LINE *line;
+
+   if (layout->num_lines == layout->lines_capacity) {
+      int capacity = layout->lines_capacity ? layout->lines_capacity * 2 : 16;
+      TEXT_LAYOUT_LINE *lines = al_realloc(layout->lines,
+         capacity * sizeof(*lines));
+      if (!lines)
+         return false;
+      layout->lines = lines;
+      layout->lines_capacity = capacity;
+   }
+
+   line = &layout->lines[layout->num_lines++];
+   line->start = start;
+   line->end = end;
+   line->width = width;
+   return true;
+}
+
+
+/* Break a hard line into soft lines, the same way get_next_soft_line in
+ * text.c does, but with the cached widths.
+ */
+static bool wrap_hard_line(ALLEGRO_TEXT_LAYOUT *layout,
+   const TEXT_LAYOUT_HARD_LINE *hard_line)
+{
+   TEXT_LAYOUT_WORD *words;
+   int n = hard_line->num_words;
+   int k = 0;
+
+   if (n == 0)
+      return add_line(layout, hard_line->start, hard_line->start, 0);
+
+   if (hard_line->width <= layout->max_width)
+      return add_line(layout, hard_line->start, hard_line->end,
+         hard_line->width);
+
+   words = _al_vector_ref(&layout->words, hard_line->first_word);
+
+   while (k < n) {
+      float width = 0;
+      float joined = 0;
+      int j;
+
+      for (j = k; j < n; j++) {
+         float candidate = joined + words[j].width;
+         if (candidate > layout->max_width)
+            break;
+         width = candidate;
+         joined = candidate + words[j].join;
+      }
+
+      if (j == n) {
+         /* The rest fits, including any whitespace at the end. */
+         return add_line(layout, words[k].start, hard_line->end, joined);
+      }
+
+      if (j == k) {
+         /* A single word which doesn't fit is put on a line anyway. */
+         if (!add_line(layout, words[k].start, words[k].end, words[k].width))
+            return false;
+         k++;
+      }
+      else {
+         if (!add_line(layout, words[k].start, words[j - 1].end, width))
+            return false;
+         k = j;
+      }
+   }
+
+   return true;
+}
+
+
+static bool wrap(ALLEGRO_TEXT_LAYOUT *layout)
+{
+   int i;
+
+   layout->num_lines = 0;
+   for (i = 0; i < (int)_al_vector_size(&layout->hard_lines); i++) {
+      if (!wrap_hard_line(layout, _al_vector_ref(&layout->hard_lines, i)))
+         return false;
+   }
+
+   return true;
+}
+
+
+/* Function: al_create_text_layout
+ */
+ALLEGRO_TEXT_LAYOUT *al_create_text_layout(const ALLEGRO_FONT *font,
+   float max_width, const ALLEGRO_USTR *ustr)
+{
+   ALLEGRO_TEXT_LAYOUT *layout;
+   ASSERT(font);
+   ASSERT(ustr);
+
+   layout = al_calloc(1, sizeof(*layout));
+   if (!layout)
+      return NULL;
+
+   layout->font = font;
+   layout->max_width = max_width;
+   _al_vector_init(&layout->words, sizeof(TEXT_LAYOUT_WORD));
+   _al_vector_init(&layout->hard_lines, sizeof(TEXT_LAYOUT_HARD_LINE));
+
+   layout->text = al_ustr_dup(ustr);
+   if (!layout->text || !split_text(layout) || !wrap(layout)) {
+      al_destroy_text_layout(layout);
+      return NULL;
+   }
+
+   return layout;
+}
+
+
+/* Function: al_destroy_text_layout
+ */
+void al_destroy_text_layout(ALLEGRO_TEXT_LAYOUT *layout)
+{
+   if (!layout)
+      return;
+
+   al_ustr_free(layout->text);
+   _al_vector_free(&layout->words);
+   _al_vector_free(&layout->hard_lines);
+   al_free(layout->lines);
+   al_free(layout);
+}
+
+
+/* Function: al_set_text_layout_width
+ */
+bool al_set_text_layout_width(ALLEGRO_TEXT_LAYOUT *layout, float max_width)
+{
+   ASSERT(layout);
+
+   if (max_width == layout->max_width)
+      return true;
+
+   layout->max_width = max_width;
+   return wrap(layout);
+}
+
+
+/* Function: al_get_text_layout_width
+ */
+float al_get_text_layout_width(const ALLEGRO_TEXT_LAYOUT *layout)
+{
+   ASSERT(layout);
+   return layout->max_width;
+}
+
+
+/* Function: al_get_text_layout_line_count
+ */
+int al_get_text_layout_line_count(const ALLEGRO_TEXT_LAYOUT *layout)
+{
+   ASSERT(layout);
+   return layout->num_lines;
+}
+
+
+/* Function: al_get_text_layout_line
+ */
+bool al_get_text_layout_line(const ALLEGRO_TEXT_LAYOUT *layout, int line_num,
+   int *start, int *end, float *width)
+{
+   const TEXT_LAYOUT_LINE *line;
+   ASSERT(layout);
+
+   if (line_num < 0 || line_num >= layout->num_lines)
+      return false;
+
+   line = &layout->lines[line_num];
+   if (start)
+      *start = line->start;
+   if (end)
+      *end = line->end;
+   if (width)
+      *width = line->width;
+   return true;
+}
+
+
+/* Function: al_get_text_layout_offset
+ */
+int al_get_text_layout_offset(const ALLEGRO_TEXT_LAYOUT *layout, int line_num,
+   float x)
+{
+   const TEXT_LAYOUT_LINE *line;
+   int pos, next;
+   int32_t ch, nch;
+   float left = 0;
+   ASSERT(layout);
+
+   if (layout->num_lines == 0)
+      return 0;
+   if (line_num < 0)
+      line_num = 0;
+   if (line_num >= layout->num_lines)
+      line_num = layout->num_lines - 1;
+   line = &layout->lines[line_num];
+
+   pos = line->start;
+   next = pos;
+   nch = next < line->end ? al_ustr_get_next(layout->text, &next) : -1;
+   while (nch >= 0) {
+      int advance;
+      int after = next;
+
+      ch = nch;
+      nch = next < line->end ? al_ustr_get_next(layout->text, &next) : -1;
+      advance = al_get_glyph_advance(layout->font, ch,
+         nch < 0 ? ALLEGRO_NO_KERNING : nch);
+
+      /* Past the middle of a character counts as after it. */
+      if (x < left + advance / 2.0f)
+         return pos;
+      left += advance;
+      pos = after;
+   }
+
+   return line->end;
+}
+
+
+/* Function: al_draw_text_layout
+ */
+void al_draw_text_layout(const ALLEGRO_TEXT_LAYOUT *layout,
+   ALLEGRO_COLOR color, float x, float y, float line_height, int flags)
+{
+   ALLEGRO_USTR_INFO info;
+   bool hold;
+   int i;
+   ASSERT(layout);
+
+   if (line_height < 1)
+      line_height = al_get_font_line_height(layout->font);
+
+   hold = al_is_bitmap_drawing_held();
+   al_hold_bitmap_drawing(true);
+
+   for (i = 0; i < layout->num_lines; i++) {
+      const TEXT_LAYOUT_LINE *line = &layout->lines[i];
+      al_draw_ustr(layout->font, color, x, y + line_height * i, flags,
+         al_ref_ustr(&info, layout->text, line->start, line->end));
+   }
+
+   al_hold_bitmap_drawing(hold);
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -36,6 +36,25 @@ ALLEGRO_IIO_FUNC(bool, al_is_image_addon_initialized, (void));
 ALLEGRO_IIO_FUNC(void, al_shutdown_image_addon, (void));
 ALLEGRO_IIO_FUNC(uint32_t, al_get_allegro_image_version, (void));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_IIO_SRC)
+ALLEGRO_IIO_FUNC(bool, al_save_bitmap_async, (const char *filename, ALLEGRO_BITMAP *bitmap));
+ALLEGRO_IIO_FUNC(bool, al_wait_for_async_bitmap_saves, (void));
+
+/* Type: ALLEGRO_ANIMATED_IMAGE
+ */
+typedef struct ALLEGRO_ANIMATED_IMAGE ALLEGRO_ANIMATED_IMAGE;
+
+ALLEGRO_IIO_FUNC(ALLEGRO_ANIMATED_IMAGE *, al_open_animated_image, (const char *filename, int flags));
+ALLEGRO_IIO_FUNC(ALLEGRO_ANIMATED_IMAGE *, al_open_animated_image_f, (ALLEGRO_FILE *fp, const char *ident, int flags));
+ALLEGRO_IIO_FUNC(void, al_close_animated_image, (ALLEGRO_ANIMATED_IMAGE *anim));
+ALLEGRO_IIO_FUNC(int, al_get_animated_image_width, (ALLEGRO_ANIMATED_IMAGE *anim));
+ALLEGRO_IIO_FUNC(int, al_get_animated_image_height, (ALLEGRO_ANIMATED_IMAGE *anim));
+ALLEGRO_IIO_FUNC(int, al_get_animated_image_frame_count, (ALLEGRO_ANIMATED_IMAGE *anim));
+ALLEGRO_IIO_FUNC(int, al_get_animated_image_loop_count, (ALLEGRO_ANIMATED_IMAGE *anim));
+ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, al_get_next_animated_image_frame, (ALLEGRO_ANIMATED_IMAGE *anim, double *duration));
+ALLEGRO_IIO_FUNC(bool, al_rewind_animated_image, (ALLEGRO_ANIMATED_IMAGE *anim));
+#endif
+
 
 #ifdef __cplusplus
 }
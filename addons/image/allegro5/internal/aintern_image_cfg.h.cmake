@@ -8,6 +8,7 @@
 #cmakedefine ALLEGRO_CFG_IIO_HAVE_PNG
 #cmakedefine ALLEGRO_CFG_IIO_HAVE_JPG
 #cmakedefine ALLEGRO_CFG_IIO_HAVE_WEBP
+#cmakedefine ALLEGRO_CFG_IIO_HAVE_WEBP_DEMUX
 
 /* which formats are supported and wanted? */
 #cmakedefine ALLEGRO_CFG_IIO_SUPPORT_PNG
@@ -0,0 +1,268 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Streaming decoder for animated images.
+ *
+ *      Frames are decoded one at a time by the format backend into a
+ *      CPU-side canvas, which is then uploaded into a single bitmap that is
+ *      reused for every frame.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#define ALLEGRO_INTERNAL_UNSTABLE
+
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_image.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_dtor.h"
+#include "allegro5/internal/aintern_image.h"
+#include "allegro5/internal/aintern_system.h"
+
+#include "iio.h"
+
+ALLEGRO_DEBUG_CHANNEL("image")
+
+
+static ALLEGRO_ANIMATED_IMAGE_INTERFACE *find_vtable(const char *ext)
+{
+   if (!ext)
+      return NULL;
+
+#ifdef ALLEGRO_CFG_IIO_HAVE_PNG
+   if (0 == _al_stricmp(ext, ".png") || 0 == _al_stricmp(ext, ".apng"))
+      return _al_animated_png_vtable();
+#endif
+
+#ifdef ALLEGRO_CFG_IIO_HAVE_WEBP_DEMUX
+   if (0 == _al_stricmp(ext, ".webp"))
+      return _al_animated_webp_vtable();
+#endif
+
+   return NULL;
+}
+
+
+/* Function: al_open_animated_image
+ */
+ALLEGRO_ANIMATED_IMAGE *al_open_animated_image(const char *filename,
+   int flags)
+{
+   ALLEGRO_FILE *fp;
+   ALLEGRO_ANIMATED_IMAGE *anim;
+
+   ASSERT(filename);
+
+   fp = al_fopen(filename, "rb");
+   if (!fp) {
+      ALLEGRO_ERROR("Unable to open %s for reading.\n", filename);
+      return NULL;
+   }
+
+   anim = al_open_animated_image_f(fp, NULL, flags);
+   if (!anim) {
+      ALLEGRO_ERROR("Could not open animated image %s.\n", filename);
+      al_fclose(fp);
+   }
+
+   return anim;
+}
+
+
+/* Function: al_open_animated_image_f
+ */
+ALLEGRO_ANIMATED_IMAGE *al_open_animated_image_f(ALLEGRO_FILE *fp,
+   const char *ident, int flags)
+{
+   ALLEGRO_ANIMATED_IMAGE *anim;
+   ALLEGRO_ANIMATED_IMAGE_INTERFACE *vtable;
+
+   ASSERT(fp);
+
+   if (!ident)
+      ident = al_identify_bitmap_f(fp);
+
+   vtable = find_vtable(ident);
+   if (!vtable) {
+      ALLEGRO_ERROR("No animated image handler for %s.\n",
+         ident ? ident : "unidentified file");
+      return NULL;
+   }
+
+   anim = al_calloc(1, sizeof(*anim));
+   if (!anim)
+      return NULL;
+
+   anim->vtable = vtable;
+   anim->file = fp;
+   anim->flags = flags;
+
+   if (!anim->vtable->open(anim)) {
+      al_free(anim);
+      return NULL;
+   }
+
+   /* The frame bitmap belongs to the animation and is destroyed with it. */
+   _al_push_destructor_owner();
+   anim->frame = al_create_bitmap(anim->width, anim->height);
+   _al_pop_destructor_owner();
+   if (!anim->frame) {
+      ALLEGRO_ERROR("Unable to create %dx%d frame bitmap.\n",
+         anim->width, anim->height);
+      anim->vtable->close(anim);
+      al_free(anim);
+      return NULL;
+   }
+
+   anim->dtor_item = _al_register_destructor(_al_dtor_list, "animated_image",
+      anim, (void (*)(void *)) al_close_animated_image);
+
+   return anim;
+}
+
+
+/* Function: al_close_animated_image
+ */
+void al_close_animated_image(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   if (!anim)
+      return;
+
+   _al_unregister_destructor(_al_dtor_list, anim->dtor_item);
+   anim->vtable->close(anim);
+   al_destroy_bitmap(anim->frame);
+   al_fclose(anim->file);
+   al_free(anim);
+}
+
+
+/* Function: al_get_animated_image_width
+ */
+int al_get_animated_image_width(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   ASSERT(anim);
+   return anim->width;
+}
+
+
+/* Function: al_get_animated_image_height
+ */
+int al_get_animated_image_height(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   ASSERT(anim);
+   return anim->height;
+}
+
+
+/* Function: al_get_animated_image_frame_count
+ */
+int al_get_animated_image_frame_count(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   ASSERT(anim);
+   return anim->frame_count;
+}
+
+
+/* Function: al_get_animated_image_loop_count
+ */
+int al_get_animated_image_loop_count(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   ASSERT(anim);
+   return anim->loop_count;
+}
+
+
+/* Copy the canvas, which is premultiplied RGBA, into the frame bitmap. */
+static bool upload_canvas(ALLEGRO_ANIMATED_IMAGE *anim,
+   const unsigned char *canvas, int pitch)
+{
+   ALLEGRO_LOCKED_REGION *lock;
+   const size_t row_size = anim->width * 4;
+   bool premul = !(anim->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   int x, y;
+
+   lock = al_lock_bitmap(anim->frame, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_WRITEONLY);
+   if (!lock)
+      return false;
+
+   for (y = 0; y < anim->height; y++) {
+      const unsigned char *src = canvas + y * pitch;
+      unsigned char *dest = (unsigned char *)lock->data + y * lock->pitch;
+
+      if (premul) {
+         memcpy(dest, src, row_size);
+         continue;
+      }
+
+      for (x = 0; x < anim->width; x++, src += 4, dest += 4) {
+         int a = src[3];
+         if (a == 0 || a == 255) {
+            memcpy(dest, src, 4);
+         }
+         else {
+            dest[0] = (src[0] * 255 + a / 2) / a;
+            dest[1] = (src[1] * 255 + a / 2) / a;
+            dest[2] = (src[2] * 255 + a / 2) / a;
+            dest[3] = a;
+         }
+      }
+   }
+
+   al_unlock_bitmap(anim->frame);
+   return true;
+}
+
+
+/* Function: al_get_next_animated_image_frame
+ */
+ALLEGRO_BITMAP *al_get_next_animated_image_frame(ALLEGRO_ANIMATED_IMAGE *anim,
+   double *duration)
+{
+   const unsigned char *canvas;
+   int pitch;
+   double d = 0.0;
+
+   ASSERT(anim);
+
+   if (anim->frame_count > 0 && anim->next_frame >= anim->frame_count)
+      return NULL;
+
+   if (!anim->vtable->read_frame(anim, &canvas, &pitch, &d))
+      return NULL;
+
+   if (!upload_canvas(anim, canvas, pitch))
+      return NULL;
+
+   anim->next_frame++;
+   if (duration)
+      *duration = d;
+
+   return anim->frame;
+}
+
+
+/* Function: al_rewind_animated_image
+ */
+bool al_rewind_animated_image(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   ASSERT(anim);
+
+   if (!anim->vtable->rewind(anim))
+      return false;
+
+   anim->next_frame = 0;
+   return true;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
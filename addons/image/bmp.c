@@ -1683,7 +1683,7 @@ ALLEGRO_BITMAP *_al_load_bmp(const char *filename, int flags)
       return NULL;
    }
 
-   bmp = _al_load_bmp_f(f, flags);
+   bmp = _al_load_cached_bitmap_f(f, filename, flags, _al_load_bmp_f);
 
    al_fclose(f);
 
@@ -0,0 +1,452 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      On-disk cache of decoded images.
+ *
+ *      Decoded pixels are stored in the pixel format of the bitmap the
+ *      loader produced, as a small header followed by tightly packed rows,
+ *      so that a warm load is a single read straight into the locked
+ *      bitmap. Entries are written under a temporary name and renamed into
+ *      place, so readers never see a partly written one.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_image.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_image.h"
+#include "allegro5/internal/aintern_pixels.h"
+
+#ifdef ALLEGRO_HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include "iio.h"
+
+ALLEGRO_DEBUG_CHANNEL("image")
+
+#define CACHE_MAGIC        "A5DC"
+#define CACHE_VERSION      1
+#define CACHE_HEADER_SIZE  (4 + 4 + 8 + 8 + 4 + 4 + 4)
+#define CACHE_EXTENSION    ".a5dc"
+#define HASH_CHUNK_SIZE    16384
+#define MAX_TEMP_TRIES     100
+
+#ifdef ALLEGRO_WINDOWS
+   #define TEMP_OPEN_FLAGS (O_EXCL | O_CREAT | O_WRONLY | O_BINARY)
+   #define TEMP_OPEN_MODE  (_S_IREAD | _S_IWRITE)
+#else
+   #define TEMP_OPEN_FLAGS (O_EXCL | O_CREAT | O_WRONLY)
+   #define TEMP_OPEN_MODE  0666
+#endif
+
+#define FNV_OFFSET_BASIS   UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME          UINT64_C(0x100000001b3)
+
+
+typedef struct CACHE_KEY {
+   uint64_t hash;
+   uint64_t source_size;
+} CACHE_KEY;
+
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+   const unsigned char *p = data;
+   size_t i;
+
+   for (i = 0; i < size; i++) {
+      hash ^= p[i];
+      hash *= FNV_PRIME;
+   }
+
+   return hash;
+}
+
+
+static uint64_t hash_string(uint64_t hash, const char *s)
+{
+   if (!s)
+      s = "";
+   /* Include the terminator so that adjacent strings can't run together. */
+   return hash_bytes(hash, s, strlen(s) + 1);
+}
+
+
+static uint64_t hash_int(uint64_t hash, int64_t value)
+{
+   unsigned char b[8];
+   int i;
+
+   for (i = 0; i < 8; i++)
+      b[i] = (value >> (i * 8)) & 0xff;
+
+   return hash_bytes(hash, b, 8);
+}
+
+
+/* Hash the contents of the file from the current position to the end,
+ * then seek back so that the loader sees the file untouched.
+ */
+static bool hash_contents(ALLEGRO_FILE *fp, CACHE_KEY *key)
+{
+   unsigned char buf[HASH_CHUNK_SIZE];
+   int64_t pos = al_ftell(fp);
+   size_t n;
+
+   if (pos < 0)
+      return false;
+
+   while ((n = al_fread(fp, buf, sizeof(buf))) > 0) {
+      key->hash = hash_bytes(key->hash, buf, n);
+      key->source_size += n;
+   }
+
+   if (al_ferror(fp)) {
+      al_fclearerr(fp);
+      al_fseek(fp, pos, ALLEGRO_SEEK_SET);
+      return false;
+   }
+
+   al_fclearerr(fp);
+   return al_fseek(fp, pos, ALLEGRO_SEEK_SET);
+}
+
+
+/* Identify the source by name, size and modification time only. This
+ * avoids reading the file twice on a cache miss, at the cost of trusting
+ * the file system timestamps.
+ */
+static bool hash_mtime(const char *filename, CACHE_KEY *key)
+{
+   ALLEGRO_FS_ENTRY *e;
+   bool ret = false;
+
+   e = al_create_fs_entry(filename);
+   if (!e)
+      return false;
+
+   if (al_fs_entry_exists(e)) {
+      key->source_size = al_get_fs_entry_size(e);
+      key->hash = hash_string(key->hash, filename);
+      key->hash = hash_int(key->hash, al_get_fs_entry_mtime(e));
+      ret = true;
+   }
+
+   al_destroy_fs_entry(e);
+   return ret;
+}
+
+
+static bool make_key(ALLEGRO_FILE *fp, const char *filename, int flags,
+   CACHE_KEY *key)
+{
+   ALLEGRO_CONFIG *cfg = al_get_system_config();
+   const char *mode = al_get_config_value(cfg, "image", "decoded_cache_key");
+
+   key->hash = FNV_OFFSET_BASIS;
+   key->source_size = 0;
+
+   /* Everything that can change the decoded pixels goes into the key. */
+   key->hash = hash_int(key->hash, CACHE_VERSION);
+   key->hash = hash_int(key->hash, flags);
+   key->hash = hash_int(key->hash, al_get_new_bitmap_format());
+   key->hash = hash_string(key->hash,
+      al_get_config_value(cfg, "image", "png_screen_gamma"));
+
+   if (mode && 0 == strcmp(mode, "mtime"))
+      return hash_mtime(filename, key);
+
+   return hash_contents(fp, key);
+}
+
+
+static ALLEGRO_PATH *make_cache_path(const char *dir, const CACHE_KEY *key)
+{
+   ALLEGRO_PATH *path;
+   char name[32];
+
+   snprintf(name, sizeof(name), "%08x%08x" CACHE_EXTENSION,
+      (unsigned)(key->hash >> 32), (unsigned)(key->hash & 0xffffffff));
+
+   path = al_create_path_for_directory(dir);
+   if (path)
+      al_set_path_filename(path, name);
+
+   return path;
+}
+
+
+static ALLEGRO_FILE *open_cache_file(ALLEGRO_PATH *path, const char *mode)
+{
+   ALLEGRO_STATE state;
+   ALLEGRO_FILE *f;
+
+   /* The cache always lives on the real file system, even if the images
+    * themselves come through e.g. PhysicsFS.
+    */
+   al_store_state(&state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+   al_set_standard_file_interface();
+   f = al_fopen(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP), mode);
+   al_restore_state(&state);
+
+   return f;
+}
+
+
+/* Create a new file next to the cache entry at path, for writing it. Its
+ * name is the entry's with a random suffix, and it is created exclusively,
+ * so concurrent writers, even in other processes, never share one.
+ */
+static ALLEGRO_FILE *create_temp_file(ALLEGRO_PATH *path,
+   ALLEGRO_PATH **temp_path)
+{
+   static const char chars[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+   ALLEGRO_PATH *temp;
+   ALLEGRO_FILE *f;
+   char name[64];
+   char suffix[9];
+   int fd = -1;
+   int i, j;
+
+   temp = al_clone_path(path);
+   if (!temp)
+      return NULL;
+
+   for (i = 0; i < MAX_TEMP_TRIES && fd == -1; i++) {
+      /* -1 to avoid the NUL terminator. */
+      for (j = 0; j < 8; j++)
+         suffix[j] = chars[_al_rand() % (sizeof(chars) - 1)];
+      suffix[8] = '\0';
+      snprintf(name, sizeof(name), "%s.%s.tmp",
+         al_get_path_filename(path), suffix);
+      al_set_path_filename(temp, name);
+
+      fd = open(al_path_cstr(temp, ALLEGRO_NATIVE_PATH_SEP), TEMP_OPEN_FLAGS,
+         TEMP_OPEN_MODE);
+      if (fd == -1 && errno != EEXIST)
+         break;
+   }
+
+   if (fd == -1) {
+      al_destroy_path(temp);
+      return NULL;
+   }
+
+   f = al_fopen_fd(fd, "wb");
+   if (!f) {
+      close(fd);
+      al_remove_filename(al_path_cstr(temp, ALLEGRO_NATIVE_PATH_SEP));
+      al_destroy_path(temp);
+      return NULL;
+   }
+
+   *temp_path = temp;
+   return f;
+}
+
+
+static uint64_t read64le(ALLEGRO_FILE *f)
+{
+   uint64_t lo = (uint32_t)al_fread32le(f);
+   uint64_t hi = (uint32_t)al_fread32le(f);
+   return lo | (hi << 32);
+}
+
+
+static void write64le(ALLEGRO_FILE *f, uint64_t value)
+{
+   al_fwrite32le(f, (int32_t)(value & 0xffffffff));
+   al_fwrite32le(f, (int32_t)(value >> 32));
+}
+
+
+static ALLEGRO_BITMAP *read_cache(ALLEGRO_PATH *path, const CACHE_KEY *key)
+{
+   ALLEGRO_FILE *f;
+   ALLEGRO_BITMAP *bmp = NULL;
+   ALLEGRO_LOCKED_REGION *lock;
+   char magic[4];
+   int w, h, format;
+   size_t row_size;
+   int y;
+
+   f = open_cache_file(path, "rb");
+   if (!f)
+      return NULL;
+
+   if (al_fread(f, magic, 4) != 4 || memcmp(magic, CACHE_MAGIC, 4) != 0)
+      goto done;
+   if (al_fread32le(f) != CACHE_VERSION)
+      goto done;
+   if (read64le(f) != key->hash || read64le(f) != key->source_size)
+      goto done;
+
+   w = al_fread32le(f);
+   h = al_fread32le(f);
+   format = al_fread32le(f);
+   if (w <= 0 || h <= 0 || format <= ALLEGRO_PIXEL_FORMAT_ANY_32_WITH_ALPHA ||
+         format >= ALLEGRO_NUM_PIXEL_FORMATS ||
+         _al_pixel_format_is_compressed(format))
+      goto done;
+
+   /* Entries are renamed into place complete, but check the size anyway. */
+   row_size = (size_t)w * al_get_pixel_size(format);
+   if (al_fsize(f) != CACHE_HEADER_SIZE + (int64_t)(row_size * h))
+      goto done;
+
+   bmp = al_create_bitmap(w, h);
+   if (!bmp)
+      goto done;
+
+   lock = al_lock_bitmap(bmp, format, ALLEGRO_LOCK_WRITEONLY);
+   if (!lock) {
+      al_destroy_bitmap(bmp);
+      bmp = NULL;
+      goto done;
+   }
+
+   if ((size_t)lock->pitch == row_size) {
+      if (al_fread(f, lock->data, row_size * h) != row_size * h)
+         goto fail;
+   }
+   else {
+      for (y = 0; y < h; y++) {
+         char *row = (char *)lock->data + y * lock->pitch;
+         if (al_fread(f, row, row_size) != row_size)
+            goto fail;
+      }
+   }
+
+   al_unlock_bitmap(bmp);
+   ALLEGRO_DEBUG("Loaded decoded image from cache %s.\n",
+      al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+   goto done;
+
+fail:
+   al_unlock_bitmap(bmp);
+   al_destroy_bitmap(bmp);
+   bmp = NULL;
+done:
+   al_fclose(f);
+   return bmp;
+}
+
+
+static void write_cache(ALLEGRO_PATH *path, const CACHE_KEY *key,
+   ALLEGRO_BITMAP *bmp)
+{
+   const int w = al_get_bitmap_width(bmp);
+   const int h = al_get_bitmap_height(bmp);
+   const int format = al_get_bitmap_format(bmp);
+   ALLEGRO_LOCKED_REGION *lock;
+   ALLEGRO_PATH *temp_path;
+   ALLEGRO_FILE *f;
+   const char *temp_name;
+   size_t row_size;
+   bool ok = true;
+   int y;
+
+   if (_al_pixel_format_is_compressed(format))
+      return;
+
+   lock = al_lock_bitmap(bmp, format, ALLEGRO_LOCK_READONLY);
+   if (!lock)
+      return;
+
+   f = create_temp_file(path, &temp_path);
+   if (!f) {
+      ALLEGRO_WARN("Unable to create a temporary file for %s.\n",
+         al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+      al_unlock_bitmap(bmp);
+      return;
+   }
+   temp_name = al_path_cstr(temp_path, ALLEGRO_NATIVE_PATH_SEP);
+
+   al_fwrite(f, CACHE_MAGIC, 4);
+   al_fwrite32le(f, CACHE_VERSION);
+   write64le(f, key->hash);
+   write64le(f, key->source_size);
+   al_fwrite32le(f, w);
+   al_fwrite32le(f, h);
+   al_fwrite32le(f, format);
+
+   row_size = (size_t)w * al_get_pixel_size(format);
+   for (y = 0; y < h && ok; y++) {
+      const char *row = (const char *)lock->data + y * lock->pitch;
+      ok = (al_fwrite(f, row, row_size) == row_size);
+   }
+
+   al_unlock_bitmap(bmp);
+
+   if (!al_fclose(f) || !ok) {
+      ALLEGRO_WARN("Failed writing %s.\n", temp_name);
+      al_remove_filename(temp_name);
+   }
+   /* Where rename does not replace an existing file, another writer got
+    * there first with the same pixels, so losing is fine.
+    */
+   else if (rename(temp_name, al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP))) {
+      ALLEGRO_DEBUG("Unable to rename %s into place.\n", temp_name);
+      al_remove_filename(temp_name);
+   }
+
+   al_destroy_path(temp_path);
+}
+
+
+/* Load a bitmap with the given loader, going through the decoded image
+ * cache if one is configured. The file must be positioned at the start
+ * of the image, as for the loader itself.
+ */
+ALLEGRO_BITMAP *_al_load_cached_bitmap_f(ALLEGRO_FILE *fp,
+   const char *filename, int flags, ALLEGRO_IIO_FS_LOADER_FUNCTION loader)
+{
+   const char *dir;
+   ALLEGRO_PATH *path;
+   ALLEGRO_BITMAP *bmp;
+   CACHE_KEY key;
+
+   ASSERT(fp);
+   ASSERT(loader);
+
+   dir = al_get_config_value(al_get_system_config(), "image",
+      "decoded_cache_path");
+   if (!dir || dir[0] == '\0')
+      return loader(fp, flags);
+
+   if (!make_key(fp, filename, flags, &key)) {
+      ALLEGRO_WARN("Unable to compute cache key for %s.\n", filename);
+      return loader(fp, flags);
+   }
+
+   path = make_cache_path(dir, &key);
+   if (!path)
+      return loader(fp, flags);
+
+   bmp = read_cache(path, &key);
+   if (!bmp) {
+      bmp = loader(fp, flags);
+      if (bmp)
+         write_cache(path, &key, bmp);
+   }
+
+   al_destroy_path(path);
+   return bmp;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -4,6 +4,8 @@
 #include "allegro5/internal/aintern_image.h"
 #include "allegro5/internal/aintern_image_cfg.h"
 
+#include "iio.h"
+
 
 /* globals */
 static bool iio_inited = false;
@@ -18,6 +20,9 @@ bool al_init_image_addon(void)
    if (iio_inited)
       return true;
 
+   if (!_al_init_async_saves())
+      return false;
+
    success = 0;
 
    success |= al_register_bitmap_loader(".pcx", _al_load_pcx);
@@ -172,6 +177,7 @@ bool al_is_image_addon_initialized(void)
  */
 void al_shutdown_image_addon(void)
 {
+   _al_shutdown_async_saves();
    iio_inited = false;
 }
 
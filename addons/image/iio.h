@@ -4,6 +4,7 @@
 
 
 #include "allegro5/internal/aintern_image_cfg.h"
+#include "allegro5/internal/aintern_list.h"
 
 
 
@@ -12,5 +13,54 @@ typedef struct PalEntry {
 } PalEntry;
 
 
+ALLEGRO_BITMAP *_al_load_cached_bitmap_f(ALLEGRO_FILE *fp,
+   const char *filename, int flags, ALLEGRO_IIO_FS_LOADER_FUNCTION loader);
+
+bool _al_init_async_saves(void);
+void _al_shutdown_async_saves(void);
+
+
+typedef struct ALLEGRO_ANIMATED_IMAGE_INTERFACE
+   ALLEGRO_ANIMATED_IMAGE_INTERFACE;
+
+/* An animation backend decodes frames into a canvas of premultiplied RGBA
+ * pixels which it owns, and which must stay valid until the next call.
+ */
+struct ALLEGRO_ANIMATED_IMAGE_INTERFACE {
+   bool (*open)(ALLEGRO_ANIMATED_IMAGE *anim);
+   void (*close)(ALLEGRO_ANIMATED_IMAGE *anim);
+   bool (*read_frame)(ALLEGRO_ANIMATED_IMAGE *anim,
+      const unsigned char **canvas, int *pitch, double *duration);
+   bool (*rewind)(ALLEGRO_ANIMATED_IMAGE *anim);
+};
+
+struct ALLEGRO_ANIMATED_IMAGE {
+   ALLEGRO_ANIMATED_IMAGE_INTERFACE *vtable;
+   ALLEGRO_FILE *file;
+   int flags;
+
+   /* Filled in by the open method. A frame count of 0 means unknown. */
+   int width;
+   int height;
+   int frame_count;
+   int loop_count;
+
+   int next_frame;
+   ALLEGRO_BITMAP *frame;
+   _AL_LIST_ITEM *dtor_item;
+
+   /* Implementation specific. */
+   void *data;
+};
+
+#ifdef ALLEGRO_CFG_IIO_HAVE_PNG
+ALLEGRO_ANIMATED_IMAGE_INTERFACE *_al_animated_png_vtable(void);
+#endif
+
+#ifdef ALLEGRO_CFG_IIO_HAVE_WEBP_DEMUX
+ALLEGRO_ANIMATED_IMAGE_INTERFACE *_al_animated_webp_vtable(void);
+#endif
+
+
 #endif
 
@@ -328,6 +328,12 @@ static void save_jpg_entry_helper(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bmp,
    const char* level = al_get_config_value(al_get_system_config(), "image", "jpeg_quality_level");
    jpeg_set_quality(&cinfo, level ? strtol(level, NULL, 10) : 75, true);
 
+   const char* dct = al_get_config_value(al_get_system_config(), "image", "jpeg_dct_method");
+   if (dct && strcmp(dct, "ifast") == 0)
+      cinfo.dct_method = JDCT_IFAST;
+   else if (dct && strcmp(dct, "float") == 0)
+      cinfo.dct_method = JDCT_FLOAT;
+
    jpeg_start_compress(&cinfo, 1);
 
    /* See comment in load_jpg_entry_helper. */
@@ -382,7 +388,7 @@ ALLEGRO_BITMAP *_al_load_jpg(char const *filename, int flags)
       return NULL;
    }
 
-   bmp = _al_load_jpg_f(fp, flags);
+   bmp = _al_load_cached_bitmap_f(fp, filename, flags, _al_load_jpg_f);
 
    al_fclose(fp);
 
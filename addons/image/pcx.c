@@ -280,7 +280,7 @@ ALLEGRO_BITMAP *_al_load_pcx(const char *filename, int flags)
       return NULL;
    }
 
-   bmp = _al_load_pcx_f(f, flags);
+   bmp = _al_load_cached_bitmap_f(f, filename, flags, _al_load_pcx_f);
 
    al_fclose(f);
 
@@ -3,11 +3,13 @@
  */
 
 
+#include <limits.h>
 #include <png.h>
 #include <zlib.h>
 
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_image.h"
+#include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_image.h"
 
 #include "iio.h"
@@ -39,6 +41,30 @@ static double get_gamma(void)
 
 
 
+/* set_gamma:
+ *  Tell libpng to correct for the screen gamma, if wanted.
+ */
+static void set_gamma(png_structp png_ptr, png_infop info_ptr)
+{
+   double image_gamma;
+   double screen_gamma = get_gamma();
+   int intent;
+
+   if (screen_gamma == 0.0)
+      return;
+
+   if (png_get_sRGB(png_ptr, info_ptr, &intent))
+      png_set_gamma(png_ptr, screen_gamma, 0.45455);
+   else {
+      if (png_get_gAMA(png_ptr, info_ptr, &image_gamma))
+         png_set_gamma(png_ptr, screen_gamma, image_gamma);
+      else
+         png_set_gamma(png_ptr, screen_gamma, 0.45455);
+   }
+}
+
+
+
 static void user_error_fn(png_structp png_ptr, png_const_charp message)
 {
    jmp_buf *jmpbuf = (jmp_buf *)png_get_error_ptr(png_ptr);
@@ -95,8 +121,6 @@ static ALLEGRO_BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr,
    ALLEGRO_BITMAP *bmp;
    png_uint_32 width, height, rowbytes, real_rowbytes;
    int bit_depth, color_type, interlace_type;
-   double image_gamma, screen_gamma;
-   int intent;
    int bpp;
    int number_passes, pass;
    int num_trans = 0;
@@ -146,17 +170,7 @@ static ALLEGRO_BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr,
       png_set_gray_to_rgb(png_ptr);
 
    /* Optionally, tell libpng to handle the gamma correction for us. */
-   screen_gamma = get_gamma();
-   if (screen_gamma != 0.0) {
-      if (png_get_sRGB(png_ptr, info_ptr, &intent))
-         png_set_gamma(png_ptr, screen_gamma, 0.45455);
-      else {
-         if (png_get_gAMA(png_ptr, info_ptr, &image_gamma))
-            png_set_gamma(png_ptr, screen_gamma, image_gamma);
-         else
-            png_set_gamma(png_ptr, screen_gamma, 0.45455);
-      }
-   }
+   set_gamma(png_ptr, info_ptr);
 
    /* Turn on interlace handling. */
    number_passes = png_set_interlace_handling(png_ptr);
@@ -416,7 +430,7 @@ ALLEGRO_BITMAP *_al_load_png(const char *filename, int flags)
       return NULL;
    }
 
-   bmp = _al_load_png_f(fp, flags);
+   bmp = _al_load_cached_bitmap_f(fp, filename, flags, _al_load_png_f);
 
    al_fclose(fp);
 
@@ -432,6 +446,12 @@ ALLEGRO_BITMAP *_al_load_png(const char *filename, int flags)
 
 
 
+/* Limits for the parallel encoder, see below. */
+#define MAX_STRIPS         64
+#define MIN_STRIP_ROWS     32
+#define DEFLATE_WINDOW     32768
+
+
 /* write_data:
  *  Custom write function to use Allegro packfile routines,
  *  rather than C streams.
@@ -471,6 +491,467 @@ static int translate_compression_level(const char* value) {
    return strtol(value, NULL, 10);
 }
 
+/* translate_filter:
+ *  Translate string with config value into a mask of PNG row filters.
+ *  Returns 0 for "default", meaning libpng's (or our) own choice.
+ */
+static int translate_filter(const char* value) {
+   if (!value || strcmp(value, "default") == 0) {
+      return 0;
+   }
+   if (strcmp(value, "none") == 0) {
+      return PNG_FILTER_NONE;
+   }
+   if (strcmp(value, "sub") == 0) {
+      return PNG_FILTER_SUB;
+   }
+   if (strcmp(value, "up") == 0) {
+      return PNG_FILTER_UP;
+   }
+   if (strcmp(value, "average") == 0) {
+      return PNG_FILTER_AVG;
+   }
+   if (strcmp(value, "paeth") == 0) {
+      return PNG_FILTER_PAETH;
+   }
+   if (strcmp(value, "adaptive") == 0) {
+      return PNG_ALL_FILTERS;
+   }
+   ALLEGRO_WARN("Unknown png_filter value '%s'.\n", value);
+   return 0;
+}
+
+/* translate_compression_strategy:
+ *  Translate string with config value into a zlib strategy, or -1 to leave
+ *  the choice to libpng.
+ */
+static int translate_compression_strategy(const char* value) {
+   if (!value || strcmp(value, "default") == 0) {
+      return -1;
+   }
+   if (strcmp(value, "filtered") == 0) {
+      return Z_FILTERED;
+   }
+   if (strcmp(value, "huffman") == 0) {
+      return Z_HUFFMAN_ONLY;
+   }
+   if (strcmp(value, "rle") == 0) {
+      return Z_RLE;
+   }
+   if (strcmp(value, "fixed") == 0) {
+      return Z_FIXED;
+   }
+   ALLEGRO_WARN("Unknown png_compression_strategy value '%s'.\n", value);
+   return -1;
+}
+
+/* get_compression_threads:
+ *  Number of threads to split compression across, from the config.
+ */
+static int get_compression_threads(void) {
+   const char *value = al_get_config_value(al_get_system_config(), "image",
+      "png_compression_threads");
+   int n;
+   if (!value) {
+      return 1;
+   }
+   if (strcmp(value, "auto") == 0) {
+      n = al_get_cpu_count();
+   }
+   else {
+      n = strtol(value, NULL, 10);
+   }
+   if (n < 1) {
+      n = 1;
+   }
+   if (n > MAX_STRIPS) {
+      n = MAX_STRIPS;
+   }
+   return n;
+}
+
+
+
+/*****************************************************************************
+ * Parallel encoder
+ *
+ * libpng compresses the whole image as one zlib stream on one thread.  For
+ * large images we instead filter the rows ourselves, split the filtered data
+ * into horizontal strips and deflate each strip on its own thread, the way
+ * pigz does.  Every strip but the last ends with a sync flush, so the raw
+ * deflate outputs concatenate into a single valid stream.  Each strip is
+ * primed with the tail of the preceding data so matches can still reach
+ * back across strip boundaries.
+ ****************************************************************************/
+
+typedef struct PNG_STRIP {
+   const unsigned char *in;
+   size_t in_size;
+   size_t dict_size;
+   unsigned char *out;
+   size_t out_size;
+   int level;
+   int strategy;
+   bool last;
+   bool ok;
+} PNG_STRIP;
+
+
+static int paeth_predictor(int a, int b, int c)
+{
+   int p = a + b - c;
+   int pa = abs(p - a);
+   int pb = abs(p - b);
+   int pc = abs(p - c);
+   if (pa <= pb && pa <= pc)
+      return a;
+   if (pb <= pc)
+      return b;
+   return c;
+}
+
+
+/* Apply one filter type to a row of 32-bit pixels.  prev is NULL for the
+ * first row, which behaves as if it were preceded by a row of zeros.
+ * Returns the sum of the absolute values of the output, as signed bytes,
+ * which is the usual heuristic for adaptive filter selection.
+ */
+static unsigned filter_row(int type, const unsigned char *row,
+   const unsigned char *prev, unsigned char *out, size_t row_size)
+{
+   unsigned sum = 0;
+   size_t i;
+
+   if (!prev) {
+      /* Up is the same as none and Paeth is the same as sub. Average still
+       * subtracts half the left byte, so it is handled below.
+       */
+      if (type == 2)
+         type = 0;
+      else if (type == 4)
+         type = 1;
+   }
+
+   switch (type) {
+      case 0:
+         memcpy(out, row, row_size);
+         break;
+      case 1:
+         for (i = 0; i < 4; i++)
+            out[i] = row[i];
+         for (; i < row_size; i++)
+            out[i] = row[i] - row[i - 4];
+         break;
+      case 2:
+         for (i = 0; i < row_size; i++)
+            out[i] = row[i] - prev[i];
+         break;
+      case 3:
+         for (i = 0; i < 4; i++)
+            out[i] = row[i] - (prev ? prev[i] : 0) / 2;
+         for (; i < row_size; i++)
+            out[i] = row[i] - (row[i - 4] + (prev ? prev[i] : 0)) / 2;
+         break;
+      case 4:
+         for (i = 0; i < 4; i++)
+            out[i] = row[i] - prev[i];
+         for (; i < row_size; i++)
+            out[i] = row[i] - paeth_predictor(row[i - 4], prev[i], prev[i - 4]);
+         break;
+   }
+
+   for (i = 0; i < row_size; i++)
+      sum += (out[i] < 128) ? out[i] : 256 - out[i];
+
+   return sum;
+}
+
+
+/* Filter every row of the locked region into buf, each row prefixed by its
+ * filter type byte as in the PNG data stream.
+ */
+static bool filter_image(ALLEGRO_LOCKED_REGION *lock, int w, int h,
+   int filters, unsigned char *buf)
+{
+   const size_t row_size = (size_t)w * 4;
+   unsigned char *tmp;
+   int y;
+
+   /* Without an explicit choice, try every filter on each row and keep the
+    * best, as libpng does by default.
+    */
+   if (filters == 0)
+      filters = PNG_ALL_FILTERS;
+
+   tmp = al_malloc(row_size);
+   if (!tmp)
+      return false;
+
+   for (y = 0; y < h; y++) {
+      const unsigned char *row = (const unsigned char *)lock->data
+         + y * lock->pitch;
+      const unsigned char *prev = (y > 0) ? row - lock->pitch : NULL;
+      unsigned char *out = buf + y * (row_size + 1);
+      unsigned best_sum = UINT_MAX;
+      int type;
+
+      for (type = 0; type < 5; type++) {
+         unsigned sum;
+         if (!(filters & (PNG_FILTER_NONE << type)))
+            continue;
+         if (best_sum == UINT_MAX) {
+            /* First candidate goes straight into the output. */
+            best_sum = filter_row(type, row, prev, out + 1, row_size);
+            out[0] = type;
+            continue;
+         }
+         sum = filter_row(type, row, prev, tmp, row_size);
+         if (sum < best_sum) {
+            best_sum = sum;
+            out[0] = type;
+            memcpy(out + 1, tmp, row_size);
+         }
+      }
+   }
+
+   al_free(tmp);
+   return true;
+}
+
+
+static void *deflate_strip(ALLEGRO_THREAD *thread, void *arg)
+{
+   PNG_STRIP *strip = arg;
+   z_stream z;
+   size_t capacity;
+   int ret;
+   (void)thread;
+
+   strip->ok = false;
+   memset(&z, 0, sizeof(z));
+
+   /* Negative window bits give a raw stream; the zlib wrapper is written
+    * once for the whole image.
+    */
+   if (deflateInit2(&z, strip->level, Z_DEFLATED, -15, 8,
+         strip->strategy) != Z_OK)
+      return NULL;
+
+   if (strip->dict_size > 0) {
+      deflateSetDictionary(&z, strip->in - strip->dict_size,
+         strip->dict_size);
+   }
+
+   capacity = deflateBound(&z, strip->in_size) + 64;
+   strip->out = al_malloc(capacity);
+   if (!strip->out)
+      goto done;
+
+   z.next_in = (Bytef *)strip->in;
+   z.avail_in = strip->in_size;
+   z.next_out = strip->out;
+   z.avail_out = capacity;
+
+   for (;;) {
+      ret = deflate(&z, strip->last ? Z_FINISH : Z_SYNC_FLUSH);
+      if (ret == Z_STREAM_ERROR)
+         goto done;
+      if (strip->last ? (ret == Z_STREAM_END) :
+            (z.avail_in == 0 && z.avail_out > 0))
+         break;
+      /* Output buffer exhausted, grow it and carry on. */
+      {
+         size_t used = capacity - z.avail_out;
+         unsigned char *out = al_realloc(strip->out, capacity * 2);
+         if (!out)
+            goto done;
+         strip->out = out;
+         z.next_out = out + used;
+         z.avail_out = capacity * 2 - used;
+         capacity *= 2;
+      }
+   }
+
+   strip->out_size = capacity - z.avail_out;
+   strip->ok = true;
+
+done:
+   deflateEnd(&z);
+   return NULL;
+}
+
+
+static void write_be32(unsigned char *p, uint32_t v)
+{
+   p[0] = (v >> 24) & 0xff;
+   p[1] = (v >> 16) & 0xff;
+   p[2] = (v >> 8) & 0xff;
+   p[3] = v & 0xff;
+}
+
+
+/* Write a chunk whose data is given in up to three pieces, so the zlib
+ * header and trailer can be attached to strip output without copying.
+ */
+static bool write_chunk(ALLEGRO_FILE *fp, const char *type,
+   const unsigned char *a, size_t a_size,
+   const unsigned char *b, size_t b_size,
+   const unsigned char *c, size_t c_size)
+{
+   unsigned char tmp[4];
+   uLong crc;
+
+   write_be32(tmp, a_size + b_size + c_size);
+   if (al_fwrite(fp, tmp, 4) != 4 || al_fwrite(fp, type, 4) != 4)
+      return false;
+
+   crc = crc32(0L, (const Bytef *)type, 4);
+   if (a_size) {
+      crc = crc32(crc, a, a_size);
+      if (al_fwrite(fp, a, a_size) != a_size)
+         return false;
+   }
+   if (b_size) {
+      crc = crc32(crc, b, b_size);
+      if (al_fwrite(fp, b, b_size) != b_size)
+         return false;
+   }
+   if (c_size) {
+      crc = crc32(crc, c, c_size);
+      if (al_fwrite(fp, c, c_size) != c_size)
+         return false;
+   }
+
+   write_be32(tmp, crc);
+   return al_fwrite(fp, tmp, 4) == 4;
+}
+
+
+static bool save_png_parallel(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bmp,
+   int num_strips, int z_level, int strategy, int filters)
+{
+   const int w = al_get_bitmap_width(bmp);
+   const int h = al_get_bitmap_height(bmp);
+   const size_t row_size = (size_t)w * 4 + 1;
+   PNG_STRIP strips[MAX_STRIPS];
+   ALLEGRO_THREAD *threads[MAX_STRIPS];
+   ALLEGRO_LOCKED_REGION *lock;
+   unsigned char *filtered;
+   unsigned char ihdr[13];
+   unsigned char zhdr[2];
+   unsigned char adler_be[4];
+   int flevel;
+   int rows, y, i;
+   bool ret = false;
+
+   /* Without an explicit choice, pick the strategy libpng would. */
+   if (strategy < 0)
+      strategy = (filters == PNG_FILTER_NONE) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+
+   filtered = al_malloc(row_size * h);
+   if (!filtered)
+      return false;
+
+   lock = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_READONLY);
+   if (!lock) {
+      al_free(filtered);
+      return false;
+   }
+   ret = filter_image(lock, w, h, filters, filtered);
+   al_unlock_bitmap(bmp);
+   if (!ret) {
+      al_free(filtered);
+      return false;
+   }
+
+   rows = (h + num_strips - 1) / num_strips;
+   for (i = 0, y = 0; i < num_strips; i++, y += rows) {
+      PNG_STRIP *s = &strips[i];
+      size_t start = (size_t)y * row_size;
+      size_t end = (size_t)_ALLEGRO_MIN(y + rows, h) * row_size;
+
+      memset(s, 0, sizeof(*s));
+      s->in = filtered + start;
+      s->in_size = end - start;
+      s->dict_size = _ALLEGRO_MIN(start, (size_t)DEFLATE_WINDOW);
+      s->level = z_level;
+      s->strategy = strategy;
+      s->last = (i == num_strips - 1);
+
+      threads[i] = al_create_thread(deflate_strip, s);
+      if (threads[i])
+         al_start_thread(threads[i]);
+      else
+         deflate_strip(NULL, s);
+   }
+
+   for (i = 0; i < num_strips; i++) {
+      if (threads[i]) {
+         al_join_thread(threads[i], NULL);
+         al_destroy_thread(threads[i]);
+      }
+   }
+
+   ret = false;
+   for (i = 0; i < num_strips; i++) {
+      if (!strips[i].ok) {
+         ALLEGRO_ERROR("Failed to compress PNG strip %d.\n", i);
+         goto done;
+      }
+   }
+
+   /* zlib stream header: deflate with a 32K window, no preset dictionary. */
+   if (z_level == Z_DEFAULT_COMPRESSION || z_level == 6)
+      flevel = 2;
+   else if (z_level < 2)
+      flevel = 0;
+   else if (z_level < 6)
+      flevel = 1;
+   else
+      flevel = 3;
+   zhdr[0] = 0x78;
+   zhdr[1] = flevel << 6;
+   zhdr[1] += 31 - ((zhdr[0] << 8) + zhdr[1]) % 31;
+
+   write_be32(adler_be, adler32(adler32(0L, NULL, 0), filtered, row_size * h));
+
+   write_be32(ihdr + 0, w);
+   write_be32(ihdr + 4, h);
+   ihdr[8] = 8;                        /* bit depth */
+   ihdr[9] = PNG_COLOR_TYPE_RGB_ALPHA;
+   ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+   ihdr[11] = PNG_FILTER_TYPE_BASE;
+   ihdr[12] = PNG_INTERLACE_NONE;
+
+   if (al_fwrite(fp, "\x89PNG\r\n\x1a\n", 8) != 8)
+      goto done;
+   if (!write_chunk(fp, "IHDR", ihdr, 13, NULL, 0, NULL, 0))
+      goto done;
+
+   /* One IDAT chunk per strip; the decoder sees their concatenation. */
+   for (i = 0; i < num_strips; i++) {
+      if (!write_chunk(fp, "IDAT",
+            zhdr, (i == 0) ? 2 : 0,
+            strips[i].out, strips[i].out_size,
+            adler_be, strips[i].last ? 4 : 0))
+         goto done;
+   }
+
+   if (!write_chunk(fp, "IEND", NULL, 0, NULL, 0, NULL, 0))
+      goto done;
+
+   ret = true;
+
+done:
+   for (i = 0; i < num_strips; i++)
+      al_free(strips[i].out);
+   al_free(filtered);
+   return ret;
+}
+
+
+
 /* save_rgba:
  *  Core save routine for 32 bpp images.
  */
@@ -506,6 +987,24 @@ bool _al_save_png_f(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bmp)
    png_structp png_ptr = NULL;
    png_infop info_ptr = NULL;
    int colour_type;
+   ALLEGRO_CONFIG *cfg = al_get_system_config();
+   int z_level = translate_compression_level(
+      al_get_config_value(cfg, "image", "png_compression_level"));
+   int strategy = translate_compression_strategy(
+      al_get_config_value(cfg, "image", "png_compression_strategy"));
+   int filters = translate_filter(
+      al_get_config_value(cfg, "image", "png_filter"));
+   int num_strips = get_compression_threads();
+
+   /* Only split the work if every strip gets a reasonable number of rows,
+    * otherwise thread start-up and lost matches at the seams aren't worth it.
+    */
+   num_strips = _ALLEGRO_MIN(num_strips,
+      al_get_bitmap_height(bmp) / MIN_STRIP_ROWS);
+   if (num_strips > 1) {
+      return save_png_parallel(fp, bmp, num_strips, z_level, strategy,
+         filters);
+   }
 
    /* Create and initialize the png_struct with the
     * desired error handler functions.
@@ -544,11 +1043,12 @@ bool _al_save_png_f(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bmp)
     */
    colour_type = PNG_COLOR_TYPE_RGB_ALPHA;
 
-   /* Set compression level. */
-   int z_level = translate_compression_level(
-      al_get_config_value(al_get_system_config(), "image", "png_compression_level")
-   );
+   /* Set compression level, strategy and row filters. */
    png_set_compression_level(png_ptr, z_level);
+   if (strategy >= 0)
+      png_set_compression_strategy(png_ptr, strategy);
+   if (filters != 0)
+      png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filters);
 
    png_set_IHDR(png_ptr, info_ptr,
                 al_get_bitmap_width(bmp), al_get_bitmap_height(bmp),
@@ -611,4 +1111,581 @@ bool _al_save_png(const char *filename, ALLEGRO_BITMAP *bmp)
    return retsave && retclose;
 }
 
+
+
+
+/*****************************************************************************
+ * Animation routines
+ ****************************************************************************/
+
+
+
+/* Values from the APNG frame control chunk. */
+#define APNG_DISPOSE_OP_NONE        0
+#define APNG_DISPOSE_OP_BACKGROUND  1
+#define APNG_DISPOSE_OP_PREVIOUS    2
+#define APNG_BLEND_OP_SOURCE        0
+#define APNG_BLEND_OP_OVER          1
+
+#define PNG_SIGNATURE_SIZE          8
+#define FCTL_SIZE                   26
+#define MAX_CHUNK_SIZE              0x7fffffff
+
+
+typedef struct MEMORY_STREAM {
+   unsigned char *data;
+   size_t size;
+   size_t capacity;
+   size_t pos;
+} MEMORY_STREAM;
+
+
+typedef struct APNG_FRAME {
+   uint32_t width;
+   uint32_t height;
+   uint32_t x;
+   uint32_t y;
+   double duration;
+   int dispose_op;
+   int blend_op;
+} APNG_FRAME;
+
+
+typedef struct APNG {
+   bool animated;
+   int64_t frames_start;
+   unsigned char ihdr[13];
+
+   /* Chunks seen before the image data, such as PLTE and tRNS. These apply
+    * to every frame, so are replayed in front of each one.
+    */
+   MEMORY_STREAM shared;
+
+   MEMORY_STREAM chunk;    /* Data of the chunk just read. */
+   MEMORY_STREAM data;     /* Compressed image data of the current frame. */
+   MEMORY_STREAM stream;   /* Stand-alone PNG made from the current frame. */
+
+   unsigned char *canvas;  /* Premultiplied RGBA, width * height. */
+   unsigned char *pixels;  /* Decoded frame, straight RGBA. */
+   unsigned char *saved;   /* Canvas under a frame disposed to PREVIOUS. */
+
+   bool have_last;
+   APNG_FRAME last;
+} APNG;
+
+
+static uint32_t read_be32(const unsigned char *p)
+{
+   return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+      ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+static bool stream_append(MEMORY_STREAM *s, const void *data, size_t size)
+{
+   if (s->size + size > s->capacity) {
+      size_t capacity = s->capacity ? s->capacity : 4096;
+      unsigned char *p;
+
+      while (capacity < s->size + size)
+         capacity *= 2;
+      p = al_realloc(s->data, capacity);
+      if (!p)
+         return false;
+      s->data = p;
+      s->capacity = capacity;
+   }
+
+   memcpy(s->data + s->size, data, size);
+   s->size += size;
+   return true;
+}
+
+
+static bool stream_append_chunk(MEMORY_STREAM *s, const char *type,
+   const unsigned char *data, size_t size)
+{
+   unsigned char tmp[4];
+   uLong crc;
+
+   crc = crc32(0L, (const Bytef *)type, 4);
+   crc = crc32(crc, data, size);
+
+   write_be32(tmp, size);
+   if (!stream_append(s, tmp, 4) || !stream_append(s, type, 4) ||
+         !stream_append(s, data, size))
+      return false;
+   write_be32(tmp, crc);
+   return stream_append(s, tmp, 4);
+}
+
+
+static void stream_free(MEMORY_STREAM *s)
+{
+   al_free(s->data);
+   memset(s, 0, sizeof(*s));
+}
+
+
+/* Read the next chunk into apng->chunk, checking its CRC. */
+static bool read_chunk(ALLEGRO_FILE *fp, APNG *apng, char type[4])
+{
+   unsigned char tmp[8];
+   uint32_t length;
+   uLong crc;
+
+   if (al_fread(fp, tmp, 8) != 8)
+      return false;
+   length = read_be32(tmp);
+   memcpy(type, tmp + 4, 4);
+   if (length > MAX_CHUNK_SIZE)
+      return false;
+
+   apng->chunk.size = 0;
+   if (apng->chunk.capacity < length) {
+      unsigned char *p = al_realloc(apng->chunk.data, length);
+      if (!p)
+         return false;
+      apng->chunk.data = p;
+      apng->chunk.capacity = length;
+   }
+   if (al_fread(fp, apng->chunk.data, length) != length ||
+         al_fread(fp, tmp, 4) != 4)
+      return false;
+   apng->chunk.size = length;
+
+   crc = crc32(0L, (const Bytef *)type, 4);
+   crc = crc32(crc, apng->chunk.data, length);
+   if (crc != read_be32(tmp)) {
+      ALLEGRO_ERROR("Bad CRC in %.4s chunk.\n", type);
+      return false;
+   }
+
+   return true;
+}
+
+
+static void read_memory(png_structp png_ptr, png_bytep data, size_t length)
+{
+   MEMORY_STREAM *s = (MEMORY_STREAM *)png_get_io_ptr(png_ptr);
+   if (length > s->size - s->pos)
+      png_error(png_ptr, "read past end of frame");
+   memcpy(data, s->data + s->pos, length);
+   s->pos += length;
+}
+
+
+/* Wrap the frame's image data up as a PNG of its own and decode that to
+ * straight RGBA in apng->pixels.
+ */
+static bool decode_frame(APNG *apng, const APNG_FRAME *frame)
+{
+   static const unsigned char signature[PNG_SIGNATURE_SIZE] =
+      {137, 80, 78, 71, 13, 10, 26, 10};
+   static const unsigned char iend[1] = {0};
+   unsigned char ihdr[13];
+   jmp_buf jmpbuf;
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_bytep *rows;
+   uint32_t y;
+
+   memcpy(ihdr, apng->ihdr, 13);
+   write_be32(ihdr, frame->width);
+   write_be32(ihdr + 4, frame->height);
+
+   apng->stream.size = 0;
+   apng->stream.pos = 0;
+   if (!stream_append(&apng->stream, signature, PNG_SIGNATURE_SIZE) ||
+         !stream_append_chunk(&apng->stream, "IHDR", ihdr, 13) ||
+         !stream_append(&apng->stream, apng->shared.data, apng->shared.size) ||
+         !stream_append_chunk(&apng->stream, "IDAT", apng->data.data,
+            apng->data.size) ||
+         !stream_append_chunk(&apng->stream, "IEND", iend, 0))
+      return false;
+
+   rows = al_malloc(frame->height * sizeof(png_bytep));
+   if (!rows)
+      return false;
+   for (y = 0; y < frame->height; y++)
+      rows[y] = apng->pixels + y * frame->width * 4;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   if (!png_ptr) {
+      al_free(rows);
+      return false;
+   }
+   info_ptr = png_create_info_struct(png_ptr);
+   if (!info_ptr) {
+      png_destroy_read_struct(&png_ptr, NULL, NULL);
+      al_free(rows);
+      return false;
+   }
+
+   if (setjmp(jmpbuf)) {
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      al_free(rows);
+      ALLEGRO_ERROR("Error decoding APNG frame\n");
+      return false;
+   }
+   png_set_error_fn(png_ptr, jmpbuf, user_error_fn, NULL);
+   png_set_read_fn(png_ptr, &apng->stream, (png_rw_ptr) read_memory);
+
+   png_read_info(png_ptr, info_ptr);
+
+   /* Whatever the source format, produce 8-bit RGBA. */
+   png_set_expand(png_ptr);
+   png_set_strip_16(png_ptr);
+   png_set_gray_to_rgb(png_ptr);
+   png_set_add_alpha(png_ptr, 0xff, PNG_FILLER_AFTER);
+   set_gamma(png_ptr, info_ptr);
+   png_set_interlace_handling(png_ptr);
+   png_read_update_info(png_ptr, info_ptr);
+
+   if (png_get_rowbytes(png_ptr, info_ptr) != frame->width * 4)
+      png_error(png_ptr, "unexpected row size");
+
+   png_read_image(png_ptr, rows);
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   al_free(rows);
+   return true;
+}
+
+
+static void clear_region(ALLEGRO_ANIMATED_IMAGE *anim, unsigned char *canvas,
+   const APNG_FRAME *frame)
+{
+   uint32_t y;
+
+   for (y = 0; y < frame->height; y++) {
+      memset(canvas + ((frame->y + y) * anim->width + frame->x) * 4, 0,
+         frame->width * 4);
+   }
+}
+
+
+/* Copy a frame sized region between the canvas and a buffer laid out the
+ * same way, in either direction.
+ */
+static void copy_region(ALLEGRO_ANIMATED_IMAGE *anim, unsigned char *dest,
+   const unsigned char *src, const APNG_FRAME *frame)
+{
+   uint32_t y;
+
+   for (y = 0; y < frame->height; y++) {
+      size_t offset = ((frame->y + y) * anim->width + frame->x) * 4;
+      memcpy(dest + offset, src + offset, frame->width * 4);
+   }
+}
+
+
+static void composite_frame(ALLEGRO_ANIMATED_IMAGE *anim, APNG *apng,
+   const APNG_FRAME *frame)
+{
+   const unsigned char *src = apng->pixels;
+   uint32_t x, y;
+
+   for (y = 0; y < frame->height; y++) {
+      unsigned char *dest = apng->canvas +
+         ((frame->y + y) * anim->width + frame->x) * 4;
+
+      for (x = 0; x < frame->width; x++, src += 4, dest += 4) {
+         int a = src[3];
+         int r = (src[0] * a + 127) / 255;
+         int g = (src[1] * a + 127) / 255;
+         int b = (src[2] * a + 127) / 255;
+
+         if (frame->blend_op == APNG_BLEND_OP_OVER && a != 255) {
+            int inv = 255 - a;
+            r += (dest[0] * inv + 127) / 255;
+            g += (dest[1] * inv + 127) / 255;
+            b += (dest[2] * inv + 127) / 255;
+            a += (dest[3] * inv + 127) / 255;
+         }
+
+         dest[0] = r;
+         dest[1] = g;
+         dest[2] = b;
+         dest[3] = a;
+      }
+   }
+}
+
+
+static bool parse_fctl(ALLEGRO_ANIMATED_IMAGE *anim, const MEMORY_STREAM *c,
+   APNG_FRAME *frame)
+{
+   int delay_num, delay_den;
+
+   if (c->size != FCTL_SIZE)
+      return false;
+
+   frame->width = read_be32(c->data + 4);
+   frame->height = read_be32(c->data + 8);
+   frame->x = read_be32(c->data + 12);
+   frame->y = read_be32(c->data + 16);
+   delay_num = (c->data[20] << 8) | c->data[21];
+   delay_den = (c->data[22] << 8) | c->data[23];
+   frame->dispose_op = c->data[24];
+   frame->blend_op = c->data[25];
+
+   if (frame->width == 0 || frame->height == 0 ||
+         frame->x > (uint32_t)anim->width ||
+         frame->y > (uint32_t)anim->height ||
+         frame->width > (uint32_t)anim->width - frame->x ||
+         frame->height > (uint32_t)anim->height - frame->y ||
+         frame->dispose_op > APNG_DISPOSE_OP_PREVIOUS ||
+         frame->blend_op > APNG_BLEND_OP_OVER)
+      return false;
+
+   /* A zero denominator means hundredths of a second. */
+   if (delay_den == 0)
+      delay_den = 100;
+   frame->duration = (double)delay_num / delay_den;
+
+   return true;
+}
+
+
+static void apng_close(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   APNG *apng = anim->data;
+
+   if (!apng)
+      return;
+
+   stream_free(&apng->shared);
+   stream_free(&apng->chunk);
+   stream_free(&apng->data);
+   stream_free(&apng->stream);
+   al_free(apng->canvas);
+   al_free(apng->pixels);
+   al_free(apng->saved);
+   al_free(apng);
+   anim->data = NULL;
+}
+
+
+static bool apng_rewind(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   APNG *apng = anim->data;
+
+   if (!al_fseek(anim->file, apng->frames_start, ALLEGRO_SEEK_SET))
+      return false;
+
+   memset(apng->canvas, 0, (size_t)anim->width * anim->height * 4);
+   apng->have_last = false;
+   return true;
+}
+
+
+/* Read the chunks up to the first image data. A PNG without an acTL chunk
+ * is opened as an animation of a single frame.
+ */
+static bool apng_open(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   ALLEGRO_FILE *fp = anim->file;
+   unsigned char sig[PNG_SIGNATURE_SIZE];
+   APNG *apng;
+   int64_t pos;
+   size_t canvas_size;
+   char type[4];
+
+   if (al_fread(fp, sig, PNG_SIGNATURE_SIZE) != PNG_SIGNATURE_SIZE ||
+         png_sig_cmp(sig, 0, PNG_SIGNATURE_SIZE) != 0) {
+      ALLEGRO_ERROR("Not a png.\n");
+      return false;
+   }
+
+   apng = al_calloc(1, sizeof(*apng));
+   if (!apng)
+      return false;
+   anim->data = apng;
+   apng->frames_start = -1;
+
+   if (!read_chunk(fp, apng, type) || memcmp(type, "IHDR", 4) != 0 ||
+         apng->chunk.size != 13) {
+      ALLEGRO_ERROR("Missing IHDR chunk.\n");
+      goto fail;
+   }
+   memcpy(apng->ihdr, apng->chunk.data, 13);
+   anim->width = read_be32(apng->ihdr);
+   anim->height = read_be32(apng->ihdr + 4);
+   if (anim->width <= 0 || anim->height <= 0 ||
+         anim->width > INT_MAX / 4 / anim->height) {
+      ALLEGRO_ERROR("Bad image size %dx%d.\n", anim->width, anim->height);
+      goto fail;
+   }
+   anim->frame_count = 1;
+   anim->loop_count = 0;
+
+   for (;;) {
+      pos = al_ftell(fp);
+      if (!read_chunk(fp, apng, type)) {
+         ALLEGRO_ERROR("Error reading PNG chunk.\n");
+         goto fail;
+      }
+
+      if (memcmp(type, "IDAT", 4) == 0) {
+         if (!apng->animated || apng->frames_start < 0)
+            apng->frames_start = pos;
+         break;
+      }
+      else if (memcmp(type, "IEND", 4) == 0) {
+         ALLEGRO_ERROR("No image data.\n");
+         goto fail;
+      }
+      else if (memcmp(type, "acTL", 4) == 0) {
+         if (apng->chunk.size != 8)
+            goto fail;
+         apng->animated = true;
+         anim->frame_count = read_be32(apng->chunk.data);
+         anim->loop_count = read_be32(apng->chunk.data + 4);
+      }
+      else if (memcmp(type, "fcTL", 4) == 0) {
+         /* The default image is the first frame. */
+         if (apng->frames_start < 0)
+            apng->frames_start = pos;
+      }
+      else if (!stream_append_chunk(&apng->shared, type, apng->chunk.data,
+            apng->chunk.size)) {
+         goto fail;
+      }
+   }
+
+   if (anim->frame_count <= 0) {
+      ALLEGRO_ERROR("APNG has no frames.\n");
+      goto fail;
+   }
+
+   canvas_size = (size_t)anim->width * anim->height * 4;
+   apng->canvas = al_malloc(canvas_size);
+   apng->pixels = al_malloc(canvas_size);
+   if (!apng->canvas || !apng->pixels)
+      goto fail;
+
+   if (!apng_rewind(anim))
+      goto fail;
+
+   return true;
+
+fail:
+   apng_close(anim);
+   return false;
+}
+
+
+/* Read the chunks of the next frame: an fcTL chunk followed by IDAT or
+ * fdAT chunks, up to the next fcTL chunk or IEND.
+ */
+static bool read_frame_data(ALLEGRO_ANIMATED_IMAGE *anim, APNG *apng,
+   APNG_FRAME *frame)
+{
+   ALLEGRO_FILE *fp = anim->file;
+   bool in_frame = false;
+   int64_t pos;
+   char type[4];
+
+   apng->data.size = 0;
+
+   for (;;) {
+      pos = al_ftell(fp);
+      if (!read_chunk(fp, apng, type))
+         return false;
+
+      if (memcmp(type, "fcTL", 4) == 0 && apng->animated) {
+         if (in_frame)
+            return al_fseek(fp, pos, ALLEGRO_SEEK_SET);
+         if (!parse_fctl(anim, &apng->chunk, frame)) {
+            ALLEGRO_ERROR("Bad fcTL chunk.\n");
+            return false;
+         }
+         in_frame = true;
+      }
+      else if (memcmp(type, "IDAT", 4) == 0) {
+         if (!apng->animated && !in_frame) {
+            frame->width = anim->width;
+            frame->height = anim->height;
+            frame->x = frame->y = 0;
+            frame->duration = 0.0;
+            frame->dispose_op = APNG_DISPOSE_OP_NONE;
+            frame->blend_op = APNG_BLEND_OP_SOURCE;
+            in_frame = true;
+         }
+         /* A default image which isn't part of the animation is skipped. */
+         if (in_frame && !stream_append(&apng->data, apng->chunk.data,
+               apng->chunk.size))
+            return false;
+      }
+      else if (memcmp(type, "fdAT", 4) == 0) {
+         /* Skip the sequence number. */
+         if (in_frame && apng->chunk.size > 4 &&
+               !stream_append(&apng->data, apng->chunk.data + 4,
+                  apng->chunk.size - 4))
+            return false;
+      }
+      else if (memcmp(type, "IEND", 4) == 0) {
+         return in_frame;
+      }
+   }
+}
+
+
+static bool apng_read_frame(ALLEGRO_ANIMATED_IMAGE *anim,
+   const unsigned char **canvas, int *pitch, double *duration)
+{
+   APNG *apng = anim->data;
+   APNG_FRAME frame;
+
+   if (!read_frame_data(anim, apng, &frame) || apng->data.size == 0)
+      return false;
+
+   if (!decode_frame(apng, &frame))
+      return false;
+
+   /* Dispose of the previous frame now that it has been shown. */
+   if (apng->have_last) {
+      if (apng->last.dispose_op == APNG_DISPOSE_OP_BACKGROUND)
+         clear_region(anim, apng->canvas, &apng->last);
+      else if (apng->last.dispose_op == APNG_DISPOSE_OP_PREVIOUS)
+         copy_region(anim, apng->canvas, apng->saved, &apng->last);
+   }
+   else if (frame.dispose_op == APNG_DISPOSE_OP_PREVIOUS) {
+      frame.dispose_op = APNG_DISPOSE_OP_BACKGROUND;
+   }
+
+   if (frame.dispose_op == APNG_DISPOSE_OP_PREVIOUS) {
+      if (!apng->saved) {
+         apng->saved = al_malloc((size_t)anim->width * anim->height * 4);
+         if (!apng->saved)
+            return false;
+      }
+      copy_region(anim, apng->saved, apng->canvas, &frame);
+   }
+
+   composite_frame(anim, apng, &frame);
+   apng->last = frame;
+   apng->have_last = true;
+
+   *canvas = apng->canvas;
+   *pitch = anim->width * 4;
+   *duration = frame.duration;
+   return true;
+}
+
+
+static ALLEGRO_ANIMATED_IMAGE_INTERFACE apng_vtable = {
+   apng_open,
+   apng_close,
+   apng_read_frame,
+   apng_rewind
+};
+
+
+ALLEGRO_ANIMATED_IMAGE_INTERFACE *_al_animated_png_vtable(void)
+{
+   return &apng_vtable;
+}
+
 /* vim: set sts=3 sw=3 et: */
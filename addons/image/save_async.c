@@ -0,0 +1,252 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Saving bitmaps on a background thread.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_image.h"
+#include "allegro5/internal/aintern_dtor.h"
+#include "allegro5/internal/aintern_image.h"
+
+#include "iio.h"
+
+ALLEGRO_DEBUG_CHANNEL("image")
+
+
+typedef struct SAVE_JOB SAVE_JOB;
+
+struct SAVE_JOB {
+   SAVE_JOB *next;
+   char *filename;
+   ALLEGRO_BITMAP *bitmap;
+   const ALLEGRO_FILE_INTERFACE *file_interface;
+};
+
+
+/* The mutex and cond live as long as the addon is initialised. The thread,
+ * queue and counters are protected by save_mutex.
+ */
+static ALLEGRO_THREAD *save_thread = NULL;
+static ALLEGRO_MUTEX *save_mutex = NULL;
+static ALLEGRO_COND *save_cond = NULL;
+static SAVE_JOB *queue_head = NULL;
+static SAVE_JOB *queue_tail = NULL;
+static int jobs_pending = 0;
+static bool all_saved = true;
+
+
+static void destroy_job(SAVE_JOB *job)
+{
+   al_destroy_bitmap(job->bitmap);
+   al_free(job->filename);
+   al_free(job);
+}
+
+
+static void *save_thread_proc(ALLEGRO_THREAD *thread, void *arg)
+{
+   SAVE_JOB *job;
+   bool ok;
+   (void)arg;
+
+   al_lock_mutex(save_mutex);
+
+   for (;;) {
+      while (!queue_head && !al_get_thread_should_stop(thread))
+         al_wait_cond(save_cond, save_mutex);
+      if (!queue_head)
+         break;
+
+      job = queue_head;
+      queue_head = job->next;
+      if (!queue_head)
+         queue_tail = NULL;
+
+      al_unlock_mutex(save_mutex);
+
+      /* Files are opened the same way they would have been on the thread
+       * which asked for the save.
+       */
+      al_set_new_file_interface(job->file_interface);
+      ok = al_save_bitmap(job->filename, job->bitmap);
+      if (!ok)
+         ALLEGRO_ERROR("Failed saving %s in the background.\n", job->filename);
+      destroy_job(job);
+
+      al_lock_mutex(save_mutex);
+      if (!ok)
+         all_saved = false;
+      jobs_pending--;
+      al_broadcast_cond(save_cond);
+   }
+
+   al_unlock_mutex(save_mutex);
+   return NULL;
+}
+
+
+/* Called with save_mutex held, so only the first save starts the thread. */
+static bool start_save_thread(void)
+{
+   if (save_thread)
+      return true;
+
+   save_thread = al_create_thread(save_thread_proc, NULL);
+   if (!save_thread)
+      return false;
+
+   al_start_thread(save_thread);
+   return true;
+}
+
+
+/* Take a copy of the bitmap in memory, so the caller can carry on drawing
+ * to the original straight away and the encoder never touches a video
+ * bitmap from the wrong thread. The copy is owned by the job rather than
+ * registered as a destructor, so it outlives the destructors run by
+ * al_uninstall_system until the queue is drained.
+ */
+static ALLEGRO_BITMAP *snapshot_bitmap(ALLEGRO_BITMAP *bitmap)
+{
+   ALLEGRO_STATE state;
+   ALLEGRO_BITMAP *clone;
+
+   al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+   al_set_new_bitmap_format(al_get_bitmap_format(bitmap));
+   _al_push_destructor_owner();
+   clone = al_clone_bitmap(bitmap);
+   _al_pop_destructor_owner();
+   al_restore_state(&state);
+
+   return clone;
+}
+
+
+/* Function: al_save_bitmap_async
+ */
+bool al_save_bitmap_async(const char *filename, ALLEGRO_BITMAP *bitmap)
+{
+   SAVE_JOB *job;
+
+   ASSERT(filename);
+   ASSERT(bitmap);
+
+   if (!save_mutex) {
+      ALLEGRO_ERROR("The image addon is not initialised.\n");
+      return false;
+   }
+
+   job = al_calloc(1, sizeof(*job));
+   if (!job)
+      return false;
+
+   job->filename = al_malloc(strlen(filename) + 1);
+   job->bitmap = snapshot_bitmap(bitmap);
+   job->file_interface = al_get_new_file_interface();
+   if (!job->filename || !job->bitmap) {
+      ALLEGRO_ERROR("Unable to copy bitmap for saving %s.\n", filename);
+      if (job->bitmap)
+         al_destroy_bitmap(job->bitmap);
+      al_free(job->filename);
+      al_free(job);
+      return false;
+   }
+   strcpy(job->filename, filename);
+
+   al_lock_mutex(save_mutex);
+   if (!start_save_thread()) {
+      al_unlock_mutex(save_mutex);
+      ALLEGRO_ERROR("Unable to start the background save thread.\n");
+      destroy_job(job);
+      return false;
+   }
+   if (queue_tail)
+      queue_tail->next = job;
+   else
+      queue_head = job;
+   queue_tail = job;
+   jobs_pending++;
+   al_broadcast_cond(save_cond);
+   al_unlock_mutex(save_mutex);
+
+   return true;
+}
+
+
+/* Function: al_wait_for_async_bitmap_saves
+ */
+bool al_wait_for_async_bitmap_saves(void)
+{
+   bool ret;
+
+   if (!save_mutex)
+      return true;
+
+   al_lock_mutex(save_mutex);
+   while (jobs_pending > 0)
+      al_wait_cond(save_cond, save_mutex);
+   ret = all_saved;
+   all_saved = true;
+   al_unlock_mutex(save_mutex);
+
+   return ret;
+}
+
+
+/* Create the mutex and cond while the addon is being initialised, before
+ * any thread can ask for a save.
+ */
+bool _al_init_async_saves(void)
+{
+   if (save_mutex)
+      return true;
+
+   save_mutex = al_create_mutex();
+   save_cond = al_create_cond();
+   if (!save_mutex || !save_cond) {
+      _al_shutdown_async_saves();
+      return false;
+   }
+   return true;
+}
+
+
+/* Finish all queued saves and stop the thread. */
+void _al_shutdown_async_saves(void)
+{
+   if (save_thread) {
+      al_wait_for_async_bitmap_saves();
+
+      al_lock_mutex(save_mutex);
+      al_set_thread_should_stop(save_thread);
+      al_broadcast_cond(save_cond);
+      al_unlock_mutex(save_mutex);
+
+      al_join_thread(save_thread, NULL);
+      al_destroy_thread(save_thread);
+      save_thread = NULL;
+   }
+
+   if (save_cond)
+      al_destroy_cond(save_cond);
+   if (save_mutex)
+      al_destroy_mutex(save_mutex);
+   save_cond = NULL;
+   save_mutex = NULL;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -654,7 +654,7 @@ ALLEGRO_BITMAP *_al_load_tga(const char *filename, int flags)
       return NULL;
    }
 
-   bmp = _al_load_tga_f(f, flags);
+   bmp = _al_load_cached_bitmap_f(f, filename, flags, _al_load_tga_f);
 
    al_fclose(f);
 
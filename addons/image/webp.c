@@ -5,6 +5,9 @@
 
 #include <webp/decode.h>
 #include <webp/encode.h>
+#ifdef ALLEGRO_CFG_IIO_HAVE_WEBP_DEMUX
+#include <webp/demux.h>
+#endif
 
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_image.h"
@@ -100,7 +103,7 @@ ALLEGRO_BITMAP *_al_load_webp(const char *filename, int flags)
       return NULL;
    }
 
-   bmp = _al_load_webp_f(fp, flags);
+   bmp = _al_load_cached_bitmap_f(fp, filename, flags, _al_load_webp_f);
 
    al_fclose(fp);
 
@@ -185,4 +188,139 @@ bool _al_save_webp(const char *filename, ALLEGRO_BITMAP *bmp)
    return retsave && retclose;
 }
 
+
+
+
+#ifdef ALLEGRO_CFG_IIO_HAVE_WEBP_DEMUX
+
+/*****************************************************************************
+ * Animation routines
+ ****************************************************************************/
+
+
+typedef struct WEBP_ANIM {
+   /* The decoder reads from this buffer for as long as it exists. */
+   uint8_t *data;
+   size_t data_size;
+   WebPAnimDecoder *decoder;
+   int timestamp;
+} WEBP_ANIM;
+
+
+static void webp_anim_close(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   WEBP_ANIM *w = anim->data;
+
+   if (!w)
+      return;
+
+   if (w->decoder)
+      WebPAnimDecoderDelete(w->decoder);
+   al_free(w->data);
+   al_free(w);
+   anim->data = NULL;
+}
+
+
+static bool webp_anim_open(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   WebPAnimDecoderOptions options;
+   WebPAnimInfo info;
+   WebPData webp_data;
+   WEBP_ANIM *w;
+   int64_t size;
+
+   size = al_fsize(anim->file) - al_ftell(anim->file);
+   if (size <= 0) {
+      ALLEGRO_ERROR("Could not determine WebP file size\n");
+      return false;
+   }
+
+   w = al_calloc(1, sizeof(*w));
+   if (!w)
+      return false;
+   anim->data = w;
+
+   w->data_size = size;
+   w->data = al_malloc(w->data_size);
+   if (!w->data || al_fread(anim->file, w->data, w->data_size) != w->data_size) {
+      ALLEGRO_ERROR("Could not read WebP file\n");
+      goto fail;
+   }
+
+   if (!WebPAnimDecoderOptionsInit(&options))
+      goto fail;
+   /* Frames are composited premultiplied, like the PNG decoder does. */
+   options.color_mode = MODE_rgbA;
+   options.use_threads = 0;
+
+   webp_data.bytes = w->data;
+   webp_data.size = w->data_size;
+   w->decoder = WebPAnimDecoderNew(&webp_data, &options);
+   if (!w->decoder || !WebPAnimDecoderGetInfo(w->decoder, &info)) {
+      ALLEGRO_ERROR("Could not read WebP animation info\n");
+      goto fail;
+   }
+
+   anim->width = info.canvas_width;
+   anim->height = info.canvas_height;
+   anim->frame_count = info.frame_count;
+   anim->loop_count = info.loop_count;
+   return true;
+
+fail:
+   webp_anim_close(anim);
+   return false;
+}
+
+
+static bool webp_anim_read_frame(ALLEGRO_ANIMATED_IMAGE *anim,
+   const unsigned char **canvas, int *pitch, double *duration)
+{
+   WEBP_ANIM *w = anim->data;
+   uint8_t *buf;
+   int timestamp;
+
+   if (!WebPAnimDecoderHasMoreFrames(w->decoder))
+      return false;
+
+   if (!WebPAnimDecoderGetNext(w->decoder, &buf, &timestamp)) {
+      ALLEGRO_ERROR("Could not decode WebP frame\n");
+      return false;
+   }
+
+   /* Timestamps are the end times of the frames, in milliseconds. */
+   *duration = (timestamp - w->timestamp) / 1000.0;
+   w->timestamp = timestamp;
+   *canvas = buf;
+   *pitch = anim->width * 4;
+   return true;
+}
+
+
+static bool webp_anim_rewind(ALLEGRO_ANIMATED_IMAGE *anim)
+{
+   WEBP_ANIM *w = anim->data;
+
+   WebPAnimDecoderReset(w->decoder);
+   w->timestamp = 0;
+   return true;
+}
+
+
+static ALLEGRO_ANIMATED_IMAGE_INTERFACE webp_anim_vtable = {
+   webp_anim_open,
+   webp_anim_close,
+   webp_anim_read_frame,
+   webp_anim_rewind
+};
+
+
+ALLEGRO_ANIMATED_IMAGE_INTERFACE *_al_animated_webp_vtable(void)
+{
+   return &webp_anim_vtable;
+}
+
+#endif
+
 /* vim: set sts=3 sw=3 et: */
@@ -59,6 +59,12 @@ typedef enum ALLEGRO_LINE_CAP
  */
 #define ALLEGRO_PRIM_QUALITY 10
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_PRIMITIVES_SRC)
+/* Type: ALLEGRO_SHAPE
+ */
+typedef struct ALLEGRO_SHAPE ALLEGRO_SHAPE;
+#endif
+
 
 ALLEGRO_PRIM_FUNC(uint32_t, al_get_allegro_primitives_version, (void));
 
@@ -72,6 +78,14 @@ ALLEGRO_PRIM_FUNC(int, al_draw_prim, (const void* vtxs, const ALLEGRO_VERTEX_DEC
 ALLEGRO_PRIM_FUNC(int, al_draw_indexed_prim, (const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture, const int* indices, int num_vtx, int type));
 ALLEGRO_PRIM_FUNC(int, al_draw_vertex_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, int start, int end, int type));
 ALLEGRO_PRIM_FUNC(int, al_draw_indexed_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, ALLEGRO_INDEX_BUFFER* index_buffer, int start, int end, int type));
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_PRIMITIVES_SRC)
+ALLEGRO_PRIM_FUNC(int, al_draw_instanced_prim, (const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture, int start, int end, int type, const ALLEGRO_PRIM_INSTANCE* instances, int num_instances));
+ALLEGRO_PRIM_FUNC(int, al_draw_indexed_instanced_prim, (const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture, const int* indices, int num_vtx, int type, const ALLEGRO_PRIM_INSTANCE* instances, int num_instances));
+ALLEGRO_PRIM_FUNC(int, al_draw_instanced_vertex_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, int start, int end, int type, const ALLEGRO_PRIM_INSTANCE* instances, int num_instances));
+ALLEGRO_PRIM_FUNC(int, al_draw_indexed_instanced_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, ALLEGRO_INDEX_BUFFER* index_buffer, int start, int end, int type, const ALLEGRO_PRIM_INSTANCE* instances, int num_instances));
+ALLEGRO_PRIM_FUNC(void, al_set_primitives_flags, (int flags));
+ALLEGRO_PRIM_FUNC(int, al_get_primitives_flags, (void));
+#endif
 
 ALLEGRO_PRIM_FUNC(ALLEGRO_VERTEX_DECL*, al_create_vertex_decl, (const ALLEGRO_VERTEX_ELEMENT* elements, int stride));
 ALLEGRO_PRIM_FUNC(void, al_destroy_vertex_decl, (ALLEGRO_VERTEX_DECL* decl));
@@ -97,9 +111,26 @@ ALLEGRO_PRIM_FUNC(int, al_get_index_buffer_size, (ALLEGRO_INDEX_BUFFER* buffer))
 /*
 * Utilities for high level primitives.
 */
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_PRIMITIVES_SRC)
+ALLEGRO_PRIM_FUNC(void, al_set_primitives_tolerance, (float tolerance));
+ALLEGRO_PRIM_FUNC(float, al_get_primitives_tolerance, (void));
+#endif
 ALLEGRO_PRIM_FUNC(bool, al_triangulate_polygon, (const float* vertices, size_t vertex_stride, const int* vertex_counts, void (*emit_triangle)(int, int, int, void*), void* userdata));
 
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_PRIMITIVES_SRC)
+/*
+* Retained shapes
+*/
+ALLEGRO_PRIM_FUNC(ALLEGRO_SHAPE*, al_create_shape, (void));
+ALLEGRO_PRIM_FUNC(void, al_destroy_shape, (ALLEGRO_SHAPE* shape));
+ALLEGRO_PRIM_FUNC(void, al_clear_shape, (ALLEGRO_SHAPE* shape));
+ALLEGRO_PRIM_FUNC(void, al_begin_shape, (ALLEGRO_SHAPE* shape));
+ALLEGRO_PRIM_FUNC(void, al_end_shape, (void));
+ALLEGRO_PRIM_FUNC(bool, al_upload_shape, (ALLEGRO_SHAPE* shape, int flags));
+ALLEGRO_PRIM_FUNC(void, al_draw_shape, (ALLEGRO_SHAPE* shape));
+#endif
+
 /*
 * Custom primitives
 */
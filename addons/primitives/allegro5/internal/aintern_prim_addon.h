@@ -33,11 +33,18 @@ void _al_prim_cache_push_triangle(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float*
 
 /* Internal functions. */
 float     _al_prim_get_scale(void);
+float     _al_prim_circle_segments(float radius);
 float     _al_prim_normalize(float* vector);
 int       _al_prim_test_line_side(const float* origin, const float* normal, const float* point);
 bool      _al_prim_is_point_in_triangle(const float* point, const float* v0, const float* v1, const float* v2);
 bool      _al_prim_intersect_segment(const float* v0, const float* v1, const float* p0, const float* p1, float* point, float* t0, float* t1);
 bool      _al_prim_are_points_equal(const float* point_a, const float* point_b);
+int       _al_prim_list_vertices(int list_type);
+int       _al_prim_list_indices(int type, const int* map, int base, int num_vtx, int* out, int* list_type);
+
+/* Shape recording. */
+struct ALLEGRO_SHAPE* _al_prim_get_recording_shape(void);
+int       _al_prim_record(struct ALLEGRO_SHAPE* shape, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture, const int* indices, int start, int end, int type);
 
 #ifdef __cplusplus
 }
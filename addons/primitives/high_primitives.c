@@ -42,7 +42,9 @@
 #ifdef ALLEGRO_CFG_OPENGL
 #include "allegro5/allegro_opengl.h"
 #endif
+#include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_prim_addon.h"
 #include "allegro5/debug.h"
 #include <math.h>
 
@@ -54,28 +56,6 @@ ALLEGRO_DEBUG_CHANNEL("primitives")
 
 #define LOCAL_VERTEX_CACHE  ALLEGRO_VERTEX vertex_cache[ALLEGRO_VERTEX_CACHE_SIZE]
 
-/*
- * Make an estimate of the scale of the current transformation.
- * We do this by computing the determinants of the 2D section of the transformation matrix.
- */
-static float get_scale(void)
-{
-#define DET2D(T) (fabs((T)->m[0][0] * (T)->m[1][1] - (T)->m[0][1] * (T)->m[1][0]))
-
-   const ALLEGRO_TRANSFORM* t = al_get_current_transform();
-   float scale_sq = DET2D(t);
-   ALLEGRO_BITMAP* b = al_get_target_bitmap();
-   if (b) {
-      const ALLEGRO_TRANSFORM* p = al_get_current_projection_transform();
-      /* Divide by 4.0f as the screen coordinates range from -1 to 1 on both axes. */
-      scale_sq *= DET2D(p) * al_get_bitmap_width(b) * al_get_bitmap_height(b) / 4.0f;
-   }
-
-   return sqrtf(scale_sq);
-
-#undef DET2D
-}
-
 /* Function: al_draw_line
  */
 void al_draw_line(float x1, float y1, float x2, float y2,
@@ -509,7 +489,7 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
    float delta_theta, ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   float scale = _al_prim_get_scale();
    int num_segments, ii;
 
    ASSERT(r >= 0);
@@ -521,7 +501,7 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
    }
 
    if (thickness <= 0) {
-      num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * sqrtf(scale * r));
+      num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * _al_prim_circle_segments(scale * r));
 
       if (num_segments < 2)
          num_segments = 2;
@@ -567,7 +547,7 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
          vertex_cache[0].x = cx + (r - thickness / 2) * cosf(central_start_angle);
          vertex_cache[0].y = cy + (r - thickness / 2) * sinf(central_start_angle);
 
-         num_segments = (inner_side_angle + outer_side_angle) / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * sqrtf(scale * (r + ht));
+         num_segments = (inner_side_angle + outer_side_angle) / (2 * ALLEGRO_PI) * _al_prim_circle_segments(scale * (r + ht));
 
          if (num_segments < 2)
             num_segments = 2;
@@ -621,7 +601,7 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
          /* Apex: 2 vertices if the apex is blunt) */
          int extra_vtx = blunt_tip ? 2 : 1;
 
-         num_segments = (2 * outer_side_angle) / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * sqrtf(scale * (r + ht));
+         num_segments = (2 * outer_side_angle) / (2 * ALLEGRO_PI) * _al_prim_circle_segments(scale * (r + ht));
 
          if (num_segments < 2)
             num_segments = 2;
@@ -665,12 +645,12 @@ void al_draw_filled_pieslice(float cx, float cy, float r, float start_theta,
    float delta_theta, ALLEGRO_COLOR color)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   float scale = _al_prim_get_scale();
    int num_segments, ii;
 
    ASSERT(r >= 0);
 
-   num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * sqrtf(scale * r));
+   num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * _al_prim_circle_segments(scale * r));
 
    if (num_segments < 2)
       num_segments = 2;
@@ -696,13 +676,13 @@ void al_draw_ellipse(float cx, float cy, float rx, float ry,
    ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   float scale = _al_prim_get_scale();
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
 
    if (thickness > 0) {
-      int num_segments = ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f);
+      int num_segments = _al_prim_circle_segments(scale * (_ALLEGRO_MAX(rx, ry) + thickness / 2));
       int ii;
 
       /* In case rx and ry are both 0. */
@@ -721,7 +701,7 @@ void al_draw_ellipse(float cx, float cy, float rx, float ry,
 
       al_draw_prim(vertex_cache, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
    } else {
-      int num_segments = ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f);
+      int num_segments = _al_prim_circle_segments(scale * _ALLEGRO_MAX(rx, ry));
       int ii;
 
       /* In case rx and ry are both 0. */
@@ -749,12 +729,12 @@ void al_draw_filled_ellipse(float cx, float cy, float rx, float ry,
 {
    LOCAL_VERTEX_CACHE;
    int num_segments, ii;
-   float scale = get_scale();
+   float scale = _al_prim_get_scale();
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
 
-   num_segments = ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f);
+   num_segments = _al_prim_circle_segments(scale * _ALLEGRO_MAX(rx, ry));
 
    /* In case rx and ry are both close to 0. If al_calculate_arc is passed
     * 0 or 1 it will assert.
@@ -798,11 +778,11 @@ void al_draw_elliptical_arc(float cx, float cy, float rx, float ry, float start_
    float delta_theta, ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   float scale = _al_prim_get_scale();
 
    ASSERT(rx >= 0 && ry >= 0);
    if (thickness > 0) {
-      int num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f));
+      int num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * _al_prim_circle_segments(scale * (_ALLEGRO_MAX(rx, ry) + thickness / 2)));
       int ii;
 
       if (num_segments < 2)
@@ -821,7 +801,7 @@ void al_draw_elliptical_arc(float cx, float cy, float rx, float ry, float start_
 
       al_draw_prim(vertex_cache, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
    } else {
-      int num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f));
+      int num_segments = fabs(delta_theta / (2 * ALLEGRO_PI) * _al_prim_circle_segments(scale * _ALLEGRO_MAX(rx, ry)));
       int ii;
 
       if (num_segments < 2)
@@ -856,13 +836,13 @@ void al_draw_rounded_rectangle(float x1, float y1, float x2, float y2,
    float rx, float ry, ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   float scale = _al_prim_get_scale();
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
 
    if (thickness > 0) {
-      int num_segments = ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f) / 4;
+      int num_segments = _al_prim_circle_segments(scale * (_ALLEGRO_MAX(rx, ry) + thickness / 2)) / 4;
       int ii;
 
       /* In case rx and ry are both 0. */
@@ -909,7 +889,7 @@ void al_draw_rounded_rectangle(float x1, float y1, float x2, float y2,
 
       al_draw_prim(vertex_cache, 0, 0, 0, 8 * num_segments + 2, ALLEGRO_PRIM_TRIANGLE_STRIP);
    } else {
-      int num_segments = ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f) / 4;
+      int num_segments = _al_prim_circle_segments(scale * _ALLEGRO_MAX(rx, ry)) / 4;
       int ii;
 
       /* In case rx and ry are both 0. */
@@ -955,8 +935,8 @@ void al_draw_filled_rounded_rectangle(float x1, float y1, float x2, float y2,
 {
    LOCAL_VERTEX_CACHE;
    int ii;
-   float scale = get_scale();
-   int num_segments = ALLEGRO_PRIM_QUALITY * sqrtf(scale * (rx + ry) / 2.0f) / 4;
+   float scale = _al_prim_get_scale();
+   int num_segments = _al_prim_circle_segments(scale * _ALLEGRO_MAX(rx, ry)) / 4;
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
@@ -1083,11 +1063,16 @@ void al_calculate_spline(float* dest, int stride, const float points[8],
 void al_draw_spline(const float points[8], ALLEGRO_COLOR color, float thickness)
 {
    int ii;
-   float scale = get_scale();
-   int num_segments = (int)(sqrtf(hypotf(points[2] - points[0], points[3] - points[1]) +
-                                  hypotf(points[4] - points[2], points[5] - points[3]) +
-                                  hypotf(points[6] - points[4], points[7] - points[5])) *
-                            1.2 * ALLEGRO_PRIM_QUALITY * scale / 10);
+   float scale = _al_prim_get_scale();
+   /*
+    * Wang's formula: uniform steps of a cubic Bezier curve stay within the
+    * tolerance of the curve with this many segments, from the largest second
+    * difference of its control points.
+    */
+   float dd = _ALLEGRO_MAX(
+      hypotf(points[0] - 2 * points[2] + points[4], points[1] - 2 * points[3] + points[5]),
+      hypotf(points[2] - 2 * points[4] + points[6], points[3] - 2 * points[5] + points[7]));
+   int num_segments = (int)ceilf(sqrtf(0.75f * scale * dd / al_get_primitives_tolerance())) + 1;
    LOCAL_VERTEX_CACHE;
 
    if(num_segments < 2)
@@ -0,0 +1,332 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Instanced primitives.
+ *
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#define ALLEGRO_INTERNAL_UNSTABLE
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_primitives.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_prim_addon.h"
+#include "allegro5/internal/aintern_primitives.h"
+
+/*
+ * Where the display can't draw the instances itself, they are written out as
+ * one list of primitives, INSTANCE_BATCH_SIZE vertices at a time (or one
+ * instance if the mesh is larger), and each list is drawn with a single call.
+ */
+#define INSTANCE_BATCH_SIZE 8192
+
+static void write_instance(const ALLEGRO_PRIM_INSTANCE* inst,
+   const ALLEGRO_VERTEX* mesh, ALLEGRO_VERTEX* out, int num_vtx)
+{
+   const float m00 = inst->transform.m[0][0];
+   const float m01 = inst->transform.m[0][1];
+   const float m02 = inst->transform.m[0][2];
+   const float m10 = inst->transform.m[1][0];
+   const float m11 = inst->transform.m[1][1];
+   const float m12 = inst->transform.m[1][2];
+   const float m20 = inst->transform.m[2][0];
+   const float m21 = inst->transform.m[2][1];
+   const float m22 = inst->transform.m[2][2];
+   const float m30 = inst->transform.m[3][0];
+   const float m31 = inst->transform.m[3][1];
+   const float m32 = inst->transform.m[3][2];
+   const ALLEGRO_COLOR tint = inst->color;
+   int ii;
+
+   for (ii = 0; ii < num_vtx; ii++) {
+      const float x = mesh[ii].x;
+      const float y = mesh[ii].y;
+      const float z = mesh[ii].z;
+      out[ii].x = x * m00 + y * m10 + z * m20 + m30;
+      out[ii].y = x * m01 + y * m11 + z * m21 + m31;
+      out[ii].z = x * m02 + y * m12 + z * m22 + m32;
+      out[ii].u = mesh[ii].u + inst->u;
+      out[ii].v = mesh[ii].v + inst->v;
+      out[ii].color.r = mesh[ii].color.r * tint.r;
+      out[ii].color.g = mesh[ii].color.g * tint.g;
+      out[ii].color.b = mesh[ii].color.b * tint.b;
+      out[ii].color.a = mesh[ii].color.a * tint.a;
+   }
+}
+
+/*
+ * Lock the drawable part of a memory bitmap target once, so that the software
+ * renderer draws every batch into it instead of locking the target for each
+ * primitive. Returns true if the target has to be unlocked afterwards.
+ */
+static bool lock_soft_target(ALLEGRO_BITMAP* texture)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   int x, y, w, h;
+
+   if (!(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP) ||
+       al_is_bitmap_locked(target))
+      return false;
+   /* The texture is locked for reading by each draw. */
+   if (texture && (texture->parent ? texture->parent : texture) ==
+       (target->parent ? target->parent : target))
+      return false;
+
+   al_get_clipping_rectangle(&x, &y, &w, &h);
+   if (w <= 0 || h <= 0)
+      return false;
+
+   return al_lock_bitmap_region(target, x, y, w, h, ALLEGRO_PIXEL_FORMAT_ANY,
+      ALLEGRO_LOCK_READWRITE) != NULL;
+}
+
+static int draw_copies(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
+   ALLEGRO_BITMAP* texture, const int* indices, int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   const char* src = vtxs;
+   int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+   int num_vtx = end - start;
+   ALLEGRO_VERTEX* mesh = NULL;
+   ALLEGRO_VERTEX* vertices = NULL;
+   int* list = NULL;
+   int* batch_indices = NULL;
+   int num_mesh;
+   int num_list;
+   int list_type;
+   int per_batch;
+   int num_primitives = 0;
+   int first, count;
+   bool unlock;
+   int ii, jj;
+
+   if (num_vtx <= 0 || num_instances <= 0)
+      return 0;
+
+   /*
+    * Convert the mesh once, then use it as a list of primitives so that the
+    * copies can be drawn together.
+    */
+   if (indices) {
+      int min_idx = indices[0];
+      int max_idx = indices[0];
+      for (ii = 1; ii < num_vtx; ii++) {
+         if (max_idx < indices[ii])
+            max_idx = indices[ii];
+         else if (min_idx > indices[ii])
+            min_idx = indices[ii];
+      }
+      num_mesh = max_idx - min_idx + 1;
+      start = min_idx;
+   }
+   else {
+      num_mesh = num_vtx;
+   }
+
+   mesh = al_malloc(num_mesh * sizeof(ALLEGRO_VERTEX));
+   list = al_malloc(3 * num_vtx * sizeof(int));
+   if (!mesh || !list)
+      goto done;
+
+   for (ii = 0; ii < num_mesh; ii++)
+      _al_convert_vertex(texture, src + (start + ii) * stride, &mesh[ii], decl);
+
+   num_list = _al_prim_list_indices(type, indices, indices ? -start : 0,
+      num_vtx, list, &list_type);
+   if (num_list == 0)
+      goto done;
+
+   per_batch = _ALLEGRO_MIN(num_instances, _ALLEGRO_MAX(1, INSTANCE_BATCH_SIZE / num_mesh));
+   vertices = al_malloc(per_batch * num_mesh * sizeof(ALLEGRO_VERTEX));
+   batch_indices = al_malloc(per_batch * num_list * sizeof(int));
+   if (!vertices || !batch_indices)
+      goto done;
+
+   for (ii = 0; ii < per_batch; ii++) {
+      for (jj = 0; jj < num_list; jj++)
+         batch_indices[ii * num_list + jj] = list[jj] + ii * num_mesh;
+   }
+
+   unlock = !_al_prim_get_recording_shape() && lock_soft_target(texture);
+
+   for (first = 0; first < num_instances; first += per_batch) {
+      count = _ALLEGRO_MIN(per_batch, num_instances - first);
+      for (ii = 0; ii < count; ii++)
+         write_instance(&instances[first + ii], mesh, &vertices[ii * num_mesh], num_mesh);
+      num_primitives += al_draw_indexed_prim(vertices, NULL, texture,
+         batch_indices, count * num_list, list_type);
+   }
+
+   if (unlock)
+      al_unlock_bitmap(al_get_target_bitmap());
+
+done:
+   al_free(mesh);
+   al_free(list);
+   al_free(vertices);
+   al_free(batch_indices);
+   return num_primitives;
+}
+
+static int draw_instanced(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
+   ALLEGRO_BITMAP* texture, const int* indices, int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   if (end <= start || num_instances <= 0)
+      return 0;
+
+   if (!_al_prim_get_recording_shape()) {
+      int ret = _al_draw_instanced_prim(texture, NULL, vtxs, decl, NULL,
+         indices, start, end, type, instances, num_instances);
+      if (ret >= 0)
+         return ret;
+   }
+
+   return draw_copies(vtxs, decl, texture, indices, start, end, type,
+      instances, num_instances);
+}
+
+/* Function: al_draw_instanced_prim
+ */
+int al_draw_instanced_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
+   ALLEGRO_BITMAP* texture, int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   ASSERT(vtxs);
+   ASSERT(end >= start);
+   ASSERT(start >= 0);
+   ASSERT(type >= 0 && type < ALLEGRO_PRIM_NUM_TYPES);
+   ASSERT(instances || num_instances == 0);
+
+   return draw_instanced(vtxs, decl, texture, NULL, start, end, type,
+      instances, num_instances);
+}
+
+/* Function: al_draw_indexed_instanced_prim
+ */
+int al_draw_indexed_instanced_prim(const void* vtxs,
+   const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture,
+   const int* indices, int num_vtx, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   ASSERT(vtxs);
+   ASSERT(indices);
+   ASSERT(num_vtx > 0);
+   ASSERT(type >= 0 && type < ALLEGRO_PRIM_NUM_TYPES);
+   ASSERT(instances || num_instances == 0);
+
+   return draw_instanced(vtxs, decl, texture, indices, 0, num_vtx, type,
+      instances, num_instances);
+}
+
+static int draw_instanced_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
+   ALLEGRO_BITMAP* texture, ALLEGRO_INDEX_BUFFER* index_buffer,
+   int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   const void* vtx;
+   int* int_idx = NULL;
+   int num_vtx = end - start;
+   int vtx_lock_start = index_buffer ? 0 : start;
+   int vtx_lock_len = index_buffer ?
+      al_get_vertex_buffer_size(vertex_buffer) : num_vtx;
+   int num_primitives = 0;
+   int ii;
+
+   if (num_vtx <= 0 || num_instances <= 0)
+      return 0;
+
+   if (!_al_prim_get_recording_shape()) {
+      int ret = _al_draw_instanced_prim(texture, vertex_buffer, NULL,
+         vertex_buffer->decl, index_buffer, NULL, start, end, type,
+         instances, num_instances);
+      if (ret >= 0)
+         return ret;
+   }
+
+   /* Otherwise the buffers are read back and drawn like client memory. */
+   if (vertex_buffer->common.write_only ||
+       (index_buffer && index_buffer->common.write_only))
+      return 0;
+
+   vtx = al_lock_vertex_buffer(vertex_buffer, vtx_lock_start, vtx_lock_len,
+      ALLEGRO_LOCK_READONLY);
+   if (!vtx)
+      return 0;
+
+   if (index_buffer) {
+      const void* idx = al_lock_index_buffer(index_buffer, start, num_vtx,
+         ALLEGRO_LOCK_READONLY);
+
+      if (idx) {
+         if (index_buffer->index_size != 4) {
+            int_idx = al_malloc(num_vtx * sizeof(int));
+            if (int_idx) {
+               for (ii = 0; ii < num_vtx; ii++)
+                  int_idx[ii] = ((const unsigned short*)idx)[ii];
+            }
+            idx = int_idx;
+         }
+         if (idx) {
+            num_primitives = draw_copies(vtx, vertex_buffer->decl, texture,
+               idx, 0, num_vtx, type, instances, num_instances);
+         }
+         al_unlock_index_buffer(index_buffer);
+         al_free(int_idx);
+      }
+   }
+   else {
+      num_primitives = draw_copies(vtx, vertex_buffer->decl, texture,
+         NULL, 0, num_vtx, type, instances, num_instances);
+   }
+
+   al_unlock_vertex_buffer(vertex_buffer);
+   return num_primitives;
+}
+
+/* Function: al_draw_instanced_vertex_buffer
+ */
+int al_draw_instanced_vertex_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
+   ALLEGRO_BITMAP* texture, int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   ASSERT(vertex_buffer);
+   ASSERT(end >= start);
+   ASSERT(start >= 0);
+   ASSERT(end <= al_get_vertex_buffer_size(vertex_buffer));
+   ASSERT(type >= 0 && type < ALLEGRO_PRIM_NUM_TYPES);
+   ASSERT(instances || num_instances == 0);
+
+   return draw_instanced_buffer(vertex_buffer, texture, NULL, start, end,
+      type, instances, num_instances);
+}
+
+/* Function: al_draw_indexed_instanced_buffer
+ */
+int al_draw_indexed_instanced_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
+   ALLEGRO_BITMAP* texture, ALLEGRO_INDEX_BUFFER* index_buffer,
+   int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   ASSERT(vertex_buffer);
+   ASSERT(index_buffer);
+   ASSERT(end >= start);
+   ASSERT(start >= 0);
+   ASSERT(end <= al_get_index_buffer_size(index_buffer));
+   ASSERT(type >= 0 && type < ALLEGRO_PRIM_NUM_TYPES);
+   ASSERT(instances || num_instances == 0);
+
+   return draw_instanced_buffer(vertex_buffer, texture, index_buffer, start,
+      end, type, instances, num_instances);
+}
+
+/* vim: set sts=3 sw=3 et: */
@@ -170,9 +170,12 @@ static void compute_cross_points(const float* v0, const float* v1, const float*
  *
  * Arc is defined by pivot point, radius, start and end angle.
  * Starting and ending angle are wrapped to two pi range.
+ * circle_segments is the number of segments a full circle of this radius
+ * needs to stay within the tolerance; the arc uses its share of them.
  */
-static void emit_arc(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot, float start, float end, float radius, int segments)
+static void emit_arc(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot, float start, float end, float radius, int circle_segments)
 {
+   int segments;
    float arc;
    float c, s, t;
    float v0[2];
@@ -195,7 +198,7 @@ static void emit_arc(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot, float
 
    arc = end - start;
 
-   segments = (int)(segments * arc / ALLEGRO_PI * 2.0f);
+   segments = (int)ceilf(arc / (ALLEGRO_PI * 2.0f) * circle_segments);
    if (segments < 1)
       segments = 1;
 
@@ -263,14 +266,14 @@ static void emit_triange_end_cap(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float*
 /*
  * Emits rounded cap.
  */
-static void emit_round_end_cap(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot, const float* dir, const float* normal, float radius)
+static void emit_round_end_cap(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot, const float* dir, const float* normal, float radius, int circle_segments)
 {
    float angle = atan2f(-normal[1], -normal[0]);
    /* XXX delete these parameters? */
    (void)dir;
    (void)radius;
 
-   emit_arc(cache, pivot, angle, angle + ALLEGRO_PI, radius, 16);
+   emit_arc(cache, pivot, angle, angle + ALLEGRO_PI, radius, circle_segments);
 }
 
 /*
@@ -281,7 +284,7 @@ static void emit_round_end_cap(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pi
  * in v1 and specified radius. p0 have to be located on the negative and p0 on the
  * positive half plane defined by direction vector.
  */
-static void emit_end_cap(ALLEGRO_PRIM_VERTEX_CACHE* cache, int cap_style, const float* v0, const float* v1, float radius)
+static void emit_end_cap(ALLEGRO_PRIM_VERTEX_CACHE* cache, int cap_style, const float* v0, const float* v1, float radius, int circle_segments)
 {
    float dir[2];
    float normal[2];
@@ -304,7 +307,7 @@ static void emit_end_cap(ALLEGRO_PRIM_VERTEX_CACHE* cache, int cap_style, const
    else if (cap_style == ALLEGRO_LINE_CAP_TRIANGLE)
       emit_triange_end_cap(cache, v1, dir, normal, radius);
    else if (cap_style == ALLEGRO_LINE_CAP_ROUND)
-      emit_round_end_cap(cache, v1, dir, normal, radius);
+      emit_round_end_cap(cache, v1, dir, normal, radius, circle_segments);
    else {
 
       ASSERT("Unknown or unsupported style of ending cap." && false);
@@ -322,7 +325,7 @@ static void emit_bevel_join(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot
 /*
  * Emits round join.
  */
-static void emit_round_join(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot, const float* p0, const float* p1, float radius)
+static void emit_round_join(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot, const float* p0, const float* p1, float radius, int circle_segments)
 {
    float start = atan2f(p1[1] - pivot[1], p1[0] - pivot[0]);
    float end   = atan2f(p0[1] - pivot[1], p0[0] - pivot[0]);
@@ -330,7 +333,7 @@ static void emit_round_join(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot
    if (end < start)
       end += ALLEGRO_PI * 2.0f;
 
-   emit_arc(cache, pivot, start, end, radius, 16);
+   emit_arc(cache, pivot, start, end, radius, circle_segments);
 }
 
 /*
@@ -379,7 +382,7 @@ static void emit_miter_join(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* pivot
  */
 static void emit_join(ALLEGRO_PRIM_VERTEX_CACHE* cache, int join_style, const float* pivot,
    const float* p0, const float* p1, float radius, const float* middle,
-   float angle, float miter_distance, float miter_limit)
+   float angle, float miter_distance, float miter_limit, int circle_segments)
 {
    /* There is nothing to do for this type of join. */
    if (join_style == ALLEGRO_LINE_JOIN_NONE)
@@ -388,7 +391,7 @@ static void emit_join(ALLEGRO_PRIM_VERTEX_CACHE* cache, int join_style, const fl
    if (join_style == ALLEGRO_LINE_JOIN_BEVEL)
       emit_bevel_join(cache, pivot, p0, p1);
    else if (join_style == ALLEGRO_LINE_JOIN_ROUND)
-      emit_round_join(cache, pivot, p0, p1, radius);
+      emit_round_join(cache, pivot, p0, p1, radius, circle_segments);
    else if (join_style == ALLEGRO_LINE_JOIN_MITER)
       emit_miter_join(cache, pivot, p0, p1, radius, middle, angle, miter_distance, miter_limit * radius);
    else {
@@ -405,6 +408,7 @@ static void emit_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* vertice
    float r0[2], r1[2];
    float p0[2], p1[2];
    float radius;
+   int circle_segments;
    int steps;
    int i;
 
@@ -416,6 +420,13 @@ static void emit_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* vertice
 
    radius = 0.5f * thickness;
 
+   /* Round joins and caps all have this radius, so find the number of
+    * segments for it once rather than for every arc.
+    */
+   circle_segments = 0;
+   if (join_style == ALLEGRO_LINE_JOIN_ROUND || cap_style == ALLEGRO_LINE_CAP_ROUND)
+      circle_segments = _al_prim_circle_segments(_al_prim_get_scale() * radius);
+
    /* Single line cannot be closed. If user forgot to explicitly specify
    * most desired alternative cap style, we just disable capping at all.
    */
@@ -431,8 +442,8 @@ static void emit_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* vertice
       * it is guaranteed that there are at least two vertices
       * in the buffer.
       */
-      emit_end_cap(cache, cap_style,  VERTEX(1),  VERTEX(0), radius);
-      emit_end_cap(cache, cap_style, VERTEX(-2), VERTEX(-1), radius);
+      emit_end_cap(cache, cap_style,  VERTEX(1),  VERTEX(0), radius, circle_segments);
+      emit_end_cap(cache, cap_style, VERTEX(-2), VERTEX(-1), radius, circle_segments);
 
       /* Compute points on the left side of the very first segment. */
       compute_end_cross_points(VERTEX(1), VERTEX(0), radius, p1, p0);
@@ -473,9 +484,9 @@ static void emit_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* vertice
 
          /* Emit join. */
          if (angle >= 0.0f)
-            emit_join(cache, join_style, v1, l0, r0, radius, middle, angle, miter_distance, miter_limit);
+            emit_join(cache, join_style, v1, l0, r0, radius, middle, angle, miter_distance, miter_limit, circle_segments);
          else
-            emit_join(cache, join_style, v1, r1, l1, radius, middle, angle, miter_distance, miter_limit);
+            emit_join(cache, join_style, v1, r1, l1, radius, middle, angle, miter_distance, miter_limit, circle_segments);
       }
       else
          compute_end_cross_points(v0, v1, radius, l0, l1);
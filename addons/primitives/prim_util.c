@@ -16,6 +16,8 @@
  *      See readme.txt for copyright information.
  */
 
+#define ALLEGRO_INTERNAL_UNSTABLE
+
 #include <float.h>
 #include <math.h>
 
@@ -23,6 +25,7 @@
 #include "allegro5/allegro_primitives.h"
 #include "allegro5/internal/aintern_list.h"
 #include "allegro5/internal/aintern_prim_addon.h"
+#include "allegro5/internal/aintern_primitives.h"
 
 #ifdef ALLEGRO_MSVC
    #define hypotf(x, y) _hypotf((x), (y))
@@ -32,12 +35,68 @@
 
 
 /*
- * Make an estimate of the scale of the current transformation.
+ * Segments of a full circle with a radius of one pixel, the others need
+ * sqrtf(radius) times as many. The chord of a circle of radius r over an angle
+ * of 2 * pi / n is at most r * (1 - cos(pi / n)) ~ r * pi^2 / (2 * n^2) away
+ * from it, so this is pi / sqrt(2 * tolerance). It is set per thread, like
+ * the rest of the drawing state.
+ */
+static float get_circle_quality(void)
+{
+   float quality = _al_get_prim_state()->circle_quality;
+   return quality > 0 ? quality : ALLEGRO_PRIM_QUALITY;
+}
+
+
+/*
+ * Make an estimate of the scale of the current transformation, in pixels.
+ * We do this by computing the determinants of the 2D section of the
+ * transformation matrix.
  */
 float _al_prim_get_scale(void)
 {
+#define DET2D(T) (fabs((T)->m[0][0] * (T)->m[1][1] - (T)->m[0][1] * (T)->m[1][0]))
+
    const ALLEGRO_TRANSFORM* t = al_get_current_transform();
-   return (hypotf(t->m[0][0], t->m[0][1]) + hypotf(t->m[1][0], t->m[1][1])) / 2;
+   float scale_sq = DET2D(t);
+   ALLEGRO_BITMAP* b = al_get_target_bitmap();
+   if (b) {
+      const ALLEGRO_TRANSFORM* p = al_get_current_projection_transform();
+      /* Divide by 4.0f as the screen coordinates range from -1 to 1 on both axes. */
+      scale_sq *= DET2D(p) * al_get_bitmap_width(b) * al_get_bitmap_height(b) / 4.0f;
+   }
+
+   return sqrtf(scale_sq);
+
+#undef DET2D
+}
+
+
+/*
+ * Number of segments a full circle of the given radius in pixels needs to
+ * stay within the tolerance.
+ */
+float _al_prim_circle_segments(float radius)
+{
+   return get_circle_quality() * sqrtf(radius);
+}
+
+
+/* Function: al_set_primitives_tolerance
+ */
+void al_set_primitives_tolerance(float tolerance)
+{
+   ASSERT(tolerance > 0);
+   _al_get_prim_state()->circle_quality = ALLEGRO_PI / sqrtf(2 * tolerance);
+}
+
+
+/* Function: al_get_primitives_tolerance
+ */
+float al_get_primitives_tolerance(void)
+{
+   float quality = get_circle_quality();
+   return ALLEGRO_PI * ALLEGRO_PI / (2 * quality * quality);
 }
 
 
@@ -250,3 +309,98 @@ void _al_prim_cache_push_point(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* v)
    ++cache->current;
    ++cache->size;
 }
+
+/*
+ * Number of vertices in a primitive of a list type.
+ */
+int _al_prim_list_vertices(int list_type)
+{
+   switch (list_type) {
+      case ALLEGRO_PRIM_LINE_LIST:
+         return 2;
+      case ALLEGRO_PRIM_TRIANGLE_LIST:
+         return 3;
+      default:
+         return 1;
+   }
+}
+
+/*
+ * Writes the indices that draw num_vtx vertices of the given type as a
+ * triangle, line or point list, which is stored to list_type. Vertex ii is
+ * base + map[ii], or base + ii without a map. The order of the vertices within
+ * each primitive is the one the software renderer uses. out must have room for
+ * 3 * num_vtx indices. Returns the number of indices written.
+ */
+int _al_prim_list_indices(int type, const int* map, int base, int num_vtx, int* out, int* list_type)
+{
+   int* start = out;
+   int ii;
+
+#define VTX(ii) (base + (map ? map[ii] : (ii)))
+
+   switch (type) {
+      case ALLEGRO_PRIM_LINE_LIST: {
+         for (ii = 0; ii < num_vtx - 1; ii += 2) {
+            *out++ = VTX(ii);
+            *out++ = VTX(ii + 1);
+         }
+         *list_type = ALLEGRO_PRIM_LINE_LIST;
+         break;
+      };
+      case ALLEGRO_PRIM_LINE_STRIP:
+      case ALLEGRO_PRIM_LINE_LOOP: {
+         for (ii = 1; ii < num_vtx; ii++) {
+            *out++ = VTX(ii - 1);
+            *out++ = VTX(ii);
+         }
+         if (type == ALLEGRO_PRIM_LINE_LOOP && num_vtx > 0) {
+            *out++ = VTX(num_vtx - 1);
+            *out++ = VTX(0);
+         }
+         *list_type = ALLEGRO_PRIM_LINE_LIST;
+         break;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_LIST: {
+         for (ii = 0; ii < num_vtx - 2; ii += 3) {
+            *out++ = VTX(ii);
+            *out++ = VTX(ii + 1);
+            *out++ = VTX(ii + 2);
+         }
+         *list_type = ALLEGRO_PRIM_TRIANGLE_LIST;
+         break;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_STRIP: {
+         for (ii = 2; ii < num_vtx; ii++) {
+            *out++ = VTX(ii - 2);
+            *out++ = VTX(ii - 1);
+            *out++ = VTX(ii);
+         }
+         *list_type = ALLEGRO_PRIM_TRIANGLE_LIST;
+         break;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_FAN: {
+         for (ii = 2; ii < num_vtx; ii++) {
+            *out++ = VTX(0);
+            *out++ = VTX(ii);
+            *out++ = VTX(ii - 1);
+         }
+         *list_type = ALLEGRO_PRIM_TRIANGLE_LIST;
+         break;
+      };
+      case ALLEGRO_PRIM_POINT_LIST: {
+         for (ii = 0; ii < num_vtx; ii++) {
+            *out++ = VTX(ii);
+         }
+         *list_type = ALLEGRO_PRIM_POINT_LIST;
+         break;
+      };
+      default:
+         *list_type = ALLEGRO_PRIM_POINT_LIST;
+         break;
+   }
+
+#undef VTX
+
+   return out - start;
+}
@@ -72,7 +72,10 @@ void al_shutdown_primitives_addon(void)
 int al_draw_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
    ALLEGRO_BITMAP* texture, int start, int end, int type)
 {
+   ALLEGRO_SHAPE* shape = _al_prim_get_recording_shape();
    ASSERT(addon_initialized);
+   if (shape)
+      return _al_prim_record(shape, vtxs, decl, texture, NULL, start, end, type);
    return _al_draw_prim(vtxs, decl, texture, start, end, type);
 }
 
@@ -81,10 +84,27 @@ int al_draw_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
 int al_draw_indexed_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
    ALLEGRO_BITMAP* texture, const int* indices, int num_vtx, int type)
 {
+   ALLEGRO_SHAPE* shape = _al_prim_get_recording_shape();
    ASSERT(addon_initialized);
+   if (shape)
+      return _al_prim_record(shape, vtxs, decl, texture, indices, 0, num_vtx, type);
    return _al_draw_indexed_prim(vtxs, decl, texture, indices, num_vtx, type);
 }
 
+/* Function: al_set_primitives_flags
+ */
+void al_set_primitives_flags(int flags)
+{
+   _al_get_prim_state()->flags = flags;
+}
+
+/* Function: al_get_primitives_flags
+ */
+int al_get_primitives_flags(void)
+{
+   return _al_get_prim_state()->flags;
+}
+
 /* Function: al_get_allegro_primitives_version
  */
 uint32_t al_get_allegro_primitives_version(void)
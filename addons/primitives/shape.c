@@ -0,0 +1,364 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Retained shapes.
+ *
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#define ALLEGRO_INTERNAL_UNSTABLE
+
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_primitives.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_prim_addon.h"
+#include "allegro5/internal/aintern_primitives.h"
+
+ALLEGRO_DEBUG_CHANNEL("primitives")
+
+/*
+ * A shape keeps everything drawn into it as indexed triangle, line and point
+ * lists. Consecutive primitives of the same kind sharing a texture are merged
+ * into one batch, so that a shape made of many small primitives is drawn with
+ * a few calls.
+ */
+typedef struct SHAPE_BATCH {
+   ALLEGRO_BITMAP* texture;
+   int type;
+   int start;
+   int end;
+} SHAPE_BATCH;
+
+struct ALLEGRO_SHAPE {
+   ALLEGRO_VERTEX* vertices;
+   int num_vertices;
+   int vertex_capacity;
+
+   int* indices;
+   int num_indices;
+   int index_capacity;
+
+   SHAPE_BATCH* batches;
+   int num_batches;
+   int batch_capacity;
+
+   ALLEGRO_VERTEX_BUFFER* vertex_buffer;
+   ALLEGRO_INDEX_BUFFER* index_buffer;
+};
+
+static bool reserve(void** data, int* capacity, int needed, size_t size)
+{
+   void* new_data;
+   int new_capacity;
+
+   if (needed <= *capacity)
+      return true;
+
+   new_capacity = _ALLEGRO_MAX(*capacity * 2, _ALLEGRO_MAX(needed, 64));
+   new_data = al_realloc(*data, new_capacity * size);
+   if (!new_data)
+      return false;
+
+   *data = new_data;
+   *capacity = new_capacity;
+   return true;
+}
+
+static void release_buffers(ALLEGRO_SHAPE* shape)
+{
+   if (shape->vertex_buffer) {
+      al_destroy_vertex_buffer(shape->vertex_buffer);
+      shape->vertex_buffer = NULL;
+   }
+   if (shape->index_buffer) {
+      al_destroy_index_buffer(shape->index_buffer);
+      shape->index_buffer = NULL;
+   }
+}
+
+/*
+ * Appends count vertices starting at vtxs, returns the index of the first one
+ * or -1 on failure.
+ */
+static int add_vertices(ALLEGRO_SHAPE* shape, const char* vtxs,
+   const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture, int count)
+{
+   int first = shape->num_vertices;
+   int ii;
+
+   if (!reserve((void**)&shape->vertices, &shape->vertex_capacity,
+         first + count, sizeof(ALLEGRO_VERTEX)))
+      return -1;
+
+   if (!decl) {
+      memcpy(&shape->vertices[first], vtxs, count * sizeof(ALLEGRO_VERTEX));
+   }
+   else {
+      for (ii = 0; ii < count; ii++) {
+         _al_convert_vertex(texture, vtxs, &shape->vertices[first + ii], decl);
+         vtxs += decl->stride;
+      }
+   }
+
+   shape->num_vertices += count;
+   return first;
+}
+
+static bool add_batch(ALLEGRO_SHAPE* shape, ALLEGRO_BITMAP* texture,
+   int type, int start)
+{
+   SHAPE_BATCH* batch;
+
+   if (shape->num_batches > 0) {
+      batch = &shape->batches[shape->num_batches - 1];
+      if (batch->texture == texture && batch->type == type && batch->end == start) {
+         batch->end = shape->num_indices;
+         return true;
+      }
+   }
+
+   if (!reserve((void**)&shape->batches, &shape->batch_capacity,
+         shape->num_batches + 1, sizeof(SHAPE_BATCH)))
+      return false;
+
+   batch = &shape->batches[shape->num_batches++];
+   batch->texture = texture;
+   batch->type = type;
+   batch->start = start;
+   batch->end = shape->num_indices;
+   return true;
+}
+
+/*
+ * Appends the primitives of num_vtx vertices of the given type as a list,
+ * see _al_prim_list_indices.
+ */
+static int add_primitives(ALLEGRO_SHAPE* shape, ALLEGRO_BITMAP* texture,
+   const int* map, int base, int num_vtx, int type)
+{
+   int start = shape->num_indices;
+   int list_type;
+   int count;
+
+   if (!reserve((void**)&shape->indices, &shape->index_capacity,
+         start + 3 * num_vtx, sizeof(int)))
+      return 0;
+
+   count = _al_prim_list_indices(type, map, base, num_vtx,
+      &shape->indices[start], &list_type);
+   if (count == 0)
+      return 0;
+
+   shape->num_indices += count;
+   if (!add_batch(shape, texture, list_type, start)) {
+      shape->num_indices = start;
+      return 0;
+   }
+   return count / _al_prim_list_vertices(list_type);
+}
+
+/*
+ * Returns the shape being recorded by al_begin_shape on this thread, if any.
+ * It is kept per thread like the rest of the drawing state, so other threads
+ * keep drawing as usual.
+ */
+ALLEGRO_SHAPE* _al_prim_get_recording_shape(void)
+{
+   return _al_get_prim_state()->recording_shape;
+}
+
+/*
+ * Records what al_draw_prim (indices == NULL) or al_draw_indexed_prim
+ * (start == 0, end == num_vtx) would draw.
+ */
+int _al_prim_record(ALLEGRO_SHAPE* shape, const void* vtxs,
+   const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture,
+   const int* indices, int start, int end, int type)
+{
+   const char* src = vtxs;
+   int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+   int num_vtx = end - start;
+   int min_idx, max_idx;
+   int base;
+   int ii;
+
+   if (num_vtx <= 0)
+      return 0;
+
+   release_buffers(shape);
+
+   if (!indices) {
+      base = add_vertices(shape, src + start * stride, decl, texture, num_vtx);
+      if (base < 0)
+         return 0;
+      return add_primitives(shape, texture, NULL, base, num_vtx, type);
+   }
+
+   min_idx = indices[0];
+   max_idx = indices[0];
+   for (ii = 1; ii < num_vtx; ii++) {
+      if (max_idx < indices[ii])
+         max_idx = indices[ii];
+      else if (min_idx > indices[ii])
+         min_idx = indices[ii];
+   }
+
+   /*
+    * Keep the sharing of vertices unless the indices are spread over far more
+    * vertices than they use, like the software renderer does.
+    */
+   if (max_idx - min_idx + 1 <= _ALLEGRO_MAX(num_vtx, ALLEGRO_VERTEX_CACHE_SIZE)) {
+      base = add_vertices(shape, src + min_idx * stride, decl, texture,
+         max_idx - min_idx + 1);
+      if (base < 0)
+         return 0;
+      return add_primitives(shape, texture, indices, base - min_idx, num_vtx, type);
+   }
+
+   base = shape->num_vertices;
+   for (ii = 0; ii < num_vtx; ii++) {
+      if (add_vertices(shape, src + indices[ii] * stride, decl, texture, 1) < 0) {
+         shape->num_vertices = base;
+         return 0;
+      }
+   }
+   return add_primitives(shape, texture, NULL, base, num_vtx, type);
+}
+
+/* Function: al_create_shape
+ */
+ALLEGRO_SHAPE* al_create_shape(void)
+{
+   return al_calloc(1, sizeof(ALLEGRO_SHAPE));
+}
+
+/* Function: al_destroy_shape
+ */
+void al_destroy_shape(ALLEGRO_SHAPE* shape)
+{
+   if (!shape)
+      return;
+
+   if (_al_prim_get_recording_shape() == shape)
+      _al_get_prim_state()->recording_shape = NULL;
+
+   release_buffers(shape);
+   al_free(shape->vertices);
+   al_free(shape->indices);
+   al_free(shape->batches);
+   al_free(shape);
+}
+
+/* Function: al_clear_shape
+ */
+void al_clear_shape(ALLEGRO_SHAPE* shape)
+{
+   ASSERT(shape);
+
+   release_buffers(shape);
+   shape->num_vertices = 0;
+   shape->num_indices = 0;
+   shape->num_batches = 0;
+}
+
+/* Function: al_begin_shape
+ */
+void al_begin_shape(ALLEGRO_SHAPE* shape)
+{
+   ASSERT(shape);
+   ASSERT(!_al_prim_get_recording_shape());
+
+   _al_get_prim_state()->recording_shape = shape;
+}
+
+/* Function: al_end_shape
+ */
+void al_end_shape(void)
+{
+   ASSERT(_al_prim_get_recording_shape());
+
+   _al_get_prim_state()->recording_shape = NULL;
+}
+
+/* Function: al_upload_shape
+ */
+bool al_upload_shape(ALLEGRO_SHAPE* shape, int flags)
+{
+   int index_size;
+   void* data;
+   int ii;
+
+   ASSERT(shape);
+   ASSERT(shape != _al_prim_get_recording_shape());
+
+   release_buffers(shape);
+   if (shape->num_indices == 0)
+      return true;
+
+   shape->vertex_buffer = al_create_vertex_buffer(NULL, shape->vertices,
+      shape->num_vertices, flags);
+   if (!shape->vertex_buffer)
+      goto fail;
+
+   index_size = shape->num_vertices <= 65536 ? 2 : 4;
+   shape->index_buffer = al_create_index_buffer(index_size, NULL,
+      shape->num_indices, flags);
+   if (!shape->index_buffer)
+      goto fail;
+
+   data = al_lock_index_buffer(shape->index_buffer, 0, shape->num_indices,
+      ALLEGRO_LOCK_WRITEONLY);
+   if (!data)
+      goto fail;
+   if (index_size == 2) {
+      for (ii = 0; ii < shape->num_indices; ii++)
+         ((uint16_t*)data)[ii] = shape->indices[ii];
+   }
+   else {
+      memcpy(data, shape->indices, shape->num_indices * sizeof(int));
+   }
+   al_unlock_index_buffer(shape->index_buffer);
+   return true;
+
+fail:
+   ALLEGRO_WARN("Could not upload the shape, it will be drawn from memory.\n");
+   release_buffers(shape);
+   return false;
+}
+
+/* Function: al_draw_shape
+ */
+void al_draw_shape(ALLEGRO_SHAPE* shape)
+{
+   const SHAPE_BATCH* batch;
+   int ii;
+
+   ASSERT(shape);
+   ASSERT(shape != _al_prim_get_recording_shape());
+
+   for (ii = 0; ii < shape->num_batches; ii++) {
+      batch = &shape->batches[ii];
+      /* While recording, the shape is added to the recorded one. */
+      if (shape->vertex_buffer && !_al_prim_get_recording_shape()) {
+         al_draw_indexed_buffer(shape->vertex_buffer, batch->texture,
+            shape->index_buffer, batch->start, batch->end, batch->type);
+      }
+      else {
+         al_draw_indexed_prim(shape->vertices, NULL, batch->texture,
+            &shape->indices[batch->start], batch->end - batch->start,
+            batch->type);
+      }
+   }
+}
+
+/* vim: set sts=3 sw=3 et: */
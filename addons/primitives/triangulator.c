@@ -10,804 +10,593 @@
  *
  *      Polygon triangulation with holes.
  *
+ *      The polygon is first split into y-monotone pieces by a sweep
+ *      from the top vertex to the bottom one, which also connects the
+ *      holes to the outline. Each piece is then triangulated in linear
+ *      time. Sorting the vertices and searching the edges crossed by the
+ *      sweep line make the whole O(n log n).
  *
- *      By Michał Cichoń.
+ *
+ *      Replaces the ear clipping triangulator by Michał Cichoń; the
+ *      monotone partition is by the Allegro developers.
  *
  *      See readme.txt for copyright information.
  */
 
 
-#include <float.h>
-#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_primitives.h"
-#include "allegro5/internal/aintern_list.h"
 #include "allegro5/internal/aintern_prim_addon.h"
 
 
-#define POLY_DEBUG 0
-
-
-/* */
-#define POLY_VERTEX_ATTR_REFLEX      0x0001
-#define POLY_VERTEX_ATTR_EAR_CLIP    0x0002
-#define POLY_VERTEX_ATTR_ALL         (POLY_VERTEX_ATTR_REFLEX | POLY_VERTEX_ATTR_EAR_CLIP)
-
+/* Kinds of vertices, by their neighbours and interior angle. "Above" means
+ * earlier in the sweep: larger y, or larger x on the same y.
+ */
+enum {
+   POLY_VERTEX_START,      /* both neighbours below, convex */
+   POLY_VERTEX_SPLIT,      /* both neighbours below, reflex */
+   POLY_VERTEX_END,        /* both neighbours above, convex */
+   POLY_VERTEX_MERGE,      /* both neighbours above, reflex */
+   POLY_VERTEX_REGULAR
+};
+
+
+typedef struct POLY_VERTEX {
+   float x;
+   float y;
+   int   index;            /* in the caller's array */
+   int   prev;
+   int   next;
+   int   type;
+} POLY_VERTEX;
+
+
+/* Node of the tree of edges crossing the sweep line, ordered from left to
+ * right. Edge i goes from vertex i to its next vertex.
+ */
+typedef struct POLY_EDGE {
+   int            left;
+   int            right;
+   int            parent;
+   unsigned int   priority;
+   bool           in_tree;
+} POLY_EDGE;
 
-typedef void (*POLY_EMIT_TRIANGLE)(int, int, int, void*);
 
 typedef struct POLY {
-   const float*            vertex_buffer;
-   size_t                  vertex_stride;
-   size_t                  vertex_count;
-   const int*              split_indices;
-   size_t                  split_stride;
-   size_t                  split_count;
-   POLY_EMIT_TRIANGLE      emit;
-   void*                   userdata;
-   _AL_LIST*               vertex_list;
-   _AL_LIST*               reflex_list;
-   _AL_LIST*               ear_list;
+   POLY_VERTEX*   vertices;
+   int            vertex_count;
+   POLY_EDGE*     edges;
+   int            root;
+   int*           helpers;
+   void         (*emit)(int, int, int, void*);
+   void*          userdata;
 } POLY;
 
-typedef struct POLY_SPLIT {
-   int      begin;
-   size_t   size;
-   float*   point;
-   int      max_index;
-} POLY_SPLIT;
-
-
-# if POLY_DEBUG
-typedef void (*poly_debug_draw_text_t)(float x, float y, int line, const char* format, ...);
-
-#if defined _MSC_VER
-#define EXPORT __declspec(dllexport)
-#else
-#define EXPORT
-#define __noop ((void)0)
-#endif
-
-EXPORT int                     g_poly_debug_split_step      = -1;
-EXPORT int                     g_poly_debug_step            = -1;
-EXPORT int                     g_poly_debug_step_current    = 0;
-EXPORT poly_debug_draw_text_t  g_poly_debug_draw_text       = NULL;
-EXPORT float                   g_poly_debug_scale           = 1.0f;
-
-#undef EXPORT
-
-# define POLY_DEBUG_TEXT(x,y,...)            (g_poly_debug_draw_text ? g_poly_debug_draw_text(x,y,INT_MAX,__VA_ARGS__) : __noop)
-# define POLY_DEBUG_TEXT_LINE(x,y,line,...)  (g_poly_debug_draw_text ? g_poly_debug_draw_text(x,y,line,__VA_ARGS__)    : __noop)
-
-# endif
 
+static bool poly_is_below(const POLY_VERTEX* a, const POLY_VERTEX* b)
+{
+   return a->y < b->y || (a->y == b->y && a->x < b->x);
+}
 
-/* Internal functions. */
-static bool      poly_initialize(POLY* poly);
-static void      poly_classify_vertices(_AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear);
-static void      poly_classify_vertices_in_range(_AL_LIST_ITEM* begin, _AL_LIST_ITEM* end, _AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear);
-static void      poly_do_triangulate(POLY* poly);
 
-static _AL_LIST* poly_create_split_list(POLY* polygon);
-static void      poly_split_list_dtor(void* user_data);
+static bool poly_is_convex(const POLY_VERTEX* a, const POLY_VERTEX* b, const POLY_VERTEX* c)
+{
+   return (c->y - a->y) * (b->x - a->x) - (c->x - a->x) * (b->y - a->y) > 0;
+}
 
 
 /*
- *  Seek for closest intersection point of polygon with a ray directed
- *  to the right.
- *
- *  Returns true if intersection was found. 'point', 'edge0' and 'edge1'
- *  are set to proper values (if not NULL).
- *  Returns false if intersection was not fount and none of above
- *  are modified.
+ *  Whether edge a1-a2 is left of edge b1-b2 where both cross the sweep
+ *  line. A point is passed as an edge with both ends the same.
  */
-static bool poly_find_closest_intersection(_AL_LIST* vertices, const float* vertex, float* point, _AL_LIST_ITEM** edge0, _AL_LIST_ITEM** edge1)
+static bool poly_edge_is_left(const POLY_VERTEX* a1, const POLY_VERTEX* a2,
+   const POLY_VERTEX* b1, const POLY_VERTEX* b2)
 {
-   size_t i;
-   const float* v0 = NULL;
-   float v1[2];
-   float intersection[2];
-   float t0, t1;
-   float best_point[2] = {0, 0};
-   float best_t;
-   _AL_LIST_ITEM* item = NULL;
-   _AL_LIST_ITEM* next = NULL;
-   _AL_LIST_ITEM* best_e0 = NULL;
-   _AL_LIST_ITEM* best_e1 = NULL;
-
-   /* Assemble line pointing to the right. */
-   v0    = vertex;
-   v1[0] = v0[0] + 1.0f;
-   v1[1] = v0[1];
-
-   /* Seek for the closest intersection. */
-   best_t = FLT_MAX;
-   item = _al_list_front(vertices);
-   next = _al_list_next_circular(vertices, item);
-   for (i = 0; i < _al_list_size(vertices); ++i, item = next, next = _al_list_next_circular(vertices, next)) {
-
-      float* p0 = (float*)_al_list_item_data(item);
-      float* p1 = (float*)_al_list_item_data(next);
-
-      /* Perform quick rejection.
-       *
-       * We are interested only with outer edges. That mean only those
-       * whose go from the bottom to the up. Note we cannot intersect
-       * parallel line.
-       *
-       * Second condition reject edges lying completely on the left
-       * side of ray origin.
-       */
-      if ((p0[1] < p1[1]) || (p0[0] <= vertex[0] && p1[0] <= vertex[0]))
-         continue;
-
-      if (_al_prim_intersect_segment(v0, v1, p0, p1, intersection, &t0, &t1) && (t1 >= 0.0f) && (t1 <= 1.0f) && (t0 >= 0.0f) && (t0 < best_t)) {
-
-         best_t        = t0;
-         best_point[0] = intersection[0];
-         best_point[1] = intersection[1];
-         best_e0       = item;
-         best_e1       = next;
-      }
+   if (b1->y == b2->y) {
+      if (a1->y == a2->y)
+         return a1->y < b1->y;
+      return poly_is_convex(a1, a2, b1);
    }
+   else if (a1->y == a2->y || a1->y < b1->y)
+      return !poly_is_convex(b1, b2, a1);
+   else
+      return poly_is_convex(a1, a2, b1);
+}
 
-   if (NULL != best_e0) {
-
-      if (NULL != point) {
-
-         point[0] = best_point[0];
-         point[1] = best_point[1];
-      }
-
-      if (NULL != edge0)
-         *edge0 = best_e0;
 
-      if (NULL != edge1)
-         *edge1 = best_e1;
+# define POLY_V(i)   (&polygon->vertices[i])
+# define POLY_E(i)   (polygon->edges[i])
 
-# if POLY_DEBUG
-      //al_draw_line(v0[0], v0[1], point[0], point[1], al_map_rgb(255, 0, 0), 0.0f);
-# endif
 
-      return true;
-   }
+static void poly_set_child(POLY* polygon, int parent, int old_child, int new_child)
+{
+   if (parent < 0)
+      polygon->root = new_child;
+   else if (POLY_E(parent).left == old_child)
+      POLY_E(parent).left = new_child;
    else
-      return false;
+      POLY_E(parent).right = new_child;
 }
 
 
 /*
- *  Seek for the best vertex in polygon for doing split.
- *
- *  Returns vertex after which split (hole) vertices
- *  can be inserted.
+ *  Rotate a node of the edge tree above its parent.
  */
-static _AL_LIST_ITEM* poly_find_outter_split_vertex(POLY* polygon, POLY_SPLIT* split)
+static void poly_rotate_up(POLY* polygon, int node)
 {
-   float intersection[2];
-   _AL_LIST_ITEM* edge_vertex_0;
-   _AL_LIST_ITEM* edge_vertex_1;
-   _AL_LIST_ITEM* vertex;
-   _AL_LIST_ITEM* reflex_item;
-   _AL_LIST_ITEM* best_vertex;
-   float  best_distance;
-   float* p0;
-   float* p1;
-   float* p;
-
-   if (!poly_find_closest_intersection(polygon->vertex_list, split->point, intersection, &edge_vertex_0, &edge_vertex_1))
-      return NULL;
-
-   p0 = (float*)_al_list_item_data(edge_vertex_0);
-   p1 = (float*)_al_list_item_data(edge_vertex_1);
-
-   /* Maybe we hit an edge vertex? */
-   if (_al_prim_are_points_equal(split->point, p0))
-      return edge_vertex_0;
-
-   if (_al_prim_are_points_equal(split->point, p1))
-      return edge_vertex_1;
-
-   /* No luck. Pick point which most far away from us. */
-   if (p0[0] > p1[0]) {
-
-      vertex = edge_vertex_0;
-      p      = p0;
+   int parent = POLY_E(node).parent;
+   int grandparent = POLY_E(parent).parent;
+
+   if (POLY_E(parent).left == node) {
+      POLY_E(parent).left = POLY_E(node).right;
+      if (POLY_E(node).right >= 0)
+         POLY_E(POLY_E(node).right).parent = parent;
+      POLY_E(node).right = parent;
    }
    else {
-
-      vertex = edge_vertex_1;
-      p      = p1;
-   }
-
-   /* Seek in reflex vertices. */
-   best_vertex = NULL;
-   best_distance = FLT_MAX;
-
-   for (reflex_item = _al_list_front(polygon->reflex_list); reflex_item; reflex_item = _al_list_next(polygon->reflex_list, reflex_item)) {
-
-      _AL_LIST_ITEM* reflex_vertex = (_AL_LIST_ITEM*)_al_list_item_data(reflex_item);
-
-      float* reflex_point = (float*)_al_list_item_data(reflex_vertex);
-
-      if (_al_prim_is_point_in_triangle(reflex_point, split->point, p, intersection)) {
-
-         float diff_x = reflex_point[0] - split->point[0];
-         float diff_y = reflex_point[1] - split->point[1];
-
-         float dist = diff_x * diff_x + diff_y * diff_y;
-
-         if (dist < best_distance) {
-
-            best_distance = dist;
-            best_vertex   = reflex_vertex;
-         }
-      }
+      POLY_E(parent).right = POLY_E(node).left;
+      if (POLY_E(node).left >= 0)
+         POLY_E(POLY_E(node).left).parent = parent;
+      POLY_E(node).left = parent;
    }
 
-   if (NULL != best_vertex)
-      vertex = best_vertex;
-
-//# if POLY_DEBUG
-//   p0 = (float*)_al_list_item_data(vertex);
-//   al_draw_line(p0[0], p0[1], intersection[0], intersection[1], al_map_rgb(255, 0, 0), 0.0f);
-//# endif
-
-   return vertex;
+   POLY_E(parent).parent = node;
+   POLY_E(node).parent = grandparent;
+   poly_set_child(polygon, grandparent, parent, node);
 }
 
 
-# define POLY_VERTEX(index)      ((float*)(((uint8_t*)polygon->vertex_buffer) + (index) * polygon->vertex_stride))
-# define POLY_SPLIT(index)       (*((int*)(((uint8_t*)polygon->split_indices) + (index) * polygon->split_stride)))
-# define POLY_SPLIT_INDEX(split) (((uint8_t*)split - (uint8_t*)polygon->split_indices) / polygon->split_stride)
-
-
 /*
- *  Create list of the splits.
+ *  The tree is a treap, kept balanced by random priorities. They only
+ *  need to look random, so they are derived from the edge index.
  */
-static _AL_LIST* poly_create_split_list(POLY* polygon)
+static void poly_insert_edge(POLY* polygon, int edge)
 {
-   int i;
-   int last_split;
-
-   _AL_LIST*       list   = _al_list_create_static(polygon->split_count);
-   POLY_SPLIT* splits = (POLY_SPLIT*)al_malloc(polygon->split_count * sizeof(POLY_SPLIT));
-
-   if ((NULL == list) || (NULL == splits)) {
-
-      _al_list_destroy(list);
-      al_free(splits);
-
-      return NULL;
+   const POLY_VERTEX* a1 = POLY_V(edge);
+   const POLY_VERTEX* a2 = POLY_V(a1->next);
+   unsigned int h = (unsigned int)edge * 2654435761u;
+   int parent = -1;
+   int node = polygon->root;
+   bool is_left = false;
+
+   while (node >= 0) {
+      parent = node;
+      is_left = poly_edge_is_left(a1, a2, POLY_V(node), POLY_V(POLY_V(node)->next));
+      node = is_left ? POLY_E(node).left : POLY_E(node).right;
    }
 
-   /* Set list destructor, so we will don't worry about
-    * manually releasing allocated memory.
-    */
-   _al_list_set_dtor(list, poly_split_list_dtor);
-   _al_list_set_user_data(list, splits);
-
-   last_split = POLY_SPLIT(0);
-   for (i = 1; i < (int)polygon->split_count; ++i) {
-
-      int j;
-      float max;
-      POLY_SPLIT* split = splits + i;
-      _AL_LIST_ITEM* where;
-
-      split->begin = last_split;
-      split->size  = POLY_SPLIT(i) - last_split;
-      last_split   = last_split + split->size;
-
-      max = -FLT_MAX;
-      split->max_index = -1;
-      for (j = split->begin; j < split->begin + (int)split->size; ++j) {
-
-         float* point = POLY_VERTEX(j);
-
-         if (point[0] >= max) {
-
-            max               = point[0];
-            split->point      = point;
-            split->max_index  = j;
-         }
-      }
-
-      split->max_index -= split->begin;
-
-      ASSERT(split->max_index >= 0);
-
-      where = NULL;
-      if (!_al_list_is_empty(list)) {
+   h ^= h >> 15;
+   POLY_E(edge).left = -1;
+   POLY_E(edge).right = -1;
+   POLY_E(edge).parent = parent;
+   POLY_E(edge).priority = h * 2246822519u;
+   POLY_E(edge).in_tree = true;
+
+   if (parent < 0)
+      polygon->root = edge;
+   else if (is_left)
+      POLY_E(parent).left = edge;
+   else
+      POLY_E(parent).right = edge;
 
-         for (where = _al_list_front(list); where; where = _al_list_next(list, where)) {
+   while (POLY_E(edge).parent >= 0 && POLY_E(POLY_E(edge).parent).priority < POLY_E(edge).priority)
+      poly_rotate_up(polygon, edge);
+}
 
-            POLY_SPLIT* local_split = (POLY_SPLIT*)_al_list_item_data(where);
 
-            if (local_split->point[0] < max)
-               break;
-         }
-      }
-
-      if (NULL == where)
-         _al_list_push_back(list, split);
+static void poly_remove_edge(POLY* polygon, int edge)
+{
+   while (POLY_E(edge).left >= 0 || POLY_E(edge).right >= 0) {
+      int left = POLY_E(edge).left;
+      int right = POLY_E(edge).right;
+
+      if (left < 0)
+         poly_rotate_up(polygon, right);
+      else if (right < 0 || POLY_E(left).priority > POLY_E(right).priority)
+         poly_rotate_up(polygon, left);
       else
-         _al_list_insert_before(list, where, split);
+         poly_rotate_up(polygon, right);
    }
 
-   return list;
+   poly_set_child(polygon, POLY_E(edge).parent, edge, -1);
+   POLY_E(edge).in_tree = false;
 }
 
 
 /*
- *  Release memory allocated by split list. This method
- *  serve as callback to the list.
+ *  Give a node of the tree to another vertex, which has taken over its edge.
  */
-static void poly_split_list_dtor(void* user_data)
+static void poly_move_edge(POLY* polygon, int from, int to)
 {
-   /* This is array of POLY_SPLIT. */
-   al_free(user_data);
+   POLY_E(to) = POLY_E(from);
+   POLY_E(from).in_tree = false;
+
+   if (!POLY_E(to).in_tree)
+      return;
+
+   poly_set_child(polygon, POLY_E(to).parent, from, to);
+   if (POLY_E(to).left >= 0)
+      POLY_E(POLY_E(to).left).parent = to;
+   if (POLY_E(to).right >= 0)
+      POLY_E(POLY_E(to).right).parent = to;
 }
 
 
 /*
- *  Perform initialization step to polygon triangulation.
- *
- *  Three linked list are initialized: vertex_list, reflex_list
- *  and ear_list.
+ *  Find the edge directly left of a vertex on the sweep line.
  *
- *  All provided splits (holes) are resolved in this step.
- *  Therefore at the end we have simple polygon.
+ *  Returns -1 if there is none, which only happens for invalid polygons.
  */
-static bool poly_initialize(POLY* polygon)
+static int poly_find_left_edge(POLY* polygon, int vertex)
 {
-   _AL_LIST* vertex_list;
-   _AL_LIST* reflex_list;
-   _AL_LIST* ear_list;
-   _AL_LIST* split_list;
-   _AL_LIST_ITEM* split_item;
-   size_t vertex_count;
-   bool use_split_list;
-   size_t j;
-   int i;
-
-# if POLY_DEBUG
-   if (g_poly_debug_split_step >= 0)
-      polygon->split_count = min(g_poly_debug_split_step, polygon->split_count);
-# endif
-
-   /* Every hole add two extra vertices to the list. */
-   vertex_count = polygon->vertex_count + (polygon->split_count - 1) * 2;
-
-   /* Create lists for polygon. */
-   vertex_list = _al_list_create_static(vertex_count);
-   reflex_list = _al_list_create_static(vertex_count);
-   ear_list    = _al_list_create_static(vertex_count);
-
-   if (polygon->split_count > 1) {
-
-      split_list     = poly_create_split_list(polygon);
-      use_split_list = true;
-   }
-   else {
-      split_list = NULL;
-      use_split_list = false;
-   }
-
-   if ((NULL == vertex_list) || (NULL == reflex_list) || (NULL == ear_list) || (use_split_list && (NULL == split_list))) {
-
-      _al_list_destroy(vertex_list);
-      _al_list_destroy(reflex_list);
-      _al_list_destroy(ear_list);
-      _al_list_destroy(split_list);
-
-      return false;
+   const POLY_VERTEX* v = POLY_V(vertex);
+   int node = polygon->root;
+   int best = -1;
+
+   while (node >= 0) {
+      if (poly_edge_is_left(POLY_V(node), POLY_V(POLY_V(node)->next), v, v)) {
+         best = node;
+         node = POLY_E(node).right;
+      }
+      else
+         node = POLY_E(node).left;
    }
 
-   /* Store lists in polygon. */
-   polygon->vertex_list = vertex_list;
-   polygon->reflex_list = reflex_list;
-   polygon->ear_list    = ear_list;
+   return best;
+}
 
-   /* Push main polygon outline. */
-   for (i = 0; i < POLY_SPLIT(0); ++i)
-      _al_list_push_back(vertex_list, POLY_VERTEX(i));
 
-   if (use_split_list) {
+/*
+ *  Connect two vertices by a diagonal, which splits the polygon they are on
+ *  in two. Both vertices are duplicated, so that each polygon has its own
+ *  copy of them: after this, a continues to b, and the copy of a made last
+ *  but one keeps the edge a had before.
+ */
+static void poly_add_diagonal(POLY* polygon, int a, int b)
+{
+   int new_a = polygon->vertex_count++;
+   int new_b = polygon->vertex_count++;
+
+   *POLY_V(new_a) = *POLY_V(a);
+   *POLY_V(new_b) = *POLY_V(b);
+
+   POLY_V(POLY_V(a)->next)->prev = new_a;
+   POLY_V(POLY_V(b)->prev)->next = new_b;
+   POLY_V(new_b)->next = new_a;
+   POLY_V(new_a)->prev = new_b;
+   POLY_V(a)->next = b;
+   POLY_V(b)->prev = a;
+
+   poly_move_edge(polygon, a, new_a);
+   polygon->helpers[new_a] = polygon->helpers[a];
+   POLY_E(new_b).in_tree = false;
+}
 
-# if POLY_DEBUG
-       int current_split = 0;
-# endif
 
-       poly_classify_vertices(vertex_list, reflex_list, NULL);
+static bool poly_helper_is_merge(POLY* polygon, int edge)
+{
+   return POLY_V(polygon->helpers[edge])->type == POLY_VERTEX_MERGE;
+}
 
-      /* Resolve all holes. */
-      for (split_item = _al_list_front(split_list); split_item; split_item = _al_list_next(split_list, split_item)) {
 
-         _AL_LIST_ITEM* first_vertex;
-         _AL_LIST_ITEM* last_vertex;
-         POLY_SPLIT* split;
+static int poly_compare_vertices(const void* a, const void* b)
+{
+   const POLY_VERTEX* va = *(const POLY_VERTEX* const*)a;
+   const POLY_VERTEX* vb = *(const POLY_VERTEX* const*)b;
+
+   if (poly_is_below(vb, va))
+      return -1;
+   if (poly_is_below(va, vb))
+      return 1;
+   return 0;
+}
 
-# if POLY_DEBUG
-         if (g_poly_debug_split_step >= 0 && current_split >= g_poly_debug_split_step)
-             break;
 
-         ++current_split;
-# endif
+/*
+ *  Sweep over the vertices from the top, adding diagonals which split the
+ *  polygon into monotone pieces. The helper of an edge is the lowest vertex
+ *  seen so far which can be connected to from below without crossing it.
+ */
+static bool poly_partition(POLY* polygon, POLY_VERTEX** order, int count)
+{
+   int i;
 
-         split = (POLY_SPLIT*)_al_list_item_data(split_item);
+   for (i = 0; i < count; i++) {
+      int v = order[i] - polygon->vertices;
+      int v2 = v;
+      int edge;
 
-         first_vertex = poly_find_outter_split_vertex(polygon, split);
+      switch (POLY_V(v)->type) {
+         case POLY_VERTEX_START:
+            poly_insert_edge(polygon, v);
+            polygon->helpers[v] = v;
+            break;
 
-         if (NULL == first_vertex)
+         case POLY_VERTEX_END:
+            edge = POLY_V(v)->prev;
+            if (!POLY_E(edge).in_tree)
+               return false;
+            if (poly_helper_is_merge(polygon, edge))
+               poly_add_diagonal(polygon, v, polygon->helpers[edge]);
+            poly_remove_edge(polygon, edge);
             break;
 
-         /* Insert hole vertices. */
-         last_vertex = first_vertex;
-         for (j = 0; j <= split->size; ++j)
-            last_vertex = _al_list_insert_after(vertex_list, last_vertex,
-               POLY_VERTEX(split->begin + ((j + split->max_index) % split->size)));
-         last_vertex = _al_list_insert_after(vertex_list, last_vertex, _al_list_item_data(first_vertex));
+         case POLY_VERTEX_SPLIT:
+            edge = poly_find_left_edge(polygon, v);
+            if (edge < 0)
+               return false;
+            poly_add_diagonal(polygon, v, polygon->helpers[edge]);
+            v2 = polygon->vertex_count - 2;
+            polygon->helpers[edge] = v;
+            poly_insert_edge(polygon, v2);
+            polygon->helpers[v2] = v2;
+            break;
 
-         _al_list_remove(reflex_list, first_vertex);
+         case POLY_VERTEX_MERGE:
+            edge = POLY_V(v)->prev;
+            if (!POLY_E(edge).in_tree)
+               return false;
+            if (poly_helper_is_merge(polygon, edge)) {
+               poly_add_diagonal(polygon, v, polygon->helpers[edge]);
+               v2 = polygon->vertex_count - 2;
+            }
+            poly_remove_edge(polygon, edge);
+
+            edge = poly_find_left_edge(polygon, v);
+            if (edge < 0)
+               return false;
+            if (poly_helper_is_merge(polygon, edge))
+               poly_add_diagonal(polygon, v2, polygon->helpers[edge]);
+            polygon->helpers[edge] = v2;
+            break;
 
-         poly_classify_vertices_in_range(first_vertex, _al_list_next(vertex_list, last_vertex), vertex_list, reflex_list, NULL);
+         default:
+            if (poly_is_below(POLY_V(v), POLY_V(POLY_V(v)->prev))) {
+               /* The interior is to the right. */
+               edge = POLY_V(v)->prev;
+               if (!POLY_E(edge).in_tree)
+                  return false;
+               if (poly_helper_is_merge(polygon, edge)) {
+                  poly_add_diagonal(polygon, v, polygon->helpers[edge]);
+                  v2 = polygon->vertex_count - 2;
+               }
+               poly_remove_edge(polygon, edge);
+               poly_insert_edge(polygon, v2);
+               polygon->helpers[v2] = v2;
+            }
+            else {
+               edge = poly_find_left_edge(polygon, v);
+               if (edge < 0)
+                  return false;
+               if (poly_helper_is_merge(polygon, edge))
+                  poly_add_diagonal(polygon, v, polygon->helpers[edge]);
+               polygon->helpers[edge] = v;
+            }
+            break;
       }
-
-      _al_list_destroy(split_list);
-
-      poly_classify_vertices(vertex_list, NULL, ear_list);
    }
-   else
-      /* Initialize reflex and ear vertex lists. */
-      poly_classify_vertices(vertex_list, reflex_list, ear_list);
 
    return true;
 }
 
-# undef POLY_VERTEX
-# undef POLY_SPLIT
-# undef POLY_SPLIT_INDEX
-
 
 /*
- *  Compute polygon vertex attributes. Currently supported attributes are:
- *    - ear clip
- *    - reflex
- *
- *  Vertex is an ear clip when triangle made by their edges does not contain
- *  any other vertices.
- *
- *  Vertex is a reflex when angle between edges is greater or equal
- *  to 180 degrees.
- *
- *  Optionally function may take reflex list (if not NULL). In this case test
- *  for ear clip is performed only on reflex vertices not on entire polygon.
- *  This is used for triangulation speed optimization, because convex
- *  (non reflect) vertices will never became reflex.
- *
- *  Flags are used to determine for which attribute we want to check.
- *  Use POLY_VERTEX_ATTR_ALL to test for all attributes.
+ *  Triangulate a monotone polygon, given as its vertices in order. The two
+ *  chains from its top to its bottom are merged, and each vertex then forms
+ *  triangles with those on a stack which it can see.
  */
-static int poly_compute_vertex_attributes(_AL_LIST* vertices, _AL_LIST_ITEM* item, int flags, _AL_LIST* reflex)
+static void poly_triangulate_monotone(POLY* polygon, const int* piece, int count,
+   int* sorted, signed char* side, int* stack)
 {
-   size_t i;
-   _AL_LIST_ITEM* prev = _al_list_previous_circular(vertices, item);
-   _AL_LIST_ITEM* next = _al_list_next_circular(vertices, item);
-   _AL_LIST_ITEM* point = NULL;
-   int result = 0;
-   float* v0;
-   float* v1;
-   float* v2;
-   float cross;
-
-   // Oops, degenerate triangle in store.
-   if (_al_list_size(vertices) < 3)
-      return result;
-
-   // Get points.
-   v0 = (float*)_al_list_item_data(prev);
-   v1 = (float*)_al_list_item_data(item);
-   v2 = (float*)_al_list_item_data(next);
-
-   // Compute the cross product between the two edges
-   cross = (v0[0] - v1[0]) * (v2[1] - v1[1]) - (v0[1] - v1[1]) * (v2[0] - v1[0]);
-
-# if POLY_DEBUG
-   if (g_poly_debug_step == g_poly_debug_step_current) {
-
-      float step = 0.25f * 0.0f;
-
-      float dir0[2] = { v0[0] - v1[0], v0[1] - v1[1] };
-      float dir2[2] = { v2[0] - v1[0], v2[1] - v1[1] };
+   int top = 0;
+   int bottom = 0;
+   int left, right;
+   int stack_size;
+   int i, j;
+
+# define PIECE(i)    POLY_V(piece[i])
+# define EMIT(a, b, c) \
+   polygon->emit(PIECE(a)->index, PIECE(b)->index, PIECE(c)->index, polygon->userdata)
+
+   if (count == 3) {
+      EMIT(0, 1, 2);
+      return;
+   }
 
-      POLY_DEBUG_TEXT(v1[0], v1[1], "%d", cross > 0);
+   for (i = 1; i < count; i++) {
+      if (poly_is_below(PIECE(top), PIECE(i)))
+         top = i;
+      if (poly_is_below(PIECE(i), PIECE(bottom)))
+         bottom = i;
+   }
 
-      al_draw_line(v1[0], v1[1], v1[0] + dir0[0] * step, v1[1] + dir0[1] * step, al_map_rgb(255, 0, 0), 4.0f * g_poly_debug_scale);
-      al_draw_line(v1[0], v1[1], v1[0] + dir2[0] * step, v1[1] + dir2[1] * step, al_map_rgb(255, 0, 0), 4.0f * g_poly_debug_scale);
+   /* Going forwards from the top follows the left chain. */
+   left = (top + 1) % count;
+   right = (top + count - 1) % count;
+   sorted[0] = top;
+   side[top] = 0;
+   for (i = 1; i < count; i++) {
+      if (left == bottom || (right != bottom && poly_is_below(PIECE(left), PIECE(right)))) {
+         sorted[i] = right;
+         side[right] = -1;
+         right = (right + count - 1) % count;
+      }
+      else {
+         sorted[i] = left;
+         side[left] = 1;
+         left = (left + 1) % count;
+      }
    }
-# endif
-
-   // If internal angle is less than 180 degrees then we may
-   // have an ear clip vertex, otherwise we have reflex.
-   if (cross >= 0)
-   {
-      if (flags & POLY_VERTEX_ATTR_EAR_CLIP)
-      {
-         _AL_LIST_ITEM* start;
-         _AL_LIST* search_list;
-         size_t size;
-
-         if (reflex) {
-
-            search_list = reflex;
-            size        = _al_list_size(search_list);
-            start       = _al_list_front(reflex);
-         }
-         else {
-            search_list = vertices;
-            size        = _al_list_size(search_list) - 3;
-            start       = _al_list_next_circular(search_list, next);
-         }
 
-         // Check for ear vertex.
-         point = start;
-         for (i = 0; i < size; ++i, point = _al_list_next_circular(search_list, point)) {
+   stack[0] = sorted[0];
+   stack[1] = sorted[1];
+   stack_size = 2;
 
-            float* v;
+   for (i = 2; i < count - 1; i++) {
+      int v = sorted[i];
 
-            // TODO: optimize this by removing if
-            if (search_list == reflex)
-               v = (float*)_al_list_item_data((_AL_LIST_ITEM*)_al_list_item_data(point));
+      if (side[v] != side[stack[stack_size - 1]]) {
+         /* On the other chain, it sees the whole stack. */
+         for (j = 0; j < stack_size - 1; j++) {
+            if (side[v] == 1)
+               EMIT(stack[j + 1], stack[j], v);
             else
-               v = (float*)_al_list_item_data(point);
-
-            // Ignore vertices which belong to the triangle.
-            if ((v == v0) || (v == v1) || (v == v2))
-               continue;
-
-            // Set point to NULL if we find any point inside the triangle.
-            if (_al_prim_is_point_in_triangle(v, v0, v1, v2)) {
-               point = NULL;
-               break;
+               EMIT(stack[j], stack[j + 1], v);
+         }
+         stack[0] = sorted[i - 1];
+         stack[1] = v;
+         stack_size = 2;
+      }
+      else {
+         /* On the same chain, it sees the stack until it turns away. */
+         stack_size--;
+         while (stack_size > 0) {
+            int a = stack[stack_size - 1];
+            int b = stack[stack_size];
+
+            if (side[v] == 1) {
+               if (!poly_is_convex(PIECE(v), PIECE(a), PIECE(b)))
+                  break;
+               EMIT(v, a, b);
+            }
+            else {
+               if (!poly_is_convex(PIECE(v), PIECE(b), PIECE(a)))
+                  break;
+               EMIT(v, b, a);
             }
+            stack_size--;
          }
-
-         // If point is not NULL, we have ear vertex.
-         if ((NULL != point) || _al_list_is_empty(search_list))
-            result |= POLY_VERTEX_ATTR_EAR_CLIP;
+         stack_size++;
+         stack[stack_size++] = v;
       }
    }
-   else if (flags & POLY_VERTEX_ATTR_REFLEX)
-      result |= POLY_VERTEX_ATTR_REFLEX;
-
-   return result;
-}
 
+   for (j = 0; j < stack_size - 1; j++) {
+      if (side[stack[j + 1]] == 1)
+         EMIT(stack[j], stack[j + 1], sorted[count - 1]);
+      else
+         EMIT(stack[j + 1], stack[j], sorted[count - 1]);
+   }
 
-/*
- *  Classify all vertices into reflex or ear group.
- *
- *  One of target group may be NULL so it will be simply ignored.
- */
-static void poly_classify_vertices(_AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear)
-{
-   poly_classify_vertices_in_range(_al_list_front(vertices), NULL, vertices, reflex, ear);
+# undef EMIT
+# undef PIECE
 }
 
 
 /*
- *  Classify selected range of vertices [begin, end) into
- *  reflex or ear group.
- *
- *  One of target group may be NULL so it will be simply ignored.
+ *  Add a ring of the caller's vertices, leaving out repeated points. The
+ *  outline is linked counter-clockwise (with y up) and holes clockwise,
+ *  whichever way they were given.
  */
-static void poly_classify_vertices_in_range(_AL_LIST_ITEM* begin, _AL_LIST_ITEM* end, _AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear)
+static void poly_add_ring(POLY* polygon, const float* vertices, size_t vertex_stride,
+   int first, int count, bool is_hole)
 {
-   _AL_LIST_ITEM* item = NULL;
-   int attribute_mask = 0;
-
-   if (NULL != ear)
-      attribute_mask |= POLY_VERTEX_ATTR_EAR_CLIP;
-
-   if (NULL != reflex)
-      attribute_mask |= POLY_VERTEX_ATTR_REFLEX;
+   const int begin = polygon->vertex_count;
+   double area = 0;
+   int size;
+   int i;
 
-   for (item = begin; item != end; item = _al_list_next(vertices, item))
-   {
-      int attr = poly_compute_vertex_attributes(vertices, item, attribute_mask, NULL);
+   for (i = first; i < first + count; i++) {
+      const float* p = (const float*)((const char*)vertices + i * vertex_stride);
+      POLY_VERTEX* v = POLY_V(polygon->vertex_count);
 
-      if (0 == attr)
+      if (polygon->vertex_count > begin && p[0] == v[-1].x && p[1] == v[-1].y)
          continue;
-
-      if (attr & POLY_VERTEX_ATTR_EAR_CLIP)
-         _al_list_push_back(ear, item);
-
-      if (attr & POLY_VERTEX_ATTR_REFLEX)
-         _al_list_push_back(reflex, item);
+      v->x = p[0];
+      v->y = p[1];
+      v->index = i;
+      polygon->vertex_count++;
    }
-}
-
-
-/*
- *  Reclassify vertex. After triangle was emitted one vertex
- *  is removed from the list. Two neighbor vertices may
- *  change their attributes. In this place we have general
- *  function which update lists to match new attributes
- *  of provided vertex.
- */
-static void poly_update_vertex_attributes(_AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear, _AL_LIST_ITEM* vertex)
-{
-   _AL_LIST_ITEM* item;
-
-   int attr = poly_compute_vertex_attributes(vertices, vertex, POLY_VERTEX_ATTR_ALL, reflex);
 
-   // Update reflex list only if an attribute change.
-   item = _al_list_find_first(reflex, vertex);
-   if (attr & POLY_VERTEX_ATTR_REFLEX) {
-
-      if (NULL == item)
-         _al_list_push_back(reflex, vertex);
-
-      _al_list_remove(ear, vertex);
+   while (polygon->vertex_count - begin > 1 &&
+         POLY_V(polygon->vertex_count - 1)->x == POLY_V(begin)->x &&
+         POLY_V(polygon->vertex_count - 1)->y == POLY_V(begin)->y) {
+      polygon->vertex_count--;
    }
-   else {
 
-      if (NULL != item)
-         _al_list_erase(reflex, item);
+   size = polygon->vertex_count - begin;
+   if (size < 3) {
+      polygon->vertex_count = begin;
+      return;
+   }
 
-      item = _al_list_find_first(ear, vertex);
-      if (attr & POLY_VERTEX_ATTR_EAR_CLIP) {
+   for (i = 0; i < size; i++) {
+      const POLY_VERTEX* a = POLY_V(begin + i);
+      const POLY_VERTEX* b = POLY_V(begin + (i + 1) % size);
+      area += (double)a->x * b->y - (double)b->x * a->y;
+   }
 
-         if (NULL == item)
-            _al_list_push_front(ear, vertex);
-      }
-      else {
+   for (i = 0; i < size; i++) {
+      int next = begin + (i + 1) % size;
+      int prev = begin + (i + size - 1) % size;
 
-         if (NULL != item)
-            _al_list_erase(ear, item);
+      if ((area < 0) != is_hole) {
+         int t = next;
+         next = prev;
+         prev = t;
       }
+      POLY_V(begin + i)->next = next;
+      POLY_V(begin + i)->prev = prev;
    }
 }
 
 
-/*
- *  Triangulator iterate trough list of ear vertices
- *  and clip isolated triangles. This process repeats
- *  until there are ear vertices.
- */
-static void poly_do_triangulate(POLY* polygon)
+static void poly_classify_vertices(POLY* polygon)
 {
-# define VERTEX_INDEX(vertex) ((((uint8_t*)vertex) - ((uint8_t*)polygon->vertex_buffer)) / polygon->vertex_stride)
-
-# if POLY_DEBUG
-   g_poly_debug_step_current = 0;
-
-   {
-      _AL_LIST_ITEM* item;
-      _AL_LIST_ITEM* next;
-      int* histogram = al_calloc(_al_list_size(polygon->vertex_list), sizeof(int));
-
-      /*std::map<float*, int> histogram;*/
-
-      int index = 0;
-      for (item = _al_list_front(polygon->vertex_list); item; item = _al_list_next(polygon->vertex_list, item)) {
-
-         float* point0;
-         float* point1;
-         float n[2];
-         float l, r;
-         char status[3] = { 0 };
-         int status_index = 0;
-
-         next = _al_list_next_circular(polygon->vertex_list, item);
-
-         point0 = (float*)_al_list_item_data(item);
-         point1 = (float*)_al_list_item_data(next);
-
-         n[0] = -(point1[1] - point0[1]);
-         n[1] =   point1[0] - point0[0];
-
-         l = 2.0f * sqrtf(n[0] * n[0] + n[1] * n[1]);
-
-         n[0] /= l;
-         n[1] /= l;
-
-         r = 1.0f * 0.0f;
-
-         al_draw_line(point0[0] + n[0] * r, point0[1] + n[1] * r, point1[0] + n[0] * r, point1[1] + n[1] * r, al_map_rgba(255, 0, 255, 128), r * g_poly_debug_scale);
-
-         if (_al_list_contains(polygon->reflex_list, item))
-            status[status_index++] = 'R';
-         if (_al_list_contains(polygon->ear_list, item))
-            status[status_index++] = 'E';
-
-         POLY_DEBUG_TEXT_LINE(point0[0], point0[1], -histogram[VERTEX_INDEX(point0)], "%s %d", status, index++);
+   int i;
 
-         ++histogram[VERTEX_INDEX(point0)];
-      }
+   for (i = 0; i < polygon->vertex_count; i++) {
+      POLY_VERTEX* v = POLY_V(i);
+      const POLY_VERTEX* prev = POLY_V(v->prev);
+      const POLY_VERTEX* next = POLY_V(v->next);
 
-      al_free(histogram);
+      if (poly_is_below(prev, v) && poly_is_below(next, v))
+         v->type = poly_is_convex(next, prev, v) ? POLY_VERTEX_START : POLY_VERTEX_SPLIT;
+      else if (poly_is_below(v, prev) && poly_is_below(v, next))
+         v->type = poly_is_convex(next, prev, v) ? POLY_VERTEX_END : POLY_VERTEX_MERGE;
+      else
+         v->type = POLY_VERTEX_REGULAR;
    }
-# endif
-
-   // Repeat until there are ear clips.
-   while (!_al_list_is_empty(polygon->ear_list)) {
-
-      _AL_LIST_ITEM* ear_item;
-      _AL_LIST_ITEM* vertex_item;
-      _AL_LIST_ITEM* next;
-      _AL_LIST_ITEM* prev;
-      float* v0;
-      float* v1;
-      float* v2;
-
-      // Get point and corresponding item on polygon->vertex_list list.
-      ear_item    = _al_list_front(polygon->ear_list);
-      vertex_item = (_AL_LIST_ITEM*)_al_list_item_data(ear_item);
-      prev        = _al_list_previous_circular(polygon->vertex_list, vertex_item);
-      next        = _al_list_next_circular(polygon->vertex_list,     vertex_item);
-      v0 = (float*)_al_list_item_data(prev);
-      v1 = (float*)_al_list_item_data(vertex_item);
-      v2 = (float*)_al_list_item_data(next);
-
-# if POLY_DEBUG
-      if (g_poly_debug_step == g_poly_debug_step_current) {
-         _AL_LIST_ITEM* item;
-         ALLEGRO_COLOR color;
-         int second = 0;
-
-         al_draw_filled_triangle(v0[0], v0[1], v1[0], v1[1], v2[0], v2[1], al_map_rgba(0, 0, 255, 64));
-
-         for (item = _al_list_front(polygon->vertex_list); item; item = _al_list_next(polygon->vertex_list, item)) {
-
-            float* point = (float*)_al_list_item_data(item);
-            al_draw_filled_circle(point[0], point[1], 6.0f * g_poly_debug_scale, al_map_rgb(255, 255, 255));
-         }
-
-         for (item = _al_list_front(polygon->reflex_list); item; item = _al_list_next(polygon->reflex_list, item)) {
+}
 
-            float* point = (float*)_al_list_item_data((_AL_LIST_ITEM*)_al_list_item_data(item));
 
-            al_draw_filled_circle(point[0], point[1], 6.0f * g_poly_debug_scale, al_map_rgb(255, 255, 0));
-         }
+/*
+ *  Triangulate each of the monotone pieces, found by following the vertices
+ *  until they come back to where they started.
+ */
+static void poly_triangulate_pieces(POLY* polygon, int* scratch, signed char* side)
+{
+   int* piece = scratch;
+   int* sorted = scratch + polygon->vertex_count;
+   int* stack = scratch + 2 * polygon->vertex_count;
+   int i;
 
-         color = al_map_rgb(255, 0, 0);
-         second = _al_list_size(polygon->ear_list) - 1;
-         for (item = _al_list_back(polygon->ear_list); item; item = _al_list_previous(polygon->ear_list, item), --second) {
+   /* Visited vertices are marked by their type. */
+   for (i = 0; i < polygon->vertex_count; i++) {
+      int count = 0;
+      int v = i;
 
-            float* point = (float*)_al_list_item_data((_AL_LIST_ITEM*)_al_list_item_data(item));
+      if (POLY_V(i)->type < 0)
+         continue;
 
-            if (second == 0)
-               color = al_map_rgb(0, 255, 0);
-            else if (second == 1)
-               color = al_map_rgb(0, 0, 255);
+      do {
+         POLY_V(v)->type = -1;
+         piece[count++] = v;
+         v = POLY_V(v)->next;
+      } while (v != i);
 
-            al_draw_circle(point[0], point[1], 9.0f * g_poly_debug_scale, color, 2.0f * g_poly_debug_scale);
-         }
-      }
-      if (g_poly_debug_step >= 0 && g_poly_debug_step_current >= g_poly_debug_step)
-         break;
-      g_poly_debug_step_current++;
-# endif
-
-      // Emit triangle.
-      polygon->emit(VERTEX_INDEX(v0), VERTEX_INDEX(v1), VERTEX_INDEX(v2), polygon->userdata);
-
-      // Remove polygon->ear_list clip from all lists.
-      _al_list_erase(polygon->ear_list,      ear_item);
-      _al_list_erase(polygon->vertex_list, vertex_item);
-      _al_list_erase(polygon->reflex_list, _al_list_find_first(polygon->reflex_list, vertex_item));
-
-      // Update attributes of corner vertices.
-      poly_update_vertex_attributes(polygon->vertex_list, polygon->reflex_list, polygon->ear_list, prev);
-      poly_update_vertex_attributes(polygon->vertex_list, polygon->reflex_list, polygon->ear_list, next);
+      if (count >= 3)
+         poly_triangulate_monotone(polygon, piece, count, sorted, side, stack);
    }
-
-# undef VERTEX_INDEX
 }
 
+# undef POLY_E
+# undef POLY_V
+
 
 /* Function: al_triangulate_polygon
  *  General triangulation function.
@@ -817,53 +606,74 @@ bool al_triangulate_polygon(
    void (*emit_triangle)(int, int, int, void*), void* userdata)
 {
    POLY polygon;
-   int vertex_count;
-   int split_count;
-   int *splits;
+   POLY_VERTEX** order = NULL;
+   int* scratch = NULL;
+   signed char* side = NULL;
+   int total;
+   int max_vertices;
+   int first;
+   int count;
    int i;
-   bool ret;
+   bool ret = false;
 
-   for (i = 0; vertex_counts[i] > 0; i++) {
-      /* do nothing */
-   }
-   ASSERT(i > 0);
-   split_count = i;
+   ASSERT(vertex_counts[0] > 0);
 
-   splits = malloc(split_count * sizeof(int));
-   if (!splits) {
-      return false;
-   }
-   vertex_count = 0;
-   for (i = 0; i < split_count; i++) {
-      vertex_count += vertex_counts[i];
-      splits[i] = vertex_count;
-   }
+   total = 0;
+   for (i = 0; vertex_counts[i] > 0; i++)
+      total += vertex_counts[i];
 
-   memset(&polygon, 0, sizeof(polygon));
-   polygon.vertex_buffer = vertices;
-   polygon.vertex_stride = vertex_stride;
-   polygon.vertex_count  = vertex_count;
-   polygon.split_indices = splits;
-   polygon.split_stride  = sizeof(int);   /* XXX can simplify code now */
-   polygon.split_count   = split_count;
-   polygon.emit          = emit_triangle;
-   polygon.userdata      = userdata;
+   /* Every diagonal adds two vertices, and there are fewer diagonals than
+    * original vertices.
+    */
+   max_vertices = 3 * total;
 
-   if (poly_initialize(&polygon)) {
+   memset(&polygon, 0, sizeof(polygon));
+   polygon.vertices = al_malloc(max_vertices * sizeof(POLY_VERTEX));
+   polygon.edges    = al_malloc(max_vertices * sizeof(POLY_EDGE));
+   polygon.helpers  = al_malloc(max_vertices * sizeof(int));
+   polygon.root     = -1;
+   polygon.emit     = emit_triangle;
+   polygon.userdata = userdata;
+   order   = al_malloc(total * sizeof(POLY_VERTEX*));
+   scratch = al_malloc(3 * max_vertices * sizeof(int));
+   side    = al_malloc(max_vertices);
+
+   if (!polygon.vertices || !polygon.edges || !polygon.helpers || !order ||
+         !scratch || !side)
+      goto done;
+
+   first = 0;
+   for (i = 0; vertex_counts[i] > 0; i++) {
+      poly_add_ring(&polygon, vertices, vertex_stride, first, vertex_counts[i], i > 0);
+      first += vertex_counts[i];
 
-      poly_do_triangulate(&polygon);
+      /* Nothing to draw if the outline is degenerate. */
+      if (i == 0 && polygon.vertex_count == 0) {
+         ret = true;
+         goto done;
+      }
+   }
 
-      _al_list_destroy(polygon.vertex_list);
-      _al_list_destroy(polygon.reflex_list);
-      _al_list_destroy(polygon.ear_list);
+   count = polygon.vertex_count;
+   for (i = 0; i < count; i++) {
+      polygon.edges[i].in_tree = false;
+      order[i] = &polygon.vertices[i];
+   }
+   qsort(order, count, sizeof(POLY_VERTEX*), poly_compare_vertices);
+   poly_classify_vertices(&polygon);
 
+   if (poly_partition(&polygon, order, count)) {
+      poly_triangulate_pieces(&polygon, scratch, side);
       ret = true;
    }
-   else {
-      ret = false;
-   }
 
-   free(splits);
+done:
+   al_free(polygon.vertices);
+   al_free(polygon.edges);
+   al_free(polygon.helpers);
+   al_free(order);
+   al_free(scratch);
+   al_free(side);
 
    return ret;
 }
@@ -5,6 +5,7 @@
 #include "allegro5/allegro_opengl.h"
 #endif
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_vector.h"
 
 #include "allegro5/allegro_ttf.h"
@@ -18,6 +19,7 @@
 #include FT_FREETYPE_H
 #include FT_TRUETYPE_TABLES_H
 
+#include <math.h>
 #include <stdlib.h>
 
 ALLEGRO_DEBUG_CHANNEL("font")
@@ -38,6 +40,15 @@ ALLEGRO_DEBUG_CHANNEL("font")
 
 #define RANGE_SIZE   128
 
+/* Codepoints are mapped to FreeType glyph indices through pages of this
+ * many entries. The first page is kept in the font data itself, so Latin-1
+ * text never needs more than an array lookup.
+ */
+#define CHAR_PAGE_BITS   8
+#define CHAR_PAGE_SIZE   (1 << CHAR_PAGE_BITS)
+#define MAX_CODEPOINT    0x10FFFF
+#define NUM_CHAR_PAGES   ((MAX_CODEPOINT >> CHAR_PAGE_BITS) + 1)
+
 
 typedef struct REGION
 {
@@ -55,28 +66,145 @@ typedef struct ALLEGRO_TTF_GLYPH_DATA
    short offset_x;
    short offset_y;
    short advance;
+   unsigned short page;    /* index into page_bitmaps if page_bitmap is set */
+   short padding;          /* distance field spread stored around the glyph */
+   bool queued;            /* waiting for the prewarming thread */
 } ALLEGRO_TTF_GLYPH_DATA;
 
 
-typedef struct ALLEGRO_TTF_GLYPH_RANGE
+/* A glyph rendered by FreeType, see rasterize_glyph. */
+typedef struct ALLEGRO_TTF_RASTER
+{
+   int ft_index;
+   bool ok;
+   int offset_x;
+   int offset_y;
+   int advance;
+   FT_Bitmap bitmap;
+} ALLEGRO_TTF_RASTER;
+
+
+/* Glyphs can be rendered ahead of time on a thread with its own FreeType
+ * face. The results wait in CPU memory until they are copied into the
+ * pages on the thread drawing the text.
+ */
+typedef struct ALLEGRO_TTF_PREWARM
+{
+   ALLEGRO_THREAD *thread;
+   ALLEGRO_MUTEX *mutex;
+   ALLEGRO_COND *cond;
+   FT_Library library;
+   FT_Face face;
+   unsigned char *file_data;
+
+   /* Protected by the mutex. */
+   _AL_VECTOR pending;       /* of int, FreeType glyph indices */
+   unsigned int pending_pos;
+   _AL_VECTOR ready;         /* of ALLEGRO_TTF_RASTER, owning the buffers */
+   bool busy;
+} ALLEGRO_TTF_PREWARM;
+
+
+/* The free space on a page is tracked as a skyline: the top edge of the
+ * glyphs packed so far, stored as horizontal segments from left to right.
+ */
+typedef struct SKYLINE_NODE
+{
+   int x;
+   int y;
+   int w;
+} SKYLINE_NODE;
+
+
+typedef struct ALLEGRO_TTF_PAGE
 {
-   int32_t range_start;
-   ALLEGRO_TTF_GLYPH_DATA *glyphs;  /* [RANGE_SIZE] */
-} ALLEGRO_TTF_GLYPH_RANGE;
+   ALLEGRO_BITMAP *bitmap;
+   _AL_VECTOR skyline;       /* of SKYLINE_NODE */
+   unsigned int last_used;
+   bool pinned;              /* holds glyphs cached when the font was loaded */
+} ALLEGRO_TTF_PAGE;
+
+
+/* A glyph waiting to be drawn, see flush_glyph_batch. */
+typedef struct ALLEGRO_TTF_BATCH_QUAD
+{
+   ALLEGRO_BITMAP *bitmap;
+   _AL_BITMAP_QUAD quad;
+} ALLEGRO_TTF_BATCH_QUAD;
+
+
+/* A glyph of a laid out string, as drawn by render_glyph. */
+typedef struct ALLEGRO_TTF_LAYOUT_GLYPH
+{
+   ALLEGRO_BITMAP *bitmap;
+   int page;
+   int sx, sy, sw, sh;       /* the region, with 1 pixel of the border */
+   int dx, dy;               /* relative to the start of the string */
+} ALLEGRO_TTF_LAYOUT_GLYPH;
+
+
+/* A string whose glyphs have all been looked up and cached, so that it can
+ * be drawn again without going through FreeType. It stays valid until a
+ * page is recycled.
+ */
+typedef struct ALLEGRO_TTF_LAYOUT
+{
+   uint32_t hash;
+   ALLEGRO_USTR *text;
+   unsigned int generation;  /* page_generation when it was laid out */
+   unsigned int last_used;
+   ALLEGRO_FONT *fallback;   /* the fallback font when it was laid out */
+   bool uses_fallback;       /* if set, the string is always drawn as usual */
+   int advance;              /* as returned by ttf_render */
+   int length;               /* as returned by ttf_text_length */
+   _AL_VECTOR glyphs;        /* of ALLEGRO_TTF_LAYOUT_GLYPH */
+} ALLEGRO_TTF_LAYOUT;
 
 
 typedef struct ALLEGRO_TTF_FONT_DATA
 {
    FT_Face face;
    int flags;
-   _AL_VECTOR glyph_ranges;  /* sorted array of of ALLEGRO_TTF_GLYPH_RANGE */
+   /* The glyphs are stored in ranges of RANGE_SIZE by FreeType index. A
+    * range is allocated the first time one of its glyphs is used.
+    */
+   ALLEGRO_TTF_GLYPH_DATA **glyph_ranges;
+   int num_glyph_ranges;
+
+   /* The FreeType index of each codepoint plus one, or zero if it hasn't
+    * been looked up yet. Pages after the first are allocated on use.
+    */
+   int latin_char_index[CHAR_PAGE_SIZE];
+   int **char_pages;         /* [NUM_CHAR_PAGES] */
 
-   _AL_VECTOR page_bitmaps;  /* of ALLEGRO_BITMAP pointers */
-   int page_pos_x;
-   int page_pos_y;
-   int page_line_height;
+   _AL_VECTOR page_bitmaps;  /* of ALLEGRO_TTF_PAGE */
+   int current_page;         /* the page new glyphs go to, or -1 */
+   ALLEGRO_BITMAP *page_locked;
    ALLEGRO_LOCKED_REGION *page_lr;
 
+   /* Once the pages would take more than max_cache_size bytes, the least
+    * recently used page is recycled rather than a new one created.
+    */
+   size_t cache_size;
+   size_t max_cache_size;
+   unsigned int lru_clock;
+
+   /* Incremented whenever glyphs move, which invalidates all layouts. */
+   unsigned int page_generation;
+
+   /* The glyphs of a string are collected here and then drawn page by
+    * page.
+    */
+   ALLEGRO_TTF_BATCH_QUAD *batch;
+   _AL_BITMAP_QUAD *batch_quads;
+   int batch_size;
+   int batch_capacity;
+   ALLEGRO_COLOR batch_color;
+
+   _AL_VECTOR layouts;       /* sorted by hash, of ALLEGRO_TTF_LAYOUT */
+   int max_layouts;
+   unsigned int layout_clock;
+
    FT_StreamRec stream;
    ALLEGRO_FILE *file;
    unsigned long base_offset;
@@ -89,6 +217,20 @@ typedef struct ALLEGRO_TTF_FONT_DATA
    int max_page_size;
 
    bool skip_cache_misses;
+
+   int size_w;
+   int size_h;
+   ALLEGRO_TTF_PREWARM *prewarm;
+
+   /* With ALLEGRO_TTF_SDF, how many pixels of distance are stored around
+    * each glyph. Zero for a normal font.
+    */
+   int sdf_spread;
+
+   /* The rest of the chain made by al_load_ttf_font_chain, which is
+    * destroyed with this font.
+    */
+   ALLEGRO_FONT *owned_fallback;
 } ALLEGRO_TTF_FONT_DATA;
 
 
@@ -108,73 +250,376 @@ static INLINE int align4(int x)
 }
 
 
+static int lookup_char_index(ALLEGRO_TTF_FONT_DATA *data, int32_t ch)
+{
+   int *page;
+   int i = ch & (CHAR_PAGE_SIZE - 1);
+
+   if (ch < 0 || ch > MAX_CODEPOINT)
+      return FT_Get_Char_Index(data->face, ch);
+
+   if (!data->char_pages) {
+      data->char_pages = al_calloc(NUM_CHAR_PAGES, sizeof(int *));
+      if (!data->char_pages)
+         return FT_Get_Char_Index(data->face, ch);
+   }
+   page = data->char_pages[ch >> CHAR_PAGE_BITS];
+   if (!page) {
+      page = al_calloc(CHAR_PAGE_SIZE, sizeof(int));
+      if (!page)
+         return FT_Get_Char_Index(data->face, ch);
+      data->char_pages[ch >> CHAR_PAGE_BITS] = page;
+   }
+
+   if (page[i] == 0)
+      page[i] = FT_Get_Char_Index(data->face, ch) + 1;
+   return page[i] - 1;
+}
+
+
+/* Like FT_Get_Char_Index, but remembers the result. */
+static INLINE int get_char_index(ALLEGRO_TTF_FONT_DATA *data, int32_t ch)
+{
+   if (ch >= 0 && ch < CHAR_PAGE_SIZE) {
+      int *index = &data->latin_char_index[ch];
+      if (*index == 0)
+         *index = FT_Get_Char_Index(data->face, ch) + 1;
+      return *index - 1;
+   }
+   return lookup_char_index(data, ch);
+}
+
+
 /* Returns false if the glyph is invalid.
  */
 static bool get_glyph(ALLEGRO_TTF_FONT_DATA *data,
    int ft_index, ALLEGRO_TTF_GLYPH_DATA **glyph)
 {
-   ALLEGRO_TTF_GLYPH_RANGE *range;
-   int32_t range_start;
-   int lo, hi, mid;
+   ALLEGRO_TTF_GLYPH_DATA **range;
    ASSERT(glyph);
+   ASSERT(ft_index >= 0 && ft_index / RANGE_SIZE < data->num_glyph_ranges);
 
-   range_start = ft_index - (ft_index % RANGE_SIZE);
+   range = &data->glyph_ranges[ft_index / RANGE_SIZE];
+   if (!*range) {
+      *range = al_calloc(RANGE_SIZE, sizeof(ALLEGRO_TTF_GLYPH_DATA));
+   }
 
-   /* Binary search for the range. */
-   lo = 0;
-   hi = _al_vector_size(&data->glyph_ranges);
-   mid = (hi + lo)/2;
-   range = NULL;
+   *glyph = &(*range)[ft_index % RANGE_SIZE];
 
-   while (lo < hi) {
-      ALLEGRO_TTF_GLYPH_RANGE *r = _al_vector_ref(&data->glyph_ranges, mid);
-      if (r->range_start == range_start) {
-         range = r;
+   /* If we're skipping cache misses and it isn't already cached, return it as invalid. */
+   if (data->skip_cache_misses && !(*glyph)->page_bitmap && (*glyph)->region.x >= 0) {
+      return false;
+   }
+
+   return ft_index != 0;
+}
+
+
+static bool is_page_bitmap(ALLEGRO_TTF_FONT_DATA *data, ALLEGRO_BITMAP *bitmap)
+{
+   int i;
+
+   for (i = 0; i < (int)_al_vector_size(&data->page_bitmaps); i++) {
+      ALLEGRO_TTF_PAGE *page = _al_vector_ref(&data->page_bitmaps, i);
+      if (page->bitmap == bitmap)
+         return true;
+   }
+
+   return false;
+}
+
+
+static void batch_glyph(ALLEGRO_TTF_FONT_DATA *data, ALLEGRO_BITMAP *bitmap,
+   float sx, float sy, float sw, float sh, float dx, float dy)
+{
+   ALLEGRO_TTF_BATCH_QUAD *b;
+
+   if (data->batch_size == data->batch_capacity) {
+      int capacity = data->batch_capacity ? data->batch_capacity * 2 : 64;
+      ALLEGRO_TTF_BATCH_QUAD *batch;
+      _AL_BITMAP_QUAD *quads;
+
+      batch = al_realloc(data->batch, capacity * sizeof *batch);
+      if (batch)
+         data->batch = batch;
+      quads = al_realloc(data->batch_quads, capacity * sizeof *quads);
+      if (quads)
+         data->batch_quads = quads;
+      if (!batch || !quads) {
+         al_draw_tinted_bitmap_region(bitmap, data->batch_color,
+            sx, sy, sw, sh, dx, dy, 0);
+         return;
+      }
+      data->batch_capacity = capacity;
+   }
+
+   b = &data->batch[data->batch_size++];
+   b->bitmap = bitmap;
+   b->quad.sx = sx;
+   b->quad.sy = sy;
+   b->quad.sw = sw;
+   b->quad.sh = sh;
+   b->quad.dx = dx;
+   b->quad.dy = dy;
+}
+
+
+/* Draw the collected glyphs with one call per page. */
+static void flush_glyph_batch(ALLEGRO_TTF_FONT_DATA *data)
+{
+   int i, j;
+
+   for (i = 0; i < data->batch_size; i++) {
+      ALLEGRO_BITMAP *bitmap = data->batch[i].bitmap;
+      int n = 0;
+
+      if (!bitmap)
+         continue;
+
+      for (j = i; j < data->batch_size; j++) {
+         if (data->batch[j].bitmap == bitmap) {
+            data->batch_quads[n++] = data->batch[j].quad;
+            data->batch[j].bitmap = NULL;
+         }
+      }
+      _al_draw_tinted_bitmap_quads(bitmap, data->batch_color,
+         data->batch_quads, n);
+   }
+
+   data->batch_size = 0;
+}
+
+
+static void unlock_current_page(ALLEGRO_TTF_FONT_DATA *data)
+{
+   if (data->page_lr) {
+      ASSERT(al_is_bitmap_locked(data->page_locked));
+      al_unlock_bitmap(data->page_locked);
+      ALLEGRO_DEBUG("Unlocking page: %p\n", data->page_locked);
+      data->page_lr = NULL;
+      data->page_locked = NULL;
+   }
+}
+
+
+static void skyline_reset(ALLEGRO_TTF_PAGE *page)
+{
+   SKYLINE_NODE *node;
+
+   _al_vector_free(&page->skyline);
+   node = _al_vector_alloc_back(&page->skyline);
+   node->x = 0;
+   node->y = 0;
+   node->w = al_get_bitmap_width(page->bitmap);
+}
+
+
+/* Find the lowest position a w x h rectangle fits at, preferring the
+ * narrowest node on ties. Returns the index of the node the rectangle's
+ * left edge would rest on, or -1 if it doesn't fit on the page.
+ */
+static int skyline_find(ALLEGRO_TTF_PAGE *page, int w, int h, int *x, int *y)
+{
+   int page_w = al_get_bitmap_width(page->bitmap);
+   int page_h = al_get_bitmap_height(page->bitmap);
+   int n = _al_vector_size(&page->skyline);
+   int best = -1;
+   int best_y = page_h;
+   int best_w = page_w + 1;
+   int i, j;
+
+   for (i = 0; i < n; i++) {
+      SKYLINE_NODE *node = _al_vector_ref(&page->skyline, i);
+      int top = 0;
+      int width_left = w;
+
+      if (node->x + w > page_w)
          break;
+
+      /* The nodes cover the whole page width, so this stays in range. */
+      for (j = i; width_left > 0; j++) {
+         SKYLINE_NODE *other = _al_vector_ref(&page->skyline, j);
+         if (other->y > top)
+            top = other->y;
+         width_left -= other->w;
       }
-      else if (r->range_start < range_start) {
-         lo = mid + 1;
+
+      if (top + h > page_h)
+         continue;
+
+      if (top < best_y || (top == best_y && node->w < best_w)) {
+         best = i;
+         best_y = top;
+         best_w = node->w;
       }
-      else {
-         hi = mid;
+   }
+
+   if (best >= 0) {
+      SKYLINE_NODE *node = _al_vector_ref(&page->skyline, best);
+      *x = node->x;
+      *y = best_y;
+   }
+
+   return best;
+}
+
+
+static void skyline_add(ALLEGRO_TTF_PAGE *page, int index,
+   int x, int y, int w, int h)
+{
+   SKYLINE_NODE *node = _al_vector_alloc_mid(&page->skyline, index);
+   unsigned int i;
+
+   node->x = x;
+   node->y = y + h;
+   node->w = w;
+
+   /* Cut away the parts of the following nodes now under the new one. */
+   i = index + 1;
+   while (i < _al_vector_size(&page->skyline)) {
+      SKYLINE_NODE *prev = _al_vector_ref(&page->skyline, i - 1);
+      SKYLINE_NODE *cur = _al_vector_ref(&page->skyline, i);
+      int overlap = prev->x + prev->w - cur->x;
+
+      if (overlap <= 0)
+         break;
+      if (overlap < cur->w) {
+         cur->x += overlap;
+         cur->w -= overlap;
+         break;
       }
-      mid = (hi + lo)/2;
+      _al_vector_delete_at(&page->skyline, i);
    }
 
-   if (!range) {
-      range = _al_vector_alloc_mid(&data->glyph_ranges, mid);
-      range->range_start = range_start;
-      range->glyphs = al_calloc(RANGE_SIZE, sizeof(ALLEGRO_TTF_GLYPH_DATA));
+   /* Merge neighbours at the same height. */
+   i = 0;
+   while (i + 1 < _al_vector_size(&page->skyline)) {
+      SKYLINE_NODE *a = _al_vector_ref(&page->skyline, i);
+      SKYLINE_NODE *b = _al_vector_ref(&page->skyline, i + 1);
+      if (a->y == b->y) {
+         a->w += b->w;
+         _al_vector_delete_at(&page->skyline, i + 1);
+      }
+      else {
+         i++;
+      }
    }
+}
 
-   *glyph = &range->glyphs[ft_index - range_start];
 
-   /* If we're skipping cache misses and it isn't already cached, return it as invalid. */
-   if (data->skip_cache_misses && !(*glyph)->page_bitmap && (*glyph)->region.x >= 0) {
-      return false;
+static void touch_page(ALLEGRO_TTF_FONT_DATA *data, int index)
+{
+   ALLEGRO_TTF_PAGE *page = _al_vector_ref(&data->page_bitmaps, index);
+   page->last_used = ++data->lru_clock;
+}
+
+
+static ALLEGRO_BITMAP *create_page_bitmap(ALLEGRO_TTF_FONT_DATA *data,
+   int page_size)
+{
+   ALLEGRO_BITMAP *bitmap;
+   ALLEGRO_STATE state;
+
+   /* The bitmap will be destroyed when the parent font is destroyed so
+    * it is not safe to register a destructor for it.
+    */
+   _al_push_destructor_owner();
+   al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+   al_set_new_bitmap_format(data->bitmap_format);
+   al_set_new_bitmap_flags(data->bitmap_flags);
+   bitmap = al_create_bitmap(page_size, page_size);
+   al_restore_state(&state);
+   _al_pop_destructor_owner();
+
+   if (bitmap)
+      data->cache_size += (size_t)page_size * page_size * 4;
+
+   return bitmap;
+}
+
+
+static void destroy_page_bitmap(ALLEGRO_TTF_FONT_DATA *data,
+   ALLEGRO_BITMAP *bitmap)
+{
+   int w = al_get_bitmap_width(bitmap);
+   int h = al_get_bitmap_height(bitmap);
+
+   data->cache_size -= (size_t)w * h * 4;
+   al_destroy_bitmap(bitmap);
+}
+
+
+static int find_lru_page(ALLEGRO_TTF_FONT_DATA *data)
+{
+   unsigned int oldest = 0;
+   int lru = -1;
+   int i;
+
+   for (i = 0; i < (int)_al_vector_size(&data->page_bitmaps); i++) {
+      ALLEGRO_TTF_PAGE *page = _al_vector_ref(&data->page_bitmaps, i);
+      /* Unsigned difference, so the clock may wrap around. */
+      unsigned int age = data->lru_clock - page->last_used;
+      if (!page->pinned && (lru < 0 || age > oldest)) {
+         lru = i;
+         oldest = age;
+      }
    }
 
-   return ft_index != 0;
+   return lru;
 }
 
 
-static void unlock_current_page(ALLEGRO_TTF_FONT_DATA *data)
+/* Forget every glyph on a page, so that they are rendered again when next
+ * used, and make the page empty.
+ */
+static ALLEGRO_TTF_PAGE *recycle_page(ALLEGRO_TTF_FONT_DATA *data, int index,
+   int page_size)
 {
-   if (data->page_lr) {
-      ALLEGRO_BITMAP **back = _al_vector_ref_back(&data->page_bitmaps);
-      ASSERT(al_is_bitmap_locked(*back));
-      al_unlock_bitmap(*back);
-      data->page_lr = NULL;
-      ALLEGRO_DEBUG("Unlocking page: %p\n", *back);
+   ALLEGRO_TTF_PAGE *page = _al_vector_ref(&data->page_bitmaps, index);
+   int i, j;
+
+   ALLEGRO_DEBUG("Recycling page %d: %p\n", index, page->bitmap);
+
+   /* Glyphs from this page may still be waiting to be drawn. */
+   flush_glyph_batch(data);
+   if (al_is_bitmap_drawing_held()) {
+      al_hold_bitmap_drawing(false);
+      al_hold_bitmap_drawing(true);
+   }
+
+   for (i = 0; i < data->num_glyph_ranges; i++) {
+      ALLEGRO_TTF_GLYPH_DATA *range = data->glyph_ranges[i];
+      if (!range)
+         continue;
+      for (j = 0; j < RANGE_SIZE; j++) {
+         ALLEGRO_TTF_GLYPH_DATA *glyph = &range[j];
+         if (glyph->page_bitmap && glyph->page == index)
+            memset(glyph, 0, sizeof(*glyph));
+      }
+   }
+
+   /* Replace the bitmap if it is too small for the new glyph. */
+   if (al_get_bitmap_width(page->bitmap) < page_size) {
+      ALLEGRO_BITMAP *bitmap = create_page_bitmap(data, page_size);
+      if (!bitmap)
+         return NULL;
+      destroy_page_bitmap(data, page->bitmap);
+      page->bitmap = bitmap;
    }
+
+   skyline_reset(page);
+   data->current_page = index;
+   data->page_generation++;
+   return page;
 }
 
 
-static ALLEGRO_BITMAP *push_new_page(ALLEGRO_TTF_FONT_DATA *data, int glyph_size)
+static ALLEGRO_TTF_PAGE *push_new_page(ALLEGRO_TTF_FONT_DATA *data,
+   int glyph_size, bool may_recycle)
 {
-    ALLEGRO_BITMAP **back;
-    ALLEGRO_BITMAP *page;
-    ALLEGRO_STATE state;
+    ALLEGRO_TTF_PAGE *page;
+    ALLEGRO_BITMAP *bitmap;
+    size_t page_bytes;
     int page_size = 1;
     /* 16 seems to work well. A particular problem are fixed width fonts which
      * take an inordinate amount of space. */
@@ -195,86 +640,86 @@ static ALLEGRO_BITMAP *push_new_page(ALLEGRO_TTF_FONT_DATA *data, int glyph_size
 
     unlock_current_page(data);
 
-    /* The bitmap will be destroyed when the parent font is destroyed so
-     * it is not safe to register a destructor for it.
-     */
-    _al_push_destructor_owner();
-    al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
-    al_set_new_bitmap_format(data->bitmap_format);
-    al_set_new_bitmap_flags(data->bitmap_flags);
-    page = al_create_bitmap(page_size, page_size);
-    al_restore_state(&state);
-    _al_pop_destructor_owner();
-
-    if (page) {
-       back = _al_vector_alloc_back(&data->page_bitmaps);
-       *back = page;
-
-       data->page_pos_x = 0;
-       data->page_pos_y = 0;
-       data->page_line_height = 0;
+    page_bytes = (size_t)page_size * page_size * 4;
+    if (may_recycle && data->max_cache_size > 0 &&
+          data->cache_size + page_bytes > data->max_cache_size) {
+       int lru = find_lru_page(data);
+       if (lru >= 0)
+          return recycle_page(data, lru, page_size);
     }
 
+    bitmap = create_page_bitmap(data, page_size);
+    if (!bitmap)
+       return NULL;
+
+    page = _al_vector_alloc_back(&data->page_bitmaps);
+    page->bitmap = bitmap;
+    page->pinned = false;
+    _al_vector_init(&page->skyline, sizeof(SKYLINE_NODE));
+    skyline_reset(page);
+    data->current_page = _al_vector_size(&data->page_bitmaps) - 1;
+
     return page;
 }
 
 
 static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
-   int ft_index, int w, int h, bool new, ALLEGRO_TTF_GLYPH_DATA *glyph,
+   int ft_index, int w, int h, ALLEGRO_TTF_GLYPH_DATA *glyph,
    bool lock_whole_page)
 {
-   ALLEGRO_BITMAP *page;
+   ALLEGRO_TTF_PAGE *page = NULL;
    int w4 = align4(w);
    int h4 = align4(h);
    int glyph_size = w4 > h4 ? w4 : h4;
+   int node = -1;
+   int x = 0, y = 0;
    bool lock = false;
 
-   if (_al_vector_is_empty(&data->page_bitmaps) || new) {
-      page = push_new_page(data, glyph_size);
+   if (data->current_page >= 0) {
+      page = _al_vector_ref(&data->page_bitmaps, data->current_page);
+      node = skyline_find(page, w4, h4, &x, &y);
+   }
+
+   if (node < 0) {
+      /* Glyphs cached while loading must all stay, as the whole page is
+       * locked and skip_cache_misses may rely on them.
+       */
+      page = push_new_page(data, glyph_size, !lock_whole_page);
       if (!page) {
          ALLEGRO_ERROR("Failed to create a new page for glyph %d.\n", ft_index);
          return NULL;
       }
-   }
-   else {
-      ALLEGRO_BITMAP **back = _al_vector_ref_back(&data->page_bitmaps);
-      page = *back;
+      node = skyline_find(page, w4, h4, &x, &y);
+      if (node < 0) {
+         ALLEGRO_ERROR("Glyph %d does not fit on a new page.\n", ft_index);
+         return NULL;
+      }
    }
 
-   ALLEGRO_DEBUG("Glyph %d: %dx%d (%dx%d)%s\n",
-      ft_index, w, h, w4, h4, new ? " new" : "");
+   ALLEGRO_DEBUG("Glyph %d: %dx%d (%dx%d) on page %d at %d,%d\n",
+      ft_index, w, h, w4, h4, data->current_page, x, y);
 
-   if (data->page_pos_x + w4 > al_get_bitmap_width(page)) {
-      data->page_pos_y += data->page_line_height;
-      data->page_pos_y = align4(data->page_pos_y);
-      data->page_pos_x = 0;
-      data->page_line_height = 0;
-   }
-
-   if (data->page_pos_y + h4 > al_get_bitmap_height(page)) {
-      return alloc_glyph_region(data, ft_index, w, h, true, glyph, lock_whole_page);
-   }
+   skyline_add(page, node, x, y, w4, h4);
+   touch_page(data, data->current_page);
 
-   glyph->page_bitmap = page;
-   glyph->region.x = data->page_pos_x;
-   glyph->region.y = data->page_pos_y;
+   glyph->page_bitmap = page->bitmap;
+   glyph->page = data->current_page;
+   glyph->region.x = x;
+   glyph->region.y = y;
    glyph->region.w = w;
    glyph->region.h = h;
 
-   data->page_pos_x = align4(data->page_pos_x + w4);
-   if (h > data->page_line_height) {
-      data->page_line_height = h4;
-   }
-
    REGION lock_rect;
    if (lock_whole_page) {
       lock_rect.x = 0;
       lock_rect.y = 0;
-      lock_rect.w = al_get_bitmap_width(page);
-      lock_rect.h = al_get_bitmap_height(page);
+      lock_rect.w = al_get_bitmap_width(page->bitmap);
+      lock_rect.h = al_get_bitmap_height(page->bitmap);
+      if (data->page_lr && data->page_locked != page->bitmap)
+         unlock_current_page(data);
       if (!data->page_lr) {
          lock = true;
-         ALLEGRO_DEBUG("Locking whole page: %p\n", page);
+         ALLEGRO_DEBUG("Locking whole page: %p\n", page->bitmap);
       }
    }
    else {
@@ -285,7 +730,7 @@ static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
       lock_rect.w = w4;
       lock_rect.h = h4;
       lock = true;
-      ALLEGRO_DEBUG("Locking glyph region: %p %d %d %d %d\n", page,
+      ALLEGRO_DEBUG("Locking glyph region: %p %d %d %d %d\n", page->bitmap,
          lock_rect.x, lock_rect.y, lock_rect.w, lock_rect.h);
    }
 
@@ -293,7 +738,7 @@ static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
       unsigned char *ptr;
       int i;
 
-      data->page_lr = al_lock_bitmap_region(page,
+      data->page_lr = al_lock_bitmap_region(page->bitmap,
          lock_rect.x, lock_rect.y, lock_rect.w, lock_rect.h,
          ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
 
@@ -301,6 +746,7 @@ static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
          ALLEGRO_ERROR("Failed to lock page.\n");
          return NULL;
       }
+      data->page_locked = page->bitmap;
 
       if (data->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA) {
          /* Fill in border with "transparent white"
@@ -340,19 +786,19 @@ static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
 }
 
 
-static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
-   unsigned char *glyph_data)
+static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data,
+   FT_Bitmap const *bitmap, unsigned char *glyph_data)
 {
    int pitch = font_data->page_lr->pitch;
    int x, y;
 
-   for (y = 0; y < (int)face->glyph->bitmap.rows; y++) {
-      unsigned char const *ptr = face->glyph->bitmap.buffer + face->glyph->bitmap.pitch * y;
+   for (y = 0; y < (int)bitmap->rows; y++) {
+      unsigned char const *ptr = bitmap->buffer + bitmap->pitch * y;
       unsigned char *dptr = glyph_data + pitch * y;
       int bit = 0;
 
-      if (face->glyph->bitmap.pixel_mode == FT_PIXEL_MODE_BGRA) {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+      if (bitmap->pixel_mode == FT_PIXEL_MODE_BGRA) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char set = ((ptr[3] >> (7-bit)) & 1) ? 255 : 0;
             *dptr++ = set;
             *dptr++ = set;
@@ -365,7 +811,7 @@ static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
          /* FIXME We could just set the alpha byte since the
           * region was cleared above when allocated
           */
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char set = ((*ptr >> (7-bit)) & 1) ? 255 : 0;
             *dptr++ = 255;
             *dptr++ = 255;
@@ -378,7 +824,7 @@ static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
          }
       }
       else {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char set = ((*ptr >> (7-bit)) & 1) ? 255 : 0;
             *dptr++ = set;
             *dptr++ = set;
@@ -394,18 +840,18 @@ static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
 }
 
 
-static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
-   unsigned char *glyph_data)
+static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data,
+   FT_Bitmap const *bitmap, unsigned char *glyph_data)
 {
    int pitch = font_data->page_lr->pitch;
    int x, y;
 
-   for (y = 0; y < (int)face->glyph->bitmap.rows; y++) {
-      unsigned char const *ptr = face->glyph->bitmap.buffer + face->glyph->bitmap.pitch * y;
+   for (y = 0; y < (int)bitmap->rows; y++) {
+      unsigned char const *ptr = bitmap->buffer + bitmap->pitch * y;
       unsigned char *dptr = glyph_data + pitch * y;
 
-      if (face->glyph->bitmap.pixel_mode == FT_PIXEL_MODE_BGRA) {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+      if (bitmap->pixel_mode == FT_PIXEL_MODE_BGRA) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             *dptr++ = ptr[2];
             *dptr++ = ptr[1];
             *dptr++ = ptr[0];
@@ -417,7 +863,7 @@ static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
          /* FIXME We could just set the alpha byte since the
           * region was cleared above when allocated
           */
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char c = *ptr;
             *dptr++ = 255;
             *dptr++ = 255;
@@ -427,7 +873,7 @@ static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
          }
       }
       else {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char c = *ptr;
             *dptr++ = c;
             *dptr++ = c;
@@ -440,26 +886,9 @@ static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
 }
 
 
-/* NOTE: this function may disable the bitmap hold drawing state
- * and leave the current page bitmap locked.
- *
- * NOTE: We have previously tried to be more clever about caching multiple
- * glyphs during incidental cache misses, but found that approach to be slower.
- */
-static void cache_glyph(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
-   int ft_index, ALLEGRO_TTF_GLYPH_DATA *glyph, bool lock_whole_page)
+static FT_Int32 get_load_flags(ALLEGRO_TTF_FONT_DATA const *data, FT_Face face)
 {
     FT_Int32 ft_load_flags;
-    FT_Error e;
-    int w, h;
-    unsigned char *glyph_data;
-
-    if (glyph->page_bitmap || glyph->region.x < 0)
-        return;
-
-    /* We shouldn't ever get here, as cache misses
-     * should have been set to ft_index = 0. */
-    ASSERT(!(font_data->skip_cache_misses && !lock_whole_page));
 
     // FIXME: make this a config setting? FT_LOAD_FORCE_AUTOHINT
 
@@ -476,22 +905,54 @@ static void cache_glyph(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
        ft_load_flags |= FT_LOAD_NO_BITMAP;
     }
 
-    if (font_data->flags & ALLEGRO_TTF_MONOCHROME)
+    if (data->flags & ALLEGRO_TTF_MONOCHROME)
        ft_load_flags |= FT_LOAD_TARGET_MONO;
-    if (font_data->flags & ALLEGRO_TTF_NO_AUTOHINT)
+    if (data->flags & ALLEGRO_TTF_NO_AUTOHINT)
        ft_load_flags |= FT_LOAD_NO_AUTOHINT;
 
-    e = FT_Load_Glyph(face, ft_index, ft_load_flags);
+    return ft_load_flags;
+}
+
+
+/* Render a glyph with FreeType. The bitmap stays in the face's glyph slot,
+ * so is only valid until the next glyph is loaded.
+ */
+static bool rasterize_glyph(ALLEGRO_TTF_FONT_DATA const *data, FT_Face face,
+   int ft_index, ALLEGRO_TTF_RASTER *raster)
+{
+    FT_Error e;
+
+    e = FT_Load_Glyph(face, ft_index, get_load_flags(data, face));
     if (e) {
        ALLEGRO_WARN("Failed loading glyph %d from.\n", ft_index);
     }
 
-    glyph->offset_x = face->glyph->bitmap_left;
-    glyph->offset_y = (face->size->metrics.ascender >> 6) - face->glyph->bitmap_top;
-    glyph->advance = face->glyph->advance.x >> 6;
+    raster->ft_index = ft_index;
+    raster->offset_x = face->glyph->bitmap_left;
+    raster->offset_y = (face->size->metrics.ascender >> 6) - face->glyph->bitmap_top;
+    raster->advance = face->glyph->advance.x >> 6;
+    raster->bitmap = face->glyph->bitmap;
+
+    return e == 0;
+}
+
+
+/* NOTE: this function may disable the bitmap hold drawing state
+ * and leave the current page bitmap locked.
+ */
+static void store_glyph_bitmap(ALLEGRO_TTF_FONT_DATA *font_data,
+   ALLEGRO_TTF_RASTER const *raster, ALLEGRO_TTF_GLYPH_DATA *glyph,
+   bool lock_whole_page)
+{
+    int w, h;
+    unsigned char *glyph_data;
+
+    glyph->offset_x = raster->offset_x;
+    glyph->offset_y = raster->offset_y;
+    glyph->advance = raster->advance;
 
-    w = face->glyph->bitmap.width;
-    h = face->glyph->bitmap.rows;
+    w = raster->bitmap.width;
+    h = raster->bitmap.rows;
 
     if (w == 0 || h == 0) {
        /* Mark this glyph so we won't try to cache it next time. */
@@ -501,30 +962,267 @@ static void cache_glyph(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
        /* Even though this glyph has no "region", include the 2-pixel border in the size */
        glyph->region.w = w + 4;
        glyph->region.h = h + 4;
-       ALLEGRO_DEBUG("Glyph %d has zero size. (pixel mode %d)\n", ft_index, face->glyph->bitmap.pixel_mode);
+       ALLEGRO_DEBUG("Glyph %d has zero size. (pixel mode %d)\n", raster->ft_index, raster->bitmap.pixel_mode);
        return;
     }
 
     /* Each glyph has a 2-pixel border all around. Note: The border is kept
      * even against the outer bitmap edge, to ensure consistent rendering.
      */
-    glyph_data = alloc_glyph_region(font_data, ft_index,
-       w + 4, h + 4, false, glyph, lock_whole_page);
+    glyph_data = alloc_glyph_region(font_data, raster->ft_index,
+       w + 4, h + 4, glyph, lock_whole_page);
 
     if (glyph_data == NULL) {
        return;
     }
 
     if (font_data->flags & ALLEGRO_TTF_MONOCHROME)
-       copy_glyph_mono(font_data, face, glyph_data);
+       copy_glyph_mono(font_data, &raster->bitmap, glyph_data);
     else
-       copy_glyph_color(font_data, face, glyph_data);
+       copy_glyph_color(font_data, &raster->bitmap, glyph_data);
 
     if (!lock_whole_page) {
        unlock_current_page(font_data);
     }
 }
 
+
+#define SDF_INF 1e20f
+
+
+/* One dimensional squared distance transform of f into d, after Felzenszwalb
+ * and Huttenlocher. v and z are scratch space for n and n + 1 entries.
+ */
+static void distance_transform_1d(float const *f, float *d, int *v, float *z,
+   int n)
+{
+   int k = 0;
+   int q;
+
+   v[0] = 0;
+   z[0] = -SDF_INF;
+   z[1] = SDF_INF;
+
+   for (q = 1; q < n; q++) {
+      float s;
+      for (;;) {
+         int r = v[k];
+         s = ((f[q] + q * q) - (f[r] + r * r)) / (2 * q - 2 * r);
+         if (s > z[k] || k == 0)
+            break;
+         k--;
+      }
+      k++;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = SDF_INF;
+   }
+
+   k = 0;
+   for (q = 0; q < n; q++) {
+      while (z[k + 1] < q)
+         k++;
+      d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+   }
+}
+
+
+/* Squared distance transform of a w x h grid, in place. */
+static void distance_transform(float *grid, int w, int h, float *f, float *d,
+   int *v, float *z)
+{
+   int x, y;
+
+   for (x = 0; x < w; x++) {
+      for (y = 0; y < h; y++)
+         f[y] = grid[y * w + x];
+      distance_transform_1d(f, d, v, z, h);
+      for (y = 0; y < h; y++)
+         grid[y * w + x] = d[y];
+   }
+
+   for (y = 0; y < h; y++) {
+      memcpy(f, grid + y * w, w * sizeof(float));
+      distance_transform_1d(f, grid + y * w, v, z, w);
+   }
+}
+
+
+/* Turn an anti-aliased glyph into a signed distance field with spread pixels
+ * of padding on each side. The outline ends up at 128, and values fall off
+ * to 0 and 255 at spread pixels outside and inside of it. Partly covered
+ * pixels place the outline inside the pixel by their coverage, as in
+ * Mapbox's TinySDF.
+ */
+static bool make_sdf(FT_Bitmap const *in, int spread, FT_Bitmap *out)
+{
+   int w = in->width + spread * 2;
+   int h = in->rows + spread * 2;
+   int n = w > h ? w : h;
+   float *outer, *inner, *f, *d, *z;
+   int *v;
+   int x, y, i;
+
+   outer = al_malloc(sizeof(float) * (w * h * 2 + n * 3 + 1));
+   v = al_malloc(sizeof(int) * n);
+   out->buffer = al_malloc(w * h);
+   if (!outer || !v || !out->buffer) {
+      al_free(outer);
+      al_free(v);
+      al_free(out->buffer);
+      out->buffer = NULL;
+      return false;
+   }
+   inner = outer + w * h;
+   f = inner + w * h;
+   d = f + n;
+   z = d + n;
+
+   for (i = 0; i < w * h; i++) {
+      outer[i] = SDF_INF;
+      inner[i] = 0;
+   }
+
+   for (y = 0; y < (int)in->rows; y++) {
+      unsigned char const *ptr = in->buffer + in->pitch * y;
+      i = (y + spread) * w + spread;
+      for (x = 0; x < (int)in->width; x++, i++) {
+         float a = ptr[x] / 255.0f;
+         if (a >= 1.0f) {
+            outer[i] = 0;
+            inner[i] = SDF_INF;
+         }
+         else if (a > 0.0f) {
+            float o = a < 0.5f ? 0.5f - a : 0.0f;
+            float e = a > 0.5f ? a - 0.5f : 0.0f;
+            outer[i] = o * o;
+            inner[i] = e * e;
+         }
+      }
+   }
+
+   distance_transform(outer, w, h, f, d, v, z);
+   distance_transform(inner, w, h, f, d, v, z);
+
+   for (i = 0; i < w * h; i++) {
+      float dist = sqrtf(outer[i]) - sqrtf(inner[i]);
+      float value = 0.5f - dist / (2 * spread);
+      if (value < 0.0f)
+         value = 0.0f;
+      else if (value > 1.0f)
+         value = 1.0f;
+      out->buffer[i] = (unsigned char)(value * 255.0f + 0.5f);
+   }
+
+   al_free(outer);
+   al_free(v);
+
+   out->width = w;
+   out->rows = h;
+   out->pitch = w;
+   out->pixel_mode = FT_PIXEL_MODE_GRAY;
+   return true;
+}
+
+
+/* Like store_glyph_bitmap, but stores a distance field for SDF fonts. */
+static void store_glyph(ALLEGRO_TTF_FONT_DATA *font_data,
+   ALLEGRO_TTF_RASTER const *raster, ALLEGRO_TTF_GLYPH_DATA *glyph,
+   bool lock_whole_page)
+{
+   ALLEGRO_TTF_RASTER sdf;
+
+   glyph->padding = 0;
+
+   if (font_data->sdf_spread == 0 ||
+         raster->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY ||
+         raster->bitmap.width == 0 || raster->bitmap.rows == 0) {
+      store_glyph_bitmap(font_data, raster, glyph, lock_whole_page);
+      return;
+   }
+
+   sdf = *raster;
+   if (!make_sdf(&raster->bitmap, font_data->sdf_spread, &sdf.bitmap)) {
+      ALLEGRO_WARN("Out of memory for distance field of glyph %d.\n",
+         raster->ft_index);
+      store_glyph_bitmap(font_data, raster, glyph, lock_whole_page);
+      return;
+   }
+   sdf.offset_x -= font_data->sdf_spread;
+   sdf.offset_y -= font_data->sdf_spread;
+   glyph->padding = font_data->sdf_spread;
+
+   store_glyph_bitmap(font_data, &sdf, glyph, lock_whole_page);
+   al_free(sdf.bitmap.buffer);
+}
+
+
+/* Take the prewarming thread's result for a glyph, if it is done. */
+static bool take_prewarmed_glyph(ALLEGRO_TTF_FONT_DATA *data, int ft_index,
+   ALLEGRO_TTF_RASTER *raster)
+{
+   ALLEGRO_TTF_PREWARM *pw = data->prewarm;
+   bool found = false;
+   int i, n;
+
+   if (!pw)
+      return false;
+
+   al_lock_mutex(pw->mutex);
+   n = _al_vector_size(&pw->ready);
+   for (i = n - 1; i >= 0; i--) {
+      ALLEGRO_TTF_RASTER *r = _al_vector_ref(&pw->ready, i);
+      if (r->ft_index == ft_index) {
+         *raster = *r;
+         /* Order doesn't matter, so fill the hole from the back. */
+         *r = *(ALLEGRO_TTF_RASTER *)_al_vector_ref_back(&pw->ready);
+         _al_vector_delete_at(&pw->ready, n - 1);
+         found = true;
+         break;
+      }
+   }
+   al_unlock_mutex(pw->mutex);
+
+   return found;
+}
+
+
+/* NOTE: this function may disable the bitmap hold drawing state
+ * and leave the current page bitmap locked.
+ *
+ * NOTE: We have previously tried to be more clever about caching multiple
+ * glyphs during incidental cache misses, but found that approach to be slower.
+ */
+static void cache_glyph(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
+   int ft_index, ALLEGRO_TTF_GLYPH_DATA *glyph, bool lock_whole_page)
+{
+    ALLEGRO_TTF_RASTER raster;
+
+    if (glyph->page_bitmap) {
+        touch_page(font_data, glyph->page);
+        return;
+    }
+    if (glyph->region.x < 0)
+        return;
+
+    /* We shouldn't ever get here, as cache misses
+     * should have been set to ft_index = 0. */
+    ASSERT(!(font_data->skip_cache_misses && !lock_whole_page));
+
+    /* Use the prewarming thread's work if it got to this glyph already. */
+    if (glyph->queued && take_prewarmed_glyph(font_data, ft_index, &raster)) {
+       glyph->queued = false;
+       if (raster.ok)
+          store_glyph(font_data, &raster, glyph, lock_whole_page);
+       al_free(raster.bitmap.buffer);
+       if (glyph->page_bitmap || glyph->region.x < 0)
+          return;
+    }
+
+    rasterize_glyph(font_data, face, ft_index, &raster);
+    store_glyph(font_data, &raster, glyph, lock_whole_page);
+}
+
 /* WARNING: It is only valid to call this function when the current page is empty
  * (or already locked), otherwise it will gibberify the current glyphs on that page.
  *
@@ -540,7 +1238,7 @@ static void cache_glyphs(ALLEGRO_TTF_FONT_DATA *data, const char *text, size_t t
 
    while ((ch = al_ustr_get_next(ustr, &pos)) >= 0) {
       ALLEGRO_TTF_GLYPH_DATA *glyph;
-      int ft_index = FT_Get_Char_Index(face, ch);
+      int ft_index = get_char_index(data, ch);
       get_glyph(data, ft_index, &glyph);
       cache_glyph(data, face, ft_index, glyph, true);
    }
@@ -570,8 +1268,9 @@ static bool ttf_get_glyph_worker(ALLEGRO_FONT const *f, int prev_ft_index, int f
    int advance = 0;
 
    if (!get_glyph(data, ft_index, &glyph)) {
-      if (f->fallback)
-         return f->fallback->vtable->get_glyph(f->fallback, prev_codepoint, codepoint, info);
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, codepoint);
+      if (fallback)
+         return fallback->vtable->get_glyph(fallback, prev_codepoint, codepoint, info);
       else {
          get_glyph(data, 0, &glyph);
          ft_index = 0;
@@ -592,53 +1291,261 @@ static bool ttf_get_glyph_worker(ALLEGRO_FONT const *f, int prev_ft_index, int f
       info->x = -1;
       info->y = -1;
    }
-   info->w = glyph->region.w - 4;
-   info->h = glyph->region.h - 4;
-   info->kerning = advance;
-   info->offset_x = glyph->offset_x;
-   info->offset_y = glyph->offset_y;
-   info->advance = glyph->advance + advance;
+   info->w = glyph->region.w - 4;
+   info->h = glyph->region.h - 4;
+   info->kerning = advance;
+   info->offset_x = glyph->offset_x;
+   info->offset_y = glyph->offset_y;
+   info->advance = glyph->advance + advance;
+
+   return ft_index != 0;
+}
+
+
+static bool ttf_get_glyph(ALLEGRO_FONT const *f, int prev_codepoint, int codepoint, ALLEGRO_GLYPH *glyph)
+{
+   ALLEGRO_TTF_FONT_DATA *data = f->data;
+   int prev_ft_index = (prev_codepoint == -1) ? -1 : get_char_index(data, prev_codepoint);
+   int ft_index = get_char_index(data, codepoint);
+   return ttf_get_glyph_worker(f, prev_ft_index, ft_index, prev_codepoint, codepoint, glyph);
+}
+
+
+static int render_glyph(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
+   int prev_ft_index, int ft_index, int32_t prev_ch, int32_t ch, float xpos, float ypos)
+{
+   ALLEGRO_GLYPH glyph;
+
+   if (ttf_get_glyph_worker(f, prev_ft_index, ft_index, prev_ch, ch, &glyph) == false)
+      return 0;
+
+   if (glyph.bitmap != NULL) {
+      /*
+       * Include 1 pixel of the 2-pixel border when drawing glyph.
+       * This improves render results when rotating and scaling.
+       */
+      float sx = glyph.x - 1;
+      float sy = glyph.y - 1;
+      float sw = glyph.w + 2;
+      float sh = glyph.h + 2;
+      float dx = xpos + glyph.offset_x + glyph.kerning - 1;
+      float dy = ypos + glyph.offset_y - 1;
+
+      /* Glyphs from a fallback font aren't ours to keep track of. */
+      if (is_page_bitmap(f->data, glyph.bitmap))
+         batch_glyph(f->data, glyph.bitmap, sx, sy, sw, sh, dx, dy);
+      else
+         al_draw_tinted_bitmap_region(glyph.bitmap, color,
+            sx, sy, sw, sh, dx, dy, 0);
+   }
+
+   return glyph.advance;
+}
+
+
+static uint32_t hash_text(const ALLEGRO_USTR *text)
+{
+   const unsigned char *p = (const unsigned char *)al_cstr(text);
+   size_t n = al_ustr_size(text);
+   uint32_t hash = 2166136261u;
+   size_t i;
+
+   /* FNV-1a */
+   for (i = 0; i < n; i++) {
+      hash ^= p[i];
+      hash *= 16777619u;
+   }
+
+   return hash;
+}
+
+
+/* Returns the index of the first layout with a hash not less than the
+ * given one.
+ */
+static int find_layout_pos(ALLEGRO_TTF_FONT_DATA *data, uint32_t hash)
+{
+   int lo = 0;
+   int hi = _al_vector_size(&data->layouts);
+
+   while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      ALLEGRO_TTF_LAYOUT *l = _al_vector_ref(&data->layouts, mid);
+      if (l->hash < hash)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   return lo;
+}
+
+
+static void evict_lru_layout(ALLEGRO_TTF_FONT_DATA *data)
+{
+   unsigned int oldest = 0;
+   int lru = -1;
+   int i;
+
+   for (i = 0; i < (int)_al_vector_size(&data->layouts); i++) {
+      ALLEGRO_TTF_LAYOUT *l = _al_vector_ref(&data->layouts, i);
+      unsigned int age = data->layout_clock - l->last_used;
+      if (lru < 0 || age > oldest) {
+         lru = i;
+         oldest = age;
+      }
+   }
+
+   if (lru >= 0) {
+      ALLEGRO_TTF_LAYOUT *l = _al_vector_ref(&data->layouts, lru);
+      al_ustr_free(l->text);
+      _al_vector_free(&l->glyphs);
+      _al_vector_delete_at(&data->layouts, lru);
+   }
+}
+
+
+/* Look up and cache every glyph of the string, mirroring what ttf_render
+ * and ttf_text_length would do.
+ */
+static void build_layout(ALLEGRO_FONT const *f, ALLEGRO_TTF_LAYOUT *layout)
+{
+   ALLEGRO_TTF_FONT_DATA *data = f->data;
+   FT_Face face = data->face;
+   int pos = 0;
+   int prev_ft_index = -1;
+   int pen = 0;
+   int32_t ch;
+
+   _al_vector_free(&layout->glyphs);
+   layout->generation = data->page_generation;
+   layout->fallback = f->fallback;
+   layout->uses_fallback = false;
+   layout->advance = 0;
+   layout->length = 0;
+
+   while ((ch = al_ustr_get_next(layout->text, &pos)) >= 0) {
+      ALLEGRO_TTF_GLYPH_DATA *glyph;
+      int ft_index = get_char_index(data, ch);
+      int used_ft_index = ft_index;
+      int kerning;
+
+      if (!get_glyph(data, ft_index, &glyph)) {
+         if (f->fallback) {
+            layout->uses_fallback = true;
+            _al_vector_free(&layout->glyphs);
+            return;
+         }
+         get_glyph(data, 0, &glyph);
+         used_ft_index = 0;
+      }
+
+      cache_glyph(data, face, used_ft_index, glyph, false);
+
+      /* The length uses the kerning with the next character. */
+      if (prev_ft_index != -1)
+         layout->length += get_kerning(data, face, prev_ft_index, ft_index);
+      layout->length += glyph->advance;
+
+      if (used_ft_index != 0) {
+         kerning = get_kerning(data, face, prev_ft_index, used_ft_index);
+         if (glyph->page_bitmap) {
+            ALLEGRO_TTF_LAYOUT_GLYPH *g = _al_vector_alloc_back(&layout->glyphs);
+            g->bitmap = glyph->page_bitmap;
+            g->page = glyph->page;
+            g->sx = glyph->region.x + 1;
+            g->sy = glyph->region.y + 1;
+            g->sw = glyph->region.w - 2;
+            g->sh = glyph->region.h - 2;
+            g->dx = pen + glyph->offset_x + kerning - 1;
+            g->dy = glyph->offset_y - 1;
+         }
+         pen += glyph->advance + kerning;
+      }
+
+      prev_ft_index = ft_index;
+   }
+
+   layout->advance = pen;
+}
+
+
+/* Returns the layout of the string, or NULL if it has to be drawn glyph by
+ * glyph.
+ */
+static ALLEGRO_TTF_LAYOUT *get_layout(ALLEGRO_FONT const *f,
+   const ALLEGRO_USTR *text)
+{
+   ALLEGRO_TTF_FONT_DATA *data = f->data;
+   ALLEGRO_TTF_LAYOUT *layout = NULL;
+   uint32_t hash = hash_text(text);
+   int pos = find_layout_pos(data, hash);
+   int i;
+
+   for (i = pos; i < (int)_al_vector_size(&data->layouts); i++) {
+      ALLEGRO_TTF_LAYOUT *l = _al_vector_ref(&data->layouts, i);
+      if (l->hash != hash)
+         break;
+      if (al_ustr_equal(l->text, text)) {
+         layout = l;
+         break;
+      }
+   }
+
+   if (!layout) {
+      if ((int)_al_vector_size(&data->layouts) >= data->max_layouts) {
+         evict_lru_layout(data);
+         pos = find_layout_pos(data, hash);
+      }
+      layout = _al_vector_alloc_mid(&data->layouts, pos);
+      memset(layout, 0, sizeof *layout);
+      layout->hash = hash;
+      layout->text = al_ustr_dup(text);
+      _al_vector_init(&layout->glyphs, sizeof(ALLEGRO_TTF_LAYOUT_GLYPH));
+      build_layout(f, layout);
+   }
+   else if (layout->generation != data->page_generation ||
+         layout->fallback != f->fallback) {
+      build_layout(f, layout);
+   }
 
-   return ft_index != 0;
+   layout->last_used = ++data->layout_clock;
+
+   /* A page may have been recycled while caching the glyphs. */
+   if (layout->uses_fallback || layout->generation != data->page_generation)
+      return NULL;
+   return layout;
 }
 
 
-static bool ttf_get_glyph(ALLEGRO_FONT const *f, int prev_codepoint, int codepoint, ALLEGRO_GLYPH *glyph)
+static void draw_layout(ALLEGRO_TTF_FONT_DATA *data,
+   ALLEGRO_TTF_LAYOUT *layout, float x, float y)
 {
-   ALLEGRO_TTF_FONT_DATA *data = f->data;
-   FT_Face face = data->face;
-   int prev_ft_index = (prev_codepoint == -1) ? -1 : (int)FT_Get_Char_Index(face, prev_codepoint);
-   int ft_index = FT_Get_Char_Index(face, codepoint);
-   return ttf_get_glyph_worker(f, prev_ft_index, ft_index, prev_codepoint, codepoint, glyph);
+   int i;
+
+   for (i = 0; i < (int)_al_vector_size(&layout->glyphs); i++) {
+      ALLEGRO_TTF_LAYOUT_GLYPH *g = _al_vector_ref(&layout->glyphs, i);
+      touch_page(data, g->page);
+      batch_glyph(data, g->bitmap, g->sx, g->sy, g->sw, g->sh,
+         x + g->dx, y + g->dy);
+   }
 }
 
 
-static int render_glyph(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
-   int prev_ft_index, int ft_index, int32_t prev_ch, int32_t ch, float xpos, float ypos)
+static void free_layouts(ALLEGRO_TTF_FONT_DATA *data)
 {
-   ALLEGRO_GLYPH glyph;
-
-   if (ttf_get_glyph_worker(f, prev_ft_index, ft_index, prev_ch, ch, &glyph) == false)
-      return 0;
+   int i;
 
-   if (glyph.bitmap != NULL) {
-      /*
-       * Include 1 pixel of the 2-pixel border when drawing glyph.
-       * This improves render results when rotating and scaling.
-       */
-      al_draw_tinted_bitmap_region(
-         glyph.bitmap, color,
-         glyph.x - 1, glyph.y - 1, glyph.w + 2, glyph.h + 2,
-         xpos + glyph.offset_x + glyph.kerning - 1,
-         ypos + glyph.offset_y - 1,
-         0
-      );
+   for (i = 0; i < (int)_al_vector_size(&data->layouts); i++) {
+      ALLEGRO_TTF_LAYOUT *l = _al_vector_ref(&data->layouts, i);
+      al_ustr_free(l->text);
+      _al_vector_free(&l->glyphs);
    }
-
-   return glyph.advance;
+   _al_vector_free(&data->layouts);
 }
 
 
+
 static int ttf_font_height(ALLEGRO_FONT const *f)
 {
    ASSERT(f);
@@ -674,16 +1581,47 @@ static int ttf_font_descent(ALLEGRO_FONT const *f)
 }
 
 
+/* Tell the SDF font shader, if one is in use, how wide the anti-aliased
+ * edge is at the current scale. The edge should be about a pixel wide on
+ * the screen, whatever the size the glyphs are drawn at.
+ */
+static void update_sdf_shader(ALLEGRO_TTF_FONT_DATA *data)
+{
+   ALLEGRO_TRANSFORM const *t;
+   float scale, smoothing;
+
+   if (data->sdf_spread == 0 || !al_get_current_shader())
+      return;
+
+   t = al_get_current_transform();
+   scale = sqrtf(fabsf(t->m[0][0] * t->m[1][1] - t->m[0][1] * t->m[1][0]));
+   if (scale <= 0.0f)
+      return;
+   smoothing = 0.7f / (2 * data->sdf_spread * scale);
+   if (smoothing > 0.5f)
+      smoothing = 0.5f;
+
+   /* Anything held so far has to be drawn with the old value. */
+   if (al_is_bitmap_drawing_held()) {
+      al_hold_bitmap_drawing(false);
+      al_hold_bitmap_drawing(true);
+   }
+   al_set_shader_float(ALLEGRO_SHADER_VAR_SDF_SMOOTHING, smoothing);
+}
+
+
 static int ttf_render_char(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
    int ch, float xpos, float ypos)
 {
    ALLEGRO_TTF_FONT_DATA *data = f->data;
-   FT_Face face = data->face;
    int advance = 0;
    int32_t ch32 = (int32_t) ch;
 
-   int ft_index = FT_Get_Char_Index(face, ch32);
+   int ft_index = get_char_index(data, ch32);
+   update_sdf_shader(data);
+   data->batch_color = color;
    advance = render_glyph(f, color, -1, ft_index, -1, ch, xpos, ypos);
+   flush_glyph_batch(data);
 
    return advance;
 }
@@ -695,10 +1633,11 @@ static int ttf_char_length(ALLEGRO_FONT const *f, int ch)
    ALLEGRO_TTF_FONT_DATA *data = f->data;
    ALLEGRO_TTF_GLYPH_DATA *glyph;
    FT_Face face = data->face;
-   int ft_index = FT_Get_Char_Index(face, ch);
+   int ft_index = get_char_index(data, ch);
    if (!get_glyph(data, ft_index, &glyph)) {
-      if (f->fallback) {
-         return al_get_glyph_width(f->fallback, ch);
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, ch);
+      if (fallback) {
+         return al_get_glyph_width(fallback, ch);
       }
       else {
          get_glyph(data, 0, &glyph);
@@ -706,7 +1645,8 @@ static int ttf_char_length(ALLEGRO_FONT const *f, int ch)
       }
    }
    cache_glyph(data, face, ft_index, glyph, false);
-   result = glyph->region.w - 4;    /* Remove 2-pixel border from width */
+   /* Remove 2-pixel border from width */
+   result = glyph->region.w - 4 - 2 * glyph->padding;
 
    return result;
 }
@@ -716,25 +1656,38 @@ static int ttf_render(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
    const ALLEGRO_USTR *text, float x, float y)
 {
    ALLEGRO_TTF_FONT_DATA *data = f->data;
-   FT_Face face = data->face;
    int pos = 0;
    int advance = 0;
    int prev_ft_index = -1;
    int32_t prev_ch = -1;
    int32_t ch;
    bool hold;
+   ALLEGRO_TTF_LAYOUT *layout = NULL;
 
+   update_sdf_shader(data);
    hold = al_is_bitmap_drawing_held();
    al_hold_bitmap_drawing(true);
 
+   data->batch_color = color;
+
+   if (data->max_layouts > 0)
+      layout = get_layout(f, text);
+   if (layout) {
+      draw_layout(data, layout, x, y);
+      flush_glyph_batch(data);
+      al_hold_bitmap_drawing(hold);
+      return layout->advance;
+   }
+
    while ((ch = al_ustr_get_next(text, &pos)) >= 0) {
-      int ft_index = FT_Get_Char_Index(face, ch);
+      int ft_index = get_char_index(data, ch);
       advance += render_glyph(f, color, prev_ft_index, ft_index, prev_ch, ch,
          x + advance, y);
       prev_ft_index = ft_index;
       prev_ch = ch;
    }
 
+   flush_glyph_batch(data);
    al_hold_bitmap_drawing(hold);
 
    return advance;
@@ -743,10 +1696,17 @@ static int ttf_render(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
 
 static int ttf_text_length(ALLEGRO_FONT const *f, const ALLEGRO_USTR *text)
 {
+   ALLEGRO_TTF_FONT_DATA *data = f->data;
    int pos = 0;
    int x = 0;
    int32_t ch, nch;
 
+   if (data->max_layouts > 0) {
+      ALLEGRO_TTF_LAYOUT *layout = get_layout(f, text);
+      if (layout)
+         return layout->length;
+   }
+
    nch = al_ustr_get_next(text, &pos);
    while (nch >= 0) {
       ch = nch;
@@ -808,6 +1768,255 @@ static void ttf_get_text_dimensions(ALLEGRO_FONT const *f,
 }
 
 
+static void set_face_size(FT_Face face, int w, int h)
+{
+    if (face->num_fixed_sizes) {
+        // TODO: we always pick the first size
+        FT_Select_Size(face, 0);
+    } else if (h > 0) {
+       FT_Set_Pixel_Sizes(face, w, h);
+    }
+    else {
+       /* Set the "real dimension" of the font to be the passed size,
+        * in pixels.
+        */
+       FT_Size_RequestRec req;
+       ASSERT(w <= 0);
+       ASSERT(h <= 0);
+       req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
+       req.width = (-w) << 6;
+       req.height = (-h) << 6;
+       req.horiResolution = 0;
+       req.vertResolution = 0;
+       FT_Request_Size(face, &req);
+    }
+}
+
+
+/* Copy the bitmap out of the glyph slot, so the face can move on. */
+static bool detach_raster(ALLEGRO_TTF_RASTER *raster)
+{
+   FT_Bitmap *bitmap = &raster->bitmap;
+   int row_size = bitmap->pitch < 0 ? -bitmap->pitch : bitmap->pitch;
+   unsigned char *buffer;
+   unsigned int y;
+
+   if (bitmap->rows == 0 || row_size == 0) {
+      bitmap->buffer = NULL;
+      return true;
+   }
+
+   buffer = al_malloc(row_size * bitmap->rows);
+   if (!buffer)
+      return false;
+
+   for (y = 0; y < bitmap->rows; y++) {
+      memcpy(buffer + y * row_size, bitmap->buffer + y * bitmap->pitch,
+         row_size);
+   }
+   bitmap->buffer = buffer;
+   bitmap->pitch = row_size;
+   return true;
+}
+
+
+static void *prewarm_thread_proc(ALLEGRO_THREAD *thread, void *arg)
+{
+   ALLEGRO_TTF_FONT_DATA *data = arg;
+   ALLEGRO_TTF_PREWARM *pw = data->prewarm;
+   ALLEGRO_TTF_RASTER raster;
+   int ft_index;
+
+   al_lock_mutex(pw->mutex);
+
+   for (;;) {
+      while (pw->pending_pos == _al_vector_size(&pw->pending) &&
+            !al_get_thread_should_stop(thread))
+         al_wait_cond(pw->cond, pw->mutex);
+      if (al_get_thread_should_stop(thread))
+         break;
+
+      ft_index = *(int *)_al_vector_ref(&pw->pending, pw->pending_pos++);
+      if (pw->pending_pos == _al_vector_size(&pw->pending)) {
+         _al_vector_free(&pw->pending);
+         pw->pending_pos = 0;
+      }
+      pw->busy = true;
+      al_unlock_mutex(pw->mutex);
+
+      /* Only the flags of the font data are read here, which never change. */
+      raster.ok = rasterize_glyph(data, pw->face, ft_index, &raster);
+      if (!detach_raster(&raster))
+         raster.ok = false;
+
+      al_lock_mutex(pw->mutex);
+      *(ALLEGRO_TTF_RASTER *)_al_vector_alloc_back(&pw->ready) = raster;
+      pw->busy = false;
+   }
+
+   al_unlock_mutex(pw->mutex);
+   return NULL;
+}
+
+
+static void free_prewarm(ALLEGRO_TTF_PREWARM *pw)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&pw->ready); i++) {
+      ALLEGRO_TTF_RASTER *r = _al_vector_ref(&pw->ready, i);
+      al_free(r->bitmap.buffer);
+   }
+   _al_vector_free(&pw->ready);
+   _al_vector_free(&pw->pending);
+
+   if (pw->cond)
+      al_destroy_cond(pw->cond);
+   if (pw->mutex)
+      al_destroy_mutex(pw->mutex);
+   if (pw->face)
+      FT_Done_Face(pw->face);
+   if (pw->library)
+      FT_Done_FreeType(pw->library);
+   al_free(pw->file_data);
+   al_free(pw);
+}
+
+
+/* FreeType faces can't be shared between threads, so the prewarming thread
+ * opens its own from a copy of the font file.
+ */
+static bool start_prewarm(ALLEGRO_TTF_FONT_DATA *data)
+{
+   ALLEGRO_TTF_PREWARM *pw;
+   size_t size;
+
+   if (data->prewarm)
+      return true;
+
+   pw = al_calloc(1, sizeof *pw);
+   if (!pw)
+      return false;
+   _al_vector_init(&pw->pending, sizeof(int));
+   _al_vector_init(&pw->ready, sizeof(ALLEGRO_TTF_RASTER));
+
+   pw->file_data = al_malloc(data->stream.size);
+   if (!pw->file_data)
+      goto fail;
+   al_fseek(data->file, data->base_offset, ALLEGRO_SEEK_SET);
+   size = al_fread(data->file, pw->file_data, data->stream.size);
+   data->offset = size;
+
+   if (FT_Init_FreeType(&pw->library) != 0) {
+      pw->library = NULL;
+      goto fail;
+   }
+   if (FT_New_Memory_Face(pw->library, pw->file_data, size, 0,
+         &pw->face) != 0) {
+      ALLEGRO_ERROR("Unable to open the font again for prewarming.\n");
+      pw->face = NULL;
+      goto fail;
+   }
+   set_face_size(pw->face, data->size_w, data->size_h);
+
+   pw->mutex = al_create_mutex();
+   pw->cond = al_create_cond();
+   if (!pw->mutex || !pw->cond)
+      goto fail;
+
+   data->prewarm = pw;
+   pw->thread = al_create_thread(prewarm_thread_proc, data);
+   if (!pw->thread) {
+      data->prewarm = NULL;
+      goto fail;
+   }
+   al_start_thread(pw->thread);
+
+   return true;
+
+fail:
+   free_prewarm(pw);
+   return false;
+}
+
+
+static void stop_prewarm(ALLEGRO_TTF_FONT_DATA *data)
+{
+   ALLEGRO_TTF_PREWARM *pw = data->prewarm;
+
+   if (!pw)
+      return;
+
+   al_lock_mutex(pw->mutex);
+   al_set_thread_should_stop(pw->thread);
+   al_broadcast_cond(pw->cond);
+   al_unlock_mutex(pw->mutex);
+   al_join_thread(pw->thread, NULL);
+   al_destroy_thread(pw->thread);
+
+   free_prewarm(pw);
+   data->prewarm = NULL;
+}
+
+
+/* Queue a glyph unless it is cached or queued already. The caller must
+ * hold the prewarm mutex.
+ */
+static void queue_glyph(ALLEGRO_TTF_FONT_DATA *data, int ft_index)
+{
+   ALLEGRO_TTF_GLYPH_DATA *glyph;
+
+   if (ft_index == 0)
+      return;
+
+   get_glyph(data, ft_index, &glyph);
+   if (glyph->page_bitmap || glyph->region.x < 0 || glyph->queued)
+      return;
+
+   glyph->queued = true;
+   *(int *)_al_vector_alloc_back(&data->prewarm->pending) = ft_index;
+}
+
+
+/* Copy up to max glyphs (all if negative) which the prewarming thread has
+ * finished into the pages.
+ */
+static int upload_prewarmed_glyphs(ALLEGRO_TTF_FONT_DATA *data, int max)
+{
+   ALLEGRO_TTF_PREWARM *pw = data->prewarm;
+   ALLEGRO_TTF_RASTER raster;
+   int count = 0;
+
+   if (!pw)
+      return 0;
+
+   for (;;) {
+      ALLEGRO_TTF_GLYPH_DATA *glyph;
+
+      if (max >= 0 && count >= max)
+         break;
+
+      al_lock_mutex(pw->mutex);
+      if (_al_vector_is_empty(&pw->ready)) {
+         al_unlock_mutex(pw->mutex);
+         break;
+      }
+      raster = *(ALLEGRO_TTF_RASTER *)_al_vector_ref_back(&pw->ready);
+      _al_vector_delete_at(&pw->ready, _al_vector_size(&pw->ready) - 1);
+      al_unlock_mutex(pw->mutex);
+
+      get_glyph(data, raster.ft_index, &glyph);
+      glyph->queued = false;
+      if (raster.ok && !glyph->page_bitmap && glyph->region.x >= 0)
+         store_glyph(data, &raster, glyph, false);
+      al_free(raster.bitmap.buffer);
+      count++;
+   }
+
+   return count;
+}
+
+
 #ifdef DEBUG_CACHE
 #include "allegro5/allegro_image.h"
 static void debug_cache(ALLEGRO_FONT *f)
@@ -820,9 +2029,9 @@ static void debug_cache(ALLEGRO_FONT *f)
    al_init_image_addon();
 
    for (i = 0; i < (int)_al_vector_size(v); i++) {
-      ALLEGRO_BITMAP **bmp = _al_vector_ref(v, i);
+      ALLEGRO_TTF_PAGE *page = _al_vector_ref(v, i);
       ALLEGRO_USTR *u = al_ustr_newf("font%d_%d.png", j, i);
-      al_save_bitmap(al_cstr(u), *bmp);
+      al_save_bitmap(al_cstr(u), page->bitmap);
       al_ustr_free(u);
    }
    j++;
@@ -836,22 +2045,33 @@ static void ttf_destroy(ALLEGRO_FONT *f)
    int i;
 
    unlock_current_page(data);
+   stop_prewarm(data);
+   free_layouts(data);
+   al_free(data->batch);
+   al_free(data->batch_quads);
 
 #ifdef DEBUG_CACHE
    debug_cache(f);
 #endif
 
    FT_Done_Face(data->face);
-   for (i = _al_vector_size(&data->glyph_ranges) - 1; i >= 0; i--) {
-      ALLEGRO_TTF_GLYPH_RANGE *range = _al_vector_ref(&data->glyph_ranges, i);
-      al_free(range->glyphs);
+   for (i = 0; i < data->num_glyph_ranges; i++) {
+      al_free(data->glyph_ranges[i]);
+   }
+   al_free(data->glyph_ranges);
+   if (data->char_pages) {
+      for (i = 0; i < NUM_CHAR_PAGES; i++) {
+         al_free(data->char_pages[i]);
+      }
+      al_free(data->char_pages);
    }
-   _al_vector_free(&data->glyph_ranges);
    for (i = _al_vector_size(&data->page_bitmaps) - 1; i >= 0; i--) {
-      ALLEGRO_BITMAP **bmp = _al_vector_ref(&data->page_bitmaps, i);
-      al_destroy_bitmap(*bmp);
+      ALLEGRO_TTF_PAGE *page = _al_vector_ref(&data->page_bitmaps, i);
+      al_destroy_bitmap(page->bitmap);
+      _al_vector_free(&page->skyline);
    }
    _al_vector_free(&data->page_bitmaps);
+   al_destroy_font(data->owned_fallback);
    al_free(data);
    al_free(f);
 }
@@ -910,6 +2130,11 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
       al_get_config_value(system_cfg, "ttf", "cache_text");
     const char* skip_cache_misses_str =
       al_get_config_value(system_cfg, "ttf", "skip_cache_misses");
+    const char* max_cache_size_str =
+      al_get_config_value(system_cfg, "ttf", "max_cache_size");
+    const char* layout_cache_size_str =
+      al_get_config_value(system_cfg, "ttf", "layout_cache_size");
+    int i;
 
     if ((h > 0 && w < 0) || (h < 0 && w > 0)) {
        ALLEGRO_ERROR("Height/width have opposite signs (w = %d, h = %d).\n", w, h);
@@ -942,6 +2167,20 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
       }
     }
 
+    if (max_cache_size_str) {
+      int max_cache_size = atoi(max_cache_size_str);
+      if (max_cache_size > 0) {
+         data->max_cache_size = (size_t)max_cache_size * 1024;
+      }
+    }
+
+    if (layout_cache_size_str) {
+      int layout_cache_size = atoi(layout_cache_size_str);
+      if (layout_cache_size > 0) {
+         data->max_layouts = layout_cache_size;
+      }
+    }
+
     if (skip_cache_misses_str && !strcmp(skip_cache_misses_str, "true")) {
        data->skip_cache_misses = true;
     }
@@ -979,26 +2218,7 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
     }
     al_destroy_path(path);
 
-    if (face->num_fixed_sizes) {
-        // TODO: we always pick the first size
-        FT_Select_Size(face, 0);
-    } else if (h > 0) {
-       FT_Set_Pixel_Sizes(face, w, h);
-    }
-    else {
-       /* Set the "real dimension" of the font to be the passed size,
-        * in pixels.
-        */
-       FT_Size_RequestRec req;
-       ASSERT(w <= 0);
-       ASSERT(h <= 0);
-       req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
-       req.width = (-w) << 6;
-       req.height = (-h) << 6;
-       req.horiResolution = 0;
-       req.vertResolution = 0;
-       FT_Request_Size(face, &req);
-    }
+    set_face_size(face, w, h);
 
     ALLEGRO_DEBUG("Font %s loaded with pixel size %d x %d.\n", filename,
         w, h);
@@ -1009,9 +2229,28 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
 
     data->face = face;
     data->flags = flags;
+    data->size_w = w;
+    data->size_h = h;
+
+    /* Fonts with only fixed sizes don't have outlines to measure. */
+    if ((flags & ALLEGRO_TTF_SDF) && !face->num_fixed_sizes) {
+       data->sdf_spread = (face->size->metrics.y_ppem + 7) / 8;
+       if (data->sdf_spread < 2)
+          data->sdf_spread = 2;
+       data->flags &= ~ALLEGRO_TTF_MONOCHROME;
+    }
 
-    _al_vector_init(&data->glyph_ranges, sizeof(ALLEGRO_TTF_GLYPH_RANGE));
-    _al_vector_init(&data->page_bitmaps, sizeof(ALLEGRO_BITMAP*));
+    data->num_glyph_ranges = face->num_glyphs / RANGE_SIZE + 1;
+    data->glyph_ranges = al_calloc(data->num_glyph_ranges,
+       sizeof(ALLEGRO_TTF_GLYPH_DATA *));
+    if (!data->glyph_ranges) {
+       FT_Done_Face(face);
+       al_free(data);
+       return NULL;
+    }
+    _al_vector_init(&data->page_bitmaps, sizeof(ALLEGRO_TTF_PAGE));
+    _al_vector_init(&data->layouts, sizeof(ALLEGRO_TTF_LAYOUT));
+    data->current_page = -1;
 
     if (data->skip_cache_misses) {
        cache_glyphs(data, "\0", 1);
@@ -1021,6 +2260,12 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
     }
     unlock_current_page(data);
 
+    /* The glyphs cached so far are never evicted. */
+    for (i = 0; i < (int)_al_vector_size(&data->page_bitmaps); i++) {
+       ALLEGRO_TTF_PAGE *page = _al_vector_ref(&data->page_bitmaps, i);
+       page->pinned = true;
+    }
+
     f = al_calloc(sizeof *f, 1);
     f->height = face->size->metrics.height >> 6;
     f->vtable = &vt;
@@ -1066,6 +2311,47 @@ ALLEGRO_FONT *al_load_ttf_font_stretch(char const *filename, int w, int h,
 }
 
 
+/* Function: al_load_ttf_font_chain
+ */
+ALLEGRO_FONT *al_load_ttf_font_chain(char const * const *filenames,
+   int num_filenames, int size, int flags)
+{
+   ALLEGRO_FONT *first = NULL;
+   ALLEGRO_FONT *last = NULL;
+   int i;
+   ASSERT(filenames);
+
+   for (i = 0; i < num_filenames; i++) {
+      ALLEGRO_FONT *font;
+
+      /* Only the first font is destroyed by the user. */
+      if (first)
+         _al_push_destructor_owner();
+      font = al_load_ttf_font(filenames[i], size, flags);
+      if (first)
+         _al_pop_destructor_owner();
+
+      if (!font) {
+         ALLEGRO_ERROR("Unable to load fallback font %s\n", filenames[i]);
+         al_destroy_font(first);
+         return NULL;
+      }
+
+      if (last) {
+         ALLEGRO_TTF_FONT_DATA *data = last->data;
+         al_set_fallback_font(last, font);
+         data->owned_fallback = font;
+      }
+      else {
+         first = font;
+      }
+      last = font;
+   }
+
+   return first;
+}
+
+
 static int ttf_get_font_ranges(ALLEGRO_FONT *font, int ranges_count,
    int *ranges)
 {
@@ -1103,10 +2389,12 @@ static bool ttf_get_glyph_dimensions(ALLEGRO_FONT const *f,
    ALLEGRO_TTF_FONT_DATA *data = f->data;
    ALLEGRO_TTF_GLYPH_DATA *glyph;
    FT_Face face = data->face;
-   int ft_index = FT_Get_Char_Index(face, codepoint);
+   int ft_index = get_char_index(data, codepoint);
+   int pad;
    if (!get_glyph(data, ft_index, &glyph)) {
-      if (f->fallback) {
-         return al_get_glyph_dimensions(f->fallback, codepoint,
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, codepoint);
+      if (fallback) {
+         return al_get_glyph_dimensions(fallback, codepoint,
             bbx, bby, bbw, bbh);
       }
       else {
@@ -1115,20 +2403,26 @@ static bool ttf_get_glyph_dimensions(ALLEGRO_FONT const *f,
       }
    }
    cache_glyph(data, face, ft_index, glyph, false);
-   *bbx = glyph->offset_x;
-   *bbw = glyph->region.w - 4;
-   *bbh = glyph->region.h - 4;
-   *bby = glyph->offset_y;
+   pad = glyph->padding;
+   *bbx = glyph->offset_x + pad;
+   *bbw = glyph->region.w - 4 - 2 * pad;
+   *bbh = glyph->region.h - 4 - 2 * pad;
+   *bby = glyph->offset_y + pad;
 
    return true;
 }
 
+static bool ttf_has_glyph(ALLEGRO_FONT const *f, int codepoint)
+{
+   return get_char_index(f->data, codepoint) != 0;
+}
+
 static int ttf_get_glyph_advance(ALLEGRO_FONT const *f, int codepoint1,
    int codepoint2)
 {
    ALLEGRO_TTF_FONT_DATA *data = f->data;
    FT_Face face = data->face;
-   int ft_index = FT_Get_Char_Index(face, codepoint1);
+   int ft_index = get_char_index(data, codepoint1);
    ALLEGRO_TTF_GLYPH_DATA *glyph;
    int kerning = 0;
    int advance = 0;
@@ -1138,8 +2432,9 @@ static int ttf_get_glyph_advance(ALLEGRO_FONT const *f, int codepoint1,
    }
 
    if (!get_glyph(data, ft_index, &glyph)) {
-      if (f->fallback) {
-         return al_get_glyph_advance(f->fallback, codepoint1, codepoint2);
+      ALLEGRO_FONT *fallback = _al_find_fallback_font(f, codepoint1);
+      if (fallback) {
+         return al_get_glyph_advance(fallback, codepoint1, codepoint2);
       }
       else {
          get_glyph(data, 0, &glyph);
@@ -1149,8 +2444,8 @@ static int ttf_get_glyph_advance(ALLEGRO_FONT const *f, int codepoint1,
    cache_glyph(data, face, ft_index, glyph, false);
 
    if (codepoint2 != ALLEGRO_NO_KERNING) {
-      int ft_index1 = FT_Get_Char_Index(face, codepoint1);
-      int ft_index2 = FT_Get_Char_Index(face, codepoint2);
+      int ft_index1 = get_char_index(data, codepoint1);
+      int ft_index2 = get_char_index(data, codepoint2);
       kerning = get_kerning(data, face, ft_index1, ft_index2);
    }
 
@@ -1160,6 +2455,101 @@ static int ttf_get_glyph_advance(ALLEGRO_FONT const *f, int codepoint1,
 
 
 
+/* Function: al_prewarm_ttf_font
+ */
+bool al_prewarm_ttf_font(ALLEGRO_FONT *f, const char *text)
+{
+   ALLEGRO_TTF_FONT_DATA *data;
+   ALLEGRO_USTR_INFO info;
+   const ALLEGRO_USTR *ustr;
+   int pos = 0;
+   int32_t ch;
+
+   ASSERT(f);
+   ASSERT(text);
+
+   if (f->vtable != &vt)
+      return false;
+   data = f->data;
+   if (!start_prewarm(data))
+      return false;
+
+   ustr = al_ref_cstr(&info, text);
+   al_lock_mutex(data->prewarm->mutex);
+   while ((ch = al_ustr_get_next(ustr, &pos)) >= 0)
+      queue_glyph(data, get_char_index(data, ch));
+   al_broadcast_cond(data->prewarm->cond);
+   al_unlock_mutex(data->prewarm->mutex);
+
+   return true;
+}
+
+
+/* Function: al_prewarm_ttf_font_ranges
+ */
+bool al_prewarm_ttf_font_ranges(ALLEGRO_FONT *f, int ranges_count,
+   const int *ranges)
+{
+   ALLEGRO_TTF_FONT_DATA *data;
+   int i, ch;
+
+   ASSERT(f);
+   ASSERT(ranges || ranges_count == 0);
+
+   if (f->vtable != &vt)
+      return false;
+   data = f->data;
+   if (!start_prewarm(data))
+      return false;
+
+   al_lock_mutex(data->prewarm->mutex);
+   for (i = 0; i < ranges_count; i++) {
+      for (ch = ranges[i * 2]; ch <= ranges[i * 2 + 1]; ch++)
+         queue_glyph(data, get_char_index(data, ch));
+   }
+   al_broadcast_cond(data->prewarm->cond);
+   al_unlock_mutex(data->prewarm->mutex);
+
+   return true;
+}
+
+
+/* Function: al_upload_prewarmed_ttf_glyphs
+ */
+int al_upload_prewarmed_ttf_glyphs(ALLEGRO_FONT *f, int max_glyphs)
+{
+   ASSERT(f);
+
+   if (f->vtable != &vt)
+      return 0;
+   return upload_prewarmed_glyphs(f->data, max_glyphs);
+}
+
+
+/* Function: al_is_ttf_font_prewarm_done
+ */
+bool al_is_ttf_font_prewarm_done(ALLEGRO_FONT *f)
+{
+   ALLEGRO_TTF_PREWARM *pw;
+   bool done;
+
+   ASSERT(f);
+
+   if (f->vtable != &vt)
+      return true;
+   pw = ((ALLEGRO_TTF_FONT_DATA *)f->data)->prewarm;
+   if (!pw)
+      return true;
+
+   al_lock_mutex(pw->mutex);
+   done = pw->pending_pos == _al_vector_size(&pw->pending) && !pw->busy &&
+      _al_vector_is_empty(&pw->ready);
+   al_unlock_mutex(pw->mutex);
+
+   return done;
+}
+
+
 /* Function: al_init_ttf_addon
  */
 bool al_init_ttf_addon(void)
@@ -1183,6 +2573,7 @@ bool al_init_ttf_addon(void)
    vt.get_glyph_dimensions = ttf_get_glyph_dimensions;
    vt.get_glyph_advance = ttf_get_glyph_advance;
    vt.get_glyph = ttf_get_glyph;
+   vt.has_glyph = ttf_has_glyph;
 
    al_register_font_loader(".ttf", al_load_ttf_font);
 
@@ -4,6 +4,7 @@
 #  WEBP_FOUND - system has WebP.
 #  WEBP_INCLUDE_DIRS - the WebP. include directories
 #  WEBP_LIBRARIES - link these to use WebP.
+#  WEBP_DEMUX_LIBRARY - the optional WebP demux library, for animations.
 #
 # Copyright (C) 2012 Raphael Kubo da Costa <rakuco@webkit.org>
 # Copyright (C) 2013 Igalia S.L.
@@ -59,6 +60,18 @@ if (SHARPYUV_LIBRARY)
   list(APPEND WEBP_LIBRARIES ${SHARPYUV_LIBRARY})
 endif()
 
+# The demux library is optional, and only needed for animations.
+find_path(WEBP_DEMUX_INCLUDE_DIR
+    NAMES webp/demux.h
+    HINTS ${PC_WEBP_INCLUDEDIR} ${PC_WEBP_INCLUDE_DIRS}
+)
+find_library(
+    WEBP_DEMUX_LIBRARY
+    NAMES webpdemux
+    HINTS ${PC_WEBP_LIBDIR} ${PC_WEBP_LIBRARY_DIRS}
+)
+mark_as_advanced(WEBP_DEMUX_INCLUDE_DIR WEBP_DEMUX_LIBRARY)
+
 set(WEBP_LIBRARIES ${WEBP_LIBRARIES} CACHE STRING "WebP libraries")
 mark_as_advanced(WEBP_LIBRARIES)
 
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef ALLEGRO_ANDROID
    #include "allegro5/allegro_android.h"
@@ -12,6 +14,20 @@ void open_log_monospace(void);
 void close_log(bool wait_for_user);
 void log_printf(char const *format, ...);
 
+typedef struct MEMORY_STATS {
+   size_t allocs;       /* allocations since reset_memory_stats */
+   size_t bytes;        /* bytes currently allocated */
+   size_t peak_bytes;   /* most bytes allocated at once since then */
+   size_t large_blocks; /* blocks currently allocated of the large size */
+} MEMORY_STATS;
+
+void count_memory(void);
+void count_large_blocks(size_t min_bytes);
+void reset_memory_stats(void);
+void get_memory_stats(MEMORY_STATS *stats);
+void example_srand(unsigned int seed);
+int example_rand(void);
+
 void init_platform_specific(void)
 {
 #ifdef ALLEGRO_ANDROID
@@ -124,4 +140,146 @@ void log_printf(char const *format, ...)
 
 #endif
 
+/* Memory statistics for the benchmarks, gathered by routing all of
+ * Allegro's allocations through the functions below. Allocations made by
+ * other libraries with malloc are not seen.
+ */
+static ALLEGRO_MUTEX *memory_mutex;
+static size_t large_block_bytes;
+static MEMORY_STATS memory_stats;
+
+/* Enough to keep the returned memory suitably aligned. */
+#define MEMORY_HEADER_SIZE 16
+
+static void count_alloc(size_t n)
+{
+   if (memory_mutex)
+      al_lock_mutex(memory_mutex);
+   memory_stats.allocs++;
+   memory_stats.bytes += n;
+   if (memory_stats.bytes > memory_stats.peak_bytes)
+      memory_stats.peak_bytes = memory_stats.bytes;
+   if (large_block_bytes && n >= large_block_bytes)
+      memory_stats.large_blocks++;
+   if (memory_mutex)
+      al_unlock_mutex(memory_mutex);
+}
+
+static void count_free(size_t n)
+{
+   if (memory_mutex)
+      al_lock_mutex(memory_mutex);
+   memory_stats.bytes -= n;
+   if (large_block_bytes && n >= large_block_bytes)
+      memory_stats.large_blocks--;
+   if (memory_mutex)
+      al_unlock_mutex(memory_mutex);
+}
+
+static void *counting_malloc(size_t n, int line, const char *file,
+   const char *func)
+{
+   char *p = (char *)malloc(n + MEMORY_HEADER_SIZE);
+   (void)line; (void)file; (void)func;
+   if (!p)
+      return NULL;
+   *(size_t *)p = n;
+   count_alloc(n);
+   return p + MEMORY_HEADER_SIZE;
+}
+
+static void counting_free(void *ptr, int line, const char *file,
+   const char *func)
+{
+   char *p = (char *)ptr;
+   (void)line; (void)file; (void)func;
+   if (!p)
+      return;
+   p -= MEMORY_HEADER_SIZE;
+   count_free(*(size_t *)p);
+   free(p);
+}
+
+static void *counting_realloc(void *ptr, size_t n, int line,
+   const char *file, const char *func)
+{
+   char *p = (char *)ptr;
+   size_t old_size;
+
+   if (!p)
+      return counting_malloc(n, line, file, func);
+
+   p -= MEMORY_HEADER_SIZE;
+   old_size = *(size_t *)p;
+   p = (char *)realloc(p, n + MEMORY_HEADER_SIZE);
+   if (!p)
+      return NULL;
+   *(size_t *)p = n;
+   count_free(old_size);
+   count_alloc(n);
+   return p + MEMORY_HEADER_SIZE;
+}
+
+static void *counting_calloc(size_t count, size_t n, int line,
+   const char *file, const char *func)
+{
+   void *p = counting_malloc(count * n, line, file, func);
+   if (p)
+      memset(p, 0, count * n);
+   return p;
+}
+
+/* Must be called before anything is allocated, so before al_init. */
+void count_memory(void)
+{
+   static ALLEGRO_MEMORY_INTERFACE memory_interface = {
+      counting_malloc,
+      counting_free,
+      counting_realloc,
+      counting_calloc
+   };
+
+   al_set_memory_interface(&memory_interface);
+   memory_mutex = al_create_mutex();
+}
+
+/* Also count the blocks of at least min_bytes in large_blocks. Like
+ * count_memory, must be called before al_init.
+ */
+void count_large_blocks(size_t min_bytes)
+{
+   large_block_bytes = min_bytes;
+}
+
+void reset_memory_stats(void)
+{
+   al_lock_mutex(memory_mutex);
+   memory_stats.allocs = 0;
+   memory_stats.peak_bytes = memory_stats.bytes;
+   al_unlock_mutex(memory_mutex);
+}
+
+void get_memory_stats(MEMORY_STATS *stats)
+{
+   al_lock_mutex(memory_mutex);
+   *stats = memory_stats;
+   al_unlock_mutex(memory_mutex);
+}
+
+/* A cheap deterministic generator, so runs are comparable on every
+ * platform. Returns numbers from 0 to 32767.
+ */
+static unsigned int example_rand_state = 1;
+
+void example_srand(unsigned int seed)
+{
+   example_rand_state = seed;
+}
+
+int example_rand(void)
+{
+   example_rand_state = example_rand_state * 1103515245 + 12345;
+   return (example_rand_state >> 16) & 0x7fff;
+}
+
 /* vim: set sts=3 sw=3 et: */
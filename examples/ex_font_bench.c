@@ -0,0 +1,395 @@
+/*
+ *    Benchmark for text rendering.
+ *
+ *    Draws corpora of Latin, CJK, emoji and other symbol text with each
+ *    font backend into a memory bitmap, so no display is needed. For every
+ *    combination it measures the first pass over the text, during which
+ *    every glyph has to be rendered or looked up for the first time, and
+ *    then the steady state.
+ *
+ *    The glyph caches are not exposed by the API, so memory statistics
+ *    stand in for them: blocks of at least the smallest TTF page size are
+ *    counted as glyph pages, and the memory a font holds on to after
+ *    drawing is reported along with them.
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_ttf.h>
+#include <allegro5/allegro_image.h>
+
+#include "common.c"
+
+/* How many seconds each measurement should approximately take. */
+#define TEST_TIME 1.0
+
+/* The TTF addon's default minimum page size, 256 x 256 x 4 bytes. Nothing
+ * else the fonts allocate comes close.
+ */
+#define PAGE_MIN_BYTES (256 * 256 * 4)
+
+#define TARGET_W 1024
+#define TARGET_H 768
+#define FONT_SIZE 20
+#define LINE_LENGTH 40
+
+
+enum Backend {
+   BITMAP,
+   BMFONT,
+   TTF,
+   TTF_LAYOUTS,
+   TTF_SMALL_CACHE,
+   NUM_BACKENDS
+};
+
+static char const *backend_names[] = {
+   "bitmap", "bmfont", "ttf", "ttf+layouts", "ttf+256KB"
+};
+
+enum Corpus {
+   LATIN,
+   CJK,
+   EMOJI,
+   SYMBOLS,
+   NUM_CORPORA
+};
+
+static char const *corpus_names[] = {
+   "latin", "cjk", "emoji", "symbols"
+};
+
+static char const *cjk_file;
+
+
+/* A random number from 0 to n - 1. */
+static int next_rand(int n)
+{
+   return example_rand() % n;
+}
+
+static char const *latin_words[] = {
+   "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "Pack",
+   "my", "box", "with", "five", "dozen", "liquor", "jugs", "How", "vexingly",
+   "daft", "zebras", "jump", "Sphinx", "of", "black", "quartz", "judge",
+   "vow", "Allegro", "game", "programming", "library", "text", "glyph",
+   "42", "1.5", "(see", "below),", "\"quoted\"", "end."
+};
+
+static int const emoji[] = {
+   0x1F403, 0x1F405, 0x1F406, 0x1F408, 0x1F40A, 0x1F40F, 0x1F410, 0x1F411,
+   0x1F412, 0x1F416, 0x1F415, 0x1F418, 0x1F42B, 0x1F420, 0x1F422, 0x1F427,
+   0x1F41F, 0x1F419, 0x1F996, 0x1F54A, 0x1F992, 0x1F98C
+};
+
+/* Appends a line of text to the corpus. CJK text uses the commonly used
+ * part of the unified ideographs, weighted towards the start like real
+ * text, while the emoji are those in NotoColorEmoji_Animals.ttf mixed with
+ * words. Symbols are Greek, Cyrillic, arrows and maths.
+ */
+static void add_line(ALLEGRO_USTR *line, enum Corpus corpus)
+{
+   int i;
+
+   al_ustr_truncate(line, 0);
+   for (i = 0; (int)al_ustr_length(line) < LINE_LENGTH; i++) {
+      int r;
+      switch (corpus) {
+         case LATIN:
+            if (i > 0)
+               al_ustr_append_chr(line, ' ');
+            al_ustr_append_cstr(line,
+               latin_words[next_rand(sizeof latin_words / sizeof *latin_words)]);
+            break;
+         case CJK:
+            r = next_rand(3000);
+            al_ustr_append_chr(line, 0x4E00 + r * r / 3000 * 7);
+            if (next_rand(12) == 0)
+               al_ustr_append_chr(line, 0x3002);
+            break;
+         case EMOJI:
+            if (i > 0)
+               al_ustr_append_chr(line, ' ');
+            if (next_rand(2) == 0)
+               al_ustr_append_cstr(line, latin_words[next_rand(8)]);
+            else
+               al_ustr_append_chr(line,
+                  emoji[next_rand(sizeof emoji / sizeof *emoji)]);
+            break;
+         case SYMBOLS:
+            r = next_rand(4);
+            if (r == 0)
+               al_ustr_append_chr(line, 0x391 + next_rand(57));
+            else if (r == 1)
+               al_ustr_append_chr(line, 0x410 + next_rand(64));
+            else if (r == 2)
+               al_ustr_append_chr(line, 0x2190 + next_rand(112));
+            else
+               al_ustr_append_chr(line, 0x2200 + next_rand(256));
+            break;
+         default:
+            break;
+      }
+   }
+}
+
+typedef struct Text {
+   ALLEGRO_USTR **lines;
+   int num_lines;
+   int glyphs;
+   int unique;
+} Text;
+
+static void make_text(Text *text, enum Corpus corpus, int num_lines)
+{
+   char *seen = calloc(0x110000, 1);
+   int i;
+
+   example_srand(corpus + 1);
+   text->lines = malloc(num_lines * sizeof *text->lines);
+   text->num_lines = num_lines;
+   text->glyphs = 0;
+   text->unique = 0;
+   for (i = 0; i < num_lines; i++) {
+      int pos = 0;
+      int32_t ch;
+
+      text->lines[i] = al_ustr_new("");
+      add_line(text->lines[i], corpus);
+      text->glyphs += al_ustr_length(text->lines[i]);
+      while ((ch = al_ustr_get_next(text->lines[i], &pos)) >= 0) {
+         if (!seen[ch]) {
+            seen[ch] = 1;
+            text->unique++;
+         }
+      }
+   }
+   free(seen);
+}
+
+static void free_text(Text *text)
+{
+   int i;
+   for (i = 0; i < text->num_lines; i++)
+      al_ustr_free(text->lines[i]);
+   free(text->lines);
+}
+
+
+static void set_ttf_config(char const *key, char const *value)
+{
+   al_set_config_value(al_get_system_config(), "ttf", key, value);
+}
+
+static ALLEGRO_FONT *load_ttf(enum Corpus corpus)
+{
+   char const *files[2] = { "data/DejaVuSans.ttf", NULL };
+
+   if (corpus == CJK) {
+      if (!cjk_file)
+         return NULL;
+      files[1] = cjk_file;
+      return al_load_ttf_font_chain(files, 2, FONT_SIZE, 0);
+   }
+   if (corpus == EMOJI) {
+      files[1] = "data/NotoColorEmoji_Animals.ttf";
+      return al_load_ttf_font_chain(files, 2, FONT_SIZE, 0);
+   }
+   return al_load_ttf_font(files[0], FONT_SIZE, 0);
+}
+
+/* Returns NULL if the backend can't draw the corpus. */
+static ALLEGRO_FONT *load_font(enum Backend backend, enum Corpus corpus)
+{
+   ALLEGRO_FONT *font = NULL;
+
+   switch (backend) {
+      case BITMAP:
+         if (corpus == LATIN)
+            font = al_create_builtin_font();
+         break;
+      case BMFONT:
+         if (corpus == LATIN)
+            font = al_load_font("data/a4_font.fnt", 0, 0);
+         break;
+      case TTF:
+         font = load_ttf(corpus);
+         break;
+      case TTF_LAYOUTS:
+         set_ttf_config("layout_cache_size", "256");
+         font = load_ttf(corpus);
+         set_ttf_config("layout_cache_size", "0");
+         break;
+      case TTF_SMALL_CACHE:
+         set_ttf_config("max_cache_size", "256");
+         font = load_ttf(corpus);
+         set_ttf_config("max_cache_size", "0");
+         break;
+      default:
+         break;
+   }
+
+   return font;
+}
+
+
+static void draw_text(ALLEGRO_FONT *font, Text *text)
+{
+   int line_height = al_get_font_line_height(font);
+   int y = 0;
+   int i;
+
+   for (i = 0; i < text->num_lines; i++) {
+      al_draw_ustr(font, al_map_rgb(255, 255, 255), 0, y, 0, text->lines[i]);
+      y += line_height;
+      if (y + line_height > TARGET_H)
+         y = 0;
+   }
+}
+
+typedef struct Result {
+   double first_ms;
+   double glyphs_per_sec;
+   size_t allocs_per_pass;
+   size_t pages;
+   size_t font_bytes;
+} Result;
+
+static bool run_one(enum Backend backend, enum Corpus corpus, Text *text,
+   Result *result)
+{
+   ALLEGRO_FONT *font;
+   MEMORY_STATS before, after;
+   double t0, t1;
+   int n = 0;
+
+   get_memory_stats(&before);
+   font = load_font(backend, corpus);
+   if (!font)
+      return false;
+
+   t0 = al_get_time();
+   draw_text(font, text);
+   result->first_ms = (al_get_time() - t0) * 1000;
+
+   /* A second pass, so that what is cached is in place. */
+   draw_text(font, text);
+   get_memory_stats(&after);
+   result->pages = after.large_blocks - before.large_blocks;
+   result->font_bytes = after.bytes - before.bytes;
+
+   t0 = al_get_time();
+   do {
+      draw_text(font, text);
+      n++;
+      t1 = al_get_time();
+   } while (t1 - t0 < TEST_TIME);
+   get_memory_stats(&before);
+
+   result->glyphs_per_sec = (double)n * text->glyphs / (t1 - t0);
+   result->allocs_per_pass = (before.allocs - after.allocs) / n;
+
+   al_destroy_font(font);
+   return true;
+}
+
+static void run(int num_lines, int only_backend)
+{
+   ALLEGRO_BITMAP *target;
+   unsigned int b, c;
+
+   target = al_create_bitmap(TARGET_W, TARGET_H);
+   if (!target)
+      abort_example("Could not create target bitmap.\n");
+   al_set_target_bitmap(target);
+
+   log_printf("%-12s %-8s %7s %7s %10s %12s %8s %6s %10s\n",
+      "backend", "corpus", "glyphs", "unique", "first(ms)", "glyphs/s",
+      "allocs", "pages", "font(KB)");
+
+   for (c = 0; c < NUM_CORPORA; c++) {
+      Text text;
+      make_text(&text, c, num_lines);
+
+      for (b = 0; b < NUM_BACKENDS; b++) {
+         Result result;
+
+         if (only_backend >= 0 && (int)b != only_backend)
+            continue;
+
+         if (!run_one(b, c, &text, &result)) {
+            if (c == CJK && b >= TTF && !cjk_file)
+               log_printf("%-12s %-8s %s\n", backend_names[b], corpus_names[c],
+                  "(no CJK font, use -cjk FILE)");
+            continue;
+         }
+
+         log_printf("%-12s %-8s %7d %7d %10.1f %12.0f %8u %6u %10.1f\n",
+            backend_names[b], corpus_names[c], text.glyphs, text.unique,
+            result.first_ms, result.glyphs_per_sec,
+            (unsigned)result.allocs_per_pass, (unsigned)result.pages,
+            result.font_bytes / 1024.0);
+      }
+
+      free_text(&text);
+   }
+
+   al_set_target_bitmap(NULL);
+   al_destroy_bitmap(target);
+}
+
+int main(int argc, char **argv)
+{
+   int num_lines = 200;
+   int only_backend = -1;
+   int i;
+
+   count_memory();
+   count_large_blocks(PAGE_MIN_BYTES);
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+   open_log_monospace();
+   al_init_image_addon();
+   al_init_font_addon();
+   al_init_ttf_addon();
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         num_lines = atoi(argv[++i]);
+         if (num_lines <= 0)
+            abort_example("Bad line count %s.\n", argv[i]);
+      }
+      else if (strcmp(argv[i], "-cjk") == 0 && i + 1 < argc) {
+         cjk_file = argv[++i];
+      }
+      else {
+         int b;
+         for (b = 0; b < NUM_BACKENDS; b++) {
+            if (strcmp(argv[i], backend_names[b]) == 0)
+               only_backend = b;
+         }
+         if (only_backend < 0)
+            abort_example("Usage: %s [-n lines] [-cjk font.ttf] [backend]\n",
+               argv[0]);
+      }
+   }
+
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+   log_printf("%d lines of %d characters per corpus, drawn at %d pixels.\n",
+      num_lines, LINE_LENGTH, FONT_SIZE);
+   log_printf("first: the first pass, allocs: per pass after that.\n");
+   run(num_lines, only_backend);
+
+   close_log(true);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
@@ -0,0 +1,248 @@
+/*
+ *    Benchmark for the image loaders and savers.
+ *
+ *    Generates test images in memory, then encodes and decodes them with
+ *    every file type that can be saved, into a range of bitmap pixel
+ *    formats. Everything happens on memory bitmaps and memory files, so no
+ *    display or disk access is needed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <allegro5/allegro_memfile.h>
+
+#include "common.c"
+
+/* How many seconds each measurement should approximately take. */
+#define TEST_TIME 1.0
+
+static char const *file_types[] = {
+   ".bmp", ".pcx", ".tga", ".png", ".jpg", ".webp"
+};
+
+static struct {
+   int format;
+   char const *name;
+} pixel_formats[] = {
+   { ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, "ABGR_8888_LE" },
+   { ALLEGRO_PIXEL_FORMAT_ARGB_8888, "ARGB_8888" },
+   { ALLEGRO_PIXEL_FORMAT_RGB_888, "RGB_888" },
+   { ALLEGRO_PIXEL_FORMAT_RGB_565, "RGB_565" }
+};
+
+enum Content {
+   GRADIENT,
+   NOISE,
+   NUM_CONTENTS
+};
+
+static char const *content_names[] = {
+   "gradient", "noise"
+};
+
+
+static ALLEGRO_BITMAP *make_image(int w, int h, enum Content content)
+{
+   ALLEGRO_BITMAP *bmp;
+   ALLEGRO_LOCKED_REGION *lock;
+   int x, y;
+
+   al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+   bmp = al_create_bitmap(w, h);
+   if (!bmp)
+      return NULL;
+
+   lock = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_WRITEONLY);
+   example_srand(1);
+   for (y = 0; y < h; y++) {
+      unsigned char *p = (unsigned char *)lock->data + y * lock->pitch;
+      for (x = 0; x < w; x++, p += 4) {
+         if (content == GRADIENT) {
+            p[0] = x * 255 / w;
+            p[1] = y * 255 / h;
+            p[2] = (x + y) * 255 / (w + h);
+         }
+         else {
+            p[0] = example_rand() & 0xff;
+            p[1] = example_rand() & 0xff;
+            p[2] = example_rand() & 0xff;
+         }
+         p[3] = 255;
+      }
+   }
+   al_unlock_bitmap(bmp);
+
+   return bmp;
+}
+
+
+typedef struct Result {
+   double encode_mbps;
+   double decode_mbps;
+   size_t encoded_size;
+   size_t decode_allocs;
+   size_t decode_peak;
+} Result;
+
+/* Save the bitmap repeatedly into the buffer. Returns the size of the
+ * encoded file, or 0 if the type can't be saved.
+ */
+static size_t encode(ALLEGRO_BITMAP *bmp, char const *type, char *buffer,
+   size_t buffer_size, double *mbps)
+{
+   double pixel_mb = al_get_bitmap_width(bmp) * al_get_bitmap_height(bmp) *
+      4 / 1e6;
+   ALLEGRO_FILE *f;
+   double t0, t1;
+   size_t size = 0;
+   int n = 0;
+
+   t0 = al_get_time();
+   do {
+      f = al_open_memfile(buffer, buffer_size, "w");
+      if (!al_save_bitmap_f(f, type, bmp)) {
+         al_fclose(f);
+         return 0;
+      }
+      size = al_ftell(f);
+      al_fclose(f);
+      n++;
+      t1 = al_get_time();
+   } while (t1 - t0 < TEST_TIME);
+
+   *mbps = n * pixel_mb / (t1 - t0);
+   return size;
+}
+
+static bool decode(char *buffer, size_t size, char const *type, int w, int h,
+   Result *result)
+{
+   double pixel_mb = w * h * 4 / 1e6;
+   ALLEGRO_BITMAP *bmp;
+   ALLEGRO_FILE *f;
+   MEMORY_STATS before, after;
+   double t0, t1;
+   int n = 0;
+
+   /* Measure a single load for the memory statistics. */
+   reset_memory_stats();
+   get_memory_stats(&before);
+   f = al_open_memfile(buffer, size, "r");
+   bmp = al_load_bitmap_f(f, type);
+   al_fclose(f);
+   if (!bmp)
+      return false;
+   al_destroy_bitmap(bmp);
+   get_memory_stats(&after);
+   result->decode_allocs = after.allocs;
+   result->decode_peak = after.peak_bytes - before.bytes;
+
+   t0 = al_get_time();
+   do {
+      f = al_open_memfile(buffer, size, "r");
+      bmp = al_load_bitmap_f(f, type);
+      al_fclose(f);
+      al_destroy_bitmap(bmp);
+      n++;
+      t1 = al_get_time();
+   } while (t1 - t0 < TEST_TIME);
+
+   result->decode_mbps = n * pixel_mb / (t1 - t0);
+   return true;
+}
+
+static void run(int w, int h, char const *only_type)
+{
+   size_t buffer_size = (size_t)w * h * 8 + 65536;
+   char *buffer = malloc(buffer_size);
+   unsigned int c, t, p;
+
+   log_printf("%-9s %-5s %-13s %10s %10s %10s %8s %10s\n",
+      "content", "type", "format", "size(KB)", "enc(MB/s)", "dec(MB/s)",
+      "allocs", "peak(KB)");
+
+   for (c = 0; c < NUM_CONTENTS; c++) {
+      ALLEGRO_BITMAP *source = make_image(w, h, c);
+      if (!source)
+         abort_example("Could not create %dx%d bitmap.\n", w, h);
+
+      for (t = 0; t < sizeof(file_types) / sizeof(file_types[0]); t++) {
+         Result result;
+         char const *type = file_types[t];
+
+         if (only_type && strcmp(only_type, type) != 0)
+            continue;
+
+         result.encoded_size = encode(source, type, buffer, buffer_size,
+            &result.encode_mbps);
+         if (result.encoded_size == 0) {
+            log_printf("%-9s %-5s %s\n", content_names[c], type,
+               "(cannot save)");
+            continue;
+         }
+
+         for (p = 0; p < sizeof(pixel_formats) / sizeof(pixel_formats[0]);
+               p++) {
+            al_set_new_bitmap_format(pixel_formats[p].format);
+            if (!decode(buffer, result.encoded_size, type, w, h, &result)) {
+               log_printf("%-9s %-5s %-13s %s\n", content_names[c], type,
+                  pixel_formats[p].name, "(cannot load)");
+               continue;
+            }
+            log_printf("%-9s %-5s %-13s %10.1f %10.1f %10.1f %8u %10.1f\n",
+               content_names[c], type, pixel_formats[p].name,
+               result.encoded_size / 1024.0, result.encode_mbps,
+               result.decode_mbps, (unsigned)result.decode_allocs,
+               result.decode_peak / 1024.0);
+         }
+      }
+
+      al_destroy_bitmap(source);
+   }
+
+   free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+   int w = 512, h = 512;
+   char const *only_type = NULL;
+   int i;
+
+   count_memory();
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+   open_log_monospace();
+   al_init_image_addon();
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+         if (sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+            abort_example("Bad size %s, expected WxH.\n", argv[i]);
+      }
+      else if (argv[i][0] == '.') {
+         only_type = argv[i];
+      }
+      else {
+         abort_example("Usage: %s [-s WxH] [.type]\n", argv[0]);
+      }
+   }
+
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+   log_printf("Image size %dx%d, MB/s counts decoded pixels at 4 bytes each.\n",
+      w, h);
+   run(w, h, only_type);
+
+   close_log(true);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
@@ -0,0 +1,697 @@
+/*
+ *    Benchmark and reference images for the primitives addon.
+ *
+ *    Draws batches of random primitives of every kind into a memory bitmap,
+ *    so no display is needed: each high level primitive, each polyline join
+ *    and cap style and several vertex declaration layouts. For each it
+ *    reports the primitives and the pixels drawn per second. The pixels are
+ *    counted by drawing the batch once more, additively into a floating
+ *    point bitmap.
+ *
+ *    With -save DIR the first batch of each kind is written to DIR as a PNG
+ *    image, with -compare DIR it is compared against such an image, so the
+ *    output can be checked before and after a change to the rasterizers.
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <allegro5/allegro_primitives.h>
+
+#include "common.c"
+
+/* How many seconds each measurement should approximately take. */
+#define TEST_TIME 0.5
+
+#define TARGET_W 800
+#define TARGET_H 600
+
+/* Random numbers available to each primitive. */
+#define NUM_PARAMS 24
+
+/* A channel may differ by this much from the reference image, to allow
+ * for rounding differences between compilers.
+ */
+#define TOLERANCE 2
+
+
+typedef struct Case Case;
+
+struct Case {
+   char const *name;
+   /* Draws one primitive from the random numbers p, or NULL for the vertex
+    * declaration cases which draw the whole batch at once.
+    */
+   void (*draw)(Case const *c, float const *p);
+   int arg1, arg2;
+};
+
+static ALLEGRO_BITMAP *texture;
+static ALLEGRO_VERTEX_DECL *decls[4];
+
+/* The vertices of the batch, for the vertex declaration cases. */
+static char *batch_vertices;
+
+
+/* A random number from 0 up to 1. */
+static float next_rand(void)
+{
+   return example_rand() / 32768.0f;
+}
+
+static ALLEGRO_COLOR param_color(float const *p)
+{
+   return al_map_rgba_f(p[0] * 0.5f, p[1] * 0.5f, p[2] * 0.5f, 0.5f);
+}
+
+/* Positions spread over the target and a bit past its edges. */
+#define PX(v) ((v) * (TARGET_W + 40) - 20)
+#define PY(v) ((v) * (TARGET_H + 40) - 20)
+/* Sizes from 2 to 80 pixels, most of them small. */
+#define PS(v) (2 + 78 * (v) * (v))
+#define THICKNESS(c, v) ((c)->arg1 ? 1 + 7 * (v) : 0)
+
+
+static void draw_line(Case const *c, float const *p)
+{
+   float x = PX(p[3]), y = PY(p[4]);
+   al_draw_line(x, y, x + PS(p[5]) * (p[6] - 0.5f) * 2,
+      y + PS(p[7]) * (p[8] - 0.5f) * 2, param_color(p), THICKNESS(c, p[9]));
+}
+
+static void draw_triangle(Case const *c, float const *p)
+{
+   float x = PX(p[3]), y = PY(p[4]), s = PS(p[5]);
+   float x2 = x + s * (p[6] - 0.5f) * 2, y2 = y + s * (p[7] - 0.5f) * 2;
+   float x3 = x + s * (p[8] - 0.5f) * 2, y3 = y + s * (p[9] - 0.5f) * 2;
+   if (c->arg2)
+      al_draw_filled_triangle(x, y, x2, y2, x3, y3, param_color(p));
+   else
+      al_draw_triangle(x, y, x2, y2, x3, y3, param_color(p),
+         THICKNESS(c, p[10]));
+}
+
+static void draw_rectangle(Case const *c, float const *p)
+{
+   float x = PX(p[3]), y = PY(p[4]);
+   float x2 = x + PS(p[5]), y2 = y + PS(p[6]);
+   if (c->arg2)
+      al_draw_filled_rectangle(x, y, x2, y2, param_color(p));
+   else
+      al_draw_rectangle(x, y, x2, y2, param_color(p), THICKNESS(c, p[7]));
+}
+
+static void draw_rounded_rectangle(Case const *c, float const *p)
+{
+   float x = PX(p[3]), y = PY(p[4]);
+   float w = PS(p[5]), h = PS(p[6]);
+   float r = p[7] * (w < h ? w : h) / 2;
+   if (c->arg2)
+      al_draw_filled_rounded_rectangle(x, y, x + w, y + h, r, r,
+         param_color(p));
+   else
+      al_draw_rounded_rectangle(x, y, x + w, y + h, r, r, param_color(p),
+         THICKNESS(c, p[8]));
+}
+
+static void draw_circle(Case const *c, float const *p)
+{
+   if (c->arg2)
+      al_draw_filled_circle(PX(p[3]), PY(p[4]), PS(p[5]) / 2, param_color(p));
+   else
+      al_draw_circle(PX(p[3]), PY(p[4]), PS(p[5]) / 2, param_color(p),
+         THICKNESS(c, p[6]));
+}
+
+static void draw_ellipse(Case const *c, float const *p)
+{
+   if (c->arg2)
+      al_draw_filled_ellipse(PX(p[3]), PY(p[4]), PS(p[5]) / 2, PS(p[6]) / 2,
+         param_color(p));
+   else
+      al_draw_ellipse(PX(p[3]), PY(p[4]), PS(p[5]) / 2, PS(p[6]) / 2,
+         param_color(p), THICKNESS(c, p[7]));
+}
+
+static void draw_arc(Case const *c, float const *p)
+{
+   float start = p[6] * 2 * ALLEGRO_PI, delta = (p[7] - 0.5f) * 4 * ALLEGRO_PI;
+   if (c->arg2)
+      al_draw_elliptical_arc(PX(p[3]), PY(p[4]), PS(p[5]) / 2, PS(p[8]) / 2,
+         start, delta, param_color(p), THICKNESS(c, p[9]));
+   else
+      al_draw_arc(PX(p[3]), PY(p[4]), PS(p[5]) / 2, start, delta,
+         param_color(p), THICKNESS(c, p[9]));
+}
+
+static void draw_pieslice(Case const *c, float const *p)
+{
+   float start = p[6] * 2 * ALLEGRO_PI, delta = (p[7] - 0.5f) * 4 * ALLEGRO_PI;
+   if (c->arg2)
+      al_draw_filled_pieslice(PX(p[3]), PY(p[4]), PS(p[5]) / 2, start, delta,
+         param_color(p));
+   else
+      al_draw_pieslice(PX(p[3]), PY(p[4]), PS(p[5]) / 2, start, delta,
+         param_color(p), THICKNESS(c, p[8]));
+}
+
+static void random_points(float const *p, float *points, int n)
+{
+   float x = PX(p[3]), y = PY(p[4]), s = PS(p[5]);
+   int j;
+
+   for (j = 0; j < n; j++) {
+      points[2 * j] = x + s * (p[6 + 2 * j] - 0.5f) * 2;
+      points[2 * j + 1] = y + s * (p[7 + 2 * j] - 0.5f) * 2;
+   }
+}
+
+static void draw_spline(Case const *c, float const *p)
+{
+   float points[8];
+   random_points(p, points, 4);
+   al_draw_spline(points, param_color(p), THICKNESS(c, p[14]));
+}
+
+static void draw_ribbon(Case const *c, float const *p)
+{
+   float points[16];
+   random_points(p, points, 8);
+   al_draw_ribbon(points, 2 * sizeof(float), param_color(p),
+      THICKNESS(c, p[22]), 8);
+}
+
+/* A star, which is concave, with a varying number of points. */
+static void star_points(float const *p, float *points, int n, float scale)
+{
+   float x = PX(p[3]), y = PY(p[4]), s = PS(p[5]) / 2 * scale;
+   float a = p[6] * 2 * ALLEGRO_PI;
+   int j;
+
+   for (j = 0; j < n; j++) {
+      float r = (j & 1) ? s * (0.3f + 0.4f * p[7]) : s;
+      float t = a + j * 2 * ALLEGRO_PI / n;
+      points[2 * j] = x + r * cosf(t);
+      points[2 * j + 1] = y + r * sinf(t);
+   }
+}
+
+static void draw_polygon(Case const *c, float const *p)
+{
+   float points[2 * 16];
+   int n = 2 * (3 + (int)(p[8] * 6));
+   star_points(p, points, n, 1);
+   if (c->arg2)
+      al_draw_filled_polygon(points, n, param_color(p));
+   else
+      al_draw_polygon(points, n, ALLEGRO_LINE_JOIN_ROUND, param_color(p),
+         THICKNESS(c, p[9]), 4);
+}
+
+static void draw_polygon_with_holes(Case const *c, float const *p)
+{
+   float points[2 * 32];
+   int counts[3];
+   int n = 2 * (3 + (int)(p[8] * 6));
+   int j;
+   (void)c;
+   star_points(p, points, n, 1);
+   /* The hole is the star shrunk and wound the other way. */
+   star_points(p, points + 2 * n, n, 0.5f);
+   for (j = 0; j < n / 2; j++) {
+      float *a = points + 2 * (n + j), *b = points + 2 * (2 * n - 1 - j);
+      float t;
+      t = a[0]; a[0] = b[0]; b[0] = t;
+      t = a[1]; a[1] = b[1]; b[1] = t;
+   }
+   counts[0] = n;
+   counts[1] = n;
+   counts[2] = 0;
+   al_draw_filled_polygon_with_holes(points, counts, param_color(p));
+}
+
+static void draw_polyline(Case const *c, float const *p)
+{
+   float points[16];
+   random_points(p, points, 8);
+   al_draw_polyline(points, 2 * sizeof(float), 8, c->arg1, c->arg2,
+      param_color(p), 1 + 7 * p[22], 3);
+}
+
+
+/* The vertex declaration cases draw the batch as one triangle list. */
+
+typedef struct {
+   float x, y;
+   ALLEGRO_COLOR color;
+} VERTEX_2D;
+
+typedef struct {
+   short x, y;
+   ALLEGRO_COLOR color;
+} VERTEX_SHORT;
+
+typedef struct {
+   float x, y, z;
+   float u, v;
+   ALLEGRO_COLOR color;
+} VERTEX_TEX;
+
+typedef struct {
+   float x, y;
+   short u, v;
+   ALLEGRO_COLOR color;
+} VERTEX_TEX_SHORT;
+
+enum {
+   DECL_NONE,
+   DECL_2D,
+   DECL_SHORT,
+   DECL_TEX,
+   DECL_TEX_SHORT,
+   NUM_LAYOUTS
+};
+
+static int const layout_sizes[NUM_LAYOUTS] = {
+   sizeof(ALLEGRO_VERTEX), sizeof(VERTEX_2D), sizeof(VERTEX_SHORT),
+   sizeof(VERTEX_TEX), sizeof(VERTEX_TEX_SHORT)
+};
+
+static void create_decls(void)
+{
+   ALLEGRO_VERTEX_ELEMENT e2d[] = {
+      {ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_FLOAT_2, offsetof(VERTEX_2D, x)},
+      {ALLEGRO_PRIM_COLOR_ATTR, 0, offsetof(VERTEX_2D, color)},
+      {0, 0, 0}
+   };
+   ALLEGRO_VERTEX_ELEMENT eshort[] = {
+      {ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_SHORT_2, offsetof(VERTEX_SHORT, x)},
+      {ALLEGRO_PRIM_COLOR_ATTR, 0, offsetof(VERTEX_SHORT, color)},
+      {0, 0, 0}
+   };
+   ALLEGRO_VERTEX_ELEMENT etex[] = {
+      {ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_FLOAT_3, offsetof(VERTEX_TEX, x)},
+      {ALLEGRO_PRIM_TEX_COORD, ALLEGRO_PRIM_FLOAT_2, offsetof(VERTEX_TEX, u)},
+      {ALLEGRO_PRIM_COLOR_ATTR, 0, offsetof(VERTEX_TEX, color)},
+      {0, 0, 0}
+   };
+   ALLEGRO_VERTEX_ELEMENT etexshort[] = {
+      {ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_FLOAT_2, offsetof(VERTEX_TEX_SHORT, x)},
+      {ALLEGRO_PRIM_TEX_COORD_PIXEL, ALLEGRO_PRIM_SHORT_2, offsetof(VERTEX_TEX_SHORT, u)},
+      {ALLEGRO_PRIM_COLOR_ATTR, 0, offsetof(VERTEX_TEX_SHORT, color)},
+      {0, 0, 0}
+   };
+
+   decls[0] = al_create_vertex_decl(e2d, sizeof(VERTEX_2D));
+   decls[1] = al_create_vertex_decl(eshort, sizeof(VERTEX_SHORT));
+   decls[2] = al_create_vertex_decl(etex, sizeof(VERTEX_TEX));
+   decls[3] = al_create_vertex_decl(etexshort, sizeof(VERTEX_TEX_SHORT));
+}
+
+static void write_vertex(int layout, void *dst, float x, float y, float u,
+   float v, ALLEGRO_COLOR color)
+{
+   switch (layout) {
+      case DECL_NONE: {
+         ALLEGRO_VERTEX *vtx = dst;
+         vtx->x = x; vtx->y = y; vtx->z = 0;
+         vtx->u = u; vtx->v = v;
+         vtx->color = color;
+         break;
+      }
+      case DECL_2D: {
+         VERTEX_2D *vtx = dst;
+         vtx->x = x; vtx->y = y;
+         vtx->color = color;
+         break;
+      }
+      case DECL_SHORT: {
+         VERTEX_SHORT *vtx = dst;
+         vtx->x = (short)x; vtx->y = (short)y;
+         vtx->color = color;
+         break;
+      }
+      case DECL_TEX: {
+         VERTEX_TEX *vtx = dst;
+         vtx->x = x; vtx->y = y; vtx->z = 0;
+         vtx->u = u / al_get_bitmap_width(texture);
+         vtx->v = v / al_get_bitmap_height(texture);
+         vtx->color = color;
+         break;
+      }
+      case DECL_TEX_SHORT: {
+         VERTEX_TEX_SHORT *vtx = dst;
+         vtx->x = x; vtx->y = y;
+         vtx->u = (short)u; vtx->v = (short)v;
+         vtx->color = color;
+         break;
+      }
+   }
+}
+
+static void make_batch_vertices(Case const *c, float const *params, int n)
+{
+   int size = layout_sizes[c->arg1];
+   int i, j;
+
+   free(batch_vertices);
+   batch_vertices = malloc(3 * n * size);
+   for (i = 0; i < n; i++) {
+      float const *p = params + i * NUM_PARAMS;
+      float x = PX(p[3]), y = PY(p[4]), s = PS(p[5]);
+      for (j = 0; j < 3; j++) {
+         /* Gradients, unless arg2 asks for a single color. */
+         ALLEGRO_COLOR color = param_color(c->arg2 ? p : p + 6 + 4 * j);
+         write_vertex(c->arg1, batch_vertices + (3 * i + j) * size,
+            x + s * (p[7 + 4 * j] - 0.5f) * 2, y + s * (p[8 + 4 * j] - 0.5f) * 2,
+            p[9 + 4 * j] * 128, p[10 + 4 * j] * 128, color);
+      }
+   }
+}
+
+static int draw_vertices(Case const *c, int n)
+{
+   ALLEGRO_BITMAP *tex = NULL;
+   if (c->arg1 == DECL_TEX || c->arg1 == DECL_TEX_SHORT)
+      tex = texture;
+   return al_draw_prim(batch_vertices,
+      c->arg1 == DECL_NONE ? NULL : decls[c->arg1 - 1], tex, 0, 3 * n,
+      ALLEGRO_PRIM_TRIANGLE_LIST);
+}
+
+
+#define HIGH_LEVEL(name, draw)                      \
+   {name, draw, 0, 0},                              \
+   {name " thick", draw, 1, 0}
+
+#define HIGH_LEVEL_FILLED(name, draw)               \
+   HIGH_LEVEL(name, draw),                          \
+   {"filled " name, draw, 0, 1}
+
+#define POLYLINE_CAPS(join, join_style)                                  \
+   {"polyline " join " none", draw_polyline, join_style, ALLEGRO_LINE_CAP_NONE},        \
+   {"polyline " join " square", draw_polyline, join_style, ALLEGRO_LINE_CAP_SQUARE},    \
+   {"polyline " join " round", draw_polyline, join_style, ALLEGRO_LINE_CAP_ROUND},      \
+   {"polyline " join " triangle", draw_polyline, join_style, ALLEGRO_LINE_CAP_TRIANGLE},\
+   {"polyline " join " closed", draw_polyline, join_style, ALLEGRO_LINE_CAP_CLOSED}
+
+static Case const cases[] = {
+   HIGH_LEVEL("line", draw_line),
+   HIGH_LEVEL_FILLED("triangle", draw_triangle),
+   HIGH_LEVEL_FILLED("rectangle", draw_rectangle),
+   HIGH_LEVEL_FILLED("rounded rectangle", draw_rounded_rectangle),
+   HIGH_LEVEL_FILLED("circle", draw_circle),
+   HIGH_LEVEL_FILLED("ellipse", draw_ellipse),
+   HIGH_LEVEL_FILLED("pieslice", draw_pieslice),
+   HIGH_LEVEL("arc", draw_arc),
+   {"elliptical arc", draw_arc, 0, 1},
+   {"elliptical arc thick", draw_arc, 1, 1},
+   HIGH_LEVEL("spline", draw_spline),
+   HIGH_LEVEL("ribbon", draw_ribbon),
+   HIGH_LEVEL_FILLED("polygon", draw_polygon),
+   {"filled polygon with holes", draw_polygon_with_holes, 0, 0},
+   POLYLINE_CAPS("none", ALLEGRO_LINE_JOIN_NONE),
+   POLYLINE_CAPS("bevel", ALLEGRO_LINE_JOIN_BEVEL),
+   POLYLINE_CAPS("round", ALLEGRO_LINE_JOIN_ROUND),
+   POLYLINE_CAPS("miter", ALLEGRO_LINE_JOIN_MITER),
+   {"ALLEGRO_VERTEX", NULL, DECL_NONE, 0},
+   {"ALLEGRO_VERTEX solid", NULL, DECL_NONE, 1},
+   {"float2 pos", NULL, DECL_2D, 0},
+   {"float2 pos solid", NULL, DECL_2D, 1},
+   {"short2 pos", NULL, DECL_SHORT, 0},
+   {"float3 pos float2 uv", NULL, DECL_TEX, 0},
+   {"float3 pos float2 uv solid", NULL, DECL_TEX, 1},
+   {"float2 pos short2 pixel uv", NULL, DECL_TEX_SHORT, 0}
+};
+
+#define NUM_CASES (int)(sizeof(cases) / sizeof(cases[0]))
+
+
+static int draw_batch(Case const *c, float const *params, int n)
+{
+   int i;
+
+   if (!c->draw)
+      return draw_vertices(c, n);
+
+   for (i = 0; i < n; i++)
+      c->draw(c, params + i * NUM_PARAMS);
+   return n;
+}
+
+/* Counts the pixels the batch writes, overlaps included, by adding up 1
+ * for each of them.
+ */
+static double count_pixels(Case const *c, float const *params, int n,
+   ALLEGRO_BITMAP *counter)
+{
+   ALLEGRO_STATE state;
+   ALLEGRO_LOCKED_REGION *lr;
+   double sum = 0;
+   int x, y;
+
+   al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+   al_set_target_bitmap(counter);
+   al_clear_to_color(al_map_rgba_f(0, 0, 0, 0));
+   al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
+   /* Everything is drawn with an alpha of 0.5, so each pixel written adds
+    * 0.5 to the alpha channel.
+    */
+   draw_batch(c, params, n);
+   al_restore_state(&state);
+
+   lr = al_lock_bitmap(counter, ALLEGRO_PIXEL_FORMAT_ABGR_F32,
+      ALLEGRO_LOCK_READONLY);
+   for (y = 0; y < TARGET_H; y++) {
+      float const *row = (float const *)((char const *)lr->data + y * lr->pitch);
+      for (x = 0; x < TARGET_W; x++)
+         sum += row[4 * x + 3] * 2;
+   }
+   al_unlock_bitmap(counter);
+   return sum;
+}
+
+static void file_name(char *buf, size_t size, char const *dir, char const *name)
+{
+   size_t i, n;
+
+   snprintf(buf, size, "%s/", dir);
+   n = strlen(buf);
+   for (i = 0; name[i] && n + 5 < size; i++)
+      buf[n++] = name[i] == ' ' ? '_' : name[i];
+   strcpy(buf + n, ".png");
+}
+
+/* Returns the number of pixels differing from the reference, or -1 if it
+ * could not be loaded.
+ */
+static int compare_image(ALLEGRO_BITMAP *target, char const *path)
+{
+   ALLEGRO_BITMAP *ref;
+   int x, y, bad = 0;
+
+   ref = al_load_bitmap(path);
+   if (!ref)
+      return -1;
+   if (al_get_bitmap_width(ref) != TARGET_W ||
+         al_get_bitmap_height(ref) != TARGET_H) {
+      al_destroy_bitmap(ref);
+      return TARGET_W * TARGET_H;
+   }
+
+   al_lock_bitmap(ref, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+   al_lock_bitmap(target, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+   for (y = 0; y < TARGET_H; y++) {
+      for (x = 0; x < TARGET_W; x++) {
+         unsigned char r1, g1, b1, a1, r2, g2, b2, a2;
+         al_unmap_rgba(al_get_pixel(ref, x, y), &r1, &g1, &b1, &a1);
+         al_unmap_rgba(al_get_pixel(target, x, y), &r2, &g2, &b2, &a2);
+         if (abs(r1 - r2) > TOLERANCE || abs(g1 - g2) > TOLERANCE ||
+               abs(b1 - b2) > TOLERANCE || abs(a1 - a2) > TOLERANCE)
+            bad++;
+      }
+   }
+   al_unlock_bitmap(target);
+   al_unlock_bitmap(ref);
+   al_destroy_bitmap(ref);
+   return bad;
+}
+
+static void create_texture(void)
+{
+   ALLEGRO_STATE state;
+   int x, y;
+
+   al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP);
+   texture = al_create_bitmap(128, 128);
+   if (!texture)
+      abort_example("Could not create texture.\n");
+   al_set_target_bitmap(texture);
+   al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
+   for (y = 0; y < 128; y++) {
+      for (x = 0; x < 128; x++) {
+         al_put_pixel(x, y, ((x ^ y) & 16) ?
+            al_map_rgb(x * 2, y * 2, 255) : al_map_rgb(255, 255 - x, y));
+      }
+   }
+   al_unlock_bitmap(texture);
+   al_restore_state(&state);
+}
+
+static void run(int batch_size, char const *filter, char const *save_dir,
+   char const *compare_dir, int *failures)
+{
+   ALLEGRO_BITMAP *target, *counter;
+   float *params;
+   int i, c;
+
+   al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888);
+   target = al_create_bitmap(TARGET_W, TARGET_H);
+   al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_F32);
+   counter = al_create_bitmap(TARGET_W, TARGET_H);
+   if (!target || !counter)
+      abort_example("Could not create target bitmaps.\n");
+   al_set_target_bitmap(target);
+
+   params = malloc(batch_size * NUM_PARAMS * sizeof(float));
+
+   log_printf("%-30s %6s %8s %10s %12s %10s %s\n", "primitive", "prims",
+      "px/prim", "batch(ms)", "prims/s", "Mpixels/s",
+      compare_dir ? "reference" : "");
+
+   for (c = 0; c < NUM_CASES; c++) {
+      Case const *cs = &cases[c];
+      double t0, t1, pixels;
+      int prims = 0, n = 0, bad = 0;
+      char path[1024];
+
+      if (filter && !strstr(cs->name, filter))
+         continue;
+
+      /* The same primitives for every run, and the same triangles for every
+       * vertex layout.
+       */
+      example_srand(cs->draw ? c + 1 : NUM_CASES);
+      for (i = 0; i < batch_size * NUM_PARAMS; i++)
+         params[i] = next_rand();
+      if (!cs->draw)
+         make_batch_vertices(cs, params, batch_size);
+
+      /* The first batch is the one saved and compared. */
+      al_clear_to_color(al_map_rgb(0, 0, 0));
+      prims = draw_batch(cs, params, batch_size);
+      if (save_dir) {
+         file_name(path, sizeof(path), save_dir, cs->name);
+         if (!al_save_bitmap(path, target))
+            abort_example("Could not save %s.\n", path);
+      }
+      if (compare_dir) {
+         file_name(path, sizeof(path), compare_dir, cs->name);
+         bad = compare_image(target, path);
+         if (bad != 0)
+            (*failures)++;
+      }
+
+      t0 = al_get_time();
+      do {
+         draw_batch(cs, params, batch_size);
+         n++;
+         t1 = al_get_time();
+      } while (t1 - t0 < TEST_TIME);
+
+      pixels = count_pixels(cs, params, batch_size, counter);
+
+      log_printf("%-30s %6d %8.1f %10.3f %12.0f %10.2f", cs->name, prims,
+         prims ? pixels / prims : 0.0, (t1 - t0) * 1000 / n,
+         prims * n / (t1 - t0), pixels * n / (t1 - t0) / 1e6);
+
+      if (compare_dir) {
+         if (bad < 0)
+            log_printf(" missing");
+         else if (bad > 0)
+            log_printf(" %d pixels differ", bad);
+         else
+            log_printf(" ok");
+      }
+      log_printf("\n");
+   }
+
+   free(params);
+   al_set_target_bitmap(NULL);
+   al_destroy_bitmap(target);
+   al_destroy_bitmap(counter);
+}
+
+int main(int argc, char **argv)
+{
+   int batch_size = 200;
+   char const *filter = NULL;
+   char const *save_dir = NULL;
+   char const *compare_dir = NULL;
+   bool antialias = false;
+   int failures = 0;
+   int i;
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+   open_log_monospace();
+   al_init_image_addon();
+   al_init_primitives_addon();
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         batch_size = atoi(argv[++i]);
+         if (batch_size <= 0)
+            abort_example("Bad batch size %s.\n", argv[i]);
+      }
+      else if (strcmp(argv[i], "-save") == 0 && i + 1 < argc) {
+         save_dir = argv[++i];
+      }
+      else if (strcmp(argv[i], "-compare") == 0 && i + 1 < argc) {
+         compare_dir = argv[++i];
+      }
+      else if (strcmp(argv[i], "-aa") == 0) {
+         antialias = true;
+      }
+      else if (argv[i][0] != '-' && !filter) {
+         filter = argv[i];
+      }
+      else {
+         abort_example("Usage: %s [-n batch] [-aa] [-save dir] "
+            "[-compare dir] [filter]\n", argv[0]);
+      }
+   }
+
+   if (save_dir && !al_make_directory(save_dir))
+      abort_example("Could not create %s.\n", save_dir);
+
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+   create_texture();
+   create_decls();
+   if (antialias)
+      al_set_primitives_flags(ALLEGRO_PRIM_ANTIALIAS);
+
+   log_printf("Batches of %d random primitives, drawn into a %dx%d "
+      "memory bitmap%s.\n", batch_size, TARGET_W, TARGET_H,
+      antialias ? " with antialiasing" : "");
+   run(batch_size, filter, save_dir, compare_dir, &failures);
+
+   if (compare_dir)
+      log_printf("%d images differ from %s.\n", failures, compare_dir);
+
+   for (i = 0; i < 4; i++)
+      al_destroy_vertex_decl(decls[i]);
+   al_destroy_bitmap(texture);
+   free(batch_vertices);
+
+   close_log(true);
+
+   return failures ? 1 : 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
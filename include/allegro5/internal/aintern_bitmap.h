@@ -189,6 +189,18 @@ void _al_convert_to_memory_bitmap(ALLEGRO_BITMAP *bitmap);
 /* Simple bitmap drawing */
 void _al_put_pixel(ALLEGRO_BITMAP *bitmap, int x, int y, ALLEGRO_COLOR color);
 
+/* An untransformed region of a bitmap and where to draw it, see
+ * _al_draw_tinted_bitmap_quads.
+ */
+typedef struct _AL_BITMAP_QUAD
+{
+   float sx, sy, sw, sh;
+   float dx, dy;
+} _AL_BITMAP_QUAD;
+
+AL_FUNC(void, _al_draw_tinted_bitmap_quads, (ALLEGRO_BITMAP *bitmap,
+   ALLEGRO_COLOR tint, const _AL_BITMAP_QUAD *quads, int count));
+
 /* Bitmap I/O */
 void _al_init_iio_table(void);
 
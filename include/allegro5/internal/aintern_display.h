@@ -104,6 +104,10 @@ struct ALLEGRO_DISPLAY_INTERFACE
 
    int (*draw_vertex_buffer)(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX_BUFFER* vertex_buffer, int start, int end, int type);
    int (*draw_indexed_buffer)(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_INDEX_BUFFER* index_buffer, int start, int end, int type);
+   /* Returns -1 if the instances can't be drawn in one go, in which case
+    * the caller draws them some other way.
+    */
+   int (*draw_prim_instanced)(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX_BUFFER* vertex_buffer, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_INDEX_BUFFER* index_buffer, const int* indices, int start, int end, int type, const struct ALLEGRO_PRIM_INSTANCE* instances, int num_instances);
 };
 
 
@@ -158,6 +162,11 @@ struct ALLEGRO_DISPLAY
    ALLEGRO_BLENDER cur_blender;
 
    ALLEGRO_SHADER* default_shader;
+   /* Used instead of the default shader to draw instanced primitives,
+    * created when first needed.
+    */
+   ALLEGRO_SHADER* instanced_shader;
+   bool instanced_shader_failed;
 
    ALLEGRO_TRANSFORM projview_transform;
 
@@ -16,6 +16,11 @@ struct ALLEGRO_FILE
    void *userdata;
    unsigned char ungetc[ALLEGRO_UNGETC_SIZE];
    int ungetc_len;
+   /* Last result of al_identify_bitmap_f, so that loading straight after
+    * identifying doesn't go through the identifiers again.
+    */
+   int64_t identified_pos;
+   int identified_handler;
 };
 
 #ifdef __cplusplus
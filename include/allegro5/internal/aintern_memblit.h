@@ -1,6 +1,8 @@
 #ifndef __al_included_allegro5_aintern_memblit_h
 #define __al_included_allegro5_aintern_memblit_h
 
+#include "allegro5/internal/aintern_bitmap.h"
+
 #ifdef __cplusplus
    extern "C" {
 #endif
@@ -10,6 +12,9 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *bitmap,
    ALLEGRO_COLOR tint,
    int sx, int sy, int sw, int sh, int dx, int dy, int flags);
 
+bool _al_draw_bitmap_quads_memory(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint, const _AL_BITMAP_QUAD *quads, int count);
+
 
 #ifdef __cplusplus
    }
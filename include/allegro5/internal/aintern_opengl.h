@@ -126,6 +126,9 @@ typedef struct ALLEGRO_OGL_VARLOCS
    GLint alpha_func_loc;
    GLint alpha_test_val_loc;
    GLint user_attr_loc[ALLEGRO_PRIM_MAX_USER_ATTR];
+   GLint instance_transform_loc;
+   GLint instance_color_loc;
+   GLint instance_texcoord_loc;
 } ALLEGRO_OGL_VARLOCS;
 
 typedef struct ALLEGRO_OGL_EXTRAS
@@ -154,6 +157,8 @@ typedef struct ALLEGRO_OGL_EXTRAS
 
    /* For OpenGL 3.0+ we use a single vao and vbo. */
    GLuint vao, vbo;
+   /* Size of the vbo storage and how much of it was streamed into. */
+   GLsizeiptr vbo_size, vbo_offset;
 
 } ALLEGRO_OGL_EXTRAS;
 
@@ -15,6 +15,7 @@ enum ALLEGRO_BITMAP_WRAP;
 int _al_fix_texcoord(float var, int max_var, ALLEGRO_BITMAP_WRAP wrap);
 int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type);
 int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, const int* indices, int num_vtx, int type);
+bool _al_draw_prim_coverage(ALLEGRO_VERTEX* cache, const int* indices, int base, int num_vtx, int type, int* num_primitives);
 
 void _al_line_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2);
 void _al_point_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v);
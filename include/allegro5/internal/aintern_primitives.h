@@ -49,6 +49,20 @@ AL_FUNC(int, _al_draw_prim, (const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
 AL_FUNC(int, _al_draw_indexed_prim, (const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture, const int* indices, int num_vtx, int type));
 AL_FUNC(int, _al_draw_vertex_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, int start, int end, int type));
 AL_FUNC(int, _al_draw_indexed_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, ALLEGRO_INDEX_BUFFER* index_buffer, int start, int end, int type));
+AL_FUNC(int, _al_draw_instanced_prim, (ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX_BUFFER* vertex_buffer, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_INDEX_BUFFER* index_buffer, const int* indices, int start, int end, int type, const struct ALLEGRO_PRIM_INSTANCE* instances, int num_instances));
+AL_FUNC(void, _al_convert_vertex, (ALLEGRO_BITMAP* texture, const void* vtx, ALLEGRO_VERTEX* dest, const ALLEGRO_VERTEX_DECL* decl));
+
+/*
+ * Per thread state of the primitives addon, kept in the core's thread local
+ * storage along with the blender.
+ */
+typedef struct _AL_PRIM_STATE {
+   int flags;
+   struct ALLEGRO_SHAPE* recording_shape;
+   float circle_quality; /* 0 until al_set_primitives_tolerance is called */
+} _AL_PRIM_STATE;
+
+AL_FUNC(_AL_PRIM_STATE*, _al_get_prim_state, (void));
 
 AL_FUNC(ALLEGRO_VERTEX_DECL*, _al_create_vertex_decl, (const ALLEGRO_VERTEX_ELEMENT* elements, int stride));
 AL_FUNC(void, _al_destroy_vertex_decl, (ALLEGRO_VERTEX_DECL* decl));
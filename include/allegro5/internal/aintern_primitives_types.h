@@ -66,6 +66,15 @@ typedef enum ALLEGRO_PRIM_BUFFER_FLAGS
    ALLEGRO_PRIM_BUFFER_READWRITE    = 0x08
 } ALLEGRO_PRIM_BUFFER_FLAGS;
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC) || defined(ALLEGRO_PRIMITIVES_SRC)
+/* Enum: ALLEGRO_PRIM_FLAGS
+ */
+typedef enum ALLEGRO_PRIM_FLAGS
+{
+   ALLEGRO_PRIM_ANTIALIAS           = 0x01
+} ALLEGRO_PRIM_FLAGS;
+#endif
+
 /* Type: ALLEGRO_VERTEX_ELEMENT
  */
 typedef struct ALLEGRO_VERTEX_ELEMENT ALLEGRO_VERTEX_ELEMENT;
@@ -98,4 +107,16 @@ typedef struct ALLEGRO_VERTEX_BUFFER ALLEGRO_VERTEX_BUFFER;
  */
 typedef struct ALLEGRO_INDEX_BUFFER ALLEGRO_INDEX_BUFFER;
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC) || defined(ALLEGRO_PRIMITIVES_SRC)
+/* Type: ALLEGRO_PRIM_INSTANCE
+ */
+typedef struct ALLEGRO_PRIM_INSTANCE ALLEGRO_PRIM_INSTANCE;
+
+struct ALLEGRO_PRIM_INSTANCE {
+   ALLEGRO_TRANSFORM transform;
+   ALLEGRO_COLOR color;
+   float u, v;
+};
+#endif
+
 #endif
@@ -764,7 +764,7 @@ AGL_API(void, VertexAttribDivisor, (GLuint, GLuint))
 #endif
 
 #if defined _ALLEGRO_GL_ARB_map_buffer_range
-AGL_API(void, MapBufferRange, (GLenum, GLintptr, GLsizeiptr, GLbitfield))
+AGL_API(GLvoid*, MapBufferRange, (GLenum, GLintptr, GLsizeiptr, GLbitfield))
 AGL_API(void, FlushMappedBufferRange, (GLenum, GLintptr, GLsizeiptr))
 #endif
 
@@ -49,6 +49,9 @@ typedef enum ALLEGRO_SHADER_PLATFORM ALLEGRO_SHADER_PLATFORM;
 #define ALLEGRO_SHADER_VAR_ALPHA_TEST        "al_alpha_test"
 #define ALLEGRO_SHADER_VAR_ALPHA_FUNCTION    "al_alpha_func"
 #define ALLEGRO_SHADER_VAR_ALPHA_TEST_VALUE  "al_alpha_test_val"
+#define ALLEGRO_SHADER_VAR_INSTANCE_TRANSFORM "al_instance_transform"
+#define ALLEGRO_SHADER_VAR_INSTANCE_COLOR    "al_instance_color"
+#define ALLEGRO_SHADER_VAR_INSTANCE_TEXCOORD "al_instance_texcoord"
 
 AL_FUNC(ALLEGRO_SHADER *, al_create_shader, (ALLEGRO_SHADER_PLATFORM platform));
 AL_FUNC(bool, al_attach_shader_source, (ALLEGRO_SHADER *shader,
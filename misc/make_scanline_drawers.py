@@ -14,6 +14,15 @@ def interp(string):
       string = string.replace('#{%s}' % item, str(eval(item, globals, locals)))
    return string
 
+# Destination formats which get loops of their own, so that the pixel format
+# switch and the conversion to and from floats are resolved at compile time.
+# Textured loops are only specialised when the texture has the same format.
+fast_formats = [
+   'ALLEGRO_PIXEL_FORMAT_ARGB_8888',
+   'ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE',
+   'ALLEGRO_PIXEL_FORMAT_XRGB_8888',
+   ]
+
 def make_drawer(name):
    global texture, grad, solid, shade, opaque, white
    texture = "_texture_" in name
@@ -156,7 +165,7 @@ def make_drawer(name):
             dst_mode='ALLEGRO_INVERSE_ALPHA',
             dst_alpha='ALLEGRO_INVERSE_ALPHA',
             const_color='NULL',
-            if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888',
+            if_formats=fast_formats,
             alpha_only=True,
             repeat=repeat,
             )
@@ -169,7 +178,7 @@ def make_drawer(name):
             dst_mode='ALLEGRO_INVERSE_ALPHA',
             dst_alpha='ALLEGRO_INVERSE_ALPHA',
             const_color='NULL',
-            if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888',
+            if_formats=fast_formats,
             alpha_only=True,
             repeat=repeat,
             )
@@ -182,7 +191,7 @@ def make_drawer(name):
             dst_mode='ALLEGRO_ONE',
             dst_alpha='ALLEGRO_ONE',
             const_color='NULL',
-            if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888',
+            if_formats=fast_formats,
             alpha_only=True,
             repeat=repeat,
             )
@@ -196,10 +205,11 @@ def make_drawer(name):
       make_loop(copy_format=True, src_size='2')
       print("else")
    else:
-      make_loop(
-            if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888'
-            )
-      print("else")
+      for if_format in fast_formats:
+         make_loop(
+               if_format=if_format
+               )
+         print("else")
 
    make_loop()
 
@@ -220,7 +230,7 @@ def make_if_blender_loop(
       src_format='src_format',
       dst_format='dst_format',
       const_color='NULL',
-      if_format=None,
+      if_formats=[],
       alpha_only=False,
       repeat=False,
       ):
@@ -233,7 +243,7 @@ def make_if_blender_loop(
             dst_alpha == #{dst_alpha}) {
       """))
 
-   if texture and if_format:
+   for if_format in if_formats:
       make_loop(
             op=op,
             src_mode=src_mode,
@@ -365,6 +375,19 @@ def make_innermost_loop(
 
    print("{")
 
+   if not texture and not grad and opaque and dst_format in fast_formats:
+      # Every pixel gets the same value, so convert the colour only once.
+      print(interp("""\
+         uint32_t pixel;
+         uint8_t *pixel_data = (uint8_t *)&pixel;
+         _AL_INLINE_PUT_PIXEL(#{dst_format}, pixel_data, cur_color, false);
+         for (; x1 <= x2; x1++) {
+            *(uint32_t *)dst_data = pixel;
+            dst_data += 4;
+         }
+      }"""))
+      return
+
    if texture:
       # In non-tiling mode we can hoist offsets out of the loop.
       if tiling:
@@ -132,6 +132,74 @@ void al_draw_tinted_bitmap_region(ALLEGRO_BITMAP *bitmap,
 }
 
 
+/* Draw regions of a bitmap with the same result as calling
+ * al_draw_tinted_bitmap_region without flags for each in turn. When drawing
+ * to a memory bitmap the source and target are locked only once for all of
+ * them, otherwise the regions are collected by held drawing as usual.
+ */
+void _al_draw_tinted_bitmap_quads(ALLEGRO_BITMAP *bitmap,
+   ALLEGRO_COLOR tint, const _AL_BITMAP_QUAD *quads, int count)
+{
+   ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   ALLEGRO_BITMAP *parent = bitmap;
+   _AL_BITMAP_QUAD clipped[64];
+   int i, n;
+   ASSERT(bitmap);
+   ASSERT(quads || count == 0);
+
+   if (bitmap->parent)
+      parent = bitmap->parent;
+
+   if (!(al_get_bitmap_flags(dest) & ALLEGRO_MEMORY_BITMAP) ||
+         _al_pixel_format_is_compressed(al_get_bitmap_format(dest)) ||
+         _al_pixel_format_is_compressed(al_get_bitmap_format(parent))) {
+      goto one_by_one;
+   }
+
+   /* Clip the source like _draw_tinted_rotated_scaled_bitmap_region, in
+    * batches that fit on the stack.
+    */
+   for (i = 0; i < count; i += n) {
+      int j;
+      for (n = 0, j = i; j < count && n < 64; j++) {
+         _AL_BITMAP_QUAD *q = &clipped[n];
+         *q = quads[j];
+         if (bitmap->parent) {
+            q->sx += bitmap->xofs;
+            q->sy += bitmap->yofs;
+         }
+         if (q->sx < 0) {
+            q->sw += q->sx;
+            q->dx -= q->sx;
+            q->sx = 0;
+         }
+         if (q->sy < 0) {
+            q->sh += q->sy;
+            q->dy -= q->sy;
+            q->sy = 0;
+         }
+         if (q->sx + q->sw > parent->w)
+            q->sw = parent->w - q->sx;
+         if (q->sy + q->sh > parent->h)
+            q->sh = parent->h - q->sy;
+         n++;
+      }
+      if (!_al_draw_bitmap_quads_memory(parent, tint, clipped, n)) {
+         quads += i;
+         count -= i;
+         goto one_by_one;
+      }
+   }
+   return;
+
+one_by_one:
+   for (i = 0; i < count; i++) {
+      al_draw_tinted_bitmap_region(bitmap, tint, quads[i].sx, quads[i].sy,
+         quads[i].sw, quads[i].sh, quads[i].dx, quads[i].dy, 0);
+   }
+}
+
+
 /* Function: al_draw_tinted_bitmap
  */
 void al_draw_tinted_bitmap(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint,
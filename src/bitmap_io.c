@@ -17,6 +17,7 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_file.h"
 #include "allegro5/internal/aintern_vector.h"
 
 #include <string.h>
@@ -25,6 +26,11 @@ ALLEGRO_DEBUG_CHANNEL("bitmap")
 
 #define MAX_EXTENSION   (32)
 
+/* Number of bytes read up front for identifying a file. Identifiers which
+ * look further than this fall back to reading the file itself.
+ */
+#define IDENTIFY_HEADER_SIZE  (256)
+
 
 typedef struct Handler
 {
@@ -81,20 +87,228 @@ static Handler *find_handler(const char *extension, bool create_if_not)
 }
 
 
+/* Well known signatures, used to try the most likely identifier first.
+ * Identifiers still have the final say, and files matching none of these
+ * go through every identifier as before.
+ */
+typedef struct Magic
+{
+   const char *extension;
+   const char *bytes;
+   int size;
+} Magic;
+
+static const Magic magic_table[] =
+{
+   { ".png",  "\x89PNG\r\n\x1a\n", 8 },
+   { ".jpg",  "\xff\xd8",             2 },
+   { ".bmp",  "BM",                   2 },
+   { ".dds",  "DDS ",                 4 },
+   { ".webp", "RIFF",                 4 },
+   { ".pcx",  "\x0a",                 1 },
+   { NULL,    NULL,                   0 }
+};
+
+
+/* A read-only view of the first bytes of a file, so that every identifier
+ * can be run against a single read of the underlying file.
+ */
+typedef struct Header
+{
+   unsigned char data[IDENTIFY_HEADER_SIZE];
+   int64_t size;
+   int64_t pos;
+   bool truncated;   /* data holds less than the whole file */
+   bool overrun;     /* an identifier looked beyond data */
+   bool eof;
+} Header;
+
+
+static size_t header_fread(ALLEGRO_FILE *f, void *ptr, size_t size)
+{
+   Header *h = f->userdata;
+   int64_t avail = h->size - h->pos;
+
+   if (avail < 0)
+      avail = 0;
+   if ((int64_t)size > avail) {
+      if (h->truncated)
+         h->overrun = true;
+      h->eof = true;
+      size = avail;
+   }
+   memcpy(ptr, h->data + h->pos, size);
+   h->pos += size;
+   return size;
+}
+
+
+static int64_t header_ftell(ALLEGRO_FILE *f)
+{
+   Header *h = f->userdata;
+   return h->pos;
+}
+
+
+static bool header_fseek(ALLEGRO_FILE *f, int64_t offset, int whence)
+{
+   Header *h = f->userdata;
+   int64_t pos;
+
+   switch (whence) {
+      case ALLEGRO_SEEK_SET: pos = offset; break;
+      case ALLEGRO_SEEK_CUR: pos = h->pos + offset; break;
+      default:
+         /* We don't know where the end is without asking the file. */
+         h->overrun = h->truncated;
+         pos = h->size + offset;
+         break;
+   }
+
+   if (pos < 0)
+      return false;
+   if (pos > h->size && h->truncated)
+      h->overrun = true;
+   h->pos = pos;
+   h->eof = false;
+   return true;
+}
+
+
+static bool header_feof(ALLEGRO_FILE *f)
+{
+   Header *h = f->userdata;
+   return h->eof;
+}
+
+
+static int header_ferror(ALLEGRO_FILE *f)
+{
+   (void)f;
+   return 0;
+}
+
+
+static const char *header_ferrmsg(ALLEGRO_FILE *f)
+{
+   (void)f;
+   return "";
+}
+
+
+static void header_fclearerr(ALLEGRO_FILE *f)
+{
+   Header *h = f->userdata;
+   h->eof = false;
+}
+
+
+static off_t header_fsize(ALLEGRO_FILE *f)
+{
+   Header *h = f->userdata;
+   if (h->truncated) {
+      h->overrun = true;
+      return -1;
+   }
+   return h->size;
+}
+
+
+static const ALLEGRO_FILE_INTERFACE header_vtable =
+{
+   NULL,             /* fopen */
+   NULL,             /* fclose */
+   header_fread,
+   NULL,             /* fwrite */
+   NULL,             /* fflush */
+   header_ftell,
+   header_fseek,
+   header_feof,
+   header_ferror,
+   header_ferrmsg,
+   header_fclearerr,
+   NULL,             /* ungetc */
+   header_fsize
+};
+
+
+/* Run one identifier against the buffered header, or against the file
+ * itself if the identifier needs to see more than we buffered.
+ */
+static bool identify(Handler *l, Header *header, ALLEGRO_FILE *f, int64_t pos)
+{
+   ALLEGRO_FILE hf;
+   bool identified;
+
+   hf.vtable = &header_vtable;
+   hf.userdata = header;
+   hf.ungetc_len = 0;
+   hf.identified_pos = -1;
+   hf.identified_handler = -1;
+
+   header->pos = 0;
+   header->overrun = false;
+   header->eof = false;
+   identified = l->identifier(&hf);
+   if (!header->overrun)
+      return identified;
+
+   identified = l->identifier(f);
+   al_fseek(f, pos, ALLEGRO_SEEK_SET);
+   return identified;
+}
+
+
+static bool magic_matches(const char *extension, const Header *header)
+{
+   const Magic *m;
+
+   for (m = magic_table; m->extension; m++) {
+      if (m->size <= header->size &&
+            0 == memcmp(header->data, m->bytes, m->size) &&
+            0 == _al_stricmp(extension, m->extension))
+         return true;
+   }
+   return false;
+}
+
+
 static Handler *find_handler_for_file(ALLEGRO_FILE *f)
 {
-   unsigned i;
+   Header header;
+   unsigned i, n;
+   int64_t pos;
+   int pass;
 
    ASSERT(f);
 
-   for (i = 0; i < _al_vector_size(&iio_table); i++) {
-      Handler *l = _al_vector_ref(&iio_table, i);
-      if (l->identifier) {
-         int64_t pos = al_ftell(f);
-         bool identified = l->identifier(f);
-         al_fseek(f, pos, ALLEGRO_SEEK_SET);
-         if (identified)
+   pos = al_ftell(f);
+   n = _al_vector_size(&iio_table);
+
+   if (f->identified_handler >= 0 && f->identified_pos == pos &&
+         (unsigned)f->identified_handler < n) {
+      Handler *l = _al_vector_ref(&iio_table, f->identified_handler);
+      if (l->identifier)
+         return l;
+   }
+
+   header.size = al_fread(f, header.data, IDENTIFY_HEADER_SIZE);
+   header.truncated = (header.size == IDENTIFY_HEADER_SIZE);
+   al_fseek(f, pos, ALLEGRO_SEEK_SET);
+
+   /* First try the handlers whose signature matches, then the rest. */
+   for (pass = 0; pass < 2; pass++) {
+      for (i = 0; i < n; i++) {
+         Handler *l = _al_vector_ref(&iio_table, i);
+         if (!l->identifier)
+            continue;
+         if (magic_matches(l->extension, &header) != (pass == 0))
+            continue;
+         if (identify(l, &header, f, pos)) {
+            f->identified_pos = pos;
+            f->identified_handler = i;
             return l;
+         }
       }
    }
    return NULL;
@@ -0,0 +1,515 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Anti-aliased software primitives.
+ *
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_pixels.h"
+#include "allegro5/internal/aintern_prim_soft.h"
+#include "allegro5/internal/aintern_primitives.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+   #define COVERAGE_SSE2
+   #include <emmintrin.h>
+#endif
+
+/*
+The primitives of one call are drawn as a single shape: the signed area every
+edge covers in each pixel is accumulated into a buffer, in which a running sum
+along each row then gives the coverage of the pixel (as in font-rs and
+stb_truetype). Edges shared by two triangles cancel out, so meshes have no
+seams. Lines become one pixel wide rectangles. Overlapping primitives are
+drawn once, their coverage saturates at 1.
+
+Pixel (x, y) covers the square from (x, y) to (x + 1, y + 1), so its centre is
+where the aliased rasterizers sample it.
+*/
+
+/* Buffers larger than this many floats are processed in bands of rows. */
+#define COVERAGE_MAX_BUFFER (1 << 18)
+
+/* Coverage below this does not change any 8-bit channel. Coverage this close
+ * to 1 is made exactly 1, so rounding errors in the sums along a row do not
+ * let the background through the inside of opaque shapes.
+ */
+#define COVERAGE_MIN (1.0f / 512.0f)
+
+typedef struct {
+   float x0, y0, x1, y1;
+} coverage_edge;
+
+typedef struct {
+   coverage_edge* edges;
+   int num_edges;
+   int capacity;
+   float min_x, min_y, max_x, max_y;
+} coverage_shape;
+
+typedef struct {
+   float* acc;
+   int stride;
+   int w, h;
+   float y;
+} coverage_band;
+
+static bool add_edge(coverage_shape* shape, float x0, float y0, float x1, float y1)
+{
+   coverage_edge* e;
+
+   if (y0 == y1)
+      return true;
+
+   if (shape->num_edges == shape->capacity) {
+      int capacity = shape->capacity ? 2 * shape->capacity : 64;
+      coverage_edge* edges = al_realloc(shape->edges, capacity * sizeof(coverage_edge));
+      if (!edges)
+         return false;
+      shape->edges = edges;
+      shape->capacity = capacity;
+   }
+
+   e = &shape->edges[shape->num_edges++];
+   e->x0 = x0;
+   e->y0 = y0;
+   e->x1 = x1;
+   e->y1 = y1;
+
+   shape->min_x = _ALLEGRO_MIN(shape->min_x, _ALLEGRO_MIN(x0, x1));
+   shape->max_x = _ALLEGRO_MAX(shape->max_x, _ALLEGRO_MAX(x0, x1));
+   shape->min_y = _ALLEGRO_MIN(shape->min_y, _ALLEGRO_MIN(y0, y1));
+   shape->max_y = _ALLEGRO_MAX(shape->max_y, _ALLEGRO_MAX(y0, y1));
+   return true;
+}
+
+/*
+Adds a polygon, wound so that every polygon of the shape has the same
+orientation and overlaps add up instead of cancelling.
+*/
+static bool add_polygon(coverage_shape* shape, const float* x, const float* y, int n)
+{
+   float area = 0;
+   int ii;
+
+   for (ii = 0; ii < n; ii++) {
+      int jj = (ii + 1) % n;
+      area += x[ii] * y[jj] - x[jj] * y[ii];
+   }
+   if (area == 0)
+      return true;
+
+   for (ii = 0; ii < n; ii++) {
+      int jj = (ii + 1) % n;
+      bool ok = area < 0 ? add_edge(shape, x[ii], y[ii], x[jj], y[jj])
+                         : add_edge(shape, x[jj], y[jj], x[ii], y[ii]);
+      if (!ok)
+         return false;
+   }
+   return true;
+}
+
+static bool add_triangle(coverage_shape* shape, const ALLEGRO_VERTEX* v1,
+   const ALLEGRO_VERTEX* v2, const ALLEGRO_VERTEX* v3)
+{
+   float x[3], y[3];
+   x[0] = v1->x; y[0] = v1->y;
+   x[1] = v2->x; y[1] = v2->y;
+   x[2] = v3->x; y[2] = v3->y;
+   return add_polygon(shape, x, y, 3);
+}
+
+/*
+A line covers a one pixel wide rectangle. Its free ends are extended by half a
+pixel so that it reaches as far as an aliased line does, the ends joined to
+another line of a strip are not, as they would overlap.
+*/
+static bool add_line(coverage_shape* shape, const ALLEGRO_VERTEX* v1,
+   const ALLEGRO_VERTEX* v2, bool cap1, bool cap2)
+{
+   float dx = v2->x - v1->x;
+   float dy = v2->y - v1->y;
+   float len = sqrtf(dx * dx + dy * dy);
+   float e1, e2;
+   float x[4], y[4];
+
+   if (len > 0) {
+      dx *= 0.5f / len;
+      dy *= 0.5f / len;
+   }
+   else {
+      dx = 0.5f;
+      dy = 0;
+      cap1 = cap2 = true;
+   }
+   e1 = cap1 ? 1.0f : 0.0f;
+   e2 = cap2 ? 1.0f : 0.0f;
+
+   x[0] = v1->x - e1 * dx - dy; y[0] = v1->y - e1 * dy + dx;
+   x[1] = v2->x + e2 * dx - dy; y[1] = v2->y + e2 * dy + dx;
+   x[2] = v2->x + e2 * dx + dy; y[2] = v2->y + e2 * dy - dx;
+   x[3] = v1->x - e1 * dx + dy; y[3] = v1->y - e1 * dy - dx;
+   return add_polygon(shape, x, y, 4);
+}
+
+/*
+Accumulates an edge lying within 0 <= x <= band->w, following font-rs.
+*/
+static void accumulate_line(coverage_band* band, float x0, float y0, float x1, float y1)
+{
+   const float w = (float)band->w;
+   float dir = 1.0f;
+   float dxdy, x;
+   int y, y_start, y_end;
+
+   y0 -= band->y;
+   y1 -= band->y;
+
+   if (y0 > y1) {
+      float t;
+      t = x0; x0 = x1; x1 = t;
+      t = y0; y0 = y1; y1 = t;
+      dir = -1.0f;
+   }
+   if (y1 <= 0 || y0 >= band->h)
+      return;
+
+   dxdy = (x1 - x0) / (y1 - y0);
+   x = x0;
+   if (y0 < 0) {
+      x -= y0 * dxdy;
+      y_start = 0;
+   }
+   else {
+      y_start = (int)y0;
+   }
+   y_end = _ALLEGRO_MIN(band->h, (int)ceilf(y1));
+
+   /* Keep rounding errors from stepping outside of the row. */
+   x = _ALLEGRO_MIN(_ALLEGRO_MAX(x, 0.0f), w);
+
+   for (y = y_start; y < y_end; y++) {
+      float* row = band->acc + y * band->stride;
+      float dy = _ALLEGRO_MIN((float)(y + 1), y1) - _ALLEGRO_MAX((float)y, y0);
+      float xnext = _ALLEGRO_MIN(_ALLEGRO_MAX(x + dxdy * dy, 0.0f), w);
+      float d = dy * dir;
+      float xa = _ALLEGRO_MIN(x, xnext);
+      float xb = _ALLEGRO_MAX(x, xnext);
+      float xa_floor = floorf(xa);
+      float xb_ceil = ceilf(xb);
+      int xai = (int)xa_floor;
+      int xbi = (int)xb_ceil;
+
+      if (xbi <= xai + 1) {
+         /* The edge stays within one pixel. */
+         float xm = 0.5f * (x + xnext) - xa_floor;
+         row[xai] += d - d * xm;
+         row[xai + 1] += d * xm;
+      }
+      else {
+         float s = 1.0f / (xb - xa);
+         float xaf = xa - xa_floor;
+         float a0 = 0.5f * s * (1.0f - xaf) * (1.0f - xaf);
+         float xbf = xb - xb_ceil + 1.0f;
+         float am = 0.5f * s * xbf * xbf;
+         int xi;
+
+         row[xai] += d * a0;
+         if (xbi == xai + 2) {
+            row[xai + 1] += d * (1.0f - a0 - am);
+         }
+         else {
+            float a1 = s * (1.5f - xaf);
+            float a2 = a1 + (float)(xbi - xai - 3) * s;
+            row[xai + 1] += d * (a1 - a0);
+            for (xi = xai + 2; xi < xbi - 1; xi++)
+               row[xi] += d * s;
+            row[xbi - 1] += d * (1.0f - a2 - am);
+         }
+         row[xbi] += d * am;
+      }
+      x = xnext;
+   }
+}
+
+/*
+Returns the y at which an edge crosses the column at x. It is computed from the
+endpoints in the same order whichever way the edge goes, so the clipped halves
+of an edge shared by two triangles still cancel out exactly.
+*/
+static float crossing_y(float x0, float y0, float x1, float y1, float x)
+{
+   if (y0 > y1 || (y0 == y1 && x0 > x1)) {
+      float t;
+      t = x0; x0 = x1; x1 = t;
+      t = y0; y0 = y1; y1 = t;
+   }
+   return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+}
+
+/*
+Clips an edge to the columns of the band. The parts to the left still count
+for every pixel to their right, so they become vertical edges at x = 0. The
+parts to the right do not affect the band.
+*/
+static void accumulate_edge(coverage_band* band, float x0, float y0, float x1, float y1)
+{
+   const float w = (float)band->w;
+   float ym;
+
+   if (x0 >= w && x1 >= w)
+      return;
+
+   if (x0 > w || x1 > w) {
+      ym = crossing_y(x0, y0, x1, y1, w);
+      if (x0 > w) {
+         x0 = w;
+         y0 = ym;
+      }
+      else {
+         x1 = w;
+         y1 = ym;
+      }
+   }
+
+   if (x0 <= 0 && x1 <= 0) {
+      accumulate_line(band, 0, y0, 0, y1);
+      return;
+   }
+
+   if (x0 < 0 || x1 < 0) {
+      ym = crossing_y(x0, y0, x1, y1, 0);
+      if (x0 < 0) {
+         accumulate_line(band, 0, y0, 0, ym);
+         accumulate_line(band, 0, ym, x1, y1);
+      }
+      else {
+         accumulate_line(band, x0, y0, 0, ym);
+         accumulate_line(band, 0, ym, 0, y1);
+      }
+      return;
+   }
+
+   accumulate_line(band, x0, y0, x1, y1);
+}
+
+/*
+Replaces the accumulated row by the coverage of its pixels.
+*/
+static void resolve_row(float* row, int w)
+{
+   float sum = 0;
+   int x = 0;
+
+#ifdef COVERAGE_SSE2
+   __m128 acc = _mm_setzero_ps();
+   const __m128 one = _mm_set1_ps(1.0f);
+   const __m128 sign = _mm_set1_ps(-0.0f);
+
+   for (; x + 4 <= w; x += 4) {
+      __m128 v = _mm_loadu_ps(row + x);
+      /* Prefix sum of the four lanes. */
+      v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+      v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+      v = _mm_add_ps(v, acc);
+      acc = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+      _mm_storeu_ps(row + x, _mm_min_ps(_mm_andnot_ps(sign, v), one));
+   }
+   sum = _mm_cvtss_f32(acc);
+#endif
+
+   for (; x < w; x++) {
+      sum += row[x];
+      row[x] = _ALLEGRO_MIN(fabsf(sum), 1.0f);
+   }
+}
+
+static void draw_band(coverage_band* band, const coverage_shape* shape,
+   int x0, int y0, ALLEGRO_COLOR color, bool alpha_only)
+{
+   int ii, x, y;
+
+   for (ii = 0; ii < shape->num_edges; ii++) {
+      const coverage_edge* e = &shape->edges[ii];
+      accumulate_edge(band, e->x0 - x0, e->y0, e->x1 - x0, e->y1);
+   }
+
+   for (y = 0; y < band->h; y++) {
+      float* row = band->acc + y * band->stride;
+
+      resolve_row(row, band->w);
+
+      for (x = 0; x < band->w; x++) {
+         const float c = row[x] > 1.0f - COVERAGE_MIN ? 1.0f : row[x];
+         if (c >= COVERAGE_MIN) {
+            ALLEGRO_COLOR pixel = color;
+            pixel.a *= c;
+            if (!alpha_only) {
+               pixel.r *= c;
+               pixel.g *= c;
+               pixel.b *= c;
+            }
+            al_put_blended_pixel(x0 + x, y0 + y, pixel);
+         }
+      }
+   }
+}
+
+static bool lock_region(ALLEGRO_BITMAP* target, int x, int y, int w, int h, bool* need_unlock)
+{
+   *need_unlock = false;
+
+   if (al_is_bitmap_locked(target)) {
+      if (x < target->lock_x || y < target->lock_y ||
+          x + w > target->lock_x + target->lock_w ||
+          y + h > target->lock_y + target->lock_h ||
+          _al_pixel_format_is_video_only(target->locked_region.format))
+         return false;
+      return true;
+   }
+
+   if (!al_lock_bitmap_region(target, x, y, w, h, ALLEGRO_PIXEL_FORMAT_ANY, 0))
+      return false;
+   *need_unlock = true;
+   return true;
+}
+
+/*
+Draws the primitives the way draw_cached in prim_soft.c would, with
+anti-aliased edges. Only untextured primitives of a single color are handled,
+returns false otherwise.
+*/
+bool _al_draw_prim_coverage(ALLEGRO_VERTEX* cache, const int* indices,
+   int base, int num_vtx, int type, int* num_primitives)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   coverage_shape shape;
+   coverage_band band;
+   ALLEGRO_COLOR color;
+   int clip_x, clip_y, clip_w, clip_h;
+   int x0, y0, x1, y1;
+   int band_h;
+   int op, src, dst, alpha_op, alpha_src, alpha_dst;
+   bool alpha_only;
+   bool need_unlock;
+   bool ok = true;
+   int ii;
+
+#define VTX(ii) (&cache[indices ? indices[ii] - base : (ii)])
+
+   if (num_vtx <= 0 || type == ALLEGRO_PRIM_POINT_LIST)
+      return false;
+
+   color = VTX(0)->color;
+   for (ii = 1; ii < num_vtx; ii++) {
+      const ALLEGRO_COLOR* c = &VTX(ii)->color;
+      if (c->r != color.r || c->g != color.g || c->b != color.b || c->a != color.a)
+         return false;
+   }
+
+   memset(&shape, 0, sizeof(shape));
+   shape.min_x = shape.min_y = HUGE_VAL;
+   shape.max_x = shape.max_y = -HUGE_VAL;
+
+   switch (type) {
+      case ALLEGRO_PRIM_LINE_LIST: {
+         for (ii = 0; ok && ii < num_vtx - 1; ii += 2)
+            ok = add_line(&shape, VTX(ii), VTX(ii + 1), true, true);
+         *num_primitives = num_vtx / 2;
+         break;
+      };
+      case ALLEGRO_PRIM_LINE_STRIP: {
+         for (ii = 1; ok && ii < num_vtx; ii++)
+            ok = add_line(&shape, VTX(ii - 1), VTX(ii), ii == 1, ii == num_vtx - 1);
+         *num_primitives = num_vtx - 1;
+         break;
+      };
+      case ALLEGRO_PRIM_LINE_LOOP: {
+         for (ii = 1; ok && ii < num_vtx; ii++)
+            ok = add_line(&shape, VTX(ii - 1), VTX(ii), false, false);
+         if (ok)
+            ok = add_line(&shape, VTX(num_vtx - 1), VTX(0), false, false);
+         *num_primitives = num_vtx;
+         break;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_LIST: {
+         for (ii = 0; ok && ii < num_vtx - 2; ii += 3)
+            ok = add_triangle(&shape, VTX(ii), VTX(ii + 1), VTX(ii + 2));
+         *num_primitives = num_vtx / 3;
+         break;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_STRIP: {
+         for (ii = 2; ok && ii < num_vtx; ii++)
+            ok = add_triangle(&shape, VTX(ii - 2), VTX(ii - 1), VTX(ii));
+         *num_primitives = num_vtx - 2;
+         break;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_FAN: {
+         for (ii = 2; ok && ii < num_vtx; ii++)
+            ok = add_triangle(&shape, VTX(0), VTX(ii), VTX(ii - 1));
+         *num_primitives = num_vtx - 2;
+         break;
+      };
+   }
+
+#undef VTX
+
+   if (!ok) {
+      al_free(shape.edges);
+      return false;
+   }
+   if (shape.num_edges == 0)
+      return true;
+
+   al_get_clipping_rectangle(&clip_x, &clip_y, &clip_w, &clip_h);
+   x0 = _ALLEGRO_MAX(clip_x, (int)floorf(shape.min_x));
+   y0 = _ALLEGRO_MAX(clip_y, (int)floorf(shape.min_y));
+   x1 = _ALLEGRO_MIN(clip_x + clip_w, (int)ceilf(shape.max_x));
+   y1 = _ALLEGRO_MIN(clip_y + clip_h, (int)ceilf(shape.max_y));
+
+   /*
+   Coverage scales the color like premultiplied alpha, unless the blender
+   multiplies by the alpha itself.
+   */
+   al_get_separate_blender(&op, &src, &dst, &alpha_op, &alpha_src, &alpha_dst);
+   alpha_only = src == ALLEGRO_ALPHA;
+
+   if (x0 < x1 && y0 < y1 && lock_region(target, x0, y0, x1 - x0, y1 - y0, &need_unlock)) {
+      band.w = x1 - x0;
+      band.stride = band.w + 2;
+      band_h = _ALLEGRO_MAX(1, _ALLEGRO_MIN(y1 - y0, COVERAGE_MAX_BUFFER / band.stride));
+      band.acc = al_calloc(band.stride * band_h, sizeof(float));
+
+      if (band.acc) {
+         for (ii = y0; ii < y1; ii += band_h) {
+            band.h = _ALLEGRO_MIN(band_h, y1 - ii);
+            band.y = (float)ii;
+            draw_band(&band, &shape, x0, ii, color, alpha_only);
+            memset(band.acc, 0, band.stride * band.h * sizeof(float));
+         }
+         al_free(band.acc);
+      }
+
+      if (need_unlock)
+         al_unlock_bitmap(target);
+   }
+
+   al_free(shape.edges);
+   return true;
+}
+
+/* vim: set sts=3 sw=3 et: */
@@ -80,6 +80,8 @@ ALLEGRO_DISPLAY *al_create_display(int w, int h)
    al_identity_transform(&display->projview_transform);
 
    display->default_shader = NULL;
+   display->instanced_shader = NULL;
+   display->instanced_shader_failed = false;
 
    _al_vector_init(&display->display_invalidated_callbacks, sizeof(void *));
    _al_vector_init(&display->display_validated_callbacks, sizeof(void *));
@@ -163,6 +165,10 @@ void al_destroy_display(ALLEGRO_DISPLAY *display)
 
       al_destroy_shader(display->default_shader);
       display->default_shader = NULL;
+      al_destroy_shader(display->instanced_shader);
+      display->instanced_shader = NULL;
+   display->instanced_shader = NULL;
+   display->instanced_shader_failed = false;
 
       ASSERT(display->vt);
       display->vt->destroy_display(display);
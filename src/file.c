@@ -47,6 +47,8 @@ ALLEGRO_FILE *al_fopen_interface(const ALLEGRO_FILE_INTERFACE *drv,
          f->vtable = drv;
          f->userdata = drv->fi_fopen(path, mode);
          f->ungetc_len = 0;
+         f->identified_pos = -1;
+         f->identified_handler = -1;
          if (!f->userdata) {
             al_free(f);
             f = NULL;
@@ -75,6 +77,8 @@ ALLEGRO_FILE *al_create_file_handle(const ALLEGRO_FILE_INTERFACE *drv,
       f->vtable = drv;
       f->userdata = userdata;
       f->ungetc_len = 0;
+      f->identified_pos = -1;
+      f->identified_handler = -1;
    }
 
    return f;
@@ -129,6 +133,7 @@ size_t al_fwrite(ALLEGRO_FILE *f, const void *ptr, size_t size)
    ASSERT(ptr || size == 0);
 
    f->ungetc_len = 0;
+   f->identified_handler = -1;
    return f->vtable->fi_fwrite(f, ptr, size);
 }
 
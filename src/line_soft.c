@@ -340,7 +340,11 @@ static void shader_texture_grad_any_step(uintptr_t state, int minor_step)
    }
 }
 
-static void line_stepper(uintptr_t state, shader_first first, shader_step step, shader_draw draw, ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2)
+/*
+Inlined into each LINE_DRAWER below, where the shader calls for every pixel
+become direct (and usually inlined) calls
+*/
+static _AL_ALWAYS_INLINE void line_stepper(uintptr_t state, shader_first first, shader_step step, shader_draw draw, ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2)
 {
    float x1, y1, x2, y2;
    float dx, dy;
@@ -489,6 +493,130 @@ static void line_stepper(uintptr_t state, shader_first first, shader_step step,
 #undef WORKER
 }
 
+static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, int h)
+{
+   ASSERT(bmp);
+
+   if (!al_is_bitmap_locked(bmp))
+      return 0;
+   if (x1 + w > bmp->lock_x && y1 + h > bmp->lock_y && x1 < bmp->lock_x + bmp->lock_w && y1 < bmp->lock_y + bmp->lock_h)
+      return 1;
+   return 0;
+}
+
+/*
+Lock the part of the target that the line may touch, unless it is locked
+already. Returns false if there is nothing to draw into.
+*/
+static bool lock_line_region(ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, bool* need_unlock)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   int min_x, max_x, min_y, max_y;
+   int clip_min_x, clip_min_y, clip_max_x, clip_max_y;
+
+   *need_unlock = false;
+
+   al_get_clipping_rectangle(&clip_min_x, &clip_min_y, &clip_max_x, &clip_max_y);
+   clip_max_x += clip_min_x;
+   clip_max_y += clip_min_y;
+
+   /*
+   TODO: Need to clip them first, make a copy of the vertices first then
+   */
+
+   /*
+   Lock the region we are drawing to. We are choosing the minimum and maximum
+   possible pixels touched from the formula (easily verified by following the
+   above algorithm).
+   */
+
+   if (vtx1->x >= vtx2->x) {
+      max_x = (int)ceilf(vtx1->x) + 1;
+      min_x = (int)floorf(vtx2->x) - 1;
+   } else {
+      max_x = (int)ceilf(vtx2->x) + 1;
+      min_x = (int)floorf(vtx1->x) - 1;
+   }
+   if (vtx1->y >= vtx2->y) {
+      max_y = (int)ceilf(vtx1->y) + 1;
+      min_y = (int)floorf(vtx2->y) - 1;
+   } else {
+      max_y = (int)ceilf(vtx2->y) + 1;
+      min_y = (int)floorf(vtx1->y) - 1;
+   }
+   /*
+   TODO: This bit is temporary, the min max's will be guaranteed to be within the bitmap
+   once clipping is implemented
+   */
+   if (min_x >= clip_max_x || min_y >= clip_max_y)
+      return false;
+   if (max_x >= clip_max_x)
+      max_x = clip_max_x;
+   if (max_y >= clip_max_y)
+      max_y = clip_max_y;
+
+   if (max_x < clip_min_x || max_y < clip_min_y)
+      return false;
+   if (min_x < clip_min_x)
+      min_x = clip_min_x;
+   if (min_y < clip_min_y)
+      min_y = clip_min_y;
+
+   if (al_is_bitmap_locked(target)) {
+      if (!bitmap_region_is_locked(target, min_x, min_y, max_x - min_x, max_y - min_y) ||
+          _al_pixel_format_is_video_only(target->locked_region.format))
+         return false;
+   } else {
+      if (!al_lock_bitmap_region(target, min_x, min_y, max_x - min_x, max_y - min_y, ALLEGRO_PIXEL_FORMAT_ANY, 0))
+         return false;
+      *need_unlock = true;
+   }
+
+   return true;
+}
+
+typedef void (*line_drawer)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*);
+
+static void draw_line(ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, uintptr_t state, line_drawer drawer)
+{
+   /*
+   Copy the vertices, because we need to alter them a bit before drawing.
+   */
+   ALLEGRO_VERTEX vtx1 = *v1;
+   ALLEGRO_VERTEX vtx2 = *v2;
+   bool need_unlock;
+
+   if (!lock_line_region(&vtx1, &vtx2, &need_unlock))
+      return;
+
+   drawer(state, &vtx1, &vtx2);
+
+   if (need_unlock)
+      al_unlock_bitmap(al_get_target_bitmap());
+}
+
+/*
+One line drawer for each combination of shaders that _al_line_2d uses
+*/
+#define LINE_DRAWER(name, shader, draw)                                        \
+   static void name(uintptr_t state, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2)  \
+   {                                                                          \
+      line_stepper(state, shader##_first, shader##_step, draw, v1, v2);       \
+   }
+
+LINE_DRAWER(line_solid_any_draw_opaque, shader_solid_any, shader_solid_any_draw_opaque)
+LINE_DRAWER(line_solid_any_draw_shade, shader_solid_any, shader_solid_any_draw_shade)
+LINE_DRAWER(line_grad_any_draw_opaque, shader_grad_any, shader_solid_any_draw_opaque)
+LINE_DRAWER(line_grad_any_draw_shade, shader_grad_any, shader_solid_any_draw_shade)
+LINE_DRAWER(line_texture_solid_any_draw_opaque, shader_texture_solid_any, shader_texture_solid_any_draw_opaque)
+LINE_DRAWER(line_texture_solid_any_draw_opaque_white, shader_texture_solid_any, shader_texture_solid_any_draw_opaque_white)
+LINE_DRAWER(line_texture_solid_any_draw_shade, shader_texture_solid_any, shader_texture_solid_any_draw_shade)
+LINE_DRAWER(line_texture_solid_any_draw_shade_white, shader_texture_solid_any, shader_texture_solid_any_draw_shade_white)
+LINE_DRAWER(line_texture_grad_any_draw_opaque, shader_texture_grad_any, shader_texture_solid_any_draw_opaque)
+LINE_DRAWER(line_texture_grad_any_draw_shade, shader_texture_grad_any, shader_texture_solid_any_draw_shade)
+
+#undef LINE_DRAWER
+
 /*
 This one will check to see what exactly we need to draw...
 I.e. this will call all of the actual renderers and set the appropriate callbacks
@@ -518,9 +646,9 @@ void _al_line_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2
          state.solid.texture = texture;
 
          if (shade) {
-            _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_solid_any_draw_shade);
+            draw_line(v1, v2, (uintptr_t)&state, line_texture_grad_any_draw_shade);
          } else {
-            _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_solid_any_draw_opaque);
+            draw_line(v1, v2, (uintptr_t)&state, line_texture_grad_any_draw_opaque);
          }
       } else {
          int white = 0;
@@ -533,15 +661,15 @@ void _al_line_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2
 
          if (shade) {
             if(white) {
-               _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_white);
+               draw_line(v1, v2, (uintptr_t)&state, line_texture_solid_any_draw_shade_white);
             } else {
-               _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade);
+               draw_line(v1, v2, (uintptr_t)&state, line_texture_solid_any_draw_shade);
             }
          } else {
             if(white) {
-               _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque_white);
+               draw_line(v1, v2, (uintptr_t)&state, line_texture_solid_any_draw_opaque_white);
             } else {
-               _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque);
+               draw_line(v1, v2, (uintptr_t)&state, line_texture_solid_any_draw_opaque);
             }
          }
       }
@@ -549,106 +677,37 @@ void _al_line_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2
       if (grad) {
          state_grad_any_2d state;
          if (shade) {
-            _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_grad_any_first, shader_grad_any_step, shader_solid_any_draw_shade);
+            draw_line(v1, v2, (uintptr_t)&state, line_grad_any_draw_shade);
          } else {
-            _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_grad_any_first, shader_grad_any_step, shader_solid_any_draw_opaque);
+            draw_line(v1, v2, (uintptr_t)&state, line_grad_any_draw_opaque);
          }
       } else {
          state_solid_any_2d state;
          if (shade) {
-            _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_shade);
+            draw_line(v1, v2, (uintptr_t)&state, line_solid_any_draw_shade);
          } else {
-            _al_draw_soft_line(v1, v2, (uintptr_t)&state, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_opaque);
+            draw_line(v1, v2, (uintptr_t)&state, line_solid_any_draw_opaque);
          }
       }
    }
 }
 
-static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, int h)
-{
-   ASSERT(bmp);
-
-   if (!al_is_bitmap_locked(bmp))
-      return 0;
-   if (x1 + w > bmp->lock_x && y1 + h > bmp->lock_y && x1 < bmp->lock_x + bmp->lock_w && y1 < bmp->lock_y + bmp->lock_h)
-      return 1;
-   return 0;
-}
-
 void _al_draw_soft_line(ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, uintptr_t state,
    void (*first)(uintptr_t, int, int, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
    void (*step)(uintptr_t, int),
    void (*draw)(uintptr_t, int, int))
 {
-   /*
-   Copy the vertices, because we need to alter them a bit before drawing.
-   */
    ALLEGRO_VERTEX vtx1 = *v1;
    ALLEGRO_VERTEX vtx2 = *v2;
-   ALLEGRO_BITMAP *target = al_get_target_bitmap();
-   int need_unlock = 0;
-   ALLEGRO_LOCKED_REGION *lr;
-   int min_x, max_x, min_y, max_y;
-   int clip_min_x, clip_min_y, clip_max_x, clip_max_y;
-
-   al_get_clipping_rectangle(&clip_min_x, &clip_min_y, &clip_max_x, &clip_max_y);
-   clip_max_x += clip_min_x;
-   clip_max_y += clip_min_y;
-
-   /*
-   TODO: Need to clip them first, make a copy of the vertices first then
-   */
+   bool need_unlock;
 
-   /*
-   Lock the region we are drawing to. We are choosing the minimum and maximum
-   possible pixels touched from the formula (easily verified by following the
-   above algorithm).
-   */
-
-   if (vtx1.x >= vtx2.x) {
-      max_x = (int)ceilf(vtx1.x) + 1;
-      min_x = (int)floorf(vtx2.x) - 1;
-   } else {
-      max_x = (int)ceilf(vtx2.x) + 1;
-      min_x = (int)floorf(vtx1.x) - 1;
-   }
-   if (vtx1.y >= vtx2.y) {
-      max_y = (int)ceilf(vtx1.y) + 1;
-      min_y = (int)floorf(vtx2.y) - 1;
-   } else {
-      max_y = (int)ceilf(vtx2.y) + 1;
-      min_y = (int)floorf(vtx1.y) - 1;
-   }
-   /*
-   TODO: This bit is temporary, the min max's will be guaranteed to be within the bitmap
-   once clipping is implemented
-   */
-   if (min_x >= clip_max_x || min_y >= clip_max_y)
+   if (!lock_line_region(&vtx1, &vtx2, &need_unlock))
       return;
-   if (max_x >= clip_max_x)
-      max_x = clip_max_x;
-   if (max_y >= clip_max_y)
-      max_y = clip_max_y;
-
-   if (max_x < clip_min_x || max_y < clip_min_y)
-      return;
-   if (min_x < clip_min_x)
-      min_x = clip_min_x;
-   if (min_y < clip_min_y)
-      min_y = clip_min_y;
-
-   if (al_is_bitmap_locked(target)) {
-      if (!bitmap_region_is_locked(target, min_x, min_y, max_x - min_x, max_y - min_y) ||
-          _al_pixel_format_is_video_only(target->locked_region.format))
-         return;
-   } else {
-      if (!(lr = al_lock_bitmap_region(target, min_x, min_y, max_x - min_x, max_y - min_y, ALLEGRO_PIXEL_FORMAT_ANY, 0)))
-         return;
-      need_unlock = 1;
-   }
 
    line_stepper(state, first, step, draw, &vtx1, &vtx2);
 
    if (need_unlock)
-      al_unlock_bitmap(target);
+      al_unlock_bitmap(al_get_target_bitmap());
 }
+
+/* vim: set sts=3 sw=3 et: */
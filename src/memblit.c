@@ -34,6 +34,13 @@ static void _al_draw_transformed_scaled_bitmap_memory(
 static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
    int sx, int sy, int sw, int sh,
    int dx, int dy, int flags);
+static void draw_transformed_bitmap_triangles(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint,
+   int sx, int sy, int sw, int sh, int dw, int dh,
+   ALLEGRO_TRANSFORM* local_trans, int flags);
+static void blit_locked_region(ALLEGRO_LOCKED_REGION *src_region,
+   ALLEGRO_BITMAP *dest, ALLEGRO_LOCKED_REGION *dst_region,
+   int sx, int sy, int sw, int sh, int dx, int dy);
 
 
 /* The CLIPPER macro takes pre-clipped coordinates for both the source
@@ -162,18 +169,114 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *src,
 }
 
 
+/* Draw regions of one bitmap, each as _al_draw_bitmap_region_memory would
+ * with the current transform translated by the region's position, but
+ * locking the source and the target only once. The source must not be a
+ * sub-bitmap. Returns false without drawing anything if that isn't
+ * possible, e.g. because one of the bitmaps is locked already.
+ */
+bool _al_draw_bitmap_quads_memory(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint, const _AL_BITMAP_QUAD *quads, int count)
+{
+   ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   ALLEGRO_BITMAP *root = dest->parent ? dest->parent : dest;
+   const ALLEGRO_TRANSFORM *current = al_get_current_transform();
+   ALLEGRO_LOCKED_REGION *src_region;
+   ALLEGRO_LOCKED_REGION *dst_region;
+   ALLEGRO_TRANSFORM t;
+   int op, src_mode, dst_mode;
+   int op_alpha, src_alpha, dst_alpha;
+   float xtrans, ytrans;
+   bool fast;
+   int i;
+
+   ASSERT(src->parent == NULL);
+   ASSERT(_al_pixel_format_is_real(al_get_bitmap_format(src)));
+
+   if (al_is_bitmap_locked(src) || al_is_bitmap_locked(root))
+      return false;
+
+   al_get_separate_bitmap_blender(&op,
+      &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
+
+   fast = _AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED_TINT_WHITE &&
+      _al_transform_is_translation(current, &xtrans, &ytrans);
+
+   /* The triangle drawer only finds the target's lock on the bitmap
+    * itself, which a sub-bitmap doesn't have.
+    */
+   if (!fast && dest->parent)
+      return false;
+
+   if (!(src_region = al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY,
+         ALLEGRO_LOCK_READONLY))) {
+      return false;
+   }
+
+   if (fast) {
+      dst_region = al_lock_bitmap(root, ALLEGRO_PIXEL_FORMAT_ANY,
+         ALLEGRO_LOCK_WRITEONLY);
+      if (dst_region) {
+         for (i = 0; i < count; i++) {
+            const _AL_BITMAP_QUAD *q = &quads[i];
+            al_identity_transform(&t);
+            al_translate_transform(&t, q->dx, q->dy);
+            al_compose_transform(&t, current);
+            _al_transform_is_translation(&t, &xtrans, &ytrans);
+            blit_locked_region(src_region, dest, dst_region,
+               q->sx, q->sy, q->sw, q->sh, xtrans, ytrans);
+         }
+         al_unlock_bitmap(root);
+      }
+   }
+   else {
+      int cx, cy, cw, ch;
+
+      al_get_clipping_rectangle(&cx, &cy, &cw, &ch);
+      if (cw > 0 && ch > 0 && al_lock_bitmap_region(dest, cx, cy, cw, ch,
+            ALLEGRO_PIXEL_FORMAT_ANY, 0)) {
+         for (i = 0; i < count; i++) {
+            const _AL_BITMAP_QUAD *q = &quads[i];
+            al_identity_transform(&t);
+            al_translate_transform(&t, q->dx, q->dy);
+            al_compose_transform(&t, current);
+            draw_transformed_bitmap_triangles(src, tint, q->sx, q->sy,
+               q->sw, q->sh, q->sw, q->sh, &t, 0);
+         }
+         al_unlock_bitmap(dest);
+      }
+   }
+
+   al_unlock_bitmap(src);
+   return true;
+}
+
+
 static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
    ALLEGRO_COLOR tint,
    int sx, int sy, int sw, int sh, int dw, int dh,
    ALLEGRO_TRANSFORM* local_trans, int flags)
+{
+   ASSERT(_al_pixel_format_is_real(al_get_bitmap_format(src)));
+
+   al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+   draw_transformed_bitmap_triangles(src, tint, sx, sy, sw, sh, dw, dh,
+      local_trans, flags);
+   al_unlock_bitmap(src);
+}
+
+
+/* The source must be locked already. */
+static void draw_transformed_bitmap_triangles(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint,
+   int sx, int sy, int sw, int sh, int dw, int dh,
+   ALLEGRO_TRANSFORM* local_trans, int flags)
 {
    float xsf[4], ysf[4];
    int tl = 0, tr = 1, bl = 3, br = 2;
    int tmp;
    ALLEGRO_VERTEX v[4];
 
-   ASSERT(_al_pixel_format_is_real(al_get_bitmap_format(src)));
-
    /* Decide what order to take corners in. */
    if (flags & ALLEGRO_FLIP_VERTICAL) {
       tl = 3;
@@ -237,12 +340,8 @@ static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
    v[bl].v = sy + sh;
    v[bl].color = tint;
 
-   al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
-
    _al_triangle_2d(src, &v[tl], &v[tr], &v[br]);
    _al_triangle_2d(src, &v[tl], &v[br], &v[bl]);
-
-   al_unlock_bitmap(src);
 }
 
 
@@ -304,4 +403,22 @@ static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
 }
 
 
+/* Like _al_draw_bitmap_region_memory_fast, with the source and the whole
+ * target locked already.
+ */
+static void blit_locked_region(ALLEGRO_LOCKED_REGION *src_region,
+   ALLEGRO_BITMAP *dest, ALLEGRO_LOCKED_REGION *dst_region,
+   int sx, int sy, int sw, int sh, int dx, int dy)
+{
+   int dw = sw, dh = sh;
+
+   CLIPPER(src_region, sx, sy, sw, sh, dest, dx, dy, dw, dh, 1, 1, 0)
+
+   _al_convert_bitmap_data(
+      src_region->data, src_region->format, src_region->pitch,
+      dst_region->data, dst_region->format, dst_region->pitch,
+      sx, sy, dx, dy, sw, sh);
+}
+
+
 /* vim: set sts=3 sw=3 et: */
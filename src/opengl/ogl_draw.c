@@ -20,6 +20,7 @@
 #include "allegro5/internal/aintern_opengl.h"
 #include "allegro5/internal/aintern_primitives.h"
 #include "allegro5/internal/aintern_prim_soft.h"
+#include "allegro5/internal/aintern_shader.h"
 
 #ifdef ALLEGRO_ANDROID
 #include "allegro5/internal/aintern_android.h"
@@ -29,6 +30,11 @@
 
 ALLEGRO_DEBUG_CHANNEL("opengl")
 
+/* Initial size of the buffer that vertices drawn from memory are streamed
+ * through, in bytes.
+ */
+#define STREAM_BUFFER_SIZE (1 << 20)
+
 /* FIXME: For some reason x86_64 Android crashes for me when calling
  * glBlendColor - so adding this hack to disable it.
  */
@@ -118,6 +124,115 @@ break;
    }
 }
 
+#if !defined ALLEGRO_CFG_OPENGLES
+/* Space a block of data takes up in the display's vbo.  Keeping every block
+ * aligned keeps the attribute and index offsets into it aligned too.
+ */
+#define STREAM_SIZE(bytes) (((bytes) + 15) & ~15)
+
+/* Binds the display's vbo and makes sure that the next bytes streamed into
+ * it fit its current storage.  Once the buffer is full it is orphaned: the
+ * driver gives it new storage and releases the old one when the draws
+ * reading it are done.  A draw that streams several blocks reserves room for
+ * all of them first, so that they end up in the same storage.
+ */
+static void stream_reserve(ALLEGRO_DISPLAY *display, GLsizeiptr bytes)
+{
+   ALLEGRO_OGL_EXTRAS *o = display->ogl_extras;
+
+   if (o->vbo == 0) {
+      glGenBuffers(1, &o->vbo);
+      ALLEGRO_DEBUG("new VBO: %u\n", o->vbo);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, o->vbo);
+
+   if (o->vbo_offset + bytes > o->vbo_size) {
+      if (o->vbo_size == 0)
+         o->vbo_size = STREAM_BUFFER_SIZE;
+      while (o->vbo_size < bytes)
+         o->vbo_size *= 2;
+      glBufferData(GL_ARRAY_BUFFER, o->vbo_size, NULL, GL_STREAM_DRAW);
+      o->vbo_offset = 0;
+   }
+}
+
+/* Copies data into the display's vbo, which is left bound, and returns the
+ * offset it was written at.  Each call appends to the buffer, so the range
+ * written was not used by an earlier draw and can be mapped without waiting
+ * for the GPU.
+ */
+static GLintptr stream_data(ALLEGRO_DISPLAY *display, const void* data, GLsizeiptr bytes)
+{
+   ALLEGRO_OGL_EXTRAS *o = display->ogl_extras;
+   GLintptr offset;
+   void* dst = NULL;
+
+   stream_reserve(display, STREAM_SIZE(bytes));
+
+   offset = o->vbo_offset;
+   o->vbo_offset += STREAM_SIZE(bytes);
+
+   if (o->extension_list->ALLEGRO_GL_ARB_map_buffer_range) {
+      dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+   }
+   if (dst) {
+      memcpy(dst, data, bytes);
+      /* The contents are lost if the buffer was corrupted while mapped. */
+      if (glUnmapBuffer(GL_ARRAY_BUFFER))
+         return offset;
+   }
+   glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+   return offset;
+}
+#endif
+
+#if !defined ALLEGRO_CFG_OPENGLES && !defined ALLEGRO_MACOSX
+/* Streams the vertices that num_idx indices refer to, followed by the
+ * indices, which are renumbered if the lowest one is not zero.  The offsets
+ * of the two blocks are stored to *vtx and *idx.  extra is the room to
+ * reserve for blocks the caller streams next, which then end up in the same
+ * storage.  Returns false, having streamed nothing, if the renumbered
+ * indices could not be allocated.
+ */
+static bool stream_indexed(ALLEGRO_DISPLAY *display, const void** vtx,
+   int stride, const int* indices, int num_idx, const void** idx,
+   GLsizeiptr extra)
+{
+   int min_idx = indices[0];
+   int max_idx = indices[0];
+   int* rebased = NULL;
+   GLsizeiptr vtx_bytes, idx_bytes;
+   int ii;
+
+   for (ii = 1; ii < num_idx; ii++) {
+      if (max_idx < indices[ii])
+         max_idx = indices[ii];
+      else if (min_idx > indices[ii])
+         min_idx = indices[ii];
+   }
+   vtx_bytes = (GLsizeiptr)(max_idx - min_idx + 1) * stride;
+   idx_bytes = (GLsizeiptr)num_idx * sizeof(GLuint);
+
+   if (min_idx > 0) {
+      rebased = al_malloc(idx_bytes);
+      if (!rebased)
+         return false;
+      for (ii = 0; ii < num_idx; ii++)
+         rebased[ii] = indices[ii] - min_idx;
+   }
+
+   stream_reserve(display, STREAM_SIZE(vtx_bytes) + STREAM_SIZE(idx_bytes) + extra);
+   *vtx = (const void*)(intptr_t)stream_data(display,
+      (const char*)*vtx + min_idx * stride, vtx_bytes);
+   *idx = (const void*)(intptr_t)stream_data(display,
+      rebased ? rebased : indices, idx_bytes);
+
+   al_free(rebased);
+   return true;
+}
+#endif
+
 static void setup_state(ALLEGRO_DISPLAY *display, const char* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture)
 {
    GLenum type;
@@ -423,6 +538,7 @@ static int draw_prim_common(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture,
    ALLEGRO_BITMAP *opengl_target = target;
    ALLEGRO_BITMAP_EXTRA_OPENGL *extra;
    int num_vtx = end - start;
+   bool streamed = false;
 
    if (target->parent) {
        opengl_target = target->parent;
@@ -442,6 +558,18 @@ static int draw_prim_common(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture,
    if (vertex_buffer) {
       glBindBuffer(GL_ARRAY_BUFFER, (GLuint)vertex_buffer->common.handle);
    }
+#if !defined ALLEGRO_CFG_OPENGLES && !defined ALLEGRO_MACOSX
+   else if (disp->flags & ALLEGRO_PROGRAMMABLE_PIPELINE) {
+      /* Stream the vertices instead of having the driver copy them out of
+       * client memory before each draw.
+       */
+      int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+      vtx = (const char*)(intptr_t)stream_data(disp,
+         (const char*)vtx + start * stride, num_vtx * stride);
+      start = 0;
+      streamed = true;
+   }
+#endif
 
    _al_opengl_set_blender(disp);
    setup_state(disp, vtx, decl, texture);
@@ -486,7 +614,7 @@ static int draw_prim_common(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture,
 
    revert_state(disp, texture);
 
-   if (vertex_buffer) {
+   if (vertex_buffer || streamed) {
       glBindBuffer(GL_ARRAY_BUFFER, 0);
    }
 
@@ -508,6 +636,7 @@ static int draw_prim_indexed_common(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* text
    int start_offset = 0;
    GLenum idx_size = GL_UNSIGNED_INT;
    bool use_buffers = index_buffer != NULL;
+   bool streamed = false;
    int num_vtx = end - start;
 #if defined ALLEGRO_IPHONE
    GLushort* iphone_idx = NULL;
@@ -552,6 +681,20 @@ static int draw_prim_indexed_common(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* text
       glBindBuffer(GL_ARRAY_BUFFER, (GLuint)vertex_buffer->common.handle);
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (GLuint)index_buffer->common.handle);
    }
+#if !defined ALLEGRO_CFG_OPENGLES && !defined ALLEGRO_MACOSX
+   else if (disp->flags & ALLEGRO_PROGRAMMABLE_PIPELINE) {
+      int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+      const void* streamed_idx;
+
+      if (stream_indexed(disp, &vtx, stride, indices + start, num_vtx,
+            &streamed_idx, 0)) {
+         idx = streamed_idx;
+         start_offset = 0;
+         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, disp->ogl_extras->vbo);
+         streamed = true;
+      }
+   }
+#endif
 
    setup_state(disp, vtx, decl, texture);
 
@@ -593,7 +736,7 @@ static int draw_prim_indexed_common(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* text
 
    revert_state(disp, texture);
 
-   if (use_buffers) {
+   if (use_buffers || streamed) {
       glBindBuffer(GL_ARRAY_BUFFER, 0);
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
    }
@@ -605,6 +748,221 @@ static int draw_prim_indexed_common(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* text
    return num_primitives;
 }
 
+#if defined ALLEGRO_CFG_OPENGL_PROGRAMMABLE_PIPELINE && !defined ALLEGRO_CFG_OPENGLES && !defined ALLEGRO_MACOSX
+static void instance_attr_on(GLint loc, int n, const char* ptr)
+{
+   if (loc >= 0) {
+      glVertexAttribPointer(loc, n, GL_FLOAT, false, sizeof(ALLEGRO_PRIM_INSTANCE), ptr);
+      glEnableVertexAttribArray(loc);
+      glVertexAttribDivisor(loc, 1);
+   }
+}
+
+static void instance_attr_off(GLint loc)
+{
+   if (loc >= 0) {
+      glVertexAttribDivisor(loc, 0);
+      glDisableVertexAttribArray(loc);
+   }
+}
+
+/* Draws all the instances with one instanced draw call, the mesh being
+ * taken from the buffers if given and streamed otherwise.  The per-instance
+ * attributes are read by the current shader if it declares them, and by the
+ * display's instanced shader if the default shader is in use.
+ */
+static int ogl_draw_prim_instanced(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture,
+   ALLEGRO_VERTEX_BUFFER* vertex_buffer,
+   const void* vtx, const ALLEGRO_VERTEX_DECL* decl,
+   ALLEGRO_INDEX_BUFFER* index_buffer, const int* indices,
+   int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   ALLEGRO_DISPLAY *disp = _al_get_bitmap_display(target);
+   ALLEGRO_OGL_EXTRAS *o = disp->ogl_extras;
+   ALLEGRO_BITMAP *opengl_target = target;
+   ALLEGRO_BITMAP_EXTRA_OPENGL *extra;
+   ALLEGRO_SHADER *restore_shader = NULL;
+   ALLEGRO_PRIM_INSTANCE *pixel_instances = NULL;
+   GLsizeiptr inst_bytes = (GLsizeiptr)num_instances * sizeof(ALLEGRO_PRIM_INSTANCE);
+   int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+   int num_vtx = end - start;
+   bool indexed = index_buffer || indices;
+   const char* idx = NULL;
+   const char* inst;
+   GLenum idx_size = GL_UNSIGNED_INT;
+   GLenum mode;
+   GLint loc;
+   int per_instance;
+   int ii;
+
+   if (!(disp->flags & ALLEGRO_PROGRAMMABLE_PIPELINE) ||
+       !o->extension_list->ALLEGRO_GL_ARB_instanced_arrays ||
+       al_get_opengl_version() < _ALLEGRO_OPENGL_VERSION_3_1) {
+      return -1;
+   }
+
+   if (target->parent) {
+      opengl_target = target->parent;
+   }
+   extra = opengl_target->extra;
+
+   if ((!extra->is_backbuffer && o->opengl_target != opengl_target) ||
+      al_is_bitmap_locked(target)) {
+      return -1;
+   }
+
+   switch (type) {
+      case ALLEGRO_PRIM_LINE_LIST:
+         mode = GL_LINES;
+         per_instance = num_vtx / 2;
+         break;
+      case ALLEGRO_PRIM_LINE_STRIP:
+         mode = GL_LINE_STRIP;
+         per_instance = num_vtx - 1;
+         break;
+      case ALLEGRO_PRIM_LINE_LOOP:
+         mode = GL_LINE_LOOP;
+         per_instance = num_vtx;
+         break;
+      case ALLEGRO_PRIM_TRIANGLE_LIST:
+         mode = GL_TRIANGLES;
+         per_instance = num_vtx / 3;
+         break;
+      case ALLEGRO_PRIM_TRIANGLE_STRIP:
+         mode = GL_TRIANGLE_STRIP;
+         per_instance = num_vtx - 2;
+         break;
+      case ALLEGRO_PRIM_TRIANGLE_FAN:
+         mode = GL_TRIANGLE_FAN;
+         per_instance = num_vtx - 2;
+         break;
+      case ALLEGRO_PRIM_POINT_LIST:
+         mode = GL_POINTS;
+         per_instance = num_vtx;
+         break;
+      default:
+         return -1;
+   }
+
+   /* The instance offsets are in pixels, but normalized texture coordinates
+    * are scaled by the texture size.
+    */
+   if (texture && decl && !decl->elements[ALLEGRO_PRIM_TEX_COORD_PIXEL].attribute) {
+      float w = al_get_bitmap_width(texture);
+      float h = al_get_bitmap_height(texture);
+
+      pixel_instances = al_malloc(inst_bytes);
+      if (!pixel_instances)
+         return -1;
+      for (ii = 0; ii < num_instances; ii++) {
+         pixel_instances[ii] = instances[ii];
+         pixel_instances[ii].u /= w;
+         pixel_instances[ii].v /= h;
+      }
+      instances = pixel_instances;
+   }
+
+   if (o->varlocs.instance_transform_loc < 0) {
+      /* A user shader that does not read the instances can't draw them. */
+      if (target->shader) {
+         al_free(pixel_instances);
+         return -1;
+      }
+      if (!disp->instanced_shader && !disp->instanced_shader_failed) {
+         disp->instanced_shader = _al_create_default_instanced_shader(disp);
+         disp->instanced_shader_failed = !disp->instanced_shader;
+      }
+      restore_shader = disp->default_shader;
+      if (!disp->instanced_shader ||
+          !disp->instanced_shader->vt->use_shader(disp->instanced_shader, disp, true)) {
+         if (restore_shader)
+            restore_shader->vt->use_shader(restore_shader, disp, true);
+         al_free(pixel_instances);
+         return -1;
+      }
+   }
+
+   /* The mesh is streamed first, with room reserved for the instances after
+    * it so that both are in the same storage.
+    */
+   if (indices) {
+      const void* streamed_idx;
+
+      if (!stream_indexed(disp, &vtx, stride, indices + start, num_vtx,
+            &streamed_idx, STREAM_SIZE(inst_bytes))) {
+         if (restore_shader)
+            restore_shader->vt->use_shader(restore_shader, disp, true);
+         al_free(pixel_instances);
+         return -1;
+      }
+      idx = streamed_idx;
+   }
+   else if (!vertex_buffer) {
+      stream_reserve(disp, STREAM_SIZE((GLsizeiptr)num_vtx * stride) + STREAM_SIZE(inst_bytes));
+      vtx = (const char*)(intptr_t)stream_data(disp,
+         (const char*)vtx + start * stride, (GLsizeiptr)num_vtx * stride);
+      start = 0;
+   }
+   inst = (const char*)(intptr_t)stream_data(disp, instances, inst_bytes);
+
+   /* The instance attributes read from the display's vbo, which is bound
+    * now.  The vertex attributes are set up once the mesh's buffer is.
+    */
+   loc = o->varlocs.instance_transform_loc;
+   for (ii = 0; ii < 4; ii++) {
+      instance_attr_on(loc + ii, 4, inst + offsetof(ALLEGRO_PRIM_INSTANCE, transform) +
+         ii * sizeof(instances->transform.m[0]));
+   }
+   instance_attr_on(o->varlocs.instance_color_loc, 4,
+      inst + offsetof(ALLEGRO_PRIM_INSTANCE, color));
+   instance_attr_on(o->varlocs.instance_texcoord_loc, 2,
+      inst + offsetof(ALLEGRO_PRIM_INSTANCE, u));
+
+   if (vertex_buffer) {
+      glBindBuffer(GL_ARRAY_BUFFER, (GLuint)vertex_buffer->common.handle);
+   }
+   if (index_buffer) {
+      idx_size = index_buffer->index_size == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+      idx = (const char*)(intptr_t)(start * index_buffer->index_size);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (GLuint)index_buffer->common.handle);
+   }
+   else if (indices) {
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, o->vbo);
+   }
+
+   _al_opengl_set_blender(disp);
+   setup_state(disp, vtx, decl, texture);
+
+   if (indexed) {
+      glDrawElementsInstanced(mode, num_vtx, idx_size, idx, num_instances);
+   }
+   else {
+      glDrawArraysInstanced(mode, start, num_vtx, num_instances);
+   }
+
+   for (ii = 0; ii < 4; ii++) {
+      instance_attr_off(loc + ii);
+   }
+   instance_attr_off(o->varlocs.instance_color_loc);
+   instance_attr_off(o->varlocs.instance_texcoord_loc);
+
+   revert_state(disp, texture);
+
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   if (indexed) {
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+   }
+
+   if (restore_shader) {
+      restore_shader->vt->use_shader(restore_shader, disp, true);
+   }
+
+   al_free(pixel_instances);
+   return per_instance * num_instances;
+}
+#endif
+
 static int ogl_draw_prim(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type)
 {
    return draw_prim_common(target, texture, 0, vtxs, decl, start, end, type);
@@ -719,6 +1077,23 @@ static void unlock_buffer_common(_AL_BUFFER_COMMON* common, GLenum type)
 {
    if (common->lock_flags != ALLEGRO_LOCK_READONLY) {
       glBindBuffer(type, (GLuint)common->handle);
+#if !defined ALLEGRO_CFG_OPENGLES
+      /* A write-only lock replaces the whole range, so the old contents are
+       * discarded instead of waiting for draws still reading them.
+       */
+      if (common->lock_flags == ALLEGRO_LOCK_WRITEONLY &&
+            al_get_current_display()->ogl_extras->extension_list->ALLEGRO_GL_ARB_map_buffer_range) {
+         void* dst = glMapBufferRange(type, common->lock_offset, common->lock_length,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+         if (dst) {
+            memcpy(dst, common->locked_memory, common->lock_length);
+            if (glUnmapBuffer(type)) {
+               glBindBuffer(type, 0);
+               return;
+            }
+         }
+      }
+#endif
       glBufferSubData(type, common->lock_offset, common->lock_length, common->locked_memory);
       glBindBuffer(type, 0);
    }
@@ -1063,41 +1438,36 @@ static void ogl_flush_vertex_cache(ALLEGRO_DISPLAY *disp)
 #endif
       int stride = sizeof(ALLEGRO_OGL_BITMAP_VERTEX);
       int bytes = disp->num_cache_vertices * stride;
+      GLintptr offset;
 
-      /* We create the VAO and VBO on first use. */
+      /* We create the VAO on first use. */
       if (o->vao == 0) {
          glGenVertexArrays(1, &o->vao);
          ALLEGRO_DEBUG("new VAO: %u\n", o->vao);
       }
       glBindVertexArray(o->vao);
 
-      if (o->vbo == 0) {
-         glGenBuffers(1, &o->vbo);
-         ALLEGRO_DEBUG("new VBO: %u\n", o->vbo);
-      }
-      glBindBuffer(GL_ARRAY_BUFFER, o->vbo);
-
-      /* Then we upload data into it. */
-      glBufferData(GL_ARRAY_BUFFER, bytes, disp->vertex_cache, GL_STREAM_DRAW);
+      /* Then we upload data into the VBO. */
+      offset = stream_data(disp, disp->vertex_cache, bytes);
 
       /* Finally set the "pos", "texccord" and "color" attributes used by our
        * shader and enable them.
        */
       if (o->varlocs.pos_loc >= 0)  {
          glVertexAttribPointer(o->varlocs.pos_loc, 3, GL_FLOAT, false, stride,
-            (void *)offsetof(ALLEGRO_OGL_BITMAP_VERTEX, x));
+            (void *)(offset + offsetof(ALLEGRO_OGL_BITMAP_VERTEX, x)));
          glEnableVertexAttribArray(o->varlocs.pos_loc);
       }
 
       if (o->varlocs.texcoord_loc >= 0) {
          glVertexAttribPointer(o->varlocs.texcoord_loc, 2, GL_FLOAT, false, stride,
-            (void *)offsetof(ALLEGRO_OGL_BITMAP_VERTEX, tx));
+            (void *)(offset + offsetof(ALLEGRO_OGL_BITMAP_VERTEX, tx)));
          glEnableVertexAttribArray(o->varlocs.texcoord_loc);
       }
 
       if (o->varlocs.color_loc >= 0) {
          glVertexAttribPointer(o->varlocs.color_loc, 4, GL_FLOAT, false, stride,
-            (void *)offsetof(ALLEGRO_OGL_BITMAP_VERTEX, r));
+            (void *)(offset + offsetof(ALLEGRO_OGL_BITMAP_VERTEX, r)));
          glEnableVertexAttribArray(o->varlocs.color_loc);
       }
    }
@@ -1236,6 +1606,10 @@ void _al_ogl_add_drawing_functions(ALLEGRO_DISPLAY_INTERFACE *vt)
 
    vt->draw_vertex_buffer = ogl_draw_vertex_buffer;
    vt->draw_indexed_buffer = ogl_draw_indexed_buffer;
+
+#if defined ALLEGRO_CFG_OPENGL_PROGRAMMABLE_PIPELINE && !defined ALLEGRO_CFG_OPENGLES && !defined ALLEGRO_MACOSX
+   vt->draw_prim_instanced = ogl_draw_prim_instanced;
+#endif
 }
 
 /* vim: set sts=3 sw=3 et: */
@@ -449,6 +449,9 @@ static void lookup_varlocs(ALLEGRO_OGL_VARLOCS *varlocs, GLuint program)
    varlocs->alpha_test_loc = glGetUniformLocation(program, ALLEGRO_SHADER_VAR_ALPHA_TEST);
    varlocs->alpha_func_loc = glGetUniformLocation(program, ALLEGRO_SHADER_VAR_ALPHA_FUNCTION);
    varlocs->alpha_test_val_loc = glGetUniformLocation(program, ALLEGRO_SHADER_VAR_ALPHA_TEST_VALUE);
+   varlocs->instance_transform_loc = glGetAttribLocation(program, ALLEGRO_SHADER_VAR_INSTANCE_TRANSFORM);
+   varlocs->instance_color_loc = glGetAttribLocation(program, ALLEGRO_SHADER_VAR_INSTANCE_COLOR);
+   varlocs->instance_texcoord_loc = glGetAttribLocation(program, ALLEGRO_SHADER_VAR_INSTANCE_TEXCOORD);
 
    for (i = 0; i < ALLEGRO_PRIM_MAX_USER_ATTR; i++) {
       /* al_user_attr_##0 */
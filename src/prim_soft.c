@@ -25,12 +25,19 @@
 #include "allegro5/internal/aintern_tri_soft.h"
 
 /*
-The vertex cache allows for bulk transformation of vertices, for faster run speeds
+The vertex cache holds every vertex a call draws after conversion and
+transformation, so that vertices shared between primitives are only processed
+once. Batches larger than the local cache are allocated.
 */
 #define LOCAL_VERTEX_CACHE  ALLEGRO_VERTEX vertex_cache[ALLEGRO_VERTEX_CACHE_SIZE]
 
-static void convert_vtx(ALLEGRO_BITMAP* texture, const char* src, ALLEGRO_VERTEX* dest, const ALLEGRO_VERTEX_DECL* decl)
+/*
+Converts one vertex described by decl to an ALLEGRO_VERTEX, with texture
+coordinates in pixels
+*/
+void _al_convert_vertex(ALLEGRO_BITMAP* texture, const void* vtx, ALLEGRO_VERTEX* dest, const ALLEGRO_VERTEX_DECL* decl)
 {
+   const char* src = vtx;
    ALLEGRO_VERTEX_ELEMENT* e;
    if(!decl) {
       *dest = *((ALLEGRO_VERTEX*)src);
@@ -98,205 +105,180 @@ static void convert_vtx(ALLEGRO_BITMAP* texture, const char* src, ALLEGRO_VERTEX
    }
 }
 
-int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type)
+static ALLEGRO_VERTEX* alloc_cache(ALLEGRO_VERTEX* local_cache, int size)
 {
-   LOCAL_VERTEX_CACHE;
-   int num_primitives;
-   int num_vtx;
-   int use_cache;
-   int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
-   const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
+   if (size <= ALLEGRO_VERTEX_CACHE_SIZE)
+      return local_cache;
+   return al_malloc(size * sizeof(ALLEGRO_VERTEX));
+}
 
-   num_primitives = 0;
-   num_vtx = end - start;
-   use_cache = num_vtx < ALLEGRO_VERTEX_CACHE_SIZE;
+static void free_cache(ALLEGRO_VERTEX* cache, ALLEGRO_VERTEX* local_cache)
+{
+   if (cache != local_cache)
+      al_free(cache);
+}
 
-   if (texture)
-      al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+/*
+Same as al_transform_coordinates on each vertex, with the matrix elements
+loaded once for the whole batch
+*/
+static void transform_vertices(const ALLEGRO_TRANSFORM* trans, ALLEGRO_VERTEX* vtx, int num_vtx)
+{
+   const float m00 = trans->m[0][0];
+   const float m01 = trans->m[0][1];
+   const float m10 = trans->m[1][0];
+   const float m11 = trans->m[1][1];
+   const float m30 = trans->m[3][0];
+   const float m31 = trans->m[3][1];
+   int ii;
 
-   if (use_cache) {
-      int ii;
-      int n = 0;
-      const char* vtxptr = (const char*)vtxs + start * stride;
-      for (ii = 0; ii < num_vtx; ii++) {
-         convert_vtx(texture, vtxptr, &vertex_cache[ii], decl);
-         al_transform_coordinates(global_trans, &vertex_cache[ii].x, &vertex_cache[ii].y);
-         n++;
-         vtxptr += stride;
-      }
+   if (m00 == 1 && m01 == 0 && m10 == 0 && m11 == 1 && m30 == 0 && m31 == 0)
+      return;
+
+   for (ii = 0; ii < num_vtx; ii++) {
+      const float x = vtx[ii].x;
+      const float y = vtx[ii].y;
+      vtx[ii].x = x * m00 + y * m10 + m30;
+      vtx[ii].y = x * m01 + y * m11 + m31;
    }
+}
+
+static void convert_vertices(ALLEGRO_BITMAP* texture, const char* src, int stride,
+   ALLEGRO_VERTEX* dest, int num_vtx, const ALLEGRO_VERTEX_DECL* decl)
+{
+   int ii;
 
-#define SET_VERTEX(v, idx)                                             \
-   convert_vtx(texture, (const char*)vtxs + stride * (idx), &v, decl); \
-   al_transform_coordinates(global_trans, &v.x, &v.y);            \
+   if (!decl) {
+      memcpy(dest, src, num_vtx * sizeof(ALLEGRO_VERTEX));
+      return;
+   }
+
+   for (ii = 0; ii < num_vtx; ii++) {
+      _al_convert_vertex(texture, src, &dest[ii], decl);
+      src += stride;
+   }
+}
+
+/*
+Draws num_vtx vertices from the cache. Without indices they are taken in
+order, otherwise indices[ii] - base is the cache entry of vertex ii.
+*/
+static int draw_cached(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* cache,
+   const int* indices, int base, int num_vtx, int type)
+{
+   int num_primitives = 0;
+   int ii;
+
+   if (!texture && (_al_get_prim_state()->flags & ALLEGRO_PRIM_ANTIALIAS) &&
+       _al_draw_prim_coverage(cache, indices, base, num_vtx, type, &num_primitives))
+      return num_primitives;
+
+#define VTX(ii) (&cache[indices ? indices[ii] - base : (ii)])
 
    switch (type) {
       case ALLEGRO_PRIM_LINE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 1; ii += 2) {
-               _al_line_2d(texture, &vertex_cache[ii], &vertex_cache[ii + 1]);
-            }
-         } else {
-            int ii;
-            for (ii = start; ii < end - 1; ii += 2) {
-               ALLEGRO_VERTEX v1, v2;
-               SET_VERTEX(v1, ii);
-               SET_VERTEX(v2, ii + 1);
-
-               _al_line_2d(texture, &v1, &v2);
-            }
+         for (ii = 0; ii < num_vtx - 1; ii += 2) {
+            _al_line_2d(texture, VTX(ii), VTX(ii + 1));
          }
          num_primitives = num_vtx / 2;
          break;
       };
       case ALLEGRO_PRIM_LINE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               _al_line_2d(texture, &vertex_cache[ii - 1], &vertex_cache[ii]);
-            }
-         } else {
-            int ii;
-            int idx = 1;
-            ALLEGRO_VERTEX vtx[2];
-            SET_VERTEX(vtx[0], start);
-            for (ii = start + 1; ii < end; ii++) {
-               SET_VERTEX(vtx[idx], ii)
-               _al_line_2d(texture, &vtx[0], &vtx[1]);
-               idx = 1 - idx;
-            }
+         for (ii = 1; ii < num_vtx; ii++) {
+            _al_line_2d(texture, VTX(ii - 1), VTX(ii));
          }
          num_primitives = num_vtx - 1;
          break;
       };
       case ALLEGRO_PRIM_LINE_LOOP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               _al_line_2d(texture, &vertex_cache[ii - 1], &vertex_cache[ii]);
-            }
-            _al_line_2d(texture, &vertex_cache[num_vtx - 1], &vertex_cache[0]);
-         } else {
-            int ii;
-            int idx = 1;
-            ALLEGRO_VERTEX vtx[2];
-            SET_VERTEX(vtx[0], start);
-            for (ii = start + 1; ii < end; ii++) {
-               SET_VERTEX(vtx[idx], ii)
-               _al_line_2d(texture, &vtx[idx], &vtx[1 - idx]);
-               idx = 1 - idx;
-            }
-            SET_VERTEX(vtx[idx], start)
-            _al_line_2d(texture, &vtx[idx], &vtx[1 - idx]);
+         for (ii = 1; ii < num_vtx; ii++) {
+            _al_line_2d(texture, VTX(ii - 1), VTX(ii));
          }
+         if (num_vtx > 0)
+            _al_line_2d(texture, VTX(num_vtx - 1), VTX(0));
          num_primitives = num_vtx;
          break;
       };
       case ALLEGRO_PRIM_TRIANGLE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 2; ii += 3) {
-               _al_triangle_2d(texture, &vertex_cache[ii], &vertex_cache[ii + 1], &vertex_cache[ii + 2]);
-            }
-         } else {
-            int ii;
-            for (ii = start; ii < end - 2; ii += 3) {
-               ALLEGRO_VERTEX v1, v2, v3;
-               SET_VERTEX(v1, ii);
-               SET_VERTEX(v2, ii + 1);
-               SET_VERTEX(v3, ii + 2);
-
-               _al_triangle_2d(texture, &v1, &v2, &v3);
-            }
+         for (ii = 0; ii < num_vtx - 2; ii += 3) {
+            _al_triangle_2d(texture, VTX(ii), VTX(ii + 1), VTX(ii + 2));
          }
          num_primitives = num_vtx / 3;
          break;
       };
       case ALLEGRO_PRIM_TRIANGLE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 2; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[ii - 2], &vertex_cache[ii - 1], &vertex_cache[ii]);
-            }
-         } else {
-            int ii;
-            int idx = 2;
-            ALLEGRO_VERTEX vtx[3];
-            SET_VERTEX(vtx[0], start);
-            SET_VERTEX(vtx[1], start + 1);
-            for (ii = start + 2; ii < end; ii++) {
-               SET_VERTEX(vtx[idx], ii);
-
-               _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
-               idx = (idx + 1) % 3;
-            }
+         for (ii = 2; ii < num_vtx; ii++) {
+            _al_triangle_2d(texture, VTX(ii - 2), VTX(ii - 1), VTX(ii));
          }
          num_primitives = num_vtx - 2;
          break;
       };
       case ALLEGRO_PRIM_TRIANGLE_FAN: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[0], &vertex_cache[ii], &vertex_cache[ii - 1]);
-            }
-         } else {
-            int ii;
-            int idx = 1;
-            ALLEGRO_VERTEX v0;
-            ALLEGRO_VERTEX vtx[2];
-            SET_VERTEX(v0, start);
-            SET_VERTEX(vtx[0], start + 1);
-            for (ii = start + 1; ii < end; ii++) {
-               SET_VERTEX(vtx[idx], ii)
-               _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
-               idx = 1 - idx;
-            }
+         for (ii = 2; ii < num_vtx; ii++) {
+            _al_triangle_2d(texture, VTX(0), VTX(ii), VTX(ii - 1));
          }
          num_primitives = num_vtx - 2;
          break;
       };
       case ALLEGRO_PRIM_POINT_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx; ii++) {
-               _al_point_2d(texture, &vertex_cache[ii]);
-            }
-         } else {
-            int ii;
-            for (ii = start; ii < end; ii++) {
-               ALLEGRO_VERTEX v;
-               SET_VERTEX(v, ii);
-
-               _al_point_2d(texture, &v);
-            }
+         for (ii = 0; ii < num_vtx; ii++) {
+            _al_point_2d(texture, VTX(ii));
          }
          num_primitives = num_vtx;
          break;
       };
    }
 
+#undef VTX
+
+   return num_primitives;
+}
+
+int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type)
+{
+   LOCAL_VERTEX_CACHE;
+   ALLEGRO_VERTEX* cache;
+   int num_primitives;
+   int num_vtx = end - start;
+   int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+
+   if (num_vtx <= 0)
+      return 0;
+
+   cache = alloc_cache(vertex_cache, num_vtx);
+   if (!cache)
+      return 0;
+
+   if (texture)
+      al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+
+   convert_vertices(texture, (const char*)vtxs + start * stride, stride, cache, num_vtx, decl);
+   transform_vertices(al_get_current_transform(), cache, num_vtx);
+
+   num_primitives = draw_cached(texture, cache, NULL, 0, num_vtx, type);
+
    if(texture)
        al_unlock_bitmap(texture);
 
+   free_cache(cache, vertex_cache);
    return num_primitives;
-#undef SET_VERTEX
 }
 
 int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
    const int* indices, int num_vtx, int type)
 {
    LOCAL_VERTEX_CACHE;
+   ALLEGRO_VERTEX* cache;
    int num_primitives;
-   int use_cache;
+   int num_cached;
+   bool by_index;
    int min_idx, max_idx;
    int ii;
    int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
-   const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
 
-   num_primitives = 0;
-   use_cache = 1;
+   if (num_vtx <= 0)
+      return 0;
+
    min_idx = indices[0];
    max_idx = indices[0];
 
@@ -307,212 +289,44 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
       int idx = indices[ii];
       if (max_idx < idx)
          max_idx = idx;
-      else if (min_idx > indices[ii])
+      else if (min_idx > idx)
          min_idx = idx;
    }
-   if (max_idx - min_idx >= ALLEGRO_VERTEX_CACHE_SIZE) {
-      use_cache = 0;
-   }
+
+   /*
+   Usually the indices refer to a range of vertices no larger than their
+   number, which is then processed as a whole. Otherwise each index gets its
+   own copy of its vertex.
+   */
+   num_cached = max_idx - min_idx + 1;
+   by_index = num_cached <= _ALLEGRO_MAX(num_vtx, ALLEGRO_VERTEX_CACHE_SIZE);
+   if (!by_index)
+      num_cached = num_vtx;
+
+   cache = alloc_cache(vertex_cache, num_cached);
+   if (!cache)
+      return 0;
 
    if (texture)
       al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
 
-   if (use_cache) {
-      int ii;
+   if (by_index) {
+      convert_vertices(texture, (const char*)vtxs + min_idx * stride, stride, cache, num_cached, decl);
+   }
+   else {
       for (ii = 0; ii < num_vtx; ii++) {
-         int idx = indices[ii];
-         convert_vtx(texture, (const char*)vtxs + idx * stride, &vertex_cache[idx - min_idx], decl);
-         al_transform_coordinates(global_trans, &vertex_cache[idx - min_idx].x, &vertex_cache[idx - min_idx].y);
+         _al_convert_vertex(texture, (const char*)vtxs + indices[ii] * stride, &cache[ii], decl);
       }
    }
+   transform_vertices(al_get_current_transform(), cache, num_cached);
 
-#define SET_VERTEX(v, idx)                                             \
-   convert_vtx(texture, (const char*)vtxs + stride * (idx), &v, decl); \
-   al_transform_coordinates(global_trans, &v.x, &v.y);            \
-
-   switch (type) {
-      case ALLEGRO_PRIM_LINE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 1; ii += 2) {
-               int idx1 = indices[ii] - min_idx;
-               int idx2 = indices[ii + 1] - min_idx;
-
-               _al_line_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2]);
-            }
-         } else {
-            int ii;
-            for (ii = 0; ii < num_vtx - 1; ii += 2) {
-               int idx1 = indices[ii];
-               int idx2 = indices[ii + 1];
-
-               ALLEGRO_VERTEX v1, v2;
-               SET_VERTEX(v1, idx1);
-               SET_VERTEX(v2, idx2);
-
-               _al_line_2d(texture, &v1, &v2);
-            }
-         }
-         num_primitives = num_vtx / 2;
-         break;
-      };
-      case ALLEGRO_PRIM_LINE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               int idx1 = indices[ii - 1] - min_idx;
-               int idx2 = indices[ii] - min_idx;
-
-               _al_line_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2]);
-            }
-         } else {
-            int ii;
-            int idx = 1;
-            ALLEGRO_VERTEX vtx[2];
-            SET_VERTEX(vtx[0], indices[0]);
-            for (ii = 1; ii < num_vtx; ii++) {
-               SET_VERTEX(vtx[idx], indices[ii])
-               _al_line_2d(texture, &vtx[0], &vtx[1]);
-               idx = 1 - idx;
-            }
-         }
-         num_primitives = num_vtx - 1;
-         break;
-      };
-      case ALLEGRO_PRIM_LINE_LOOP: {
-         if (use_cache) {
-            int ii;
-            int idx1, idx2;
-
-            for (ii = 1; ii < num_vtx; ii++) {
-               int idx1 = indices[ii - 1] - min_idx;
-               int idx2 = indices[ii] - min_idx;
-
-               _al_line_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2]);
-            }
-            idx1 = indices[0] - min_idx;
-            idx2 = indices[num_vtx - 1] - min_idx;
-
-            _al_line_2d(texture, &vertex_cache[idx2], &vertex_cache[idx1]);
-         } else {
-            int ii;
-            int idx = 1;
-            ALLEGRO_VERTEX vtx[2];
-            SET_VERTEX(vtx[0], indices[0]);
-            for (ii = 1; ii < num_vtx; ii++) {
-               SET_VERTEX(vtx[idx], indices[ii])
-               _al_line_2d(texture, &vtx[0], &vtx[1]);
-               idx = 1 - idx;
-            }
-            SET_VERTEX(vtx[idx], indices[0])
-            _al_line_2d(texture, &vtx[0], &vtx[1]);
-         }
-         num_primitives = num_vtx;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 2; ii += 3) {
-               int idx1 = indices[ii] - min_idx;
-               int idx2 = indices[ii + 1] - min_idx;
-               int idx3 = indices[ii + 2] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
-            }
-         } else {
-            int ii;
-            for (ii = 0; ii < num_vtx - 2; ii += 3) {
-               int idx1 = indices[ii];
-               int idx2 = indices[ii + 1];
-               int idx3 = indices[ii + 2];
-
-               ALLEGRO_VERTEX v1, v2, v3;
-               SET_VERTEX(v1, idx1);
-               SET_VERTEX(v2, idx2);
-               SET_VERTEX(v3, idx3);
-
-               _al_triangle_2d(texture, &v1, &v2, &v3);
-            }
-         }
-         num_primitives = num_vtx / 3;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 2; ii < num_vtx; ii++) {
-               int idx1 = indices[ii - 2] - min_idx;
-               int idx2 = indices[ii - 1] - min_idx;
-               int idx3 = indices[ii] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
-            }
-         } else {
-            int ii;
-            int idx = 2;
-            ALLEGRO_VERTEX vtx[3];
-            SET_VERTEX(vtx[0], indices[0]);
-            SET_VERTEX(vtx[1], indices[1]);
-            for (ii = 2; ii < num_vtx; ii ++) {
-               SET_VERTEX(vtx[idx], indices[ii]);
-
-               _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
-               idx = (idx + 1) % 3;
-            }
-         }
-         num_primitives = num_vtx - 2;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_FAN: {
-         if (use_cache) {
-            int ii;
-            int idx0 = indices[0] - min_idx;
-            for (ii = 1; ii < num_vtx; ii++) {
-               int idx1 = indices[ii] - min_idx;
-               int idx2 = indices[ii - 1] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx0], &vertex_cache[idx1], &vertex_cache[idx2]);
-            }
-         } else {
-            int ii;
-            int idx = 1;
-            ALLEGRO_VERTEX v0;
-            ALLEGRO_VERTEX vtx[2];
-            SET_VERTEX(v0, indices[0]);
-            SET_VERTEX(vtx[0], indices[1]);
-            for (ii = 2; ii < num_vtx; ii ++) {
-               SET_VERTEX(vtx[idx], indices[ii])
-               _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
-               idx = 1 - idx;
-            }
-         }
-         num_primitives = num_vtx - 2;
-         break;
-      };
-      case ALLEGRO_PRIM_POINT_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx; ii++) {
-               int idx = indices[ii] - min_idx;
-               _al_point_2d(texture, &vertex_cache[idx]);
-            }
-         } else {
-            int ii;
-            for (ii = 0; ii < num_vtx; ii++) {
-               ALLEGRO_VERTEX v;
-               SET_VERTEX(v, indices[ii]);
-
-               _al_point_2d(texture, &v);
-            }
-         }
-         num_primitives = num_vtx;
-         break;
-      };
-   }
+   num_primitives = draw_cached(texture, cache, by_index ? indices : NULL, min_idx, num_vtx, type);
 
    if(texture)
        al_unlock_bitmap(texture);
 
+   free_cache(cache, vertex_cache);
    return num_primitives;
-#undef SET_VERTEX
 }
 
 /* vim: set sts=3 sw=3 et: */
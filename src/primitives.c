@@ -91,10 +91,10 @@ ALLEGRO_VERTEX_DECL* _al_create_vertex_decl(const ALLEGRO_VERTEX_ELEMENT* elemen
    ALLEGRO_VERTEX_DECL* ret;
    ALLEGRO_VERTEX_ELEMENT* e;
    ALLEGRO_DISPLAY *disp = al_get_current_display();
-   ASSERT(disp);
-   ASSERT(disp->vt);
 
    ret = al_malloc(sizeof(ALLEGRO_VERTEX_DECL));
+   ret->d3d_decl = NULL;
+   ret->d3d_dummy_shader = NULL;
    ret->elements = al_calloc(1, sizeof(ALLEGRO_VERTEX_ELEMENT) * ALLEGRO_PRIM_ATTR_NUM);
    while(elements->attribute) {
 #ifdef ALLEGRO_CFG_OPENGLES
@@ -130,7 +130,10 @@ ALLEGRO_VERTEX_DECL* _al_create_vertex_decl(const ALLEGRO_VERTEX_ELEMENT* elemen
    }
 
    ret->stride = stride;
-   if (disp->vt->create_vertex_decl) {
+   /* Without a display, the declaration is only used by the software
+    * renderer.
+    */
+   if (disp && disp->vt->create_vertex_decl) {
       if (!disp->vt->create_vertex_decl(disp, ret))
          goto fail;
    }
@@ -460,6 +463,45 @@ int _al_draw_indexed_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
 }
 
 
+/* Draws the instances with the display driver.  Returns -1 if it can't, in
+ * which case the caller has to draw each instance itself.
+ */
+int _al_draw_instanced_prim(ALLEGRO_BITMAP* texture,
+   ALLEGRO_VERTEX_BUFFER* vertex_buffer, const void* vtxs,
+   const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_INDEX_BUFFER* index_buffer,
+   const int* indices, int start, int end, int type,
+   const ALLEGRO_PRIM_INSTANCE* instances, int num_instances)
+{
+   ALLEGRO_BITMAP *target;
+   ALLEGRO_DISPLAY *disp;
+
+   ASSERT(end >= start);
+   ASSERT(start >= 0);
+   ASSERT(type >= 0 && type < ALLEGRO_PRIM_NUM_TYPES);
+   ASSERT(vertex_buffer || vtxs);
+   ASSERT(!vertex_buffer || !vertex_buffer->common.is_locked);
+   ASSERT(!index_buffer || !index_buffer->common.is_locked);
+   ASSERT(instances);
+
+   target = al_get_target_bitmap();
+
+   if (al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP ||
+       (texture && al_get_bitmap_flags(texture) & ALLEGRO_MEMORY_BITMAP) ||
+       _al_pixel_format_is_compressed(al_get_bitmap_format(target))) {
+      return -1;
+   }
+
+   disp = _al_get_bitmap_display(target);
+   ASSERT(disp);
+   ASSERT(disp->vt);
+   if (!disp->vt->draw_prim_instanced)
+      return -1;
+
+   return disp->vt->draw_prim_instanced(target, texture, vertex_buffer, vtxs,
+      decl, index_buffer, indices, start, end, type, instances, num_instances);
+}
+
+
 int _al_get_vertex_buffer_size(ALLEGRO_VERTEX_BUFFER* buffer)
 {
    ASSERT(buffer);
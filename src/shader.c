@@ -409,34 +409,41 @@ bool al_set_shader_bool(const char *name, bool b)
    }
 }
 
-/* Function: al_get_default_shader_source
- */
-char const *al_get_default_shader_source(ALLEGRO_SHADER_PLATFORM platform,
-   ALLEGRO_SHADER_TYPE type)
+#ifdef ALLEGRO_CFG_SHADER_GLSL
+static bool use_gl3_shader_source(ALLEGRO_DISPLAY *display)
 {
-   (void)type;
-   bool use_gl3_shader = false;
-   ALLEGRO_DISPLAY *display = al_get_current_display();
 #ifdef ALLEGRO_MACOSX
    /* Apple's glsl implementation supports either 1.20 shaders, or strictly
     * versioned 3.2+ shaders which do not use deprecated features.
     */
    if (display && (display->flags & ALLEGRO_OPENGL_3_0)) {
-      use_gl3_shader = true;
+      return true;
    }
 #endif
    if (display && (display->flags & (ALLEGRO_OPENGL_3_0 | ALLEGRO_OPENGL_FORWARD_COMPATIBLE))) {
-      use_gl3_shader = true;
+      return true;
    }
+   return false;
+}
+#endif
+
+/* Function: al_get_default_shader_source
+ */
+char const *al_get_default_shader_source(ALLEGRO_SHADER_PLATFORM platform,
+   ALLEGRO_SHADER_TYPE type)
+{
+   (void)type;
 
    switch (resolve_platform(al_get_current_display(), platform)) {
       case ALLEGRO_SHADER_GLSL:
 #ifdef ALLEGRO_CFG_SHADER_GLSL
          switch (type) {
             case ALLEGRO_VERTEX_SHADER:
-               return use_gl3_shader ? default_glsl_vertex_source_gl3 : default_glsl_vertex_source;
+               return use_gl3_shader_source(al_get_current_display()) ?
+                  default_glsl_vertex_source_gl3 : default_glsl_vertex_source;
             case ALLEGRO_PIXEL_SHADER:
-               return use_gl3_shader ? default_glsl_pixel_source_gl3 : default_glsl_pixel_source;
+               return use_gl3_shader_source(al_get_current_display()) ?
+                  default_glsl_pixel_source_gl3 : default_glsl_pixel_source;
          }
 #endif
          break;
@@ -444,9 +451,11 @@ char const *al_get_default_shader_source(ALLEGRO_SHADER_PLATFORM platform,
 #ifdef ALLEGRO_CFG_SHADER_GLSL
          switch (type) {
             case ALLEGRO_VERTEX_SHADER:
-               return use_gl3_shader ? default_glsl_vertex_source_gl3 : default_glsl_vertex_source;
+               return use_gl3_shader_source(al_get_current_display()) ?
+                  default_glsl_vertex_source_gl3 : default_glsl_vertex_source;
             case ALLEGRO_PIXEL_SHADER:
-               return use_gl3_shader ? default_glsl_minimal_pixel_source_gl3 : default_glsl_minimal_pixel_source;
+               return use_gl3_shader_source(al_get_current_display()) ?
+                  default_glsl_minimal_pixel_source_gl3 : default_glsl_minimal_pixel_source;
          }
 #endif
          break;
@@ -509,13 +518,10 @@ void _al_unregister_shader_bitmap(ALLEGRO_SHADER *shader, ALLEGRO_BITMAP *bmp)
    ASSERT(deleted);
 }
 
-ALLEGRO_SHADER *_al_create_default_shader(ALLEGRO_DISPLAY *display)
+static ALLEGRO_SHADER *create_builtin_shader(ALLEGRO_SHADER_PLATFORM platform,
+   const char *vertex_source, const char *pixel_source)
 {
    ALLEGRO_SHADER *shader;
-   ALLEGRO_SHADER_PLATFORM platform = resolve_platform(
-      display,
-      display->extra_settings.settings[ALLEGRO_DEFAULT_SHADER_PLATFORM]
-   );
 
    _al_push_destructor_owner();
    shader = al_create_shader(platform);
@@ -525,14 +531,12 @@ ALLEGRO_SHADER *_al_create_default_shader(ALLEGRO_DISPLAY *display)
       ALLEGRO_ERROR("Error creating default shader.\n");
       return false;
    }
-   if (!al_attach_shader_source(shader, ALLEGRO_VERTEX_SHADER,
-         al_get_default_shader_source(platform, ALLEGRO_VERTEX_SHADER))) {
+   if (!al_attach_shader_source(shader, ALLEGRO_VERTEX_SHADER, vertex_source)) {
       ALLEGRO_ERROR("al_attach_shader_source for vertex shader failed: %s\n",
          al_get_shader_log(shader));
       goto fail;
    }
-   if (!al_attach_shader_source(shader, ALLEGRO_PIXEL_SHADER,
-         al_get_default_shader_source(platform, ALLEGRO_PIXEL_SHADER))) {
+   if (!al_attach_shader_source(shader, ALLEGRO_PIXEL_SHADER, pixel_source)) {
       ALLEGRO_ERROR("al_attach_shader_source for pixel shader failed: %s\n",
          al_get_shader_log(shader));
       goto fail;
@@ -548,4 +552,41 @@ fail:
    return NULL;
 }
 
+ALLEGRO_SHADER *_al_create_default_shader(ALLEGRO_DISPLAY *display)
+{
+   ALLEGRO_SHADER_PLATFORM platform = resolve_platform(
+      display,
+      display->extra_settings.settings[ALLEGRO_DEFAULT_SHADER_PLATFORM]
+   );
+
+   return create_builtin_shader(platform,
+      al_get_default_shader_source(platform, ALLEGRO_VERTEX_SHADER),
+      al_get_default_shader_source(platform, ALLEGRO_PIXEL_SHADER));
+}
+
+/* Like the default shader, but also transforms, tints and offsets the
+ * texture coordinates of each vertex by the per-instance attributes used by
+ * the primitives addon.  Only there for GLSL.
+ */
+ALLEGRO_SHADER *_al_create_default_instanced_shader(ALLEGRO_DISPLAY *display)
+{
+#ifdef ALLEGRO_CFG_SHADER_GLSL
+   ALLEGRO_SHADER_PLATFORM platform = resolve_platform(
+      display,
+      display->extra_settings.settings[ALLEGRO_DEFAULT_SHADER_PLATFORM]
+   );
+
+   if (platform == ALLEGRO_SHADER_GLSL || platform == ALLEGRO_SHADER_GLSL_MINIMAL) {
+      return create_builtin_shader(platform,
+         use_gl3_shader_source(display) ?
+            default_glsl_instanced_vertex_source_gl3 :
+            default_glsl_instanced_vertex_source,
+         al_get_default_shader_source(platform, ALLEGRO_PIXEL_SHADER));
+   }
+#else
+   (void)display;
+#endif
+   return NULL;
+}
+
 /* vim: set sts=3 sw=3 et: */
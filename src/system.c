@@ -269,6 +269,11 @@ bool al_install_system(int version, int (*atexit_ptr)(void (*)(void)))
       al_get_system_config(), "graphics", "min_bitmap_size");
    active_sysdrv->min_bitmap_size = min_bitmap_size ? atoi(min_bitmap_size) : 16;
 
+   const char *soft_triangle_rasterizer = al_get_config_value(
+      al_get_system_config(), "graphics", "soft_triangle_rasterizer");
+   active_sysdrv->soft_edge_rasterizer = soft_triangle_rasterizer &&
+      _al_stricmp(soft_triangle_rasterizer, "edge") == 0;
+
    ALLEGRO_INFO("Allegro version: %s\n", ALLEGRO_VERSION_STR);
 
    if (strcmp(al_get_app_name(), "") == 0) {
@@ -42,6 +42,7 @@
 #include "allegro5/internal/aintern_display.h"
 #include "allegro5/internal/aintern_file.h"
 #include "allegro5/internal/aintern_fshook.h"
+#include "allegro5/internal/aintern_primitives.h"
 #include "allegro5/internal/aintern_shader.h"
 #include "allegro5/internal/aintern_tls.h"
 
@@ -85,6 +86,9 @@ typedef struct thread_local_state {
    /* Blender */
    ALLEGRO_BLENDER current_blender;
 
+   /* Primitives addon state */
+   _AL_PRIM_STATE prim_state;
+
    /* Bitmap parameters */
    int new_bitmap_format;
    int new_bitmap_flags;
@@ -997,4 +1001,13 @@ int *_al_tls_get_dtor_owner_count(void)
 }
 
 
+_AL_PRIM_STATE *_al_get_prim_state(void)
+{
+   thread_local_state *tls;
+
+   tls = tls_get();
+   return &tls->prim_state;
+}
+
+
 /* vim: set sts=3 sw=3 et: */
@@ -23,9 +23,15 @@
 #include "allegro5/internal/aintern_blend.h"
 #include "allegro5/internal/aintern_pixels.h"
 #include "allegro5/internal/aintern_primitives.h"
+#include "allegro5/internal/aintern_system.h"
 #include "allegro5/internal/aintern_tri_soft.h"
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+   #define TRI_SOFT_SSE2
+   #include <emmintrin.h>
+#endif
+
 ALLEGRO_DEBUG_CHANNEL("tri_soft")
 
 #define MIN _ALLEGRO_MIN
@@ -410,7 +416,11 @@ static void shader_texture_grad_any_step(uintptr_t state, int minor)
 #include "scanline_drawers.inc"
 
 
-static void triangle_stepper(uintptr_t state,
+/*
+This is always inlined, so that wherever it is called with known shader
+functions the compiler can inline those into the scanline loop as well
+*/
+static _AL_ALWAYS_INLINE void triangle_stepper(uintptr_t state,
    shader_init init, shader_first first, shader_step step, shader_draw draw,
    ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3)
 {
@@ -685,6 +695,422 @@ static void triangle_stepper(uintptr_t state,
    }
 }
 
+/*
+The edge function rasterizer works in fixed point with this many bits below
+the pixel. Triangles spanning more than EDGE_MAX_SIZE pixels in either
+direction are left to the stepper, which keeps all edge function values
+within 32 bits.
+*/
+#define EDGE_SUBPIXEL_BITS 4
+#define EDGE_ONE (1 << EDGE_SUBPIXEL_BITS)
+#define EDGE_MAX_SIZE 1024
+
+typedef struct {
+   int min_x, min_y;
+   int max_x, max_y;    /* exclusive */
+} triangle_bounds;
+
+typedef struct {
+   int32_t value;       /* at the first pixel of the current row */
+   int32_t step_x;
+   int32_t step_y;
+} edge_function;
+
+/*
+The three edge functions at four neighbouring pixels of a row
+*/
+typedef struct {
+#ifdef TRI_SOFT_SSE2
+   __m128i lanes[3];
+   __m128i step[3];
+   __m128i value[3];
+#else
+   int32_t step[3];
+   int32_t value[3];
+#endif
+} edge_quad;
+
+static int to_edge_fixed(float v)
+{
+   return (int)floorf(v * EDGE_ONE + 0.5f);
+}
+
+/*
+Sets up the edge from a to b, positive on the inside of a triangle which is
+clockwise on the screen, at the centre of pixel (px, py). Centres exactly on
+the edge only count as inside on top and left edges, so that triangles which
+share an edge neither overlap nor leave gaps.
+*/
+static void init_edge(edge_function* e, int ax, int ay, int bx, int by, int px, int py)
+{
+   const int dx = bx - ax;
+   const int dy = by - ay;
+   const int64_t cx = (int64_t)px * EDGE_ONE + EDGE_ONE / 2 - ax;
+   const int64_t cy = (int64_t)py * EDGE_ONE + EDGE_ONE / 2 - ay;
+   const bool top_left = dy < 0 || (dy == 0 && dx > 0);
+
+   e->value = (int32_t)((int64_t)dx * cy - (int64_t)dy * cx - (top_left ? 0 : 1));
+   e->step_x = -dy * EDGE_ONE;
+   e->step_y = dx * EDGE_ONE;
+}
+
+static _AL_ALWAYS_INLINE void quad_init(edge_quad* q, const edge_function* e)
+{
+   int i;
+   for (i = 0; i < 3; i++) {
+#ifdef TRI_SOFT_SSE2
+      q->lanes[i] = _mm_set_epi32(3 * e[i].step_x, 2 * e[i].step_x, e[i].step_x, 0);
+      q->step[i] = _mm_set1_epi32(4 * e[i].step_x);
+#else
+      q->step[i] = e[i].step_x;
+#endif
+   }
+}
+
+/*
+Moves to the four pixels starting x pixels into the current row
+*/
+static _AL_ALWAYS_INLINE void quad_seek(edge_quad* q, const edge_function* e, int x)
+{
+   int i;
+   for (i = 0; i < 3; i++) {
+#ifdef TRI_SOFT_SSE2
+      q->value[i] = _mm_add_epi32(_mm_set1_epi32(e[i].value + x * e[i].step_x), q->lanes[i]);
+#else
+      q->value[i] = e[i].value + x * e[i].step_x;
+#endif
+   }
+}
+
+static _AL_ALWAYS_INLINE void quad_next(edge_quad* q)
+{
+   int i;
+   for (i = 0; i < 3; i++) {
+#ifdef TRI_SOFT_SSE2
+      q->value[i] = _mm_add_epi32(q->value[i], q->step[i]);
+#else
+      q->value[i] += 4 * q->step[i];
+#endif
+   }
+}
+
+/*
+Returns a bit for each of the four pixels which is inside all three edges
+*/
+static _AL_ALWAYS_INLINE int quad_coverage(const edge_quad* q)
+{
+#ifdef TRI_SOFT_SSE2
+   __m128i outside = _mm_or_si128(_mm_or_si128(q->value[0], q->value[1]), q->value[2]);
+   return ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+#else
+   int mask = 0;
+   int i;
+   for (i = 0; i < 4; i++) {
+      if (((q->value[0] + i * q->step[0]) | (q->value[1] + i * q->step[1]) |
+            (q->value[2] + i * q->step[2])) >= 0)
+         mask |= 1 << i;
+   }
+   return mask;
+#endif
+}
+
+/* Indices of the lowest and highest set bits of a four bit mask. */
+static const int lowest_bit[16] = {4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0};
+static const int highest_bit[16] = {-1, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3};
+
+static _AL_ALWAYS_INLINE int valid_lanes(int remaining)
+{
+   return remaining >= 4 ? 0xF : (1 << remaining) - 1;
+}
+
+/*
+Finds the pixels of the current row inside the triangle, as offsets from the
+left of the bounding box. Those are always contiguous, and their ends are
+usually close to where they were on the row before, so the searches for them
+start from there.
+*/
+static _AL_ALWAYS_INLINE bool find_span(edge_quad* q, const edge_function* e,
+   int width, int* left, int* right)
+{
+   int x = *left & ~3;
+   int lane;
+   int covered;
+
+   quad_seek(q, e, x);
+   covered = quad_coverage(q) & valid_lanes(width - x);
+
+   if (!covered) {
+      const int start = x;
+      for (x = start + 4; x < width; x += 4) {
+         quad_next(q);
+         covered = quad_coverage(q) & valid_lanes(width - x);
+         if (covered)
+            break;
+      }
+      if (!covered) {
+         for (x = start - 4; x >= 0; x -= 4) {
+            quad_seek(q, e, x);
+            covered = quad_coverage(q);
+            if (covered)
+               break;
+         }
+         if (!covered)
+            return false;
+      }
+   }
+   while ((covered & 1) && x > 0) {
+      int before;
+      quad_seek(q, e, x - 4);
+      before = quad_coverage(q);
+      if (!before)
+         break;
+      x -= 4;
+      covered = before;
+   }
+   *left = x + lowest_bit[covered];
+
+   x = MAX(*left, *right);
+   lane = x & 3;
+   x -= lane;
+   quad_seek(q, e, x);
+   covered = quad_coverage(q) & valid_lanes(width - x);
+
+   if (covered & (1 << lane)) {
+      int uncovered = ~covered & (0xF << lane) & 0xF;
+      while (!uncovered) {
+         x += 4;
+         if (x >= width) {
+            *right = width - 1;
+            return true;
+         }
+         quad_next(q);
+         uncovered = ~(quad_coverage(q) & valid_lanes(width - x)) & 0xF;
+      }
+      *right = x + lowest_bit[uncovered] - 1;
+   }
+   else {
+      covered &= (1 << lane) - 1;
+      while (!covered) {
+         x -= 4;
+         quad_seek(q, e, x);
+         covered = quad_coverage(q);
+      }
+      *right = x + highest_bit[covered];
+   }
+   return true;
+}
+
+/*
+An alternative to the stepper which tests pixel centres against the edge
+functions of the triangle, four pixels at a time. The shader is set up with
+first() for every row, and step() is never called.
+*/
+static _AL_ALWAYS_INLINE void triangle_edge_rasterizer(uintptr_t state,
+   shader_init init, shader_first first, shader_draw draw,
+   ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3,
+   const triangle_bounds* bounds)
+{
+   int x1 = to_edge_fixed(vtx1->x);
+   int y1 = to_edge_fixed(vtx1->y);
+   int x2 = to_edge_fixed(vtx2->x);
+   int y2 = to_edge_fixed(vtx2->y);
+   int x3 = to_edge_fixed(vtx3->x);
+   int y3 = to_edge_fixed(vtx3->y);
+   int64_t area = (int64_t)(x2 - x1) * (y3 - y1) - (int64_t)(y2 - y1) * (x3 - x1);
+   int min_x, min_y, max_x, max_y, width, y;
+   int left = 0;
+   int right = 0;
+   edge_function e[3];
+   edge_quad q;
+
+   if (area == 0)
+      return;
+   if (area < 0) {
+      int t;
+      t = x2; x2 = x3; x3 = t;
+      t = y2; y2 = y3; y3 = t;
+   }
+
+   /*
+   The pixels whose centres lie within the bounding box of the triangle
+   */
+   min_x = (MIN(x1, MIN(x2, x3)) + EDGE_ONE / 2 - 1) >> EDGE_SUBPIXEL_BITS;
+   min_y = (MIN(y1, MIN(y2, y3)) + EDGE_ONE / 2 - 1) >> EDGE_SUBPIXEL_BITS;
+   max_x = (MAX(x1, MAX(x2, x3)) - EDGE_ONE / 2) >> EDGE_SUBPIXEL_BITS;
+   max_y = (MAX(y1, MAX(y2, y3)) - EDGE_ONE / 2) >> EDGE_SUBPIXEL_BITS;
+
+   min_x = MAX(min_x, bounds->min_x);
+   min_y = MAX(min_y, bounds->min_y);
+   max_x = MIN(max_x, bounds->max_x - 1);
+   max_y = MIN(max_y, bounds->max_y - 1);
+   if (min_x > max_x || min_y > max_y)
+      return;
+   width = max_x - min_x + 1;
+
+   init_edge(&e[0], x1, y1, x2, y2, min_x, min_y);
+   init_edge(&e[1], x2, y2, x3, y3, min_x, min_y);
+   init_edge(&e[2], x3, y3, x1, y1, min_x, min_y);
+   quad_init(&q, e);
+
+   init(state, vtx1, vtx2, vtx3);
+
+   for (y = min_y; y <= max_y; y++) {
+      if (find_span(&q, e, width, &left, &right)) {
+         /*
+         The scanline drawers expect the row below, like the stepper gives them
+         */
+         first(state, min_x + left, y + 1, 0, 0);
+         draw(state, min_x + left, y + 1, min_x + right);
+      }
+
+      e[0].value += e[0].step_y;
+      e[1].value += e[1].step_y;
+      e[2].value += e[2].step_y;
+   }
+}
+
+static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, int h)
+{
+   ASSERT(bmp);
+
+   if (!al_is_bitmap_locked(bmp))
+      return 0;
+   if (x1 + w > bmp->lock_x && y1 + h > bmp->lock_y && x1 < bmp->lock_x + bmp->lock_w && y1 < bmp->lock_y + bmp->lock_h)
+      return 1;
+   return 0;
+}
+
+/*
+Lock the part of the target that the triangle may touch, unless it is locked
+already. Returns false if there is nothing to draw into.
+*/
+static bool lock_triangle_region(ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2,
+   ALLEGRO_VERTEX* vtx3, triangle_bounds* bounds, bool* need_unlock)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   int min_x, max_x, min_y, max_y;
+   int clip_min_x, clip_min_y, clip_max_x, clip_max_y;
+
+   *need_unlock = false;
+
+   al_get_clipping_rectangle(&clip_min_x, &clip_min_y, &clip_max_x, &clip_max_y);
+   clip_max_x += clip_min_x;
+   clip_max_y += clip_min_y;
+
+   /*
+   TODO: Need to clip them first, make a copy of the vertices first then
+   */
+
+   /*
+   Lock the region we are drawing to. We are choosing the minimum and maximum
+   possible pixels touched from the formula (easily verified by following the
+   above algorithm.
+   */
+
+   min_x = (int)floorf(MIN(vtx1->x, MIN(vtx2->x, vtx3->x))) - 1;
+   min_y = (int)floorf(MIN(vtx1->y, MIN(vtx2->y, vtx3->y))) - 1;
+   max_x = (int)ceilf(MAX(vtx1->x, MAX(vtx2->x, vtx3->x))) + 1;
+   max_y = (int)ceilf(MAX(vtx1->y, MAX(vtx2->y, vtx3->y))) + 1;
+
+   /*
+   TODO: This bit is temporary, the min max's will be guaranteed to be within the bitmap
+   once clipping is implemented
+   */
+   if (min_x >= clip_max_x || min_y >= clip_max_y)
+      return false;
+   if (max_x >= clip_max_x)
+      max_x = clip_max_x;
+   if (max_y >= clip_max_y)
+      max_y = clip_max_y;
+
+   if (max_x < clip_min_x || max_y < clip_min_y)
+      return false;
+   if (min_x < clip_min_x)
+      min_x = clip_min_x;
+   if (min_y < clip_min_y)
+      min_y = clip_min_y;
+
+   if (al_is_bitmap_locked(target)) {
+      if (!bitmap_region_is_locked(target, min_x, min_y, max_x - min_x, max_y - min_y) ||
+          _al_pixel_format_is_video_only(target->locked_region.format))
+         return false;
+   } else {
+      if (!al_lock_bitmap_region(target, min_x, min_y, max_x - min_x, max_y - min_y, ALLEGRO_PIXEL_FORMAT_ANY, 0))
+         return false;
+      *need_unlock = true;
+   }
+
+   bounds->min_x = min_x;
+   bounds->min_y = min_y;
+   bounds->max_x = max_x;
+   bounds->max_y = max_y;
+   return true;
+}
+
+typedef void (*triangle_drawer)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, const triangle_bounds*);
+
+static bool use_edge_rasterizer(ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+{
+   ALLEGRO_SYSTEM *system = al_get_system_driver();
+   float w, h;
+
+   if (!system || !system->soft_edge_rasterizer)
+      return false;
+
+   w = MAX(v1->x, MAX(v2->x, v3->x)) - MIN(v1->x, MIN(v2->x, v3->x));
+   h = MAX(v1->y, MAX(v2->y, v3->y)) - MIN(v1->y, MIN(v2->y, v3->y));
+   /* Written so that NaNs fail too. */
+   return w <= EDGE_MAX_SIZE && h <= EDGE_MAX_SIZE;
+}
+
+static void draw_triangle(ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3,
+   uintptr_t state, triangle_drawer drawer)
+{
+   triangle_bounds bounds;
+   bool need_unlock;
+
+   if (!lock_triangle_region(v1, v2, v3, &bounds, &need_unlock))
+      return;
+
+   drawer(state, v1, v2, v3, use_edge_rasterizer(v1, v2, v3) ? &bounds : NULL);
+
+   if (need_unlock)
+      al_unlock_bitmap(al_get_target_bitmap());
+}
+
+/*
+A rasterizer for each of the generated scanline drawers, with the shader
+functions resolved at compile time rather than called through pointers. With
+bounds, the edge function rasterizer draws the triangle instead of the stepper.
+*/
+#define TRIANGLE_DRAWER(shader, draw)                                          \
+   static void triangle_##draw(uintptr_t state,                                \
+      ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3,              \
+      const triangle_bounds* bounds)                                           \
+   {                                                                           \
+      if (bounds)                                                              \
+         triangle_edge_rasterizer(state, shader##_init, shader##_first, draw,  \
+            v1, v2, v3, bounds);                                               \
+      else                                                                     \
+         triangle_stepper(state, shader##_init, shader##_first, shader##_step, \
+            draw, v1, v2, v3);                                                 \
+   }
+
+TRIANGLE_DRAWER(shader_solid_any, shader_solid_any_draw_shade)
+TRIANGLE_DRAWER(shader_solid_any, shader_solid_any_draw_opaque)
+TRIANGLE_DRAWER(shader_grad_any, shader_grad_any_draw_shade)
+TRIANGLE_DRAWER(shader_grad_any, shader_grad_any_draw_opaque)
+TRIANGLE_DRAWER(shader_texture_solid_any, shader_texture_solid_any_draw_shade)
+TRIANGLE_DRAWER(shader_texture_solid_any, shader_texture_solid_any_draw_shade_repeat)
+TRIANGLE_DRAWER(shader_texture_solid_any, shader_texture_solid_any_draw_shade_white)
+TRIANGLE_DRAWER(shader_texture_solid_any, shader_texture_solid_any_draw_shade_white_repeat)
+TRIANGLE_DRAWER(shader_texture_solid_any, shader_texture_solid_any_draw_opaque)
+TRIANGLE_DRAWER(shader_texture_solid_any, shader_texture_solid_any_draw_opaque_white)
+TRIANGLE_DRAWER(shader_texture_grad_any, shader_texture_grad_any_draw_shade)
+TRIANGLE_DRAWER(shader_texture_grad_any, shader_texture_grad_any_draw_opaque)
+
+#undef TRIANGLE_DRAWER
+
 /*
 This one will check to see what exactly we need to draw...
 I.e. this will call all of the actual renderers and set the appropriate callbacks
@@ -729,9 +1155,9 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
          state.solid.texture = texture;
 
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_shade);
+            draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_grad_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_opaque);
+            draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_grad_any_draw_opaque);
          }
       } else {
          int white = 0;
@@ -744,22 +1170,22 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
          if (shade) {
             if (white) {
                if (repeat) {
-                  _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_white_repeat);
+                  draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_solid_any_draw_shade_white_repeat);
                } else {
-                  _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_white);
+                  draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_solid_any_draw_shade_white);
                }
             } else {
                if (repeat) {
-                  _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_repeat);
+                  draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_solid_any_draw_shade_repeat);
                } else {
-                  _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade);
+                  draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_solid_any_draw_shade);
                }
             }
          } else {
             if (white) {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque_white);
+               draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_solid_any_draw_opaque_white);
             } else {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque);
+               draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_texture_solid_any_draw_opaque);
             }
          }
       }
@@ -767,32 +1193,21 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
       if (grad) {
          state_grad_any_2d state;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_shade);
+            draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_grad_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_opaque);
+            draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_grad_any_draw_opaque);
          }
       } else {
          state_solid_any_2d state;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_shade);
+            draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_solid_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_opaque);
+            draw_triangle(v1, v2, v3, (uintptr_t)&state, triangle_shader_solid_any_draw_opaque);
          }
       }
    }
 }
 
-static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, int h)
-{
-   ASSERT(bmp);
-
-   if (!al_is_bitmap_locked(bmp))
-      return 0;
-   if (x1 + w > bmp->lock_x && y1 + h > bmp->lock_y && x1 < bmp->lock_x + bmp->lock_w && y1 < bmp->lock_y + bmp->lock_h)
-      return 1;
-   return 0;
-}
-
 void _al_draw_soft_triangle(
    ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3, uintptr_t state,
    void (*init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
@@ -800,69 +1215,16 @@ void _al_draw_soft_triangle(
    void (*step)(uintptr_t, int),
    void (*draw)(uintptr_t, int, int, int))
 {
-   /*
-   ALLEGRO_VERTEX copy_v1, copy_v2; <- may be needed for clipping later on
-   */
-   ALLEGRO_VERTEX* vtx1 = v1;
-   ALLEGRO_VERTEX* vtx2 = v2;
-   ALLEGRO_VERTEX* vtx3 = v3;
-   ALLEGRO_BITMAP *target = al_get_target_bitmap();
-   int need_unlock = 0;
-   ALLEGRO_LOCKED_REGION *lr;
-   int min_x, max_x, min_y, max_y;
-   int clip_min_x, clip_min_y, clip_max_x, clip_max_y;
-
-   al_get_clipping_rectangle(&clip_min_x, &clip_min_y, &clip_max_x, &clip_max_y);
-   clip_max_x += clip_min_x;
-   clip_max_y += clip_min_y;
-
-   /*
-   TODO: Need to clip them first, make a copy of the vertices first then
-   */
-
-   /*
-   Lock the region we are drawing to. We are choosing the minimum and maximum
-   possible pixels touched from the formula (easily verified by following the
-   above algorithm.
-   */
+   triangle_bounds bounds;
+   bool need_unlock;
 
-   min_x = (int)floorf(MIN(vtx1->x, MIN(vtx2->x, vtx3->x))) - 1;
-   min_y = (int)floorf(MIN(vtx1->y, MIN(vtx2->y, vtx3->y))) - 1;
-   max_x = (int)ceilf(MAX(vtx1->x, MAX(vtx2->x, vtx3->x))) + 1;
-   max_y = (int)ceilf(MAX(vtx1->y, MAX(vtx2->y, vtx3->y))) + 1;
-
-   /*
-   TODO: This bit is temporary, the min max's will be guaranteed to be within the bitmap
-   once clipping is implemented
-   */
-   if (min_x >= clip_max_x || min_y >= clip_max_y)
+   if (!lock_triangle_region(v1, v2, v3, &bounds, &need_unlock))
       return;
-   if (max_x >= clip_max_x)
-      max_x = clip_max_x;
-   if (max_y >= clip_max_y)
-      max_y = clip_max_y;
-
-   if (max_x < clip_min_x || max_y < clip_min_y)
-      return;
-   if (min_x < clip_min_x)
-      min_x = clip_min_x;
-   if (min_y < clip_min_y)
-      min_y = clip_min_y;
-
-   if (al_is_bitmap_locked(target)) {
-      if (!bitmap_region_is_locked(target, min_x, min_y, max_x - min_x, max_y - min_y) ||
-          _al_pixel_format_is_video_only(target->locked_region.format))
-         return;
-   } else {
-      if (!(lr = al_lock_bitmap_region(target, min_x, min_y, max_x - min_x, max_y - min_y, ALLEGRO_PIXEL_FORMAT_ANY, 0)))
-         return;
-      need_unlock = 1;
-   }
 
    triangle_stepper(state, init, first, step, draw, v1, v2, v3);
 
    if (need_unlock)
-      al_unlock_bitmap(target);
+      al_unlock_bitmap(al_get_target_bitmap());
 }
 
 /* vim: set sts=3 sw=3 et: */
@@ -21,6 +21,7 @@ ALLEGRO_DEBUG_CHANNEL("test")
 #define MAX_BITMAPS  128
 #define MAX_TRANS    8
 #define MAX_FONTS    16
+#define MAX_SHAPES   8
 #define MAX_VERTICES 100
 #define MAX_POLYGONS 8
 
@@ -39,6 +40,11 @@ typedef struct {
    ALLEGRO_TRANSFORM transform;
 } Transform;
 
+typedef struct {
+   ALLEGRO_USTR   *name;
+   ALLEGRO_SHAPE  *shape;
+} NamedShape;
+
 typedef struct {
    int            x;
    int            y;
@@ -60,6 +66,7 @@ Bitmap            bitmaps[MAX_BITMAPS];
 LockRegion        lock_region;
 Transform         transforms[MAX_TRANS];
 NamedFont         fonts[MAX_FONTS];
+NamedShape        shapes[MAX_SHAPES];
 ALLEGRO_VERTEX    vertices[MAX_VERTICES];
 float             simple_vertices[2 * MAX_VERTICES];
 int               num_simple_vertices;
@@ -249,6 +256,7 @@ static void set_target_reset(ALLEGRO_BITMAP *target)
    al_use_transform(&ident);
    al_orthographic_transform(&ident, 0, 0, -1, al_get_bitmap_width(target), al_get_bitmap_height(target), 1);
    al_use_projection_transform(&ident);
+   al_set_primitives_flags(0);
 }
 
 static char const *resolve_var(ALLEGRO_CONFIG const *cfg, char const *section,
@@ -363,6 +371,25 @@ static ALLEGRO_TRANSFORM *get_transform(const char *name)
    return NULL;
 }
 
+static ALLEGRO_SHAPE *get_shape(const char *name)
+{
+   int i;
+
+   for (i = 0; i < MAX_SHAPES; i++) {
+      if (!shapes[i].name) {
+         shapes[i].name = al_ustr_new(name);
+         shapes[i].shape = al_create_shape();
+         return shapes[i].shape;
+      }
+
+      if (shapes[i].name && streq(al_cstr(shapes[i].name), name))
+         return shapes[i].shape;
+   }
+
+   fatal_error("shapes limit reached");
+   return NULL;
+}
+
 static int get_pixel_format(char const *v)
 {
    int format = streq(v, "ALLEGRO_PIXEL_FORMAT_ANY") ? ALLEGRO_PIXEL_FORMAT_ANY
@@ -644,6 +671,12 @@ static int get_prim_type(char const *value)
       : atoi(value);
 }
 
+static int get_prim_flags(char const *value)
+{
+   return streq(value, "ALLEGRO_PRIM_ANTIALIAS") ? ALLEGRO_PRIM_ANTIALIAS
+      : atoi(value);
+}
+
 static int get_line_join(char const *value)
 {
    return streq(value, "ALLEGRO_LINE_JOIN_NONE") ? ALLEGRO_LINE_JOIN_NONE
@@ -1402,6 +1435,25 @@ static bool do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          continue;
       }
 
+      if (SCAN("al_set_primitives_flags", 1)) {
+         al_set_primitives_flags(get_prim_flags(V(0)));
+         continue;
+      }
+
+      /* Retained shapes (5.2) */
+      if (SCAN("al_begin_shape", 1)) {
+         al_begin_shape(get_shape(V(0)));
+         continue;
+      }
+      if (SCAN0("al_end_shape")) {
+         al_end_shape();
+         continue;
+      }
+      if (SCAN("al_draw_shape", 1)) {
+         al_draw_shape(get_shape(V(0)));
+         continue;
+      }
+
       /* Transformations (5.1) */
       if (SCAN("al_horizontal_shear_transform", 2)) {
          al_horizontal_shear_transform(get_transform(V(0)), F(1));
@@ -1574,6 +1626,14 @@ static bool do_test(ALLEGRO_CONFIG *cfg, char const *testname,
       transforms[i].name = NULL;
    }
 
+   /* Destroy shapes. */
+   for (i = 0; i < MAX_SHAPES; i++) {
+      al_ustr_free(shapes[i].name);
+      shapes[i].name = NULL;
+      al_destroy_shape(shapes[i].shape);
+      shapes[i].shape = NULL;
+   }
+
    return good;
 #undef MAXBUF
 }